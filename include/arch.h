@@ -1,17 +1,38 @@
 #ifndef __ARCH_H__
 #define __ARCH_H__
 
+#include <inttypes.h>
 #include <stdint.h>
 
+// register width, fixed at compile time: the iss library is RV32, iss64 is
+// the same sources built with XLEN=64
+#ifndef XLEN
+#define XLEN 32
+#endif
+
 // common types
 typedef uint8_t byte_t;
+#if XLEN == 32
 typedef uint32_t reg_t;
+typedef int32_t sreg_t;
 typedef uint32_t addr_t;
+#define PRIxREG "08" PRIx32
+#elif XLEN == 64
+typedef uint64_t reg_t;
+typedef int64_t sreg_t;
+typedef uint64_t addr_t;
+#define PRIxREG "016" PRIx64
+#else
+#error "XLEN should be 32 or 64"
+#endif
 
 // architectural states of a ISS
 typedef struct arch_state {
     reg_t current_pc; // Program Counter
     reg_t gpr[32];    // General Purpose Registers (x0-x31)
+    // F and D: singles are NaN-boxed (upper 32 bits all ones)
+    uint64_t fpr[32]; // Floating-Point Registers (f0-f31)
+    uint32_t fcsr;    // frm << 5 | fflags
 } arch_state_t;
 
 #endif
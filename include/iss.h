@@ -4,12 +4,218 @@
 #include "arch.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // forward declaration
 typedef struct iss ISS;
+typedef struct iss_batch ISSBatch;
+
+// upper bound of iss_config_t::harts
+#define ISS_MAX_HARTS 16
+// upper bound of iss_config_t::vlen
+#define ISS_VLEN_MAX 1024
+
+// source of the Zicntr `time` CSR
+typedef enum {
+    ISS_TIME_INSTRET = 0, // derived from the cycle count (deterministic)
+    ISS_TIME_HOST,        // derived from the host monotonic clock
+} iss_time_source_t;
+
+// replacement policy of a modeled cache
+typedef enum {
+    ISS_CACHE_LRU = 0,
+    ISS_CACHE_PLRU, // tree pseudo-LRU, needs a power-of-two number of ways
+    ISS_CACHE_RANDOM,
+} iss_cache_repl_t;
+
+// geometry and policies of a modeled cache
+typedef struct iss_cache_config {
+    unsigned size;      // capacity in bytes (0: no such cache)
+    unsigned ways;      // associativity
+    unsigned line_size; // bytes per line (power of two)
+    iss_cache_repl_t replacement;
+    bool write_back;     // otherwise write-through
+    bool write_allocate; // allocate a line on a store miss
+} iss_cache_config_t;
+
+// configuration of an ISS instance
+typedef struct iss_config {
+    // `time` CSR model
+    iss_time_source_t time_source;
+    unsigned long timebase_hz; // frequency of the `time` CSR
+    unsigned long core_hz;     // nominal core clock (ISS_TIME_INSTRET only)
+
+    // ECALL host syscall proxy (newlib ABI)
+    bool syscall_proxy;      // serve ECALL on the host
+    const char *sandbox_dir; // root of guest file access (NULL: no files)
+
+    // host file streamed through the InputFile device (NULL: no device)
+    const char *input_file;
+
+    // cache hierarchy model (off unless l1i or l1d has a size), the L2 is
+    // shared by both L1s
+    iss_cache_config_t l1i;
+    iss_cache_config_t l1d;
+    iss_cache_config_t l2;
+    const char *cache_report; // per-PC statistics as CSV (NULL: none)
+
+    // in-order pipeline timing model, feeds the `cycle` CSR
+    bool timing_model;
+    const char *timing_config; // "key = value" overrides (NULL: defaults)
+
+    // locality analysis: reuse distance, working set and load strides
+    const char *locality_report;     // CSV file prefix (NULL: analysis off)
+    unsigned locality_block;         // granularity in bytes (power of two)
+    unsigned long locality_interval; // instructions per working-set sample
+
+    // SimPoint basic-block vectors; the run halts at the start of interval
+    // simpoint_stop_interval and saves its state to state_image
+    const char *bbv_file;        // .bb output (NULL: no collection)
+    unsigned long bbv_interval;  // instructions per interval
+    long simpoint_stop_interval; // -1: run to the end (needs bbv_file)
+    const char *state_image;     // file for the state at the stop (NULL: none)
+
+    // parallel sampled execution, see ISS_run_sampled(): the cache and
+    // timing models run in the workers instead of the functional run
+    unsigned long sample_interval; // instructions per sample (0: off)
+    unsigned sample_jobs;          // concurrent workers (0: online CPUs)
+    const char *sample_report;     // per-interval CSV (NULL: none)
+
+    // AFL-style edge coverage of BRANCH/JAL/JALR, in the fuzzer's shared
+    // memory if __AFL_SHM_ID is set; also adds the InputFile device (empty
+    // unless input_file is set) to deliver test cases, see ISS_set_input()
+    bool coverage;
+
+    // harts sharing the memory map, each with its own registers and mhartid;
+    // they start at the ELF entry and advance in quanta of hart_quantum
+    // instructions. With hart_threads each hart runs on a host thread of
+    // its own (the interleaving within a quantum is up to the host),
+    // otherwise the harts run one after the other (deterministic). Caches,
+    // timing, locality, BBVs and coverage observe hart 0 only.
+    unsigned harts;             // 1..ISS_MAX_HARTS
+    unsigned long hart_quantum; // instructions per hart per quantum
+    bool hart_threads;
+
+    // ISA string of the harts, e.g. "rv32iafdv_zba_zbb_zbs"; leaving an
+    // extension out makes its instructions illegal (NULL: all implemented)
+    const char *isa;
+
+    // V extension: bits per vector register (a power of two, 64..ISS_VLEN_MAX)
+    unsigned vlen;
+
+    // reverse execution (one hart only): every instruction saves the
+    // registers and memory bytes it overwrites in an undo log of this many
+    // MB, see ISS_step_back() (0: off)
+    unsigned undo_log_mb;
+
+    // deterministic record and replay: the inputs a run takes from the host
+    // (loads of the InputFile device, the host clock of ISS_TIME_HOST and the
+    // results of proxied syscalls) are logged with their instruction counts
+    // to record_inputs, or taken from replay_inputs without touching the
+    // host (the input file is not opened then), see ISS_replay_diverged().
+    // Needs the harts on one thread, no undo log and no sampled execution.
+    const char *record_inputs; // NULL: no recording
+    const char *replay_inputs; // NULL: no replay
+
+    // unchecked RAM: ROM and main memory live in a host reservation
+    // mirroring the 32-bit physical address space, with PROT_NONE guard pages
+    // everywhere else, and the untranslated fetches, loads and stores of the
+    // hart within them go straight to it, after one range compare per
+    // memory and without a TLB lookup. Any other access (a device register,
+    // or a stray address) takes the checked way, so a stray one raises the
+    // guest access fault as usual; a host fault on a guard page is reported
+    // to stderr with its PC and address, and the instruction is redone the
+    // checked way. ROM/RAM accesses are counted in ISS_get_stats() as usual.
+    // Needs a 64-bit host, one hart and no cache model, locality analysis or
+    // undo log; break/watchpoints turn it off while they are set.
+    bool fast_mem;
+} iss_config_t;
+
+// software TLB statistics, summed over the harts; index 0/1/2 counts
+// instruction fetches, loads and stores (AMOs included)
+typedef struct iss_tlb_stats {
+    uint64_t hits[3];
+    uint64_t misses[3];
+    uint64_t flushes; // sfence.vma and satp changes
+} iss_tlb_stats_t;
+
+// upper bound of iss_stats_t::num_devices
+#define ISS_STATS_MAX_DEVICES 16
+
+// classes of retired instructions in iss_stats_t
+typedef enum {
+    ISS_INST_ALU = 0, // OP/OP-IMM(-32), LUI, AUIPC (M, Zba/Zbb/Zbs included)
+    ISS_INST_LOAD,
+    ISS_INST_STORE,
+    ISS_INST_BRANCH,
+    ISS_INST_JUMP,   // JAL, JALR
+    ISS_INST_AMO,    // LR/SC and AMOs
+    ISS_INST_FENCE,  // FENCE, FENCE.I
+    ISS_INST_SYSTEM, // CSR access, ECALL/EBREAK, xRET, WFI, SFENCE.VMA
+    ISS_INST_FP,     // F and D
+    ISS_INST_VECTOR, // V, its loads and stores included
+    ISS_INST_CLASS_NUM,
+} iss_inst_class_t;
+
+// guest accesses of a mapped device; AMOs count as stores, a vector access
+// once per page it touches
+typedef struct iss_device_stats {
+    const char *name;
+    addr_t base;
+    addr_t size;
+    uint64_t loads;
+    uint64_t stores;
+} iss_device_stats_t;
+
+// run statistics since the ctor or the last ISS_reset_stats(), summed over
+// the harts (reverse execution does not uncount what it undoes, except in
+// instret)
+typedef struct iss_stats {
+    // retired instructions (those that trapped are not), as the instret CSR
+    // counts them; cycle is instret plus the stalls of the timing model
+    uint64_t instret;
+    uint64_t inst_class[ISS_INST_CLASS_NUM];
+    uint64_t branches_taken;
+    uint64_t branches_not_taken;
+    unsigned num_devices; // in the order of the memory map
+    iss_device_stats_t devices[ISS_STATS_MAX_DEVICES];
+    uint64_t step_ns; // host wall time spent in ISS_step()
+} iss_stats_t;
+
+// accesses a watchpoint fires on (AMOs are writes)
+typedef enum {
+    ISS_WATCH_WRITE  = 1,
+    ISS_WATCH_READ   = 2,
+    ISS_WATCH_ACCESS = 3,
+} iss_watch_t;
+
+// why ISS_step() returned early for the debugger
+typedef enum {
+    ISS_STOP_NONE = 0,
+    ISS_STOP_BREAKPOINT, // before executing the instruction at pc
+    ISS_STOP_WATCHPOINT, // after the instruction at pc accessed addr
+    ISS_STOP_LOG_BEGIN,  // reverse execution reached the oldest instruction logged
+} iss_stop_reason_t;
+
+typedef struct iss_stop {
+    iss_stop_reason_t reason;
+    unsigned hart;
+    addr_t pc;
+    addr_t addr;       // data address (watchpoints) or pc (breakpoints)
+    iss_watch_t watch; // type of the watchpoint
+} iss_stop_t;
+
+// guest-visible state of an ISS (architectural state, counters, memories and
+// device registers); host resources such as open files are not included
+typedef struct iss_state_image iss_state_image_t;
 
 // for initializetion and finalization
+extern void ISS_config_default(iss_config_t *config);
 extern int ISS_ctor(ISS **self, const char *elf_file_name);
+extern int ISS_ctor_with_config(ISS **self,
+                                const char *elf_file_name,
+                                const iss_config_t *config);
 extern void ISS_dtor(ISS *self);
 
 // for Reference-Model-Based Verification with RTL model
@@ -23,7 +229,97 @@ extern void ISS_set_main_memory(ISS *self,
                                 const byte_t *const ref_data);
 extern arch_state_t ISS_get_arch_state(const ISS *self);
 extern void ISS_set_arch_state(ISS *self, const arch_state_t ref_arch_state);
+// with several harts, every hart executes up to n_step instructions and the
+// arch state is the one of hart 0; an instruction that traps (and an
+// interrupt taken) is a step too, though it does not retire
 extern void ISS_step(ISS *self, unsigned long n_step);
 extern bool ISS_get_halt(ISS *self);
+extern arch_state_t ISS_get_hart_arch_state(const ISS *self, unsigned hart);
+extern void ISS_get_tlb_stats(const ISS *self, iss_tlb_stats_t *stats);
+// counters that are always on (a few increments per instruction), reset for
+// measuring an interval
+extern void ISS_get_stats(const ISS *self, iss_stats_t *stats);
+extern void ISS_reset_stats(ISS *self);
+
+// for checkpointing (e.g. fast-forwarding to a SimPoint), an image can only
+// be restored into an ISS of the same build; restoring clears the halt flag
+extern iss_state_image_t *ISS_save_state(const ISS *self);
+extern void ISS_restore_state(ISS *self, const iss_state_image_t *image);
+extern void ISS_free_state(iss_state_image_t *image);
+extern int ISS_write_state(const iss_state_image_t *image, const char *file_name);
+extern iss_state_image_t *ISS_read_state(const char *file_name);
+
+// for coverage-guided fuzzing in persistent mode: ISS_reset() goes back to
+// the state right after the ctor (memories, registers, counters, devices and
+// guest files) without re-creating the ISS; ISS_set_input() makes data (kept
+// alive by the caller) the contents of the InputFile device
+extern void ISS_reset(ISS *self);
+extern void ISS_set_input(ISS *self, const byte_t *data, size_t size);
+// the coverage bitmap (NULL if coverage is off), cleared by the caller
+extern byte_t *ISS_get_coverage(ISS *self, size_t *size);
+
+// for debugging: breakpoints and watchpoints on virtual addresses of every
+// hart (-1: table full, or no such point to remove). Only the pages holding
+// one are checked, so code elsewhere runs at full speed. A hit ends
+// ISS_step() early (the halt flag stays clear) and ISS_get_stop() tells why;
+// resuming at a breakpoint executes its instruction.
+extern int ISS_add_breakpoint(ISS *self, addr_t addr);
+extern int ISS_remove_breakpoint(ISS *self, addr_t addr);
+extern int ISS_add_watchpoint(ISS *self, addr_t addr, addr_t len, iss_watch_t type);
+extern int ISS_remove_watchpoint(ISS *self, addr_t addr, addr_t len, iss_watch_t type);
+// the stop of the last ISS_step() (reason ISS_STOP_NONE if it ran on)
+extern iss_stop_t ISS_get_stop(const ISS *self);
+// debugger access to plain memory (RAM and ROM, no device registers) at
+// virtual addresses as hart 0 loads them; return -1 on an unmapped or
+// read-only range (stores)
+extern int ISS_debug_read(ISS *self, addr_t addr, unsigned length, byte_t *buffer);
+extern int ISS_debug_write(ISS *self, addr_t addr, unsigned length, const byte_t *data);
+// serve the GDB remote serial protocol on endpoint (a TCP port on localhost
+// or a Unix socket path) until the debugger detaches (0), kills the guest
+// (1) or the connection fails (-1); Ctrl-C interrupts a continue
+extern int ISS_gdb_serve(ISS *self, const char *endpoint);
+
+// reverse execution with an undo log (undo_log_mb): undo the last n
+// instructions, fewer if the log holds fewer (a full log drops the oldest);
+// return how many were undone. The memory written by the syscalls and DMA
+// transfers of an instruction is rewound with it; device registers, host
+// files and the models are not. Undoing an instruction clears the halt flag.
+extern uint64_t ISS_step_back(ISS *self, uint64_t n);
+// undo instructions until one at a breakpoint, or one that stored into a
+// write watchpoint (as mapped at the call), is undone; ISS_get_stop() tells
+// which. Return how many were undone.
+extern uint64_t ISS_reverse_continue(ISS *self);
+
+// a replay (replay_inputs) asked for an input the log does not have, which
+// also raised the halt flag: the run is not the recorded one
+extern bool ISS_replay_diverged(const ISS *self);
+
+// parallel sampled execution: run to the halt functionally, forking a worker
+// at the start of every sample_interval instructions which replays the
+// interval (copy-on-write) with the cache/timing models attached; the
+// per-interval results are stitched into one report. Models start cold in
+// every interval. Return -1 if fork() or pipe() fails.
+extern int ISS_run_sampled(ISS *self);
+
+// lockstep interpretation of many instances ("lanes") of one ELF, each with
+// its own registers, main memory and input (e.g. input sweeps): lanes at the
+// same PC execute together with SIMD kernels. RV32I only (not part of the
+// iss64 library), code must be in the ROM; lanes run as the ISS runs them,
+// and a lane that makes any other access, any syscall but exit or anything
+// the ISS would trap on halts with a fault at that instruction. One step
+// executes one instruction for one group of lanes.
+extern int ISSBatch_ctor(ISSBatch **self, const char *elf_file_name, unsigned num_lanes);
+extern void ISSBatch_dtor(ISSBatch *self);
+extern void ISSBatch_set_input(ISSBatch *self, unsigned lane, const byte_t *data, size_t size);
+extern void ISSBatch_step(ISSBatch *self, unsigned long n_step);
+extern bool ISSBatch_get_halt(const ISSBatch *self, unsigned lane);
+extern bool ISSBatch_get_fault(const ISSBatch *self, unsigned lane);
+extern uint64_t ISSBatch_get_instret(const ISSBatch *self, unsigned lane);
+extern arch_state_t ISSBatch_get_arch_state(const ISSBatch *self, unsigned lane);
+extern void ISSBatch_get_main_memory(const ISSBatch *self,
+                                     unsigned lane,
+                                     const addr_t base_addr,
+                                     const unsigned length,
+                                     byte_t *const buffer);
 
 #endif
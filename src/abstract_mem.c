@@ -16,7 +16,8 @@ static void _store(AbstractMem *self, addr_t base_addr, unsigned length, const b
 
 void AbstractMem_ctor(AbstractMem *self) {
     assert(self != NULL);
-    static struct AbstractMemVtbl const vtbl = { .load = &_load, .store = &_store };
+    static struct AbstractMemVtbl const vtbl = { .load = &_load, .store = &_store, .host_ptr = NULL,
+                                                 .page_ptr = NULL, .accepts = NULL };
     self->vtbl = &vtbl;
 }
 
@@ -29,3 +30,27 @@ void AbstractMem_store(AbstractMem *self, addr_t base_addr, unsigned length, con
     assert((self != NULL) && (self->vtbl != NULL));
     self->vtbl->store(self, base_addr, length, ref_data);
 }
+
+byte_t *AbstractMem_host_ptr(AbstractMem *self, addr_t base_addr, unsigned length, bool write) {
+    assert((self != NULL) && (self->vtbl != NULL));
+    if (self->vtbl->host_ptr == NULL) {
+        return NULL;
+    }
+    return self->vtbl->host_ptr(self, base_addr, length, write);
+}
+
+byte_t *AbstractMem_page_ptr(AbstractMem *self, addr_t base_addr, unsigned length, bool write) {
+    assert((self != NULL) && (self->vtbl != NULL));
+    if (self->vtbl->page_ptr == NULL) {
+        return NULL;
+    }
+    return self->vtbl->page_ptr(self, base_addr, length, write);
+}
+
+bool AbstractMem_accepts(const AbstractMem *self, addr_t base_addr, unsigned length, bool write) {
+    assert((self != NULL) && (self->vtbl != NULL));
+    if (self->vtbl->accepts == NULL) {
+        return true;
+    }
+    return self->vtbl->accepts(self, base_addr, length, write);
+}
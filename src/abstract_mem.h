@@ -3,6 +3,8 @@
 
 #include "arch.h"
 
+#include <stdbool.h>
+
 struct AbstractMemVtbl; // forward declaration
 typedef struct {
     struct AbstractMemVtbl const *vtbl; // vtable ptr
@@ -12,6 +14,18 @@ typedef struct {
 struct AbstractMemVtbl {
     void (*load)(const AbstractMem *self, addr_t base_addr, unsigned length, byte_t *buffer);
     void (*store)(AbstractMem *self, addr_t base_addr, unsigned length, const byte_t *ref_data);
+    // optional: host pointer to the backing storage of a plain memory device
+    // (left NULL by MMIO devices whose accesses have side effects); NULL if
+    // the range may not be written through it, if write
+    byte_t *(*host_ptr)(AbstractMem *self, addr_t base_addr, unsigned length, bool write);
+    // optional: host pointer that stays valid for the lifetime of the device,
+    // for the TLB of the MMU; NULL if the guest may not access the range
+    // directly for reading (or writing, if write)
+    byte_t *(*page_ptr)(AbstractMem *self, addr_t base_addr, unsigned length, bool write);
+    // optional: false if the device does not take the load (or store, if
+    // write) of [base_addr, base_addr + length), e.g. of a width its
+    // registers lack; the access faults instead of reaching load/store
+    bool (*accepts)(const AbstractMem *self, addr_t base_addr, unsigned length, bool write);
 };
 
 // define public APIs
@@ -20,6 +34,12 @@ extern void
 AbstractMem_load(const AbstractMem *self, addr_t base_addr, unsigned length, byte_t *buffer);
 extern void
 AbstractMem_store(AbstractMem *self, addr_t base_addr, unsigned length, const byte_t *ref_data);
+extern byte_t *
+AbstractMem_host_ptr(AbstractMem *self, addr_t base_addr, unsigned length, bool write);
+extern byte_t *
+AbstractMem_page_ptr(AbstractMem *self, addr_t base_addr, unsigned length, bool write);
+extern bool
+AbstractMem_accepts(const AbstractMem *self, addr_t base_addr, unsigned length, bool write);
 
 // define helper macros
 // clang-format off
@@ -33,6 +53,21 @@ AbstractMem_store(AbstractMem *self, addr_t base_addr, unsigned length, const by
     void (SIGNATURE_ABSTRACT_MEM_STORE(cls))(AbstractMem * self,                \
                                             addr_t base_addr, unsigned length,  \
                                             const byte_t *ref_data)
+#define SIGNATURE_ABSTRACT_MEM_HOST_PTR(cls) cls##_AbstractMem_host_ptr
+#define DECLARE_ABSTRACT_MEM_HOST_PTR(cls)                                      \
+    byte_t *(SIGNATURE_ABSTRACT_MEM_HOST_PTR(cls))(AbstractMem * self,          \
+                                                  addr_t base_addr,             \
+                                                  unsigned length, bool write)
+#define SIGNATURE_ABSTRACT_MEM_PAGE_PTR(cls) cls##_AbstractMem_page_ptr
+#define DECLARE_ABSTRACT_MEM_PAGE_PTR(cls)                                      \
+    byte_t *(SIGNATURE_ABSTRACT_MEM_PAGE_PTR(cls))(AbstractMem * self,          \
+                                                  addr_t base_addr,             \
+                                                  unsigned length, bool write)
+#define SIGNATURE_ABSTRACT_MEM_ACCEPTS(cls) cls##_AbstractMem_accepts
+#define DECLARE_ABSTRACT_MEM_ACCEPTS(cls)                                       \
+    bool (SIGNATURE_ABSTRACT_MEM_ACCEPTS(cls))(const AbstractMem *self,         \
+                                              addr_t base_addr,                 \
+                                              unsigned length, bool write)
 // clang-format on
 
 #endif
@@ -0,0 +1,158 @@
+#include "bbv.h"
+
+#include "arch.h"
+#include "common.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BBV_TABLE_INIT 4096
+
+static inline unsigned hash32(uint32_t key) {
+    return (unsigned)(key * 2654435761u);
+}
+
+static unsigned BBV_find(BBV *self, reg_t pc);
+
+static void BBV_grow(BBV *self) {
+    bbv_block_t *old      = self->blocks;
+    unsigned old_capacity = self->capacity;
+    self->capacity *= 2;
+    self->count  = 0;
+    self->blocks = calloc(self->capacity, sizeof(bbv_block_t));
+    free(self->touched);
+    self->touched = malloc(self->capacity * sizeof(unsigned));
+    Assert(self->blocks != NULL && self->touched != NULL, "Out of memory");
+    // rehashing moves the blocks, rebuild the touched list as well
+    self->num_touched = 0;
+    for (unsigned i = 0; i < old_capacity; i++) {
+        if (old[i].used) {
+            unsigned j      = BBV_find(self, old[i].pc);
+            self->blocks[j] = old[i];
+            if (old[i].count != 0) {
+                self->touched[self->num_touched++] = j;
+            }
+        }
+    }
+    free(old);
+}
+
+// index of the block starting at pc, inserted with a new id if unseen
+static unsigned BBV_find(BBV *self, reg_t pc) {
+    if (unlikely(2 * (self->count + 1) > self->capacity)) {
+        BBV_grow(self);
+    }
+    unsigned mask = self->capacity - 1;
+    unsigned i    = hash32(pc >> 2) & mask;
+    while (self->blocks[i].used && self->blocks[i].pc != pc) {
+        i = (i + 1) & mask;
+    }
+    if (!self->blocks[i].used) {
+        self->blocks[i].used  = true;
+        self->blocks[i].pc    = pc;
+        self->blocks[i].id    = ++self->count;
+        self->blocks[i].count = 0;
+    }
+    return i;
+}
+
+// one line of the .bb file: "T:id:count :id:count ..."
+static void BBV_emit_interval(BBV *self) {
+    if (self->num_touched == 0) {
+        return;
+    }
+    fputc('T', self->out);
+    for (unsigned i = 0; i < self->num_touched; i++) {
+        bbv_block_t *block = &self->blocks[self->touched[i]];
+        fprintf(self->out, ":%u:%llu ", block->id, (unsigned long long)block->count);
+        block->count = 0;
+    }
+    fputc('\n', self->out);
+    self->num_touched = 0;
+}
+
+static void BBV_end_block(BBV *self) {
+    unsigned i = BBV_find(self, self->block_pc);
+    if (self->blocks[i].count == 0) {
+        self->touched[self->num_touched++] = i;
+    }
+    // counts are weighted by the block length
+    self->blocks[i].count += self->block_len;
+    self->in_block = false;
+}
+
+void BBV_retire(BBV *self, reg_t pc, bool block_end) {
+    if (!self->in_block) {
+        self->in_block  = true;
+        self->block_pc  = pc;
+        self->block_len = 0;
+    }
+    self->block_len += 1;
+    self->interval_insts += 1;
+    if (!block_end) {
+        return;
+    }
+    BBV_end_block(self);
+
+    // intervals close at the first block end after N instructions
+    if (self->interval_insts >= self->interval) {
+        BBV_emit_interval(self);
+        self->interval_insts = 0;
+        self->interval_id += 1;
+        if ((int64_t)self->interval_id == self->stop_interval) {
+            self->stop_pending    = true;
+            self->halt->halt_flag = true;
+        }
+    }
+}
+
+/* --------------------------- ctor / dtor --------------------------- */
+int BBV_ctor(BBV *self, const iss_config_t *config, Halt *halt) {
+    assert((self != NULL) && (config != NULL) && (halt != NULL));
+    memset(self, 0, sizeof(BBV));
+
+    if (config->bbv_interval == 0) {
+        fprintf(stderr, "BBV: the interval should be > 0\n");
+        return -1;
+    }
+    self->halt          = halt;
+    self->interval      = config->bbv_interval;
+    self->stop_interval = config->simpoint_stop_interval;
+
+    self->capacity = BBV_TABLE_INIT;
+    self->blocks   = calloc(self->capacity, sizeof(bbv_block_t));
+    self->touched  = malloc(self->capacity * sizeof(unsigned));
+    if (self->blocks == NULL || self->touched == NULL) {
+        BBV_dtor(self);
+        return -1;
+    }
+    if (NULL == (self->out = fopen(config->bbv_file, "w"))) {
+        fprintf(stderr, "Fail to open BBV file: %s\n", config->bbv_file);
+        BBV_dtor(self);
+        return -1;
+    }
+
+    // interval 0 starts right away
+    if (self->stop_interval == 0) {
+        self->stop_pending    = true;
+        self->halt->halt_flag = true;
+    }
+    return 0;
+}
+
+void BBV_dtor(BBV *self) {
+    assert(self != NULL);
+    if (self->out != NULL) {
+        if (self->in_block) {
+            BBV_end_block(self);
+        }
+        BBV_emit_interval(self);
+        fclose(self->out);
+    }
+    free(self->blocks);
+    free(self->touched);
+}
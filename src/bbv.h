@@ -0,0 +1,51 @@
+#ifndef __BBV_H__
+#define __BBV_H__
+
+#include "arch.h"
+#include "halt.h"
+#include "iss.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// a basic block, identified by its start PC (open-addressing hash table)
+typedef struct {
+    reg_t pc;
+    bool used;
+    uint32_t id;    // 1-based, in order of first execution
+    uint64_t count; // instructions executed in the block this interval
+} bbv_block_t;
+
+// basic-block vector collection in the SimPoint .bb format
+typedef struct {
+    FILE *out;
+    Halt *halt; // raised to stop at the start of the selected interval
+    uint64_t interval; // instructions per interval
+
+    bbv_block_t *blocks;
+    unsigned capacity; // power of two
+    unsigned count;
+    // blocks with a non-zero count in the current interval
+    unsigned *touched;
+    unsigned num_touched;
+
+    // block being executed
+    reg_t block_pc;
+    uint32_t block_len;
+    bool in_block;
+
+    // interval being collected
+    uint64_t interval_insts;
+    uint64_t interval_id;
+    int64_t stop_interval; // stop before this interval starts (-1: never)
+    bool stop_pending;
+} BBV;
+
+extern int BBV_ctor(BBV *self, const iss_config_t *config, Halt *halt);
+// flush the last (partial) interval and close the output
+extern void BBV_dtor(BBV *self);
+// account one retired instruction, block_end is set for BRANCH/JAL/JALR
+extern void BBV_retire(BBV *self, reg_t pc, bool block_end);
+
+#endif
@@ -0,0 +1,361 @@
+#include "cache.h"
+
+#include "arch.h"
+#include "common.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_PC_TABLE_INIT 1024
+
+static inline bool is_pow2(unsigned x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static inline unsigned log2u(unsigned x) {
+    return (unsigned)__builtin_ctz(x);
+}
+
+/* -------------------------- per-PC table --------------------------- */
+static int cache_pc_table_ctor(cache_pc_table_t *self, unsigned capacity) {
+    self->capacity = capacity;
+    self->count    = 0;
+    self->slots    = calloc(capacity, sizeof(cache_pc_stat_t));
+    return (self->slots == NULL) ? -1 : 0;
+}
+
+static cache_pc_stat_t *cache_pc_table_get(cache_pc_table_t *self, reg_t pc) {
+    // grow at 50% load
+    if (unlikely(2 * (self->count + 1) > self->capacity)) {
+        cache_pc_table_t bigger;
+        Assert(cache_pc_table_ctor(&bigger, self->capacity * 2) == 0, "Out of memory");
+        for (unsigned i = 0; i < self->capacity; i++) {
+            if (self->slots[i].used) {
+                *cache_pc_table_get(&bigger, self->slots[i].pc) = self->slots[i];
+            }
+        }
+        free(self->slots);
+        *self = bigger;
+    }
+
+    unsigned mask = self->capacity - 1;
+    unsigned i    = (unsigned)((pc >> 2) * 2654435761u) & mask;
+    while (self->slots[i].used && self->slots[i].pc != pc) {
+        i = (i + 1) & mask;
+    }
+    if (!self->slots[i].used) {
+        self->slots[i].used = true;
+        self->slots[i].pc   = pc;
+        self->count += 1;
+    }
+    return &self->slots[i];
+}
+
+/* ---------------------------- one level ---------------------------- */
+static int Cache_ctor(Cache *self, const char *name, const iss_cache_config_t *config, Cache *next) {
+    memset(self, 0, sizeof(Cache));
+    self->name   = name;
+    self->config = *config;
+    self->next   = next;
+
+    unsigned ways = config->ways;
+    Assert(ways > 0 && is_pow2(config->line_size), "%s: invalid ways or line size", name);
+    Assert(config->size % (ways * config->line_size) == 0, "%s: size is not a multiple of ways * line_size",
+           name);
+    self->num_sets   = config->size / (ways * config->line_size);
+    self->line_shift = log2u(config->line_size);
+    Assert(is_pow2(self->num_sets), "%s: the number of sets should be a power of two", name);
+    Assert(config->replacement != ISS_CACHE_PLRU || (is_pow2(ways) && ways <= 64),
+           "%s: PLRU needs a power-of-two number of ways (<= 64)", name);
+
+    unsigned lines   = self->num_sets * ways;
+    self->tag        = calloc(lines, sizeof(addr_t));
+    self->valid      = calloc(lines, sizeof(bool));
+    self->dirty      = calloc(lines, sizeof(bool));
+    self->lru_stamp  = calloc(lines, sizeof(uint32_t));
+    self->plru_bits  = calloc(self->num_sets, sizeof(uint64_t));
+    self->rand_state = 0x12345678u;
+    if (self->tag == NULL || self->valid == NULL || self->dirty == NULL || self->lru_stamp == NULL ||
+        self->plru_bits == NULL) {
+        return -1;
+    }
+    return cache_pc_table_ctor(&self->pc_stats, CACHE_PC_TABLE_INIT);
+}
+
+static void Cache_dtor(Cache *self) {
+    free(self->tag);
+    free(self->valid);
+    free(self->dirty);
+    free(self->lru_stamp);
+    free(self->plru_bits);
+    free(self->pc_stats.slots);
+}
+
+static void Cache_touch(Cache *self, unsigned set, unsigned way) {
+    switch (self->config.replacement) {
+    case ISS_CACHE_LRU:
+        self->lru_stamp[set * self->config.ways + way] = ++self->stamp;
+        break;
+    case ISS_CACHE_PLRU: {
+        // every node on the path points away from the touched way
+        unsigned levels = log2u(self->config.ways);
+        unsigned node   = 1;
+        for (unsigned l = 0; l < levels; l++) {
+            unsigned bit = (way >> (levels - 1 - l)) & 1;
+            if (bit) {
+                self->plru_bits[set] &= ~(1ull << node);
+            } else {
+                self->plru_bits[set] |= (1ull << node);
+            }
+            node = 2 * node + bit;
+        }
+        break;
+    }
+    case ISS_CACHE_RANDOM:
+        break;
+    }
+}
+
+static unsigned Cache_victim(Cache *self, unsigned set) {
+    unsigned ways = self->config.ways;
+    unsigned base = set * ways;
+    for (unsigned w = 0; w < ways; w++) {
+        if (!self->valid[base + w]) {
+            return w;
+        }
+    }
+
+    switch (self->config.replacement) {
+    case ISS_CACHE_LRU: {
+        unsigned victim = 0;
+        for (unsigned w = 1; w < ways; w++) {
+            // wrap-safe comparison of the stamps
+            if ((int32_t)(self->lru_stamp[base + w] - self->lru_stamp[base + victim]) < 0) {
+                victim = w;
+            }
+        }
+        return victim;
+    }
+    case ISS_CACHE_PLRU: {
+        unsigned levels = log2u(ways);
+        unsigned node = 1, way = 0;
+        for (unsigned l = 0; l < levels; l++) {
+            unsigned bit = (self->plru_bits[set] >> node) & 1;
+            way          = (way << 1) | bit;
+            node         = 2 * node + bit;
+        }
+        return way;
+    }
+    default: {
+        // xorshift32
+        uint32_t x = self->rand_state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        self->rand_state = x;
+        return x % ways;
+    }
+    }
+}
+
+// access the line containing addr
+static void Cache_access(Cache *self, reg_t pc, addr_t addr, bool is_write) {
+    addr_t line   = addr >> self->line_shift;
+    unsigned set  = line & (self->num_sets - 1);
+    unsigned ways = self->config.ways;
+    unsigned base = set * ways;
+
+    cache_pc_stat_t *pc_stat = cache_pc_table_get(&self->pc_stats, pc);
+    pc_stat->accesses += 1;
+    self->accesses += 1;
+
+    for (unsigned w = 0; w < ways; w++) {
+        if (self->valid[base + w] && self->tag[base + w] == line) {
+            self->hits += 1;
+            Cache_touch(self, set, w);
+            if (is_write) {
+                if (self->config.write_back) {
+                    self->dirty[base + w] = true;
+                } else if (self->next != NULL) {
+                    Cache_access(self->next, pc, addr, true);
+                }
+            }
+            return;
+        }
+    }
+
+    // miss
+    self->misses += 1;
+    pc_stat->misses += 1;
+    if (is_write && !self->config.write_allocate) {
+        if (self->next != NULL) {
+            Cache_access(self->next, pc, addr, true);
+        }
+        return;
+    }
+
+    unsigned w = Cache_victim(self, set);
+    if (self->valid[base + w]) {
+        self->evictions += 1;
+        if (self->dirty[base + w]) {
+            self->writebacks += 1;
+            if (self->next != NULL) {
+                Cache_access(self->next, pc, self->tag[base + w] << self->line_shift, true);
+            }
+        }
+    }
+    if (self->next != NULL) {
+        Cache_access(self->next, pc, addr, false); // line fill
+    }
+    self->valid[base + w] = true;
+    self->tag[base + w]   = line;
+    self->dirty[base + w] = false;
+    Cache_touch(self, set, w);
+
+    if (is_write) {
+        if (self->config.write_back) {
+            self->dirty[base + w] = true;
+        } else if (self->next != NULL) {
+            Cache_access(self->next, pc, addr, true);
+        }
+    }
+}
+
+// an access may straddle two lines
+static inline void
+Cache_access_range(Cache *self, reg_t pc, addr_t addr, unsigned length, bool is_write) {
+    Cache_access(self, pc, addr, is_write);
+    addr_t last = addr + length - 1;
+    if (unlikely((last >> self->line_shift) != (addr >> self->line_shift))) {
+        Cache_access(self, pc, last, is_write);
+    }
+}
+
+static int cmp_pc_stat_misses(const void *a, const void *b) {
+    const cache_pc_stat_t *x = a, *y = b;
+    return (x->misses < y->misses) - (x->misses > y->misses);
+}
+
+static void Cache_report(Cache *self, FILE *csv) {
+    fprintf(stderr,
+            "[CACHE] %s: accesses %llu, hits %llu, misses %llu (%.2f%%), evictions %llu, "
+            "writebacks %llu\n",
+            self->name, (unsigned long long)self->accesses, (unsigned long long)self->hits,
+            (unsigned long long)self->misses,
+            self->accesses ? 100.0 * (double)self->misses / (double)self->accesses : 0.0,
+            (unsigned long long)self->evictions, (unsigned long long)self->writebacks);
+    if (csv == NULL) {
+        return;
+    }
+
+    // PCs with the most misses first
+    cache_pc_stat_t *rows = malloc(self->pc_stats.count * sizeof(cache_pc_stat_t));
+    Assert(rows != NULL || self->pc_stats.count == 0, "Out of memory");
+    unsigned n = 0;
+    for (unsigned i = 0; i < self->pc_stats.capacity; i++) {
+        if (self->pc_stats.slots[i].used) {
+            rows[n++] = self->pc_stats.slots[i];
+        }
+    }
+    qsort(rows, n, sizeof(cache_pc_stat_t), cmp_pc_stat_misses);
+    for (unsigned i = 0; i < n; i++) {
+        fprintf(csv, "%s,0x%" PRIxREG ",%llu,%llu\n", self->name, rows[i].pc,
+                (unsigned long long)rows[i].accesses, (unsigned long long)rows[i].misses);
+    }
+    free(rows);
+}
+
+/* ---------------------------- hierarchy ---------------------------- */
+bool CacheSim_enabled(const iss_config_t *config) {
+    return config->l1i.size != 0 || config->l1d.size != 0;
+}
+
+int CacheSim_ctor(CacheSim *self, const iss_config_t *config) {
+    assert((self != NULL) && (config != NULL));
+    memset(self, 0, sizeof(CacheSim));
+
+    self->has_l2      = (config->l2.size != 0);
+    self->has_l1i     = (config->l1i.size != 0);
+    self->has_l1d     = (config->l1d.size != 0);
+    self->report_file = config->cache_report;
+
+    Cache *next = self->has_l2 ? &self->l2 : NULL;
+    if ((self->has_l2 && Cache_ctor(&self->l2, "L2", &config->l2, NULL) != 0) ||
+        (self->has_l1i && Cache_ctor(&self->l1i, "L1I", &config->l1i, next) != 0) ||
+        (self->has_l1d && Cache_ctor(&self->l1d, "L1D", &config->l1d, next) != 0)) {
+        CacheSim_dtor(self);
+        return -1;
+    }
+    return 0;
+}
+
+void CacheSim_dtor(CacheSim *self) {
+    assert(self != NULL);
+    Cache_dtor(&self->l1i);
+    Cache_dtor(&self->l1d);
+    Cache_dtor(&self->l2);
+}
+
+void CacheSim_add_cacheable(CacheSim *self, addr_t first, addr_t second) {
+    Assert(self->num_cacheable < CACHE_SIM_MAX_REGIONS, "Too many cacheable regions");
+    self->cacheable[self->num_cacheable].first  = first;
+    self->cacheable[self->num_cacheable].second = second;
+    self->num_cacheable += 1;
+}
+
+static inline bool CacheSim_is_cacheable(const CacheSim *self, addr_t addr) {
+    for (unsigned i = 0; i < self->num_cacheable; i++) {
+        if (addr - self->cacheable[i].first < self->cacheable[i].second - self->cacheable[i].first) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CacheSim_fetch(CacheSim *self, reg_t pc) {
+    addr_t addr = MemoryMap_fold(pc); // the memory fetched from
+    if (self->has_l1i && CacheSim_is_cacheable(self, addr)) {
+        Cache_access_range(&self->l1i, pc, addr, 4, false);
+    }
+}
+
+void CacheSim_load(CacheSim *self, reg_t pc, addr_t addr, unsigned length) {
+    if (self->has_l1d && CacheSim_is_cacheable(self, addr)) {
+        Cache_access_range(&self->l1d, pc, addr, length, false);
+    }
+}
+
+void CacheSim_store(CacheSim *self, reg_t pc, addr_t addr, unsigned length) {
+    if (self->has_l1d && CacheSim_is_cacheable(self, addr)) {
+        Cache_access_range(&self->l1d, pc, addr, length, true);
+    }
+}
+
+void CacheSim_report(CacheSim *self) {
+    assert(self != NULL);
+
+    FILE *csv = NULL;
+    if (self->report_file != NULL) {
+        if (NULL == (csv = fopen(self->report_file, "w"))) {
+            fprintf(stderr, "Fail to open cache report file: %s\n", self->report_file);
+        } else {
+            fprintf(csv, "cache,pc,accesses,misses\n");
+        }
+    }
+    if (self->has_l1i) {
+        Cache_report(&self->l1i, csv);
+    }
+    if (self->has_l1d) {
+        Cache_report(&self->l1d, csv);
+    }
+    if (self->has_l2) {
+        Cache_report(&self->l2, csv);
+    }
+    if (csv != NULL) {
+        fclose(csv);
+    }
+}
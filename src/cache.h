@@ -0,0 +1,83 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "arch.h"
+#include "iss.h"
+#include "mem_map.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// per-PC statistics (open-addressing hash table keyed by PC)
+typedef struct {
+    reg_t pc;
+    bool used;
+    uint64_t accesses;
+    uint64_t misses;
+} cache_pc_stat_t;
+
+typedef struct {
+    cache_pc_stat_t *slots;
+    unsigned capacity; // power of two
+    unsigned count;
+} cache_pc_table_t;
+
+// one level of a set-associative cache (tags only, no data)
+typedef struct Cache {
+    const char *name;
+    iss_cache_config_t config;
+    unsigned num_sets;
+    unsigned line_shift; // log2(line_size)
+    struct Cache *next;  // next level (NULL: memory)
+
+    // per-line state, indexed by set * ways + way
+    addr_t *tag;
+    bool *valid;
+    bool *dirty;
+    uint32_t *lru_stamp; // ISS_CACHE_LRU
+    uint64_t *plru_bits; // ISS_CACHE_PLRU, one tree per set
+    uint32_t stamp;
+    uint32_t rand_state; // ISS_CACHE_RANDOM
+
+    // statistics
+    uint64_t accesses;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t writebacks;
+    cache_pc_table_t pc_stats;
+} Cache;
+
+#define CACHE_SIM_MAX_REGIONS 8
+
+// the modeled hierarchy: split L1I/L1D and an optional shared L2
+typedef struct {
+    Cache l1i;
+    Cache l1d;
+    Cache l2;
+    bool has_l1i;
+    bool has_l1d;
+    bool has_l2;
+
+    // only plain memory is cacheable, MMIO accesses bypass the model
+    addr_pair_t cacheable[CACHE_SIM_MAX_REGIONS];
+    unsigned num_cacheable;
+
+    const char *report_file;
+} CacheSim;
+
+// true if the config asks for a cache hierarchy at all
+extern bool CacheSim_enabled(const iss_config_t *config);
+extern int CacheSim_ctor(CacheSim *self, const iss_config_t *config);
+extern void CacheSim_dtor(CacheSim *self);
+// mark [first, second) as cacheable memory
+extern void CacheSim_add_cacheable(CacheSim *self, addr_t first, addr_t second);
+// observe accesses (pc is the address of the accessing instruction)
+extern void CacheSim_fetch(CacheSim *self, reg_t pc);
+extern void CacheSim_load(CacheSim *self, reg_t pc, addr_t addr, unsigned length);
+extern void CacheSim_store(CacheSim *self, reg_t pc, addr_t addr, unsigned length);
+// print summary to stderr and write the per-PC CSV report
+extern void CacheSim_report(CacheSim *self);
+
+#endif
@@ -0,0 +1,99 @@
+#include "clint.h"
+
+#include "abstract_mem.h"
+#include "core.h"
+#include "csr.h"
+#include "common.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// 32-bit half at offset of a register
+static uint32_t CLINT_read_word(CLINT *self, addr_t offset) {
+    uint64_t value = 0;
+    if (offset < CLINT_MTIMECMP) {
+        unsigned hart = (offset - CLINT_MSIP) / 4;
+        value         = (hart < self->num_harts) ? Core_get_msip(self->harts[hart]) : 0;
+    } else if (offset < CLINT_MTIME) {
+        unsigned hart = (offset - CLINT_MTIMECMP) / 8;
+        value         = (hart < self->num_harts) ? Core_get_timecmp(self->harts[hart]) : 0;
+    } else if (self->num_harts > 0) {
+        value = CSRFile_get_time(&self->harts[0]->csr);
+    }
+    return (uint32_t)(value >> ((offset & 0x4) ? 32 : 0));
+}
+
+static void CLINT_write_word(CLINT *self, addr_t offset, uint32_t value) {
+    if (offset < CLINT_MTIMECMP) {
+        unsigned hart = (offset - CLINT_MSIP) / 4;
+        if (hart < self->num_harts) {
+            Core_set_msip(self->harts[hart], value & 0x1);
+        }
+    } else if (offset < CLINT_MTIME) {
+        unsigned hart = (offset - CLINT_MTIMECMP) / 8;
+        if (hart < self->num_harts) {
+            uint64_t timecmp = Core_get_timecmp(self->harts[hart]);
+            uint64_t shift   = (offset & 0x4) ? 32 : 0;
+            timecmp          = (timecmp & ~((uint64_t)UINT32_MAX << shift)) | ((uint64_t)value << shift);
+            Core_set_timecmp(self->harts[hart], timecmp);
+        }
+    }
+    // mtime follows the instruction count (or the host clock), writes are ignored
+}
+
+// word access, or doubleword access (RV64) going through both halves
+DECLARE_ABSTRACT_MEM_LOAD(CLINT) {
+    Assert(self != NULL, "");
+    Assert(base_addr + length <= CLINT_SIZE, "");
+    Assert((length == 4 || length == 8) && (base_addr & (length - 1)) == 0,
+           "CLINT registers only support word or doubleword access");
+
+    CLINT *self_ = container_of(self, CLINT, super);
+    for (unsigned w = 0; w < length; w += 4) {
+        uint32_t value = CLINT_read_word(self_, base_addr + w);
+        for (int i = 0; i < 4; i++) {
+            buffer[w + i] = (byte_t)(value >> (8 * i));
+        }
+    }
+}
+
+DECLARE_ABSTRACT_MEM_STORE(CLINT) {
+    Assert(self != NULL, "");
+    Assert(base_addr + length <= CLINT_SIZE, "");
+    Assert((length == 4 || length == 8) && (base_addr & (length - 1)) == 0,
+           "CLINT registers only support word or doubleword access");
+
+    CLINT *self_ = container_of(self, CLINT, super);
+    for (unsigned w = 0; w < length; w += 4) {
+        uint32_t value = (uint32_t)ref_data[w] | ((uint32_t)ref_data[w + 1] << 8) |
+                         ((uint32_t)ref_data[w + 2] << 16) | ((uint32_t)ref_data[w + 3] << 24);
+        CLINT_write_word(self_, base_addr + w, value);
+    }
+}
+
+DECLARE_ABSTRACT_MEM_ACCEPTS(CLINT) {
+    (void)self, (void)write;
+    return (length == 4 || length == 8) && (base_addr & (length - 1)) == 0;
+}
+
+void CLINT_ctor(CLINT *self) {
+    assert(self != NULL);
+
+    // AbstractMem vtable initialization
+    AbstractMem_ctor(&self->super);
+    static struct AbstractMemVtbl const vtbl = {
+        .load    = &SIGNATURE_ABSTRACT_MEM_LOAD(CLINT),
+        .store   = &SIGNATURE_ABSTRACT_MEM_STORE(CLINT),
+        .accepts = &SIGNATURE_ABSTRACT_MEM_ACCEPTS(CLINT)
+    };
+    self->super.vtbl = &vtbl;
+
+    self->num_harts = 0;
+}
+
+void CLINT_add_hart(CLINT *self, Core *hart) {
+    assert((self != NULL) && (hart != NULL));
+    Assert(self->num_harts < ISS_MAX_HARTS, "Too many harts for the CLINT");
+    self->harts[self->num_harts++] = hart;
+}
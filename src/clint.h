@@ -0,0 +1,32 @@
+#ifndef __CLINT_H__
+#define __CLINT_H__
+
+#include "arch.h"
+#include "abstract_mem.h"
+#include "core.h"
+#include "iss.h"
+
+#define CLINT_MMAP_BASE 0x02000000
+#define CLINT_SIZE 0x10000
+
+// register offsets (word access, RV64 may access the 64-bit ones at once)
+#define CLINT_MSIP 0x0000     // + 4 * hart, bit 0: machine software interrupt
+#define CLINT_MTIMECMP 0x4000 // + 8 * hart, 64-bit timer compare
+#define CLINT_MTIME 0xbff8    // 64-bit timer, read-only
+
+// core-local interruptor: mtime is the time CSR of the harts, mtimecmp and
+// msip live in the cores, which schedule the timer interrupt as an event
+// (see Core_set_timecmp()) so nothing polls this device
+typedef struct {
+    // derived base class
+    AbstractMem super;
+
+    Core *harts[ISS_MAX_HARTS];
+    unsigned num_harts;
+} CLINT;
+
+void CLINT_ctor(CLINT *self);
+// the next hart, in mhartid order
+void CLINT_add_hart(CLINT *self, Core *hart);
+
+#endif
@@ -4,8 +4,10 @@
 #include <assert.h>
 #include <stdio.h>
 
-// offsetof() macro
+// offsetof() macro (unless <stddef.h> provides it)
+#ifndef offsetof
 #define offsetof(type, member) __builtin_offsetof(type, member)
+#endif
 
 /* container_of() - Calculate address of object that contains address ptr
  * @ptr: pointer to member variable
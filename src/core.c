@@ -3,30 +3,1313 @@
 #include "inst.h"
 #include "tick.h"
 #include "arch.h"
+#include "csr.h"
+#include "debug.h"
+#include "undo.h"
+#include "fpu.h"
 #include "mem_map.h"
 #include "common.h"
 
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-/* ---- 32-bit wrap-safe add: base (u32) + off (i32) ---- */
-static inline reg_t add_addr_u32(reg_t base, int32_t off) {
-    return (reg_t)((uint32_t)base + (uint32_t)off); // modulo 2^32, well-defined
+/* ---- XLEN-bit wrap-safe add: base + sign-extended off ---- */
+static inline reg_t add_addr(reg_t base, int32_t off) {
+    return base + (reg_t)(sreg_t)off; // modulo 2^XLEN, well-defined
+}
+
+// the 32-bit result of a W operation (or load) sign-extended to XLEN
+static inline reg_t sext32(uint32_t v) {
+    return (reg_t)(sreg_t)(int32_t)v;
+}
+
+/* ---------------------------- Traps ---------------------------- */
+// the MMU context follows the mode, mstatus and satp
+static inline void Core_update_mmu(Core *self) {
+    priv_state_t *p = &self->csr.priv;
+    MMU_set_context(&self->mmu, p->mode, p->mstatus, p->satp);
+}
+
+// take a trap at the current instruction: the handler of M-mode, or of
+// S-mode if medeleg/mideleg delegates it there, runs next. The instruction
+// has no other effect and does not retire; it is still a step, so that
+// ISS_step() ends even if the handler traps again.
+static void Core_trap(Core *self, reg_t cause, reg_t tval) {
+    priv_state_t *p = &self->csr.priv;
+    if (unlikely(self->undo != NULL)) {
+        UndoLog_save(self->undo, p, sizeof(priv_state_t));
+    }
+    reg_t pc        = self->arch_state.current_pc;
+    bool interrupt  = (cause & CAUSE_INTERRUPT) != 0;
+    reg_t code      = cause & ~CAUSE_INTERRUPT;
+    reg_t deleg     = interrupt ? p->mideleg : p->medeleg;
+    reg_t tvec;
+    if (p->mode <= PRIV_S && ((deleg >> code) & 0x1)) {
+        p->sepc    = pc;
+        p->scause  = cause;
+        p->stval   = tval;
+        p->mstatus = (p->mstatus & ~(MSTATUS_SPP | MSTATUS_SPIE | MSTATUS_SIE)) |
+                     ((p->mode == PRIV_S) ? MSTATUS_SPP : 0) |
+                     ((p->mstatus & MSTATUS_SIE) ? MSTATUS_SPIE : 0);
+        p->mode = PRIV_S;
+        tvec    = p->stvec;
+    } else {
+        p->mepc    = pc;
+        p->mcause  = cause;
+        p->mtval   = tval;
+        p->mstatus = (p->mstatus & ~(MSTATUS_MPP | MSTATUS_MPIE | MSTATUS_MIE)) |
+                     (p->mode << MSTATUS_MPP_SHIFT) |
+                     ((p->mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0);
+        p->mode = PRIV_M;
+        tvec    = p->mtvec;
+    }
+    // vectored mode: interrupts go to BASE + 4 * code
+    self->new_pc  = (tvec & ~(reg_t)0x3) + ((interrupt && (tvec & 0x1)) ? 4 * code : 0);
+    self->trapped = true;
+    Core_update_mmu(self);
+}
+
+/* -------------------------- Interrupts -------------------------- */
+// look at mip (and the timer) before the next instruction
+static inline void Core_request_events(Core *self) {
+    __atomic_store_n(&self->next_event, 0, __ATOMIC_RELEASE);
+}
+
+// the pending and enabled interrupt of the highest priority (0: none)
+static reg_t Core_pending_interrupt(Core *self) {
+    priv_state_t *p = &self->csr.priv;
+    reg_t pending   = __atomic_load_n(&p->mip, __ATOMIC_ACQUIRE) & p->mie;
+    if (likely(pending == 0)) {
+        return 0;
+    }
+    bool m_enabled = (p->mode < PRIV_M) || (p->mstatus & MSTATUS_MIE);
+    bool s_enabled = (p->mode < PRIV_S) || (p->mode == PRIV_S && (p->mstatus & MSTATUS_SIE));
+    reg_t enabled  = (m_enabled ? (pending & ~p->mideleg) : 0) |
+                    (s_enabled ? (pending & p->mideleg) : 0);
+    // MEI, MSI, MTI, SEI, SSI, STI
+    static const reg_t priority[] = { 11, 3, 7, 9, 1, 5 };
+    for (size_t i = 0; i < sizeof(priority) / sizeof(priority[0]); i++) {
+        if ((enabled >> priority[i]) & 0x1) {
+            return CAUSE_INTERRUPT | priority[i];
+        }
+    }
+    return 0;
+}
+
+// instret reached next_event: raise MTIP if the timer is due, schedule its
+// deadline otherwise, and take a pending interrupt; true if one was taken
+static bool Core_handle_events(Core *self) {
+    if (unlikely(self->undo != NULL)) {
+        UndoLog_save(self->undo, &self->csr.priv.mip, sizeof(reg_t)); // MTIP
+    }
+    __atomic_store_n(&self->next_event, UINT64_MAX, __ATOMIC_SEQ_CST);
+    uint64_t deadline = UINT64_MAX;
+    uint64_t timecmp  = __atomic_load_n(&self->timecmp, __ATOMIC_ACQUIRE);
+    if (timecmp != UINT64_MAX) {
+        uint64_t wait = CSRFile_instret_until(&self->csr, timecmp);
+        if (wait == 0) {
+            __atomic_fetch_or(&self->csr.priv.mip, MIP_MTIP, __ATOMIC_SEQ_CST);
+        } else {
+            deadline = (wait > UINT64_MAX - self->csr.instret) ? UINT64_MAX
+                                                              : self->csr.instret + wait;
+        }
+    }
+    // a request of another hart since the first store wins over the deadline
+    uint64_t expected = UINT64_MAX;
+    __atomic_compare_exchange_n(&self->next_event, &expected, deadline, false, __ATOMIC_SEQ_CST,
+                                __ATOMIC_RELAXED);
+
+    reg_t cause = Core_pending_interrupt(self);
+    if (cause == 0) {
+        return false;
+    }
+    Core_trap(self, cause, 0);
+    return true;
+}
+
+// mret/sret: back to the mode saved by the trap
+static void Core_trap_return(Core *self, reg_t from) {
+    priv_state_t *p = &self->csr.priv;
+    if (from == PRIV_M) {
+        reg_t mpp  = (p->mstatus & MSTATUS_MPP) >> MSTATUS_MPP_SHIFT;
+        p->mstatus = (p->mstatus & ~(MSTATUS_MPP | MSTATUS_MIE)) | MSTATUS_MPIE |
+                     ((p->mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0);
+        if (mpp != PRIV_M) {
+            p->mstatus &= ~MSTATUS_MPRV;
+        }
+        p->mode      = mpp;
+        self->new_pc = p->mepc;
+    } else {
+        reg_t spp  = (p->mstatus & MSTATUS_SPP) ? PRIV_S : PRIV_U;
+        p->mstatus = (p->mstatus & ~(MSTATUS_SPP | MSTATUS_SIE | MSTATUS_MPRV)) | MSTATUS_SPIE |
+                     ((p->mstatus & MSTATUS_SPIE) ? MSTATUS_SIE : 0);
+        p->mode      = spp;
+        self->new_pc = p->sepc;
+    }
+    Core_update_mmu(self);
+    Core_request_events(self); // xIE may be set again
+}
+
+// exception cause of a failed translation
+static inline reg_t mmu_fault_cause(mmu_fault_t fault, mmu_access_t type) {
+    static const reg_t causes[2][MMU_NUM_ACCESS] = {
+        { CAUSE_FETCH_PAGE_FAULT, CAUSE_LOAD_PAGE_FAULT, CAUSE_STORE_PAGE_FAULT },
+        { CAUSE_FETCH_ACCESS, CAUSE_LOAD_ACCESS, CAUSE_STORE_ACCESS },
+    };
+    return causes[fault == MMU_ACCESS_FAULT][type];
+}
+
+/* ------------------------ Memory access ------------------------ */
+// all data accesses of the core go through these, so that observers (the
+// cache model, ...) see every one of them; they see physical addresses
+
+// an access of length bytes to a page holding debugger points; false stops
+// the hart before a fetch at a breakpoint (no trap, nothing retires)
+static bool Core_debug_access(Core *self, addr_t addr, unsigned length, mmu_access_t type) {
+    if (type != MMU_FETCH) {
+        Debug_access(self->debug, self->csr.hartid, self->arch_state.current_pc, addr, length,
+                     type);
+        return true;
+    }
+    if (!Debug_fetch(self->debug, self->csr.hartid, addr, self->csr.instret)) {
+        return true;
+    }
+    self->new_pc = addr;
+    if (unlikely(self->undo != NULL)) {
+        reg_t pc;
+        UndoLog_undo(self->undo, &pc); // nothing executed, drop its mark
+    }
+    return false;
+}
+
+// translate an access of length bytes, or trap and return false
+static inline bool Core_translate(Core *self, addr_t addr, unsigned length, mmu_access_t type,
+                                  addr_t *paddr, byte_t **host) {
+#ifdef ISS_HOST_PERF
+    // (the counter reads keep GCC from seeing that a successful translation
+    // sets both)
+    *paddr = 0;
+    *host  = NULL;
+#endif
+    HOST_PERF_ENTER(self->host_perf, HOST_PHASE_MEM_DISPATCH);
+    mmu_fault_t fault = MMU_translate(&self->mmu, addr, type, paddr, host);
+    HOST_PERF_LEAVE(self->host_perf);
+    if (unlikely(fault != MMU_OK)) {
+        if (fault == MMU_DEBUG) {
+            return Core_debug_access(self, addr, length, type);
+        }
+        Core_trap(self, mmu_fault_cause(fault, type), addr);
+        return false;
+    }
+    return true;
+}
+
+static inline void Core_observe_load(Core *self, addr_t addr, unsigned length) {
+    if (unlikely(self->cache_sim != NULL)) {
+        CacheSim_load(self->cache_sim, self->arch_state.current_pc, addr, length);
+    }
+    if (unlikely(self->locality != NULL)) {
+        Locality_load(self->locality, self->arch_state.current_pc, addr);
+    }
+}
+
+// the length bytes at host are about to be stored to (device registers are
+// not rewound)
+static inline void Core_undo_store(Core *self, void *host, size_t length) {
+    if (unlikely(self->undo != NULL)) {
+        UndoLog_save(self->undo, host, length);
+    }
+}
+
+static inline void Core_observe_store(Core *self, addr_t addr, unsigned length) {
+    if (unlikely(self->cache_sim != NULL)) {
+        CacheSim_store(self->cache_sim, self->arch_state.current_pc, addr, length);
+    }
+    if (unlikely(self->locality != NULL)) {
+        Locality_store(self->locality, self->arch_state.current_pc, addr);
+    }
+}
+
+// host address of a naturally aligned bare access through the window,
+// counted like the TLB counts it (NULL: the access takes the TLB); one
+// unsigned compare per memory, so devices and stray addresses go the checked
+// way, and the guard pages only catch what slips through
+static inline byte_t *Core_window(Core *self, addr_t addr, mmu_access_t type) {
+    if (self->window == NULL || self->mmu.ctx[type] != 0) {
+        return NULL;
+    }
+    for (unsigned i = 0; i < CORE_WINDOW_MEMS; i++) {
+        const core_window_mem_t *mem = &self->window_mem[i];
+        if (addr - mem->base < mem->size && (type != MMU_STORE || mem->writable)) {
+            if (type != MMU_FETCH) {
+                self->mem_map.count_arr[mem->device].access[type]++;
+            }
+            return self->window + addr;
+        }
+    }
+    return NULL;
+}
+
+// a naturally aligned load (or fetch) of type, so it stays within a page;
+// return false if it trapped
+static inline bool Core_mem_read(Core *self, addr_t addr, unsigned length, byte_t *buffer,
+                                 mmu_access_t type) {
+    byte_t *host = Core_window(self, addr, type);
+    if (host != NULL) {
+        memcpy(buffer, host, length);
+        return true;
+    }
+    addr_t paddr;
+    if (!Core_translate(self, addr, length, type, &paddr, &host)) {
+        return false;
+    }
+    if (type == MMU_LOAD) {
+        Core_observe_load(self, paddr, length);
+    }
+    if (likely(host != NULL)) {
+        memcpy(buffer, host, length);
+        return true;
+    }
+    HOST_PERF_ENTER(self->host_perf, HOST_PHASE_MEM_DISPATCH);
+    bool loaded = MemoryMap_guest_load(&self->mem_map, paddr, length, buffer);
+    HOST_PERF_LEAVE(self->host_perf);
+    if (unlikely(!loaded)) {
+        Core_trap(self, mmu_fault_cause(MMU_ACCESS_FAULT, type), addr);
+        return false;
+    }
+    return true;
+}
+
+static inline bool Core_mem_load(Core *self, addr_t addr, unsigned length, byte_t *buffer) {
+    if (unlikely(addr & (length - 1))) {
+        Core_trap(self, CAUSE_LOAD_MISALIGNED, addr);
+        return false;
+    }
+    return Core_mem_read(self, addr, length, buffer, MMU_LOAD);
+}
+
+static inline bool Core_mem_store(Core *self, addr_t addr, unsigned length, const byte_t *ref_data) {
+    if (unlikely(addr & (length - 1))) {
+        Core_trap(self, CAUSE_STORE_MISALIGNED, addr);
+        return false;
+    }
+    byte_t *host = Core_window(self, addr, MMU_STORE);
+    if (host != NULL) {
+        memcpy(host, ref_data, length);
+        return true;
+    }
+    addr_t paddr;
+    if (!Core_translate(self, addr, length, MMU_STORE, &paddr, &host)) {
+        return false;
+    }
+    Core_observe_store(self, paddr, length);
+    if (likely(host != NULL)) {
+        Core_undo_store(self, host, length);
+        memcpy(host, ref_data, length);
+        return true;
+    }
+    HOST_PERF_ENTER(self->host_perf, HOST_PHASE_MEM_DISPATCH);
+    bool stored = MemoryMap_guest_store(&self->mem_map, paddr, length, ref_data);
+    HOST_PERF_LEAVE(self->host_perf);
+    if (unlikely(!stored)) {
+        Core_trap(self, CAUSE_STORE_ACCESS, addr);
+        return false;
+    }
+    return true;
+}
+
+/* ------------------------ Atomics (A) ------------------------- */
+// the value an AMO stores for funct5, given the old memory value and rs2
+static inline uint32_t amo_result(reg_t funct5, uint32_t old, uint32_t src) {
+    switch (funct5) {
+    case AMOSWAP_FUNC5: return src;
+    case AMOADD_FUNC5:  return old + src;
+    case AMOXOR_FUNC5:  return old ^ src;
+    case AMOAND_FUNC5:  return old & src;
+    case AMOOR_FUNC5:   return old | src;
+    case AMOMIN_FUNC5:  return ((int32_t)old < (int32_t)src) ? old : src;
+    case AMOMAX_FUNC5:  return ((int32_t)old > (int32_t)src) ? old : src;
+    case AMOMINU_FUNC5: return (old < src) ? old : src;
+    case AMOMAXU_FUNC5: return (old > src) ? old : src;
+    default:            return old;
+    }
+}
+
+// LR.W/SC.W/AMO*.W on addr, the value for rd goes to *result; return false
+// if the access trapped. The read-modify-write is a host atomic, so harts on
+// other threads observe it as one access; aq/rl are subsumed by the
+// sequentially consistent order. Only plain memory has a host word for it:
+// elsewhere (devices, the ROM) they raise the access fault, as on memory
+// whose PMAs exclude AMOs. SC succeeds if memory still holds the value LR
+// loaded (an A-B-A change by another hart in between goes unnoticed, which
+// LR/SC loops tolerate). Reservations are on physical addresses.
+static bool Core_execute_amo(Core *self, reg_t funct5, addr_t addr, uint32_t src, reg_t *result) {
+    if (unlikely(addr & 0x3u)) {
+        Core_trap(self, (funct5 == LR_FUNC5) ? CAUSE_LOAD_MISALIGNED : CAUSE_STORE_MISALIGNED, addr);
+        return false;
+    }
+    addr_t paddr;
+    byte_t *page;
+    if (!Core_translate(self, addr, 4, (funct5 == LR_FUNC5) ? MMU_LOAD : MMU_STORE, &paddr,
+                        &page)) {
+        return false;
+    }
+    uint32_t *host = (uint32_t *)page;
+    if (unlikely(host == NULL)) {
+        Core_trap(self, (funct5 == LR_FUNC5) ? CAUSE_LOAD_ACCESS : CAUSE_STORE_ACCESS, addr);
+        return false;
+    }
+
+    switch (funct5) {
+    case LR_FUNC5: {
+        Core_observe_load(self, paddr, 4);
+        uint32_t v     = __atomic_load_n(host, __ATOMIC_SEQ_CST);
+        self->lr_valid = true;
+        self->lr_addr  = paddr;
+        self->lr_value = v;
+        *result        = sext32(v);
+        return true;
+    }
+    case SC_FUNC5: {
+        bool reserved  = self->lr_valid && self->lr_addr == paddr;
+        self->lr_valid = false;
+        *result        = 1;
+        if (!reserved) {
+            return true;
+        }
+        Core_observe_store(self, paddr, 4);
+        Core_undo_store(self, host, 4);
+        uint32_t expected = (uint32_t)self->lr_value;
+        *result = __atomic_compare_exchange_n(host, &expected, src, false, __ATOMIC_SEQ_CST,
+                                              __ATOMIC_SEQ_CST) ? 0 : 1;
+        return true;
+    }
+    default: {
+        Core_observe_load(self, paddr, 4);
+        Core_observe_store(self, paddr, 4);
+        Core_undo_store(self, host, 4);
+        uint32_t old = __atomic_load_n(host, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(host, &old, amo_result(funct5, old, src), true,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        }
+        *result = sext32(old);
+        return true;
+    }
+    }
+}
+
+/* ----------------- Bit manipulation (Zba/Zbb/Zbs) ----------------- */
+// XLEN-bit host builtins (clz/ctz are undefined for 0)
+#if XLEN == 64
+#define REG_CLZ(v)   ((v) ? (reg_t)__builtin_clzll(v) : XLEN)
+#define REG_CTZ(v)   ((v) ? (reg_t)__builtin_ctzll(v) : XLEN)
+#define REG_CPOP(v)  ((reg_t)__builtin_popcountll(v))
+#define REG_BSWAP(v) __builtin_bswap64(v)
+#else
+#define REG_CLZ(v)   ((v) ? (reg_t)__builtin_clz(v) : XLEN)
+#define REG_CTZ(v)   ((v) ? (reg_t)__builtin_ctz(v) : XLEN)
+#define REG_CPOP(v)  ((reg_t)__builtin_popcount(v))
+#define REG_BSWAP(v) __builtin_bswap32(v)
+#endif
+// rotations the host compiler turns into one rotate instruction
+#define ROL(v, sh, bits) (((v) << (sh)) | ((v) >> (-(sh) & ((bits) - 1))))
+#define ROR(v, sh, bits) (((v) >> (sh)) | ((v) << (-(sh) & ((bits) - 1))))
+
+// orc.b: each byte becomes 0xff if it is not zero
+static inline reg_t orc_b(reg_t v) {
+    reg_t lo = ((reg_t)-1) / 0xff * 0x7f; // 0x7f in every byte
+    reg_t t  = ((v & lo) + lo) | v;       // the top bit of each byte: byte != 0
+    return ((t & ~lo) >> 7) * 0xff;
+}
+
+// OP with a funct7 other than ADD/SUB/..., into *res; return false if the
+// instruction is illegal (or its extension is left out)
+static bool Core_execute_bitmanip(const Core *self, reg_t funct7, reg_t funct3, reg_t rs2,
+                                  reg_t v1, reg_t v2, reg_t *res) {
+    uint32_t isa = self->csr.isa;
+    reg_t sh     = v2 & (XLEN - 1);
+    reg_t bit    = (reg_t)1 << sh;
+    switch (funct7) {
+    case 0x10: // SH1ADD/SH2ADD/SH3ADD
+        if (!(isa & ISA_ZBA) || (funct3 != 0x2 && funct3 != 0x4 && funct3 != 0x6)) return false;
+        *res = (v1 << (funct3 >> 1)) + v2;
+        return true;
+    case 0x20: // ANDN/ORN/XNOR (SUB and SRA are not handled here)
+        if (!(isa & ISA_ZBB)) return false;
+        switch (funct3) {
+        case 0x4: *res = ~(v1 ^ v2); return true;
+        case 0x6: *res = v1 | ~v2;   return true;
+        case 0x7: *res = v1 & ~v2;   return true;
+        default:  return false;
+        }
+    case 0x05: // MIN/MINU/MAX/MAXU
+        if (!(isa & ISA_ZBB)) return false;
+        switch (funct3) {
+        case 0x4: *res = ((sreg_t)v1 < (sreg_t)v2) ? v1 : v2; return true;
+        case 0x5: *res = (v1 < v2) ? v1 : v2;                 return true;
+        case 0x6: *res = ((sreg_t)v1 > (sreg_t)v2) ? v1 : v2; return true;
+        case 0x7: *res = (v1 > v2) ? v1 : v2;                 return true;
+        default:  return false;
+        }
+    case 0x30: // ROL/ROR
+        if (!(isa & ISA_ZBB) || (funct3 != 0x1 && funct3 != 0x5)) return false;
+        *res = (funct3 == 0x1) ? ROL(v1, sh, XLEN) : ROR(v1, sh, XLEN);
+        return true;
+#if XLEN == 32
+    case 0x04: // ZEXT.H (OP-32 on RV64)
+        if (!(isa & ISA_ZBB) || funct3 != 0x4 || rs2 != 0) return false;
+        *res = v1 & 0xffffu;
+        return true;
+#endif
+    case 0x24: // BCLR/BEXT
+        if (!(isa & ISA_ZBS) || (funct3 != 0x1 && funct3 != 0x5)) return false;
+        *res = (funct3 == 0x1) ? (v1 & ~bit) : ((v1 >> sh) & 1);
+        return true;
+    case 0x34: // BINV
+        if (!(isa & ISA_ZBS) || funct3 != 0x1) return false;
+        *res = v1 ^ bit;
+        return true;
+    case 0x14: // BSET
+        if (!(isa & ISA_ZBS) || funct3 != 0x1) return false;
+        *res = v1 | bit;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// OP-IMM shifts with a funct other than SLLI/SRLI/SRAI (funct7, or funct6 on
+// RV64, as SHIFT_FUNCT() extracts it), into *res; return false if illegal
+static bool Core_execute_bitmanip_imm(const Core *self, reg_t funct, reg_t funct3, reg_t imm,
+                                      reg_t v1, reg_t *res) {
+    uint32_t isa = self->csr.isa;
+    reg_t shamt  = imm & (XLEN - 1);
+    if (funct3 == 0x1) {
+        switch (funct) {
+        case 0x30: // CLZ/CTZ/CPOP/SEXT.B/SEXT.H (shamt selects)
+            if (!(isa & ISA_ZBB)) return false;
+            switch (imm & 0x1f) {
+            case 0x0: *res = REG_CLZ(v1);                    break;
+            case 0x1: *res = REG_CTZ(v1);                    break;
+            case 0x2: *res = REG_CPOP(v1);                   break;
+            case 0x4: *res = (reg_t)(sreg_t)(int8_t)v1;      break;
+            case 0x5: *res = (reg_t)(sreg_t)(int16_t)v1;     break;
+            default:  return false;
+            }
+            return (imm & (XLEN - 1) & ~(reg_t)0x1f) == 0;
+        case 0x24: // BCLRI
+            if (!(isa & ISA_ZBS)) return false;
+            *res = v1 & ~((reg_t)1 << shamt);
+            return true;
+        case 0x34: // BINVI
+            if (!(isa & ISA_ZBS)) return false;
+            *res = v1 ^ ((reg_t)1 << shamt);
+            return true;
+        case 0x14: // BSETI
+            if (!(isa & ISA_ZBS)) return false;
+            *res = v1 | ((reg_t)1 << shamt);
+            return true;
+        default:
+            return false;
+        }
+    }
+    switch (funct) { // funct3 == 5
+    case 0x30: // RORI
+        if (!(isa & ISA_ZBB)) return false;
+        *res = ROR(v1, shamt, XLEN);
+        return true;
+    case 0x24: // BEXTI
+        if (!(isa & ISA_ZBS)) return false;
+        *res = (v1 >> shamt) & 1;
+        return true;
+    case 0x14: // ORC.B
+        if (!(isa & ISA_ZBB) || shamt != 0x7) return false;
+        *res = orc_b(v1);
+        return true;
+    case 0x34: // REV8
+        if (!(isa & ISA_ZBB) || shamt != XLEN - 8) return false;
+        *res = REG_BSWAP(v1);
+        return true;
+    default:
+        return false;
+    }
+}
+
+#if XLEN == 64
+// the OP-32 and OP-IMM-32 forms: ADD.UW, SHnADD.UW, SLLI.UW, ZEXT.H, ROLW,
+// RORW, RORIW, CLZW, CTZW and CPOPW; return false if illegal
+static bool Core_execute_bitmanip_w(const Core *self, reg_t opcode, reg_t funct7, reg_t funct3,
+                                    reg_t rs2, reg_t v1, reg_t v2, reg_t *res) {
+    uint32_t isa = self->csr.isa;
+    uint32_t w   = (uint32_t)v1;
+    if (opcode == OP_IMM_32) {
+        if (funct3 == 0x1 && (funct7 >> 1) == 0x02) { // SLLI.UW (6-bit shamt)
+            if (!(isa & ISA_ZBA)) return false;
+            *res = (reg_t)w << (((funct7 & 0x1) << 5) | rs2);
+            return true;
+        }
+        if (funct7 != 0x30 || !(isa & ISA_ZBB)) return false;
+        if (funct3 == 0x5) { // RORIW
+            *res = sext32(ROR(w, rs2, 32));
+            return true;
+        }
+        switch ((funct3 == 0x1) ? rs2 : 0x1f) {
+        case 0x0: *res = w ? (reg_t)__builtin_clz(w) : 32; return true;
+        case 0x1: *res = w ? (reg_t)__builtin_ctz(w) : 32; return true;
+        case 0x2: *res = (reg_t)__builtin_popcount(w);     return true;
+        default:  return false;
+        }
+    }
+    switch (funct7) {
+    case 0x04: // ADD.UW, ZEXT.H
+        if (funct3 == 0x0 && (isa & ISA_ZBA)) {
+            *res = (reg_t)w + v2;
+            return true;
+        }
+        if (funct3 == 0x4 && rs2 == 0 && (isa & ISA_ZBB)) {
+            *res = v1 & 0xffffu;
+            return true;
+        }
+        return false;
+    case 0x10: // SH1ADD.UW/SH2ADD.UW/SH3ADD.UW
+        if (!(isa & ISA_ZBA) || (funct3 != 0x2 && funct3 != 0x4 && funct3 != 0x6)) return false;
+        *res = ((reg_t)w << (funct3 >> 1)) + v2;
+        return true;
+    case 0x30: { // ROLW/RORW
+        if (!(isa & ISA_ZBB) || (funct3 != 0x1 && funct3 != 0x5)) return false;
+        unsigned sh = v2 & 31u;
+        *res        = sext32((funct3 == 0x1) ? ROL(w, sh, 32) : ROR(w, sh, 32));
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+#endif
+
+/* -------------------- Floating point (F/D) -------------------- */
+// upper half of a single in an FP register
+#define NAN_BOX 0xffffffff00000000ull
+
+static inline bool Core_fp_enabled(const Core *self) {
+    return (self->csr.isa & ISA_F) && (self->csr.priv.mstatus & MSTATUS_FS) != MSTATUS_FS_OFF;
+}
+
+static inline void Core_fp_dirty(Core *self) {
+    self->csr.priv.mstatus |= MSTATUS_FS_DIRTY | MSTATUS_SD;
+}
+
+// the single in register r, the canonical NaN if it is not NaN-boxed
+static inline uint32_t Core_fpr_s(const Core *self, reg_t r) {
+    uint64_t v = self->arch_state.fpr[r];
+    return ((v & NAN_BOX) == NAN_BOX) ? (uint32_t)v : FPU_NAN_S;
+}
+
+static inline void Core_set_fpr(Core *self, reg_t r, uint64_t v) {
+    self->arch_state.fpr[r] = v;
+    Core_fp_dirty(self);
+}
+
+// the rounding mode of the rm field (DYN: frm), false if it is reserved
+static inline bool Core_fp_rm(const Core *self, reg_t rm, unsigned *ret) {
+    if (rm == FRM_DYN) {
+        rm = (self->arch_state.fcsr >> 5) & 0x7;
+    }
+    *ret = (unsigned)rm;
+    return rm <= FRM_RMM;
+}
+
+// fflags, frm and fcsr are views of arch_state.fcsr; return false if the
+// access is illegal
+static bool Core_fp_csr_read(Core *self, unsigned csr_addr, reg_t *value) {
+    if (!Core_fp_enabled(self)) {
+        return false;
+    }
+    uint32_t fcsr = self->arch_state.fcsr;
+    switch (csr_addr) {
+    case CSR_FFLAGS: *value = fcsr & FFLAGS_MASK; break;
+    case CSR_FRM:    *value = fcsr >> 5;          break;
+    default:         *value = fcsr;               break;
+    }
+    return true;
+}
+
+static bool Core_fp_csr_write(Core *self, unsigned csr_addr, reg_t value) {
+    if (!Core_fp_enabled(self)) {
+        return false;
+    }
+    uint32_t *fcsr = &self->arch_state.fcsr;
+    switch (csr_addr) {
+    case CSR_FFLAGS: *fcsr = (*fcsr & ~FFLAGS_MASK) | (value & FFLAGS_MASK);  break;
+    case CSR_FRM:    *fcsr = (*fcsr & FFLAGS_MASK) | ((value & 0x7) << 5);    break;
+    default:         *fcsr = value & 0xff;                                    break;
+    }
+    Core_fp_dirty(self);
+    return true;
+}
+
+// OP-FP and the fused multiply-adds (FS is on), the arithmetic itself runs in
+// fpu.c; return false if the instruction is illegal
+static bool Core_execute_fp(Core *self, reg_t raw) {
+    reg_t opcode = raw & 0x7fu;
+    reg_t rd     = (raw >> 7) & 0x1fu;
+    reg_t funct3 = (raw >> 12) & 0x7u;
+    reg_t rs1    = (raw >> 15) & 0x1fu;
+    reg_t rs2    = (raw >> 20) & 0x1fu;
+    reg_t rs3    = (raw >> 27) & 0x1fu;
+    reg_t funct7 = (raw >> 25) & 0x7fu;
+    reg_t fmt    = funct7 & 0x3u;
+
+    reg_t *x    = self->arch_state.gpr;
+    uint64_t *f = self->arch_state.fpr;
+    bool dbl = (fmt == 1);
+    // only S and D; FCVT.S.D needs D as well
+    if (fmt > 1 || ((dbl || (opcode == OP_FP && funct7 == FCVT_FF_FUNC7)) &&
+                    !(self->csr.isa & ISA_D))) {
+        return false;
+    }
+
+    unsigned rm;
+    unsigned flags = 0;
+    uint64_t res   = 0; // for f[rd]
+    bool to_x      = false;
+    reg_t xres     = 0; // for x[rd] if to_x
+
+    if (opcode != OP_FP) {
+        // MADD, MSUB, NMSUB and NMADD are consecutive opcodes
+        fpu_op_t op = (fpu_op_t)(FPU_MADD + ((opcode >> 2) & 0x3u));
+        if (!Core_fp_rm(self, funct3, &rm)) {
+            return false;
+        }
+        res = dbl ? fpu_arith_d(op, f[rs1], f[rs2], f[rs3], rm, &flags)
+                  : NAN_BOX | fpu_arith_s(op, Core_fpr_s(self, rs1), Core_fpr_s(self, rs2),
+                                          Core_fpr_s(self, rs3), rm, &flags);
+    } else {
+        uint64_t a = dbl ? f[rs1] : Core_fpr_s(self, rs1);
+        uint64_t b = dbl ? f[rs2] : Core_fpr_s(self, rs2);
+        switch (funct7 & ~0x3u) {
+        case FSQRT_FUNC7:
+            if (rs2 != 0) {
+                return false;
+            }
+            // fall through
+        case FADD_FUNC7:
+        case FSUB_FUNC7:
+        case FMUL_FUNC7:
+        case FDIV_FUNC7: {
+            fpu_op_t op = (funct7 >> 2 == FSQRT_FUNC7 >> 2) ? FPU_SQRT : (fpu_op_t)(funct7 >> 2);
+            if (!Core_fp_rm(self, funct3, &rm)) {
+                return false;
+            }
+            res = dbl ? fpu_arith_d(op, a, b, 0, rm, &flags)
+                      : NAN_BOX | fpu_arith_s(op, a, b, 0, rm, &flags);
+            break;
+        }
+        case FSGNJ_FUNC7: { // FSGNJ, FSGNJN, FSGNJX
+            uint64_t sign = dbl ? (1ull << 63) : (1ull << 31);
+            switch (funct3) {
+            case 0x0: res = (a & ~sign) | (b & sign);       break;
+            case 0x1: res = (a & ~sign) | (~b & sign);      break;
+            case 0x2: res = a ^ (b & sign);                 break;
+            default:  return false;
+            }
+            res |= dbl ? 0 : NAN_BOX;
+            break;
+        }
+        case FMINMAX_FUNC7:
+            if (funct3 > 0x1) {
+                return false;
+            }
+            res = dbl ? fpu_minmax_d(a, b, funct3, &flags)
+                      : NAN_BOX | fpu_minmax_s(a, b, funct3, &flags);
+            break;
+        case FCVT_FF_FUNC7: // FCVT.S.D (rs2 1) and FCVT.D.S (rs2 0)
+            if (rs2 != !dbl || !Core_fp_rm(self, funct3, &rm)) {
+                return false;
+            }
+            res = dbl ? fpu_cvt_d_s(Core_fpr_s(self, rs1), &flags)
+                      : NAN_BOX | fpu_cvt_s_d(f[rs1], rm, &flags);
+            break;
+        case FCMP_FUNC7: // FLE, FLT, FEQ
+            if (funct3 > 0x2) {
+                return false;
+            }
+            to_x = true;
+            xres = dbl ? fpu_compare_d(a, b, funct3, &flags) : fpu_compare_s(a, b, funct3, &flags);
+            break;
+        case FCVT_IF_FUNC7: { // FCVT.W, .WU (and .L, .LU on RV64)
+            bool wide      = rs2 & 0x2;
+            bool is_signed = !(rs2 & 0x1);
+            if (rs2 > (XLEN == 64 ? 0x3 : 0x1) || !Core_fp_rm(self, funct3, &rm)) {
+                return false;
+            }
+            uint64_t v = dbl ? fpu_cvt_int_d(a, wide, is_signed, rm, &flags)
+                             : fpu_cvt_int_s(a, wide, is_signed, rm, &flags);
+            to_x = true;
+            xres = wide ? (reg_t)v : sext32((uint32_t)v);
+            break;
+        }
+        case FCVT_FI_FUNC7: { // from W, WU (and L, LU on RV64)
+            bool is_signed = !(rs2 & 0x1);
+            if (rs2 > (XLEN == 64 ? 0x3 : 0x1) || !Core_fp_rm(self, funct3, &rm)) {
+                return false;
+            }
+            uint64_t v = x[rs1];
+            if (!(rs2 & 0x2)) {
+                v = is_signed ? (uint64_t)(int64_t)(int32_t)v : (uint32_t)v;
+            }
+            res = dbl ? fpu_cvt_d_int(v, is_signed, rm, &flags)
+                      : NAN_BOX | fpu_cvt_s_int(v, is_signed, rm, &flags);
+            break;
+        }
+        case FMV_XF_FUNC7: // FMV.X.W (FMV.X.D on RV64), FCLASS
+            if (rs2 != 0 || funct3 > 0x1 || (funct3 == 0x0 && dbl && XLEN == 32)) {
+                return false;
+            }
+            to_x = true;
+            if (funct3 == 0x1) {
+                xres = dbl ? fpu_class_d(a) : fpu_class_s(a);
+            } else {
+                // the raw bits, NaN-boxed or not
+                xres = dbl ? (reg_t)f[rs1] : sext32((uint32_t)f[rs1]);
+            }
+            break;
+        case FMV_FX_FUNC7: // FMV.W.X (FMV.D.X on RV64)
+            if (rs2 != 0 || funct3 != 0x0 || (dbl && XLEN == 32)) {
+                return false;
+            }
+            res = dbl ? (uint64_t)x[rs1] : NAN_BOX | (uint32_t)x[rs1];
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (flags != 0) {
+        self->arch_state.fcsr |= flags;
+        Core_fp_dirty(self);
+    }
+    if (!to_x) {
+        Core_set_fpr(self, rd, res);
+    } else if (rd != 0) {
+        x[rd] = xres;
+    }
+    return true;
+}
+
+/* ------------------------- Vector (V) ------------------------- */
+// the element kernels are in vector.c, this part decodes, checks the register
+// groups and applies masks; arithmetic does not resume (vstart must be 0)
+
+static inline bool Core_vector_enabled(const Core *self) {
+    return (self->csr.isa & ISA_V) && (self->csr.priv.mstatus & MSTATUS_VS) != MSTATUS_VS_OFF;
+}
+
+static inline void Core_vector_dirty(Core *self) {
+    self->csr.priv.mstatus |= MSTATUS_VS_DIRTY | MSTATUS_SD;
+}
+
+static inline bool is_vector_csr(unsigned csr_addr) {
+    return (csr_addr >= CSR_VSTART && csr_addr <= CSR_VXRM) || csr_addr == CSR_VCSR ||
+           (csr_addr >= CSR_VL && csr_addr <= CSR_VLENB);
+}
+
+static bool Core_vector_csr_read(Core *self, unsigned csr_addr, reg_t *value) {
+    if (!Core_vector_enabled(self)) {
+        return false;
+    }
+    const VectorState *v = &self->vec;
+    switch (csr_addr) {
+    case CSR_VSTART: *value = v->vstart;                 break;
+    case CSR_VXSAT:  *value = v->vxsat;                  break;
+    case CSR_VXRM:   *value = v->vxrm;                   break;
+    case CSR_VCSR:   *value = (v->vxrm << 1) | v->vxsat; break;
+    case CSR_VL:     *value = v->vl;                     break;
+    case CSR_VTYPE:  *value = v->vtype;                  break;
+    default:         *value = v->vlenb;                  break;
+    }
+    return true;
+}
+
+static bool Core_vector_csr_write(Core *self, unsigned csr_addr, reg_t value) {
+    // vl, vtype and vlenb are read-only
+    if (!Core_vector_enabled(self) || CSR_READ_ONLY(csr_addr)) {
+        return false;
+    }
+    VectorState *v = &self->vec;
+    switch (csr_addr) {
+    case CSR_VSTART: v->vstart = value & (v->vlenb * 8 - 1); break; // element index < VLEN
+    case CSR_VXSAT:  v->vxsat  = value & 0x1;                break;
+    case CSR_VXRM:   v->vxrm   = value & 0x3;                break;
+    default:
+        v->vxrm  = (value >> 1) & 0x3;
+        v->vxsat = value & 0x1;
+        break;
+    }
+    Core_vector_dirty(self);
+    return true;
+}
+
+// OPIVV/OPIVX/OPIVI forms
+#define VF_VV 0x1u
+#define VF_VX 0x2u
+#define VF_VI 0x4u
+#define VF_ALL (VF_VV | VF_VX | VF_VI)
+
+// OPI* instructions by funct6: the kernel operation and the forms that exist
+static const struct {
+    vop_t op;
+    unsigned forms; // 0: reserved or not implemented
+} vector_opi[64] = {
+    [0x00] = { VOP_ADD, VF_ALL },          [0x02] = { VOP_SUB, VF_VV | VF_VX },
+    [0x03] = { VOP_RSUB, VF_VX | VF_VI },  [0x04] = { VOP_MINU, VF_VV | VF_VX },
+    [0x05] = { VOP_MIN, VF_VV | VF_VX },   [0x06] = { VOP_MAXU, VF_VV | VF_VX },
+    [0x07] = { VOP_MAX, VF_VV | VF_VX },   [0x09] = { VOP_AND, VF_ALL },
+    [0x0a] = { VOP_OR, VF_ALL },           [0x0b] = { VOP_XOR, VF_ALL },
+    [0x17] = { VOP_MV, VF_ALL },           // vmerge, vmv.v
+    [0x18] = { VOP_MSEQ, VF_ALL },         [0x19] = { VOP_MSNE, VF_ALL },
+    [0x1a] = { VOP_MSLTU, VF_VV | VF_VX }, [0x1b] = { VOP_MSLT, VF_VV | VF_VX },
+    [0x1c] = { VOP_MSLEU, VF_ALL },        [0x1d] = { VOP_MSLE, VF_ALL },
+    [0x1e] = { VOP_MSGTU, VF_VX | VF_VI }, [0x1f] = { VOP_MSGT, VF_VX | VF_VI },
+    [0x25] = { VOP_SLL, VF_ALL },          [0x28] = { VOP_SRL, VF_ALL },
+    [0x29] = { VOP_SRA, VF_ALL },
+};
+
+// vredsum, vredand, vredor, vredxor, vredminu, vredmin, vredmaxu, vredmax
+static const vop_t vector_red[8] = {
+    VOP_ADD, VOP_AND, VOP_OR, VOP_XOR, VOP_MINU, VOP_MIN, VOP_MAXU, VOP_MAX,
+};
+
+// the first vl elements of src into the group at vd; with masked, only the
+// active ones (the rest and the tail stay undisturbed)
+static void Core_vector_writeback(Core *self, unsigned vd, const byte_t *src, bool masked) {
+    VectorState *v     = &self->vec;
+    unsigned esz       = Vector_sew(v) / 8;
+    unsigned vl        = (unsigned)v->vl;
+    byte_t *d          = Vector_reg(v, vd);
+    const byte_t *mask = Vector_reg(v, 0);
+    if (!masked) {
+        memcpy(d, src, (size_t)vl * esz);
+        return;
+    }
+    for (unsigned i = 0; i < vl; i++) {
+        if (vector_mask_bit(mask, i)) {
+            memcpy(d + i * esz, src + i * esz, esz);
+        }
+    }
+}
+
+// a mask logical (funct6 & 7: andn, and, or, xor, orn, nand, nor, xnor) of
+// eight mask bits
+static inline byte_t vector_mask_op(unsigned f, byte_t p, byte_t q) {
+    switch (f) {
+    case 0:  return p & ~q;
+    case 1:  return p & q;
+    case 2:  return p | q;
+    case 3:  return p ^ q;
+    case 4:  return p | ~q;
+    case 5:  return ~(p & q);
+    case 6:  return ~(p | q);
+    default: return ~(p ^ q);
+    }
+}
+
+static bool Core_vector_opi(Core *self, unsigned funct3, unsigned funct6, unsigned vd,
+                            unsigned rs1, unsigned vs2, bool masked) {
+    VectorState *v = &self->vec;
+    unsigned form  = (funct3 == OPIVV_FUNC3) ? VF_VV : (funct3 == OPIVX_FUNC3) ? VF_VX : VF_VI;
+    if (!(vector_opi[funct6].forms & form)) {
+        return false;
+    }
+    vop_t op      = vector_opi[funct6].op;
+    unsigned sew  = Vector_sew(v);
+    unsigned lmul = Vector_lmul_regs(v);
+    unsigned vl   = (unsigned)v->vl;
+
+    const byte_t *src1 = NULL;
+    uint64_t scalar    = 0;
+    if (form == VF_VV) {
+        if (rs1 % lmul) {
+            return false;
+        }
+        src1 = Vector_reg(v, rs1);
+    } else if (form == VF_VX) {
+        scalar = (uint64_t)(int64_t)(sreg_t)self->arch_state.gpr[rs1];
+    } else if (op == VOP_SLL || op == VOP_SRL || op == VOP_SRA) {
+        scalar = rs1; // uimm5
+    } else {
+        scalar = (uint64_t)(int64_t)((int32_t)(rs1 << 27) >> 27); // simm5
+    }
+    if (vs2 % lmul) {
+        return false;
+    }
+
+    const byte_t *mask = Vector_reg(v, 0);
+    if (op >= VOP_MSEQ) {
+        // a single mask register, which may be v0 even when masked
+        uint64_t bits[VEC_MASK_WORDS] = { 0 };
+        Vector_compare(op, sew, bits, Vector_reg(v, vs2), src1, scalar, vl);
+        byte_t *d = Vector_reg(v, vd);
+        for (unsigned i = 0; i < vl; i++) {
+            if (!masked || vector_mask_bit(mask, i)) {
+                vector_set_mask_bit(d, i, (bits[i / 64] >> (i % 64)) & 1);
+            }
+        }
+        return true;
+    }
+    if ((vd % lmul) || (masked && vd == 0)) {
+        return false;
+    }
+    byte_t tmp[8 * VLENB_MAX + VEC_HOST_BYTES];
+    if (op == VOP_MV) {
+        // vmv.v.* (unmasked, vs2 = 0) or vmerge (v0 picks src1 over vs2)
+        if (!masked && vs2 != 0) {
+            return false;
+        }
+        Vector_alu(VOP_MV, sew, tmp, Vector_reg(v, vs2), src1, scalar, NULL, vl);
+        if (masked) {
+            unsigned esz      = sew / 8;
+            const byte_t *old = Vector_reg(v, vs2);
+            for (unsigned i = 0; i < vl; i++) {
+                if (!vector_mask_bit(mask, i)) {
+                    memcpy(tmp + i * esz, old + i * esz, esz);
+                }
+            }
+        }
+        Core_vector_writeback(self, vd, tmp, false);
+        return true;
+    }
+    Vector_alu(op, sew, tmp, Vector_reg(v, vs2), src1, scalar, Vector_reg(v, vd), vl);
+    Core_vector_writeback(self, vd, tmp, masked);
+    return true;
+}
+
+static bool Core_vector_opm(Core *self, unsigned funct3, unsigned funct6, unsigned vd,
+                            unsigned rs1, unsigned vs2, bool masked) {
+    VectorState *v     = &self->vec;
+    reg_t *x           = self->arch_state.gpr;
+    bool vv            = (funct3 == OPMVV_FUNC3);
+    unsigned sew       = Vector_sew(v);
+    unsigned lmul      = Vector_lmul_regs(v);
+    unsigned vl        = (unsigned)v->vl;
+    const byte_t *mask = Vector_reg(v, 0);
+    byte_t tmp[8 * VLENB_MAX + VEC_HOST_BYTES];
+
+    if (funct6 < 8) {
+        // reductions: vd[0] = op(vs1[0], the active elements of vs2)
+        if (!vv || (vs2 % lmul)) {
+            return false;
+        }
+        if (vl > 0) {
+            uint64_t init = vector_get(Vector_reg(v, rs1), sew, 0);
+            uint64_t res  = Vector_reduce(vector_red[funct6], sew, Vector_reg(v, vs2),
+                                          masked ? mask : NULL, init, vl);
+            vector_set(Vector_reg(v, vd), sew, 0, res);
+        }
+        return true;
+    }
+
+    switch (funct6) {
+    case 0x10: { // VWXUNARY0 (vmv.x.s, vcpop.m, vfirst.m) and VRXUNARY0 (vmv.s.x)
+        if (!vv) {
+            if (vs2 != 0 || masked) {
+                return false;
+            }
+            if (vl > 0) {
+                vector_set(Vector_reg(v, vd), sew, 0, (uint64_t)(int64_t)(sreg_t)x[rs1]);
+            }
+            return true;
+        }
+        const byte_t *src = Vector_reg(v, vs2);
+        reg_t res;
+        if (rs1 == 0x00) { // vmv.x.s, sign-extending element 0 (even if vl is 0)
+            if (masked) {
+                return false;
+            }
+            res = (reg_t)((int64_t)(vector_get(src, sew, 0) << (64 - sew)) >> (64 - sew));
+        } else if (rs1 == 0x10 || rs1 == 0x11) { // vcpop.m, vfirst.m
+            res = (rs1 == 0x10) ? 0 : ~(reg_t)0;
+            for (unsigned i = 0; i < vl; i++) {
+                if (vector_mask_bit(src, i) && (!masked || vector_mask_bit(mask, i))) {
+                    if (rs1 == 0x11) {
+                        res = i;
+                        break;
+                    }
+                    res++;
+                }
+            }
+        } else {
+            return false;
+        }
+        if (vd != 0) {
+            x[vd] = res;
+        }
+        return true;
+    }
+
+    case 0x14: // VMUNARY0: vid.v
+        if (!vv || rs1 != 0x11 || vs2 != 0 || (vd % lmul) || (masked && vd == 0)) {
+            return false;
+        }
+        for (unsigned i = 0; i < vl; i++) {
+            vector_set(tmp, sew, i, i);
+        }
+        Core_vector_writeback(self, vd, tmp, masked);
+        return true;
+
+    case 0x25: // vmul
+    case 0x2d: // vmacc
+        if ((vs2 % lmul) || (vd % lmul) || (masked && vd == 0) || (vv && (rs1 % lmul))) {
+            return false;
+        }
+        Vector_alu((funct6 == 0x25) ? VOP_MUL : VOP_MACC, sew, tmp, Vector_reg(v, vs2),
+                   vv ? Vector_reg(v, rs1) : NULL, (uint64_t)(int64_t)(sreg_t)x[rs1],
+                   Vector_reg(v, vd), vl);
+        Core_vector_writeback(self, vd, tmp, masked);
+        return true;
+
+    default:
+        if (funct6 >= 0x18 && vv && !masked) {
+            // mask logicals, eight elements at a time
+            const byte_t *p = Vector_reg(v, vs2);
+            const byte_t *q = Vector_reg(v, rs1);
+            byte_t *d       = Vector_reg(v, vd);
+            unsigned f      = funct6 & 0x7;
+            unsigned i      = 0;
+            for (; i + 8 <= vl; i += 8) {
+                d[i / 8] = vector_mask_op(f, p[i / 8], q[i / 8]);
+            }
+            for (; i < vl; i++) {
+                vector_set_mask_bit(d, i, (vector_mask_op(f, p[i / 8], q[i / 8]) >> (i % 8)) & 1);
+            }
+            return true;
+        }
+        return false;
+    }
+}
+
+// OP-V (VS is on): vset{i}vl{i} and the integer arithmetic; return false if
+// the instruction is illegal
+static bool Core_execute_vector(Core *self, reg_t raw) {
+    VectorState *v  = &self->vec;
+    reg_t *x        = self->arch_state.gpr;
+    unsigned rd     = (raw >> 7) & 0x1fu; // vd
+    unsigned funct3 = (raw >> 12) & 0x7u;
+    unsigned rs1    = (raw >> 15) & 0x1fu; // vs1 or the immediate
+    unsigned vs2    = (raw >> 20) & 0x1fu;
+    bool masked     = !((raw >> 25) & 0x1u);
+    unsigned funct6 = (raw >> 26) & 0x3fu;
+
+    if (funct3 == OPCFG_FUNC3) {
+        reg_t vtype;
+        bool imm_avl = false;
+        if (!((raw >> 31) & 0x1u)) { // vsetvli
+            vtype = (raw >> 20) & 0x7ffu;
+        } else if (((raw >> 30) & 0x3u) == 0x3u) { // vsetivli
+            vtype   = (raw >> 20) & 0x3ffu;
+            imm_avl = true;
+        } else if (((raw >> 25) & 0x7fu) == 0x40u) { // vsetvl
+            vtype = x[vs2];
+        } else {
+            return false;
+        }
+        // rs1 = x0 asks for VLMAX, or keeps vl if rd is x0 too
+        reg_t avl = imm_avl ? rs1 : (rs1 != 0) ? x[rs1] : (rd != 0) ? ~(reg_t)0 : v->vl;
+        Vector_set_vtype(v, vtype, avl);
+        Core_vector_dirty(self);
+        if (rd != 0) {
+            x[rd] = v->vl;
+        }
+        return true;
+    }
+
+    if ((v->vtype & VTYPE_VILL) || v->vstart != 0) {
+        return false;
+    }
+    bool ok;
+    switch (funct3) {
+    case OPIVV_FUNC3:
+    case OPIVX_FUNC3:
+    case OPIVI_FUNC3:
+        ok = Core_vector_opi(self, funct3, funct6, rd, rs1, vs2, masked);
+        break;
+    case OPMVV_FUNC3:
+    case OPMVX_FUNC3:
+        ok = Core_vector_opm(self, funct3, funct6, rd, rs1, vs2, masked);
+        break;
+    default: // no vector floating point
+        return false;
+    }
+    if (ok) {
+        Core_vector_dirty(self); // also after vmv.x.s and friends, which is allowed
+    }
+    return ok;
+}
+
+// vector loads/stores (VS is on): unit-stride (vle/vse, vlm/vsm) and strided
+// (vlse/vsse). Unmasked unit-stride accesses to RAM are a copy per page,
+// other accesses go element by element; a trap leaves the element index in
+// vstart, where the access resumes. Return false if the instruction is illegal
+static bool Core_vector_mem(Core *self, reg_t raw, bool store) {
+    VectorState *v  = &self->vec;
+    reg_t *x        = self->arch_state.gpr;
+    unsigned vd     = (raw >> 7) & 0x1fu; // vs3 of stores
+    unsigned width  = (raw >> 12) & 0x7u;
+    unsigned rs1    = (raw >> 15) & 0x1fu;
+    unsigned rs2    = (raw >> 20) & 0x1fu; // lumop/sumop, or the stride register
+    bool masked     = !((raw >> 25) & 0x1u);
+    unsigned mop    = (raw >> 26) & 0x3u;
+    unsigned mew_nf = (raw >> 28) & 0xfu;
+
+    unsigned eew;
+    switch (width) {
+    case VLE8_FUNC3:  eew = 8;  break;
+    case VLE16_FUNC3: eew = 16; break;
+    case VLE32_FUNC3: eew = 32; break;
+    case VLE64_FUNC3: eew = 64; break;
+    default:          return false;
+    }
+    // no segments (nf), no indexed accesses (mop 1, 3)
+    if ((v->vtype & VTYPE_VILL) || mew_nf != 0 || (mop != 0 && mop != 2)) {
+        return false;
+    }
+    unsigned esz  = eew / 8;
+    unsigned evl  = (unsigned)v->vl;
+    reg_t stride  = esz;
+    bool bulk     = (mop == 0 && !masked);
+    if (mop == 0 && rs2 == 0x0b) {
+        // vlm.v/vsm.v: the mask register as ceil(vl / 8) bytes
+        if (masked || eew != 8) {
+            return false;
+        }
+        evl = (evl + 7) / 8;
+    } else {
+        if (mop == 0 && rs2 != 0) {
+            return false;
+        }
+        if (mop == 2) {
+            stride = x[rs2];
+        }
+        // EMUL = EEW / SEW * LMUL, in eighths of a register
+        unsigned vlmul = v->vtype & VTYPE_VLMUL;
+        unsigned lmul8 = (vlmul & 0x4) ? 8u >> (8 - vlmul) : 8u << vlmul;
+        unsigned emul8 = lmul8 * eew / Vector_sew(v);
+        unsigned regs  = (emul8 >= 8) ? emul8 / 8 : 1;
+        if (emul8 == 0 || emul8 > 64 || (vd % regs) || (masked && vd == 0 && !store)) {
+            return false;
+        }
+    }
+
+    byte_t *data       = Vector_reg(v, vd);
+    const byte_t *mask = Vector_reg(v, 0);
+    reg_t base         = x[rs1];
+    mmu_access_t type  = store ? MMU_STORE : MMU_LOAD;
+    unsigned i         = (unsigned)v->vstart;
+    while (bulk && i < evl) {
+        addr_t addr = (addr_t)(base + (reg_t)i * esz);
+        if (unlikely(addr & (esz - 1))) {
+            Core_trap(self, store ? CAUSE_STORE_MISALIGNED : CAUSE_LOAD_MISALIGNED, addr);
+            v->vstart = i;
+            return true;
+        }
+        unsigned n = (unsigned)((MMU_PAGE_SIZE - (addr & MMU_PAGE_MASK)) / esz);
+        n          = (n < evl - i) ? n : evl - i;
+        addr_t paddr;
+        byte_t *host;
+        if (!Core_translate(self, addr, n * esz, type, &paddr, &host)) {
+            v->vstart = i;
+            return true;
+        }
+        if (host == NULL) {
+            break; // a device, element by element below
+        }
+        if (unlikely(self->cache_sim != NULL || self->locality != NULL)) {
+            for (unsigned k = 0; k < n; k++) {
+                if (store) {
+                    Core_observe_store(self, paddr + k * esz, esz);
+                } else {
+                    Core_observe_load(self, paddr + k * esz, esz);
+                }
+            }
+        }
+        if (store) {
+            Core_undo_store(self, host, (size_t)n * esz);
+            memcpy(host, data + (size_t)i * esz, (size_t)n * esz);
+        } else {
+            memcpy(data + (size_t)i * esz, host, (size_t)n * esz);
+        }
+        i += n;
+    }
+    for (; i < evl; i++) {
+        if (masked && !vector_mask_bit(mask, i)) {
+            continue;
+        }
+        addr_t addr = (addr_t)(base + (reg_t)i * stride);
+        bool done   = store ? Core_mem_store(self, addr, esz, data + (size_t)i * esz)
+                            : Core_mem_load(self, addr, esz, data + (size_t)i * esz);
+        if (!done) {
+            v->vstart = i;
+            return true;
+        }
+    }
+    v->vstart = 0;
+    if (!store) {
+        Core_vector_dirty(self);
+    }
+    return true;
+}
+
+/* ------------------------- CSR access ------------------------- */
+// the FP and vector CSRs are kept by the core, the others are in the CSR
+// file; return false if the access is illegal
+static bool Core_csr_read(Core *self, unsigned csr_addr, reg_t *value) {
+    if (csr_addr >= CSR_FFLAGS && csr_addr <= CSR_FCSR) {
+        return Core_fp_csr_read(self, csr_addr, value);
+    }
+    if (is_vector_csr(csr_addr)) {
+        return Core_vector_csr_read(self, csr_addr, value);
+    }
+    return CSRFile_read(&self->csr, csr_addr, value);
+}
+
+static bool Core_csr_write(Core *self, unsigned csr_addr, reg_t value) {
+    if (csr_addr >= CSR_FFLAGS && csr_addr <= CSR_FCSR) {
+        return Core_fp_csr_write(self, csr_addr, value);
+    }
+    if (is_vector_csr(csr_addr)) {
+        return Core_vector_csr_write(self, csr_addr, value);
+    }
+    return CSRFile_write(&self->csr, csr_addr, value);
 }
 
 /* --------------------------- Fetch --------------------------- */
-static inst_fields_t Core_fetch(Core *self) {
-    // fetch instruction according to self->arch_state.current_pc
+// fetch the instruction at self->arch_state.current_pc into *ret, return
+// false if the fetch trapped
+static bool Core_fetch(Core *self, inst_fields_t *ret) {
     byte_t inst_in_bytes[4] = {};
-    MemoryMap_generic_load(&self->mem_map, self->arch_state.current_pc, 4, inst_in_bytes);
+    if (unlikely(self->arch_state.current_pc & 0x3u)) {
+        Core_trap(self, CAUSE_FETCH_MISALIGNED, self->arch_state.current_pc);
+        return false;
+    }
+    if (unlikely(self->cache_sim != NULL)) {
+        CacheSim_fetch(self->cache_sim, self->arch_state.current_pc);
+    }
+    if (unlikely(self->locality != NULL)) {
+        Locality_fetch(self->locality, self->arch_state.current_pc);
+    }
+    if (!Core_mem_read(self, self->arch_state.current_pc, 4, inst_in_bytes, MMU_FETCH)) {
+        return false;
+    }
     // little-endian pack into raw
-    inst_fields_t ret = {};
-    ret.raw |= (reg_t)inst_in_bytes[0];
-    ret.raw |= (reg_t)inst_in_bytes[1] << 8;
-    ret.raw |= (reg_t)inst_in_bytes[2] << 16;
-    ret.raw |= (reg_t)inst_in_bytes[3] << 24;
-    return ret;
+    ret->raw = 0;
+    ret->raw |= (reg_t)inst_in_bytes[0];
+    ret->raw |= (reg_t)inst_in_bytes[1] << 8;
+    ret->raw |= (reg_t)inst_in_bytes[2] << 16;
+    ret->raw |= (reg_t)inst_in_bytes[3] << 24;
+    return true;
 }
 
 /* --------------------------- Decode -------------------------- */
@@ -45,6 +1328,21 @@ static inst_enum_t Core_decode(Core *self, inst_fields_t inst_fields) {
     case JALR:                ret = inst_jalr;             break; // 0x67
     case AUIPC:               ret = inst_auipc;            break; // 0x17
     case LUI:                 ret = inst_lui;              break; // 0x37
+    case SYSTEM:   /* 0x73 */ ret = (inst_enum_t)SYSTEM;   break;
+    case AMO:      /* 0x2F */ ret = (inst_enum_t)AMO;      break;
+    case MISC_MEM: /* 0x0F */ ret = (inst_enum_t)MISC_MEM; break;
+    case LOAD_FP:  /* 0x07 */ ret = inst_flw;              break; // FLW/FLD/VLE
+    case STORE_FP: /* 0x27 */ ret = inst_fsw;              break; // FSW/FSD/VSE
+    case MADD:     /* 0x43 */ ret = inst_fmadd;            break;
+    case MSUB:     /* 0x47 */ ret = inst_fmsub;            break;
+    case NMSUB:    /* 0x4B */ ret = inst_fnmsub;           break;
+    case NMADD:    /* 0x4F */ ret = inst_fnmadd;           break;
+    case OP_FP:    /* 0x53 */ ret = inst_op_fp;            break;
+    case OP_V:     /* 0x57 */ ret = inst_op_v;             break;
+#if XLEN == 64
+    case OP_IMM_32: /* 0x1B */ ret = (inst_enum_t)OP_IMM_32; break;
+    case OP_32:     /* 0x3B */ ret = (inst_enum_t)OP_32;     break;
+#endif
     default:                  ret = (inst_enum_t)0;        break; // illegal/unused
     }
     return ret;
@@ -54,12 +1352,18 @@ static inst_enum_t Core_decode(Core *self, inst_fields_t inst_fields) {
 static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst_enum) {
     (void)inst_enum; // We decode from raw directly
 
-    // default next PC = PC + 4 (wrap mod 2^32)
-    self->new_pc = add_addr_u32(self->arch_state.current_pc, 4);
+    // default next PC = PC + 4 (wrap mod 2^XLEN)
+    self->new_pc = add_addr(self->arch_state.current_pc, 4);
 
     /* helpers */
     #define GETBITS(x,hi,lo) (((x) >> (lo)) & ((uint32_t)((1u << ((hi)-(lo)+1)) - 1u)))
     #define SEXT(val,bits)   ((int32_t)((int32_t)((uint32_t)(val) << (32-(bits))) >> (32-(bits))))
+    // funct7 of the immediate shifts, whose shamt takes inst[25] on RV64
+    #if XLEN == 64
+    #define SHIFT_FUNCT(x)   (GETBITS(x, 31, 26) << 1)
+    #else
+    #define SHIFT_FUNCT(x)   GETBITS(x, 31, 25)
+    #endif
 
     reg_t raw    = inst_fields.raw;
     reg_t opcode = GETBITS(raw, 6, 0);
@@ -82,7 +1386,7 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
          (GETBITS(raw, 11,8)  << 1 )),
         13
     );
-    reg_t   imm_u = (raw & 0xFFFFF000u);
+    reg_t   imm_u = sext32(raw & 0xFFFFF000u);
     int32_t imm_j = SEXT(
         ((GETBITS(raw, 31,31) << 20) |
          (GETBITS(raw, 19,12) << 12) |
@@ -91,33 +1395,42 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
         21
     );
 
+    // reserved encodings raise an illegal instruction exception (tval: the
+    // instruction) and change nothing else
+    bool illegal = false;
+
     switch (opcode) {
 
     /* -------------------------- R-type (OP) -------------------------- */
     case OP: { // 0x33
         reg_t v1 = x[rs1], v2 = x[rs2];
         reg_t res = 0;
+        if (funct7 != 0x00 && !(funct7 == 0x20 && (funct3 == 0x0 || funct3 == 0x5))) {
+            illegal = !Core_execute_bitmanip(self, funct7, funct3, rs2, v1, v2, &res);
+            if (!illegal && rd != 0) x[rd] = res;
+            break;
+        }
 
         switch (funct3) {
         case 0x0: // ADD/SUB (wrap)
-            if (funct7 == 0x20) res = (reg_t)((uint32_t)v1 - (uint32_t)v2); // SUB
-            else                 res = (reg_t)((uint32_t)v1 + (uint32_t)v2); // ADD
+            if (funct7 == 0x20) res = v1 - v2; // SUB
+            else                 res = v1 + v2; // ADD
             break;
         case 0x1: // SLL
-            res = v1 << (v2 & 31u);
+            res = v1 << (v2 & (XLEN - 1));
             break;
         case 0x2: // SLT
-            res = ((int32_t)v1 < (int32_t)v2) ? 1u : 0u;
+            res = ((sreg_t)v1 < (sreg_t)v2) ? 1u : 0u;
             break;
         case 0x3: // SLTU
-            res = ((uint32_t)v1 < (uint32_t)v2) ? 1u : 0u;
+            res = (v1 < v2) ? 1u : 0u;
             break;
         case 0x4: // XOR
             res = v1 ^ v2;
             break;
         case 0x5: // SRL/SRA
-            if (funct7 == 0x20) res = (reg_t)((int32_t)v1   >> (v2 & 31u)); // SRA (arith)
-            else                 res = (reg_t)((uint32_t)v1 >> (v2 & 31u)); // SRL (logical)
+            if (funct7 == 0x20) res = (reg_t)((sreg_t)v1 >> (v2 & (XLEN - 1))); // SRA (arith)
+            else                 res = v1 >> (v2 & (XLEN - 1));                  // SRL (logical)
             break;
         case 0x6: // OR
             res = v1 | v2;
@@ -141,13 +1454,13 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
 
         switch (funct3) {
         case 0x0: // ADDI (wrap)
-            res = (reg_t)((uint32_t)v1 + (uint32_t)imm_i);
+            res = v1 + (reg_t)imm_i;
             break;
         case 0x2: // SLTI
-            res = ((int32_t)v1 < imm_i) ? 1u : 0u;
+            res = ((sreg_t)v1 < imm_i) ? 1u : 0u;
             break;
         case 0x3: // SLTIU
-            res = ((uint32_t)v1 < (uint32_t)imm_i) ? 1u : 0u;
+            res = (v1 < (reg_t)imm_i) ? 1u : 0u;
             break;
         case 0x4: // XORI
             res = v1 ^ (reg_t)imm_i;
@@ -159,16 +1472,26 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
             res = v1 & (reg_t)imm_i;
             break;
         case 0x1: { // SLLI
-            reg_t shamt = (reg_t)(imm_i & 0x1F);
+            if (SHIFT_FUNCT(raw) != 0x00) {
+                illegal = !Core_execute_bitmanip_imm(self, SHIFT_FUNCT(raw), funct3, (reg_t)imm_i,
+                                                     v1, &res);
+                break;
+            }
+            reg_t shamt = (reg_t)(imm_i & (XLEN - 1));
             res = v1 << shamt;
             break;
         }
         case 0x5: { // SRLI/SRAI
-            reg_t shamt = (reg_t)(imm_i & 0x1F);
-            if (GETBITS(raw, 31, 25) == 0x20) // SRAI (funct7=0100000)
-                res = (reg_t)((int32_t)v1   >> shamt);
-            else                               // SRLI (logical)
-                res = (reg_t)((uint32_t)v1 >> shamt);
+            if (SHIFT_FUNCT(raw) != 0x00 && SHIFT_FUNCT(raw) != 0x20) {
+                illegal = !Core_execute_bitmanip_imm(self, SHIFT_FUNCT(raw), funct3, (reg_t)imm_i,
+                                                     v1, &res);
+                break;
+            }
+            reg_t shamt = (reg_t)(imm_i & (XLEN - 1));
+            if (SHIFT_FUNCT(raw) == 0x20) // SRAI (funct7=0100000)
+                res = (reg_t)((sreg_t)v1 >> shamt);
+            else                           // SRLI (logical)
+                res = v1 >> shamt;
             break;
         }
         default:
@@ -176,50 +1499,69 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
             break;
         }
 
-        if (rd != 0 && rd < 32) x[rd] = res;
+        if (!illegal && rd != 0 && rd < 32) x[rd] = res;
         break;
     }
 
     /* --------------------------- LOAD (I) ---------------------------- */
     case LOAD: { // 0x03
-        reg_t addr = add_addr_u32(x[rs1], imm_i); // wrap-safe
+        reg_t addr = add_addr(x[rs1], imm_i); // wrap-safe
 
         switch (funct3) {
         case 0x0: { // LB
             byte_t b[1];
-            MemoryMap_generic_load(&self->mem_map, addr, 1, b);
+            if (!Core_mem_load(self, addr, 1, b)) break;
             if (rd != 0 && rd < 32) x[rd] = (reg_t)SEXT((uint32_t)b[0], 8);
             break;
         }
         case 0x1: { // LH
             byte_t b[2];
-            MemoryMap_generic_load(&self->mem_map, addr, 2, b);
+            if (!Core_mem_load(self, addr, 2, b)) break;
             uint32_t v = (uint32_t)b[0] | ((uint32_t)b[1] << 8);
             if (rd != 0 && rd < 32) x[rd] = (reg_t)SEXT(v, 16);
             break;
         }
         case 0x2: { // LW
             byte_t b[4];
-            MemoryMap_generic_load(&self->mem_map, addr, 4, b);
+            if (!Core_mem_load(self, addr, 4, b)) break;
             uint32_t v = (uint32_t)b[0] | ((uint32_t)b[1] << 8)
                         | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
-            if (rd != 0 && rd < 32) x[rd] = (reg_t)v;
+            if (rd != 0 && rd < 32) x[rd] = sext32(v);
             break;
         }
         case 0x4: { // LBU
             byte_t b[1];
-            MemoryMap_generic_load(&self->mem_map, addr, 1, b);
+            if (!Core_mem_load(self, addr, 1, b)) break;
             if (rd != 0 && rd < 32) x[rd] = (reg_t)((uint32_t)b[0] & 0xFFu);
             break;
         }
         case 0x5: { // LHU
             byte_t b[2];
-            MemoryMap_generic_load(&self->mem_map, addr, 2, b);
+            if (!Core_mem_load(self, addr, 2, b)) break;
             uint32_t v = (uint32_t)b[0] | ((uint32_t)b[1] << 8);
             if (rd != 0 && rd < 32) x[rd] = (reg_t)(v & 0xFFFFu);
             break;
         }
+#if XLEN == 64
+        case 0x3: { // LD
+            byte_t b[8];
+            if (!Core_mem_load(self, addr, 8, b)) break;
+            reg_t v = 0;
+            for (int i = 7; i >= 0; i--) v = (v << 8) | b[i];
+            if (rd != 0 && rd < 32) x[rd] = v;
+            break;
+        }
+        case 0x6: { // LWU
+            byte_t b[4];
+            if (!Core_mem_load(self, addr, 4, b)) break;
+            uint32_t v = (uint32_t)b[0] | ((uint32_t)b[1] << 8)
+                        | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+            if (rd != 0 && rd < 32) x[rd] = (reg_t)v;
+            break;
+        }
+#endif
         default:
+            illegal = true;
             break;
         }
         break;
@@ -227,21 +1569,21 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
 
     /* --------------------------- STORE (S) --------------------------- */
     case STORE: { // 0x23
-        reg_t addr = add_addr_u32(x[rs1], imm_s); // wrap-safe
+        reg_t addr = add_addr(x[rs1], imm_s); // wrap-safe
         reg_t v2   = x[rs2];
 
         switch (funct3) {
         case 0x0: { // SB
             byte_t b[1];
             b[0] = (byte_t)(v2 & 0xFFu);
-            MemoryMap_generic_store(&self->mem_map, addr, 1, b);
+            Core_mem_store(self, addr, 1, b);
             break;
         }
         case 0x1: { // SH
             byte_t b[2];
             b[0] = (byte_t)(v2 & 0xFFu);
             b[1] = (byte_t)((v2 >> 8) & 0xFFu);
-            MemoryMap_generic_store(&self->mem_map, addr, 2, b);
+            Core_mem_store(self, addr, 2, b);
             break;
         }
         case 0x2: { // SW
@@ -250,10 +1592,19 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
             b[1] = (byte_t)((v2 >> 8)  & 0xFFu);
             b[2] = (byte_t)((v2 >> 16) & 0xFFu);
             b[3] = (byte_t)((v2 >> 24) & 0xFFu);
-            MemoryMap_generic_store(&self->mem_map, addr, 4, b);
+            Core_mem_store(self, addr, 4, b);
+            break;
+        }
+#if XLEN == 64
+        case 0x3: { // SD
+            byte_t b[8];
+            for (int i = 0; i < 8; i++) b[i] = (byte_t)((v2 >> (8 * i)) & 0xFFu);
+            Core_mem_store(self, addr, 8, b);
             break;
         }
+#endif
         default:
+            illegal = true;
             break;
         }
         break;
@@ -267,35 +1618,55 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
         switch (funct3) {
         case 0x0: take = (v1 == v2); break;                          // BEQ
         case 0x1: take = (v1 != v2); break;                          // BNE
-        case 0x4: take = ((int32_t)v1 <  (int32_t)v2); break;        // BLT
-        case 0x5: take = ((int32_t)v1 >= (int32_t)v2); break;        // BGE
-        case 0x6: take = ((uint32_t)v1 <  (uint32_t)v2); break;      // BLTU
-        case 0x7: take = ((uint32_t)v1 >= (uint32_t)v2); break;      // BGEU
-        default: break;
+        case 0x4: take = ((sreg_t)v1 <  (sreg_t)v2); break;          // BLT
+        case 0x5: take = ((sreg_t)v1 >= (sreg_t)v2); break;          // BGE
+        case 0x6: take = (v1 <  v2); break;                          // BLTU
+        case 0x7: take = (v1 >= v2); break;                          // BGEU
+        default: illegal = true; break;
+        }
+        if (take) {
+            reg_t target = add_addr(pc, imm_b);
+            if (target & 0x3u) {
+                Core_trap(self, CAUSE_FETCH_MISALIGNED, target);
+                break;
+            }
+            self->new_pc = target;
         }
-        if (take) self->new_pc = add_addr_u32(pc, imm_b);
         break;
     }
 
     /* ----------------------------- JAL ------------------------------- */
     case JAL: { // 0x6F
-        if (rd != 0 && rd < 32) x[rd] = add_addr_u32(pc, 4);
-        self->new_pc = add_addr_u32(pc, imm_j);
+        reg_t target = add_addr(pc, imm_j);
+        if (target & 0x3u) {
+            Core_trap(self, CAUSE_FETCH_MISALIGNED, target);
+            break; // rd is not written
+        }
+        if (rd != 0 && rd < 32) x[rd] = add_addr(pc, 4);
+        self->new_pc = target;
         break;
     }
 
     /* ----------------------------- JALR ------------------------------ */
     case JALR: { // 0x67
-        reg_t target = add_addr_u32(x[rs1], imm_i);
-        target &= ~1u; // clear bit 0
-        if (rd != 0 && rd < 32) x[rd] = add_addr_u32(pc, 4);
+        if (funct3 != 0x0) {
+            illegal = true;
+            break;
+        }
+        reg_t target = add_addr(x[rs1], imm_i);
+        target &= ~(reg_t)1; // clear bit 0
+        if (target & 0x3u) {
+            Core_trap(self, CAUSE_FETCH_MISALIGNED, target);
+            break; // rd is not written
+        }
+        if (rd != 0 && rd < 32) x[rd] = add_addr(pc, 4);
         self->new_pc = target;
         break;
     }
 
     /* ----------------------------- AUIPC ----------------------------- */
     case AUIPC: { // 0x17
-        if (rd != 0 && rd < 32) x[rd] = add_addr_u32(pc, (int32_t)imm_u);
+        if (rd != 0 && rd < 32) x[rd] = pc + imm_u;
         break;
     }
 
@@ -305,16 +1676,241 @@ static void Core_execute(Core *self, inst_fields_t inst_fields, inst_enum_t inst
         break;
     }
 
+    /* ---------------------------- SYSTEM ----------------------------- */
+    case SYSTEM: { // 0x73
+        if (funct3 == 0x0) {
+            reg_t mode   = self->csr.priv.mode;
+            reg_t func12 = GETBITS(raw, 31, 20);
+            if (funct7 == SFENCE_VMA_FUNC7 && rd == 0) {
+                if (mode == PRIV_U) {
+                    illegal = true;
+                    break;
+                }
+                MMU_flush(&self->mmu, rs1 != 0, x[rs1]);
+                break;
+            }
+            if (rd != 0 || rs1 != 0) {
+                illegal = true;
+                break;
+            }
+            switch (func12) {
+            case ECALL_FUNC12:
+                // with a proxy the host serves the call, otherwise the guest
+                if (self->syscall_proxy != NULL) {
+                    SyscallProxy_handle(self->syscall_proxy, x);
+                } else {
+                    Core_trap(self, CAUSE_ECALL_U + mode, 0);
+                }
+                break;
+            case EBREAK_FUNC12: Core_trap(self, CAUSE_BREAKPOINT, pc); break;
+            case MRET_FUNC12:
+                if (mode != PRIV_M) {
+                    illegal = true;
+                    break;
+                }
+                Core_trap_return(self, PRIV_M);
+                break;
+            case SRET_FUNC12:
+                if (mode == PRIV_U) {
+                    illegal = true;
+                    break;
+                }
+                Core_trap_return(self, PRIV_S);
+                break;
+            case WFI_FUNC12:
+                illegal = (mode == PRIV_U); // otherwise a no-op
+                break;
+            default: illegal = true; break;
+            }
+            break;
+        }
+        if (funct3 == 0x4) {
+            illegal = true; // reserved
+            break;
+        }
+
+        unsigned csr_addr = (unsigned)GETBITS(raw, 31, 20);
+        reg_t src         = (funct3 & 0x4) ? rs1 : x[rs1]; // zimm or rs1
+        reg_t old         = 0;
+
+        // CSRRW(I) with rd == x0 must not read the CSR; CSRRS/C(I) with
+        // rs1 == x0 (or zimm == 0) must not write it
+        bool do_read  = !((funct3 & 0x3) == 0x1 && rd == 0);
+        bool do_write = ((funct3 & 0x3) == 0x1) || (rs1 != 0);
+
+        if (do_read && !Core_csr_read(self, csr_addr, &old)) {
+            illegal = true; // missing CSR or not accessible in this mode
+            break;
+        }
+        if (do_write) {
+            reg_t res = 0;
+            switch (funct3 & 0x3) {
+            case 0x1: res = src;        break; // CSRRW(I)
+            case 0x2: res = old | src;  break; // CSRRS(I)
+            case 0x3: res = old & ~src; break; // CSRRC(I)
+            }
+            if (!Core_csr_write(self, csr_addr, res)) {
+                illegal = true; // read-only or missing CSR
+                break;
+            }
+            Core_update_mmu(self);     // mstatus or satp may have changed
+            Core_request_events(self); // and mie, mip or mstatus.xIE
+        }
+        if (rd != 0 && rd < 32) x[rd] = old;
+        break;
+    }
+
+    /* ----------------------------- AMO (A) --------------------------- */
+    case AMO: { // 0x2F
+        reg_t funct5 = GETBITS(raw, 31, 27);
+        bool known   = funct5 == AMOADD_FUNC5 || funct5 == AMOSWAP_FUNC5 || funct5 == LR_FUNC5 ||
+                     funct5 == SC_FUNC5 || funct5 == AMOXOR_FUNC5 || funct5 == AMOOR_FUNC5 ||
+                     funct5 == AMOAND_FUNC5 || funct5 == AMOMIN_FUNC5 ||
+                     funct5 == AMOMAX_FUNC5 || funct5 == AMOMINU_FUNC5 ||
+                     funct5 == AMOMAXU_FUNC5;
+        // only the .W forms on RV32
+        if (!(self->csr.isa & ISA_A) || funct3 != 0x2 || !known ||
+            (funct5 == LR_FUNC5 && rs2 != 0)) {
+            illegal = true;
+            break;
+        }
+        reg_t res;
+        if (!Core_execute_amo(self, funct5, x[rs1], (uint32_t)x[rs2], &res)) {
+            break;
+        }
+        if (rd != 0 && rd < 32) x[rd] = res;
+        break;
+    }
+
+#if XLEN == 64
+    /* ------------------- RV64: OP-IMM-32 and OP-32 ------------------- */
+    case OP_IMM_32: { // 0x1B
+        if (funct3 != 0x0 && funct7 != 0x00 && !(funct3 == 0x5 && funct7 == 0x20)) {
+            reg_t res = 0;
+            illegal   = !Core_execute_bitmanip_w(self, opcode, funct7, funct3, rs2, x[rs1], 0, &res);
+            if (!illegal && rd != 0) x[rd] = res;
+            break;
+        }
+        uint32_t v1  = (uint32_t)x[rs1];
+        uint32_t res = 0;
+        switch (funct3) {
+        case 0x0: res = v1 + (uint32_t)imm_i; break; // ADDIW
+        case 0x1: // SLLIW
+            illegal = (funct7 != 0x00);
+            res     = v1 << rs2;
+            break;
+        case 0x5: // SRLIW/SRAIW
+            illegal = (funct7 != 0x00 && funct7 != 0x20);
+            res     = (funct7 == 0x20) ? (uint32_t)((int32_t)v1 >> rs2) : v1 >> rs2;
+            break;
+        default: illegal = true; break;
+        }
+        if (!illegal && rd != 0 && rd < 32) x[rd] = sext32(res);
+        break;
+    }
+
+    case OP_32: { // 0x3B
+        if (funct7 != 0x00 && !(funct7 == 0x20 && (funct3 == 0x0 || funct3 == 0x5))) {
+            reg_t res = 0;
+            illegal   = !Core_execute_bitmanip_w(self, opcode, funct7, funct3, rs2, x[rs1], x[rs2],
+                                                 &res);
+            if (!illegal && rd != 0) x[rd] = res;
+            break;
+        }
+        uint32_t v1 = (uint32_t)x[rs1], v2 = (uint32_t)x[rs2];
+        uint32_t res = 0;
+        switch (funct3) {
+        case 0x0: // ADDW/SUBW
+            illegal = (funct7 != 0x00 && funct7 != 0x20);
+            res     = (funct7 == 0x20) ? v1 - v2 : v1 + v2;
+            break;
+        case 0x1: // SLLW
+            illegal = (funct7 != 0x00);
+            res     = v1 << (v2 & 31u);
+            break;
+        case 0x5: // SRLW/SRAW
+            illegal = (funct7 != 0x00 && funct7 != 0x20);
+            res     = (funct7 == 0x20) ? (uint32_t)((int32_t)v1 >> (v2 & 31u)) : v1 >> (v2 & 31u);
+            break;
+        default: illegal = true; break;
+        }
+        if (!illegal && rd != 0 && rd < 32) x[rd] = sext32(res);
+        break;
+    }
+#endif
+
+    /* ------------------------- F and D (FP) -------------------------- */
+    case LOAD_FP: { // 0x07
+        if (funct3 != FLW_FUNC3 && funct3 != FLD_FUNC3) {
+            illegal = !Core_vector_enabled(self) || !Core_vector_mem(self, raw, false);
+            break;
+        }
+        unsigned length = (funct3 == FLW_FUNC3) ? 4 : 8;
+        if (!Core_fp_enabled(self) || (length == 8 && !(self->csr.isa & ISA_D))) {
+            illegal = true;
+            break;
+        }
+        byte_t b[8];
+        if (!Core_mem_load(self, add_addr(x[rs1], imm_i), length, b)) break;
+        uint64_t v = 0;
+        for (int i = (int)length - 1; i >= 0; i--) v = (v << 8) | b[i];
+        Core_set_fpr(self, rd, (length == 4) ? NAN_BOX | v : v);
+        break;
+    }
+
+    case STORE_FP: { // 0x27
+        if (funct3 != FLW_FUNC3 && funct3 != FLD_FUNC3) {
+            illegal = !Core_vector_enabled(self) || !Core_vector_mem(self, raw, true);
+            break;
+        }
+        unsigned length = (funct3 == FLW_FUNC3) ? 4 : 8;
+        if (!Core_fp_enabled(self) || (length == 8 && !(self->csr.isa & ISA_D))) {
+            illegal = true;
+            break;
+        }
+        uint64_t v2 = self->arch_state.fpr[rs2]; // FSW stores the low half as is
+        byte_t b[8];
+        for (unsigned i = 0; i < length; i++) b[i] = (byte_t)((v2 >> (8 * i)) & 0xFFu);
+        Core_mem_store(self, add_addr(x[rs1], imm_s), length, b);
+        break;
+    }
+
+    case MADD:  // 0x43
+    case MSUB:  // 0x47
+    case NMSUB: // 0x4B
+    case NMADD: // 0x4F
+    case OP_FP: // 0x53
+        illegal = !Core_fp_enabled(self) || !Core_execute_fp(self, raw);
+        break;
+
+    /* --------------------------- V (OP-V) ---------------------------- */
+    case OP_V: // 0x57
+        illegal = !Core_vector_enabled(self) || !Core_execute_vector(self, raw);
+        break;
+
+    /* --------------------------- MISC-MEM ---------------------------- */
+    case MISC_MEM: { // 0x0F
+        // FENCE orders nothing for one in-order hart (AMOs are sequentially
+        // consistent across harts), FENCE.I has no decoded code to drop
+        illegal = (funct3 != 0x0 && funct3 != 0x1);
+        break;
+    }
+
     default:
-        // illegal/unsupported -> do nothing; advance PC by +4 (already set)
+        illegal = true;
         break;
     }
 
+    if (unlikely(illegal)) {
+        Core_trap(self, CAUSE_ILLEGAL_INST, raw);
+    }
+
     // Enforce x0 == 0
     x[0] = 0;
 
     #undef GETBITS
     #undef SEXT
+    #undef SHIFT_FUNCT
 }
 
 /* -------------------------- PC update ------------------------- */
@@ -323,21 +1919,159 @@ static void Core_update_pc(Core *self) {
 }
 
 /* ---------------------------- Tick ---------------------------- */
+// BRANCH/JAL/JALR end basic blocks and form the edges of the coverage map
+static inline bool Core_is_control(reg_t raw) {
+    reg_t opcode = raw & 0x7Fu;
+    return opcode == BRANCH || opcode == JAL || opcode == JALR;
+}
+
+// the instruction raw retires: a couple of increments, cheap enough to
+// always count
+static inline void Core_count(Core *self, reg_t raw) {
+    reg_t opcode = raw & 0x7Fu;
+    self->stats.opcode[opcode]++;
+    if (opcode == BRANCH) {
+        self->stats.branches_taken += (self->new_pc != add_addr(self->arch_state.current_pc, 4));
+    } else if (unlikely((opcode | 0x20u) == STORE_FP)) { // LOAD_FP as well
+        reg_t width = (raw >> 12) & 0x7u;
+        self->stats.vector_mem += (width != FLW_FUNC3 && width != FLD_FUNC3);
+    }
+}
+
+// save what the instruction raw may write besides memory (the stores save
+// that themselves): rd, and the state of its extension
+static void Core_undo_inst(Core *self, reg_t raw) {
+    UndoLog *undo = self->undo;
+    reg_t opcode  = raw & 0x7Fu;
+    reg_t rd      = (raw >> 7) & 0x1Fu;
+    reg_t width   = (raw >> 12) & 0x7u;
+    UndoLog_save(undo, &self->arch_state.gpr[rd], sizeof(reg_t));
+    switch (opcode) {
+    case AMO:
+        UndoLog_save(undo, &self->lr_valid, sizeof(self->lr_valid));
+        UndoLog_save(undo, &self->lr_value, sizeof(self->lr_value));
+        UndoLog_save(undo, &self->lr_addr, sizeof(self->lr_addr));
+        break;
+    case LOAD_FP:
+    case STORE_FP:
+    case OP_V:
+        if (opcode == OP_V || (width != FLW_FUNC3 && width != FLD_FUNC3)) {
+            // a register group of up to 8 registers, vl/vtype/vstart/...
+            unsigned regs = (rd + 8 <= 32) ? 8 : 32 - rd;
+            UndoLog_save(undo, Vector_reg(&self->vec, rd), (size_t)regs * self->vec.vlenb);
+            UndoLog_save(undo, &self->vec.vl,
+                         (size_t)((byte_t *)(&self->vec.vxsat + 1) - (byte_t *)&self->vec.vl));
+        }
+        // fall through
+    case MADD:
+    case MSUB:
+    case NMSUB:
+    case NMADD:
+    case OP_FP:
+        UndoLog_save(undo, &self->arch_state.fpr[rd], sizeof(uint64_t));
+        UndoLog_save(undo, &self->arch_state.fcsr, sizeof(uint32_t));
+        UndoLog_save(undo, &self->csr.priv.mstatus, sizeof(reg_t)); // FS/VS
+        break;
+    case SYSTEM:
+        // CSRs (the FP and vector ones too), xRET, and a0 of an ECALL
+        UndoLog_save(undo, &self->csr.priv, sizeof(priv_state_t));
+        UndoLog_save(undo, &self->arch_state.fcsr, sizeof(uint32_t));
+        UndoLog_save(undo, &self->vec.vl,
+                     (size_t)((byte_t *)(&self->vec.vxsat + 1) - (byte_t *)&self->vec.vl));
+        UndoLog_save(undo, &self->arch_state.gpr[10], sizeof(reg_t));
+        break;
+    default:
+        break;
+    }
+}
+
 DECLARE_TICK_TICK(Core) {
-    Core *self_               = container_of(self, Core, super);
-    inst_fields_t inst_fields = Core_fetch(self_);
-    inst_enum_t inst_enum     = Core_decode(self_, inst_fields);
+    Core *self_    = container_of(self, Core, super);
+    self_->trapped = false;
+    if (unlikely(self_->undo != NULL)) {
+        UndoLog_mark(self_->undo, self_->arch_state.current_pc);
+        UndoLog_save(self_->undo, &self_->csr.instret, sizeof(uint64_t));
+    }
+    // one compare per step: interrupts are only looked at once something
+    // may have changed (next_event 0) or the timer deadline is reached
+    if (unlikely(self_->csr.instret >= __atomic_load_n(&self_->next_event, __ATOMIC_ACQUIRE)) &&
+        Core_handle_events(self_)) {
+        Core_update_pc(self_); // to the trap handler
+        return;
+    }
+    inst_fields_t inst_fields;
+    HOST_PERF_ENTER(self_->host_perf, HOST_PHASE_FETCH);
+    bool fetched = Core_fetch(self_, &inst_fields);
+    HOST_PERF_LEAVE(self_->host_perf);
+    if (unlikely(!fetched)) {
+        Core_update_pc(self_); // to the trap handler
+        return;
+    }
+    if (unlikely(self_->undo != NULL)) {
+        Core_undo_inst(self_, inst_fields.raw);
+    }
+    HOST_PERF_ENTER(self_->host_perf, HOST_PHASE_DECODE);
+    inst_enum_t inst_enum = Core_decode(self_, inst_fields);
+    HOST_PERF_LEAVE(self_->host_perf);
+    HOST_PERF_ENTER(self_->host_perf, HOST_PHASE_EXECUTE);
     Core_execute(self_, inst_fields, inst_enum);
+    HOST_PERF_LEAVE(self_->host_perf);
+    if (unlikely(self_->trapped)) {
+        Core_update_pc(self_);
+        return;
+    }
+    self_->csr.instret++;
+    Core_count(self_, inst_fields.raw);
+    if (unlikely(self_->timing != NULL)) {
+        self_->csr.extra_cycles += Timing_retire(self_->timing, inst_fields.raw,
+                                                 self_->arch_state.current_pc, self_->new_pc);
+    }
+    if (unlikely(self_->bbv != NULL)) {
+        BBV_retire(self_->bbv, self_->arch_state.current_pc, Core_is_control(inst_fields.raw));
+    }
+    if (unlikely(self_->coverage != NULL) && Core_is_control(inst_fields.raw)) {
+        Coverage_edge(self_->coverage, self_->arch_state.current_pc, self_->new_pc);
+    }
     Core_update_pc(self_);
 }
 
 /* ------------------------ ctor / dtor ------------------------- */
-void Core_ctor(Core *self) {
-    assert(self != NULL);
+void Core_ctor(Core *self, const iss_config_t *config) {
+    assert((self != NULL) && (config != NULL));
+
+    // registers start out zero (x0 is never written, so it must be)
+    memset(&self->arch_state, 0, sizeof(arch_state_t));
+    self->new_pc = 0;
 
     // initialize memory map object
     MemoryMap_ctor(&self->mem_map);
 
+    // initialize CSRs and the MMU (M-mode, bare)
+    CSRFile_ctor(&self->csr, config);
+    MMU_ctor(&self->mmu, &self->mem_map);
+    Vector_ctor(&self->vec, config->vlen);
+    self->syscall_proxy = NULL;
+    self->cache_sim     = NULL;
+    self->timing        = NULL;
+    self->locality      = NULL;
+    self->bbv           = NULL;
+    self->coverage      = NULL;
+    self->debug         = NULL;
+    self->undo          = NULL;
+    self->window        = NULL;
+    memset(self->window_mem, 0, sizeof(self->window_mem));
+#ifdef ISS_HOST_PERF
+    self->host_perf = NULL;
+#endif
+    self->lr_valid      = false;
+    self->lr_addr       = 0;
+    self->lr_value      = 0;
+    self->timecmp       = UINT64_MAX;
+    self->next_event    = UINT64_MAX;
+    self->trapped       = false;
+    self->steps         = 0;
+    memset(&self->stats, 0, sizeof(core_stats_t));
+
     // initialize base class (Tick)
     Tick_ctor(&self->super);
     static struct TickVtbl const vtbl = { .tick = SIGNATURE_TICK_TICK(Core) };
@@ -352,3 +2086,115 @@ void Core_dtor(Core *self) {
 int Core_add_device(Core *self, mmap_unit_t new_device) {
     return MemoryMap_add_device(&self->mem_map, new_device);
 }
+
+void Core_set_syscall_proxy(Core *self, SyscallProxy *syscall_proxy) {
+    self->syscall_proxy = syscall_proxy;
+}
+
+void Core_set_cache_sim(Core *self, CacheSim *cache_sim) {
+    self->cache_sim = cache_sim;
+}
+
+void Core_set_timing(Core *self, Timing *timing) {
+    self->timing = timing;
+}
+
+void Core_set_locality(Core *self, Locality *locality) {
+    self->locality = locality;
+}
+
+void Core_set_bbv(Core *self, BBV *bbv) {
+    self->bbv = bbv;
+}
+
+void Core_set_coverage(Core *self, Coverage *coverage) {
+    self->coverage = coverage;
+}
+
+void Core_set_debug(Core *self, Debug *debug) {
+    self->debug     = debug;
+    self->mmu.debug = debug;
+}
+
+void Core_set_undo(Core *self, UndoLog *undo) {
+    self->undo     = undo;
+    self->mmu.undo = undo;
+}
+
+void Core_set_input_log(Core *self, InputLog *input_log) {
+    self->mem_map.input_log = input_log;
+    self->csr.input_log     = input_log;
+}
+
+void Core_set_window(Core *self, byte_t *window) {
+    self->window = window;
+}
+
+void Core_add_window_mem(Core *self, addr_t base, addr_t size, bool writable) {
+    mmap_count_t *count = MemoryMap_count_ptr(&self->mem_map, base, size);
+    Assert(count != NULL && size % 8 == 0, "0x%" PRIxREG " is not a plain memory", (reg_t)base);
+    for (unsigned i = 0; i < CORE_WINDOW_MEMS; i++) {
+        core_window_mem_t *mem = &self->window_mem[i];
+        if (mem->size == 0) {
+            *mem = (core_window_mem_t){ .base     = base,
+                                        .size     = size,
+                                        .writable = writable,
+                                        .device   = (unsigned)(count - self->mem_map.count_arr) };
+            return;
+        }
+    }
+    Panic("More than %d memories in the window", CORE_WINDOW_MEMS);
+}
+
+#ifdef ISS_HOST_PERF
+void Core_set_host_perf(Core *self, HostPerf *host_perf) {
+    self->host_perf = host_perf;
+}
+#endif
+
+bool Core_undo(Core *self) {
+    reg_t pc;
+    if (self->undo == NULL || !UndoLog_undo(self->undo, &pc)) {
+        return false;
+    }
+    self->arch_state.current_pc = pc;
+    Core_request_events(self); // mip/mie may be back to other values
+    return true;
+}
+
+void Core_sync_mmu(Core *self) {
+    MMU_flush(&self->mmu, false, 0);
+    Core_update_mmu(self);
+}
+
+// (the undo log of a single hart takes the CLINT stores as its own)
+void Core_set_msip(Core *self, bool pending) {
+    if (unlikely(self->undo != NULL)) {
+        UndoLog_save(self->undo, &self->csr.priv.mip, sizeof(reg_t));
+    }
+    if (pending) {
+        __atomic_fetch_or(&self->csr.priv.mip, MIP_MSIP, __ATOMIC_SEQ_CST);
+    } else {
+        __atomic_fetch_and(&self->csr.priv.mip, ~(reg_t)MIP_MSIP, __ATOMIC_SEQ_CST);
+    }
+    Core_request_events(self);
+}
+
+bool Core_get_msip(const Core *self) {
+    return (__atomic_load_n(&self->csr.priv.mip, __ATOMIC_ACQUIRE) & MIP_MSIP) != 0;
+}
+
+// a new compare value takes MTIP back until the timer reaches it again
+void Core_set_timecmp(Core *self, uint64_t timecmp) {
+    if (unlikely(self->undo != NULL)) {
+        UndoLog_save(self->undo, &self->csr.priv.mip, sizeof(reg_t));
+        UndoLog_save(self->undo, &self->timecmp, sizeof(uint64_t));
+    }
+    __atomic_store_n(&self->timecmp, timecmp, __ATOMIC_SEQ_CST);
+    __atomic_fetch_and(&self->csr.priv.mip, ~(reg_t)MIP_MTIP, __ATOMIC_SEQ_CST);
+    Core_request_events(self);
+}
+
+uint64_t Core_get_timecmp(const Core *self) {
+    return __atomic_load_n(&self->timecmp, __ATOMIC_ACQUIRE);
+}
@@ -3,7 +3,40 @@
 
 #include "tick.h"
 #include "arch.h"
+#include "bbv.h"
+#include "cache.h"
+#include "coverage.h"
+#include "csr.h"
+#include "debug.h"
+#include "host_perf.h"
+#include "input_log.h"
+#include "iss.h"
+#include "locality.h"
 #include "mem_map.h"
+#include "mmu.h"
+#include "syscall_proxy.h"
+#include "timing.h"
+#include "undo.h"
+#include "vector.h"
+
+// retired instructions of a hart, see ISS_get_stats()
+typedef struct {
+    uint64_t opcode[128];     // by major opcode
+    uint64_t vector_mem;      // LOAD-FP/STORE-FP of the V extension
+    uint64_t branches_taken;
+    uint64_t instret_start; // csr.instret at the start of the interval
+} core_stats_t;
+
+// the plain memories the window of a hart may hold, see Core_add_window_mem()
+#define CORE_WINDOW_MEMS 2
+
+// a plain memory in the window (size 0: none)
+typedef struct {
+    addr_t base;
+    addr_t size;
+    bool writable;
+    unsigned device; // index in the memory map, for the access counts
+} core_window_mem_t;
 
 typedef struct {
     Tick super; // inherit from parent class
@@ -11,12 +44,77 @@ typedef struct {
     // internal states of core (includes memory map object)
     arch_state_t arch_state; // RISC-V architectural states
     reg_t new_pc;            // helper data member for next-pc calculation
+    CSRFile csr;             // control and status registers (Zicsr/Zicntr)
     MemoryMap mem_map;       // memory map which contains all MMIO devices (with
                              // LOAD/STORE capability)
+    MMU mmu;                 // Sv32 translation and software TLB
+    VectorState vec;         // vector registers and CSRs (V)
+    SyscallProxy *syscall_proxy; // serves ECALL (NULL: ECALL does nothing)
+    CacheSim *cache_sim;         // observes fetches/loads/stores (NULL: off)
+    Timing *timing;              // pipeline timing model (NULL: off)
+    Locality *locality;          // locality analysis (NULL: off)
+    BBV *bbv;                    // basic-block vectors (NULL: off)
+    Coverage *coverage;          // fuzzing edge coverage (NULL: off)
+    Debug *debug;                // debugger break/watchpoints (NULL: off)
+    UndoLog *undo;               // reverse execution (NULL: off)
+    byte_t *window;              // unchecked bare accesses (NULL: off)
+    core_window_mem_t window_mem[CORE_WINDOW_MEMS]; // what goes through it
+#ifdef ISS_HOST_PERF
+    HostPerf *host_perf; // host counters of the phases
+#endif
+
+    // LR/SC reservation of this hart (see Core_execute_amo())
+    bool lr_valid;  // a reservation is held
+    addr_t lr_addr; // reserved word
+    reg_t lr_value; // value loaded by LR, SC succeeds while memory still holds it
+
+    // interrupts: the tick looks at mip and the timer only once instret
+    // reaches next_event (the timer deadline, or 0 when a CSR write or the
+    // CLINT may have made an interrupt pending), instead of every step
+    uint64_t timecmp;    // CLINT mtimecmp of this hart (UINT64_MAX: never)
+    uint64_t next_event; // atomic, other harts' CLINT stores set it to 0
+    bool trapped;        // the current instruction trapped
+
+    // steps of the step loop of ISS_step(), which advances it instead of the
+    // tick: instructions, retired or trapped, interrupts taken and debugger
+    // stops (a plain counter, step back does not rewind it)
+    uint64_t steps;
+
+    core_stats_t stats;
 } Core;
 
-extern void Core_ctor(Core *self);
+extern void Core_ctor(Core *self, const iss_config_t *config);
 extern void Core_dtor(Core *self);
 extern int Core_add_device(Core *self, mmap_unit_t new_device);
+extern void Core_set_syscall_proxy(Core *self, SyscallProxy *syscall_proxy);
+extern void Core_set_cache_sim(Core *self, CacheSim *cache_sim);
+extern void Core_set_timing(Core *self, Timing *timing);
+extern void Core_set_locality(Core *self, Locality *locality);
+extern void Core_set_bbv(Core *self, BBV *bbv);
+extern void Core_set_coverage(Core *self, Coverage *coverage);
+extern void Core_set_debug(Core *self, Debug *debug);
+extern void Core_set_undo(Core *self, UndoLog *undo);
+// record/replay the device loads and host clock reads of the hart
+extern void Core_set_input_log(Core *self, InputLog *input_log);
+// bare fetches, loads and stores go straight to window + physical address,
+// see GuestWindow (NULL: through the TLB and the memory map)
+extern void Core_set_window(Core *self, byte_t *window);
+// the plain memory [base, base + size) (a device of the memory map, size a
+// multiple of 8) is in the window; only accesses within one of them take it
+extern void Core_add_window_mem(Core *self, addr_t base, addr_t size, bool writable);
+#ifdef ISS_HOST_PERF
+extern void Core_set_host_perf(Core *self, HostPerf *host_perf);
+#endif
+// undo the last instruction in the undo log (false if there is none), the
+// caller calls Core_sync_mmu() once done
+extern bool Core_undo(Core *self);
+// the privileged state was changed from outside (e.g. a restored image)
+extern void Core_sync_mmu(Core *self);
+// CLINT side of the hart: machine software interrupt and timer compare (may
+// be called from the thread of another hart)
+extern void Core_set_msip(Core *self, bool pending);
+extern bool Core_get_msip(const Core *self);
+extern void Core_set_timecmp(Core *self, uint64_t timecmp);
+extern uint64_t Core_get_timecmp(const Core *self);
 
 #endif
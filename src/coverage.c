@@ -0,0 +1,37 @@
+#include "coverage.h"
+
+#include "arch.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/shm.h>
+
+int Coverage_ctor(Coverage *self) {
+    assert(self != NULL);
+
+    const char *shm_id = getenv("__AFL_SHM_ID");
+    if (shm_id != NULL) {
+        void *map = shmat(atoi(shm_id), NULL, 0);
+        if (map == (void *)-1) {
+            fprintf(stderr, "Fail to attach the coverage map (__AFL_SHM_ID=%s)\n", shm_id);
+            return -1;
+        }
+        self->map    = map;
+        self->shared = true;
+        return 0;
+    }
+    self->map    = calloc(COVERAGE_MAP_SIZE, 1);
+    self->shared = false;
+    return (self->map == NULL) ? -1 : 0;
+}
+
+void Coverage_dtor(Coverage *self) {
+    assert(self != NULL);
+    if (self->shared) {
+        shmdt(self->map);
+    } else {
+        free(self->map);
+    }
+}
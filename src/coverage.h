@@ -0,0 +1,35 @@
+#ifndef __COVERAGE_H__
+#define __COVERAGE_H__
+
+#include "arch.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// AFL's MAP_SIZE
+#define COVERAGE_MAP_SIZE (1u << 16)
+
+// AFL-style edge coverage: one hit counter per (source, target) hash
+typedef struct {
+    byte_t *map;
+    bool shared; // the fuzzer's SysV shared memory (__AFL_SHM_ID)
+} Coverage;
+
+// attach the map of the fuzzer if __AFL_SHM_ID is set, else allocate one
+extern int Coverage_ctor(Coverage *self);
+extern void Coverage_dtor(Coverage *self);
+
+static inline unsigned coverage_hash(reg_t pc) {
+    return (unsigned)((pc >> 1) * 2654435761u) >> 16;
+}
+
+// record a control transfer pc -> new_pc (taken or not)
+static inline void Coverage_edge(Coverage *self, reg_t pc, reg_t new_pc) {
+    // shifting one side keeps A -> B and B -> A apart
+    unsigned index = (coverage_hash(pc) ^ (coverage_hash(new_pc) >> 1)) & (COVERAGE_MAP_SIZE - 1);
+    // counters never wrap back to 0 (AFL++ "NeverZero")
+    byte_t hits      = self->map[index] + 1;
+    self->map[index] = hits + (hits == 0);
+}
+
+#endif
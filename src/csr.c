@@ -0,0 +1,275 @@
+#include "csr.h"
+
+#include "arch.h"
+#include "common.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// a * b / c without overflowing the intermediate product (for b, c < 2^32)
+static inline uint64_t muldiv64(uint64_t a, uint64_t b, uint64_t c) {
+    return (a / c) * b + (a % c) * b / c;
+}
+
+static uint64_t CSRFile_cycle(const CSRFile *self) {
+    // one cycle per instruction plus the stalls of the timing model (if any)
+    return self->instret + self->extra_cycles;
+}
+
+static uint64_t CSRFile_time(const CSRFile *self) {
+    if (self->time_source == ISS_TIME_HOST) {
+        uint64_t time = 0;
+        if (likely(self->input_log == NULL) || !self->input_log->replay) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            uint64_t elapsed_ns =
+                (uint64_t)(now.tv_sec - self->host_start.tv_sec) * 1000000000ull +
+                (uint64_t)now.tv_nsec - (uint64_t)self->host_start.tv_nsec;
+            time = muldiv64(elapsed_ns, self->timebase_hz, 1000000000ull);
+        }
+        if (unlikely(self->input_log != NULL)) {
+            InputLog_input(self->input_log, INPUT_TIME, &time, sizeof(time));
+        }
+        return time;
+    }
+    return muldiv64(CSRFile_cycle(self), self->timebase_hz, self->core_hz);
+}
+
+// writable bits of mstatus and of its sstatus view
+#define MSTATUS_WMASK                                                                       \
+    (MSTATUS_SIE | MSTATUS_MIE | MSTATUS_SPIE | MSTATUS_MPIE | MSTATUS_SPP | MSTATUS_MPP | \
+     MSTATUS_VS | MSTATUS_FS | MSTATUS_MPRV | MSTATUS_SUM | MSTATUS_MXR)
+#if XLEN == 64
+#define SSTATUS_MASK                                                                     \
+    (MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP | MSTATUS_VS | MSTATUS_FS | MSTATUS_SUM | \
+     MSTATUS_MXR | MSTATUS_UXL | MSTATUS_SD)
+#else
+#define SSTATUS_MASK                                                                     \
+    (MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP | MSTATUS_VS | MSTATUS_FS | MSTATUS_SUM | \
+     MSTATUS_MXR | MSTATUS_SD)
+#endif
+
+// exceptions that can be delegated to S-mode (all but ECALL from M-mode)
+#define MEDELEG_WMASK 0xb3ffu
+// supervisor software/timer/external interrupts
+#define MIDELEG_WMASK (MIP_SSIP | MIP_STIP | MIP_SEIP)
+#define MIE_WMASK (MIDELEG_WMASK | MIP_MSIP | MIP_MTIP | MIP_MEIP)
+// MSIP and MTIP follow the CLINT, M-mode may raise the S-level interrupts
+#define MIP_WMASK MIDELEG_WMASK
+
+#if XLEN == 64
+// RV64 (MXL = 2); A only has its .W forms, so misa does not show it
+#define MISA_MXL ((reg_t)2 << 62)
+#define MISA_HIDDEN ISA_A
+#else
+// RV32 (MXL = 1)
+#define MISA_MXL ((reg_t)1 << 30)
+#define MISA_HIDDEN 0u
+#endif
+// S and U are not selectable
+#define MISA_PRIV (ISA_LETTER('s') | ISA_LETTER('u'))
+#define MISA_VALUE(isa) (MISA_MXL | MISA_PRIV | ((isa) & ISA_LETTERS & ~MISA_HIDDEN))
+
+static reg_t mstatus_legalize(reg_t old, reg_t value, reg_t mask) {
+    reg_t ret = (old & ~mask) | (value & mask);
+    // MPP is WARL, the reserved mode 2 reads back as U
+    if (((ret & MSTATUS_MPP) >> MSTATUS_MPP_SHIFT) == 2) {
+        ret &= ~MSTATUS_MPP;
+    }
+    // SD summarizes a dirty FS or VS
+    ret &= ~MSTATUS_SD;
+    if ((ret & MSTATUS_FS) == MSTATUS_FS_DIRTY || (ret & MSTATUS_VS) == MSTATUS_VS_DIRTY) {
+        ret |= MSTATUS_SD;
+    }
+    return ret;
+}
+
+// FS and VS are read-only zero without F and V
+static inline reg_t mstatus_ext_mask(const CSRFile *self) {
+    return ~(((self->isa & ISA_F) ? 0 : (reg_t)MSTATUS_FS) |
+             ((self->isa & ISA_V) ? 0 : (reg_t)MSTATUS_VS));
+}
+
+// the writable bits of mip under mask, atomically as other harts set bits
+static void mip_write(reg_t *mip, reg_t value, reg_t mask) {
+    reg_t old = __atomic_load_n(mip, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(mip, &old, (old & ~mask) | (value & mask), true,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    }
+}
+
+bool isa_parse(const char *isa, uint32_t *ret) {
+    if (isa == NULL) {
+        *ret = ISA_ALL;
+        return true;
+    }
+    char base[8];
+    snprintf(base, sizeof(base), "rv%d", XLEN);
+    if (strncasecmp(isa, base, strlen(base)) != 0) {
+        return false;
+    }
+    // single-letter extensions up to the first '_', then Z extensions
+    uint32_t exts = 0;
+    const char *p = isa + strlen(base);
+    for (; *p != '\0' && *p != '_'; p++) {
+        int c = tolower((unsigned char)*p);
+        if (c < 'a' || c > 'z') {
+            return false;
+        }
+        exts |= ISA_LETTER(c);
+    }
+    while (*p == '_') {
+        const char *name = ++p;
+        size_t len       = strcspn(name, "_");
+        p += len;
+        if (len == 3 && strncasecmp(name, "zba", 3) == 0) {
+            exts |= ISA_ZBA;
+        } else if (len == 3 && strncasecmp(name, "zbb", 3) == 0) {
+            exts |= ISA_ZBB;
+        } else if (len == 3 && strncasecmp(name, "zbs", 3) == 0) {
+            exts |= ISA_ZBS;
+        } else if (!((len == 5 && strncasecmp(name, "zicsr", 5) == 0) ||
+                     (len == 6 && strncasecmp(name, "zicntr", 6) == 0) ||
+                     (len == 8 && strncasecmp(name, "zifencei", 8) == 0))) {
+            return false; // (Zicsr, Zicntr and Zifencei are always there)
+        }
+    }
+    // I is the base, D needs F
+    if (!(exts & ISA_I) || (exts & ~ISA_ALL) || ((exts & ISA_D) && !(exts & ISA_F))) {
+        return false;
+    }
+    *ret = exts;
+    return true;
+}
+
+uint64_t CSRFile_get_time(const CSRFile *self) {
+    return CSRFile_time(self);
+}
+
+uint64_t CSRFile_instret_until(const CSRFile *self, uint64_t time) {
+    uint64_t now = CSRFile_time(self);
+    if (now >= time) {
+        return 0;
+    }
+    // instructions take at least one cycle each, so the estimate of the
+    // cycles left never overshoots
+    unsigned __int128 cycles =
+        ((unsigned __int128)(time - now) * self->core_hz + self->timebase_hz - 1) /
+        self->timebase_hz;
+    if (cycles == 0) {
+        return 1;
+    }
+    return (cycles > UINT64_MAX) ? UINT64_MAX : (uint64_t)cycles;
+}
+
+void CSRFile_ctor(CSRFile *self, const iss_config_t *config) {
+    assert((self != NULL) && (config != NULL));
+    Assert(config->timebase_hz != 0, "timebase_hz should not be 0");
+    Assert(config->core_hz != 0, "core_hz should not be 0");
+
+    self->instret      = 0;
+    self->extra_cycles = 0;
+    self->time_source  = config->time_source;
+    self->timebase_hz  = config->timebase_hz;
+    self->core_hz      = config->core_hz;
+    clock_gettime(CLOCK_MONOTONIC, &self->host_start);
+    self->input_log = NULL;
+    self->hartid = 0;
+    Assert(isa_parse(config->isa, &self->isa), "Unsupported ISA string: %s", config->isa);
+
+    // harts reset into M-mode with translation off, and with the FPU and the
+    // vector unit on (FS and VS Initial) so that bare-metal programs need not
+    // enable them
+    memset(&self->priv, 0, sizeof(self->priv));
+    self->priv.mode    = PRIV_M;
+    self->priv.mstatus = (MSTATUS_FS_INIT | MSTATUS_VS_INIT) & mstatus_ext_mask(self);
+#if XLEN == 64
+    self->priv.mstatus |= MSTATUS_UXL | MSTATUS_SXL;
+#endif
+}
+
+bool CSRFile_read(CSRFile *self, unsigned csr_addr, reg_t *value) {
+    assert((self != NULL) && (value != NULL));
+    priv_state_t *p = &self->priv;
+    if (CSR_MIN_PRIV(csr_addr) > p->mode) {
+        return false;
+    }
+    reg_t mip = __atomic_load_n(&p->mip, __ATOMIC_RELAXED);
+
+    switch (csr_addr) {
+    case CSR_CYCLE:    *value = (reg_t)CSRFile_cycle(self);         break;
+    case CSR_TIME:     *value = (reg_t)CSRFile_time(self);          break;
+    case CSR_INSTRET:  *value = (reg_t)self->instret;               break;
+#if XLEN == 32
+    case CSR_CYCLEH:   *value = (reg_t)(CSRFile_cycle(self) >> 32); break;
+    case CSR_TIMEH:    *value = (reg_t)(CSRFile_time(self) >> 32);  break;
+    case CSR_INSTRETH: *value = (reg_t)(self->instret >> 32);       break;
+#endif
+    case CSR_MHARTID:  *value = self->hartid;                       break;
+    case CSR_SSTATUS:  *value = p->mstatus & SSTATUS_MASK;          break;
+    case CSR_SIE:      *value = p->mie & p->mideleg;                break;
+    case CSR_SIP:      *value = mip & p->mideleg;                   break;
+    case CSR_STVEC:    *value = p->stvec;                           break;
+    case CSR_SSCRATCH: *value = p->sscratch;                        break;
+    case CSR_SEPC:     *value = p->sepc;                            break;
+    case CSR_SCAUSE:   *value = p->scause;                          break;
+    case CSR_STVAL:    *value = p->stval;                           break;
+    case CSR_SATP:     *value = p->satp;                            break;
+    case CSR_MSTATUS:  *value = p->mstatus;                         break;
+    case CSR_MISA:     *value = MISA_VALUE(self->isa);              break;
+    case CSR_MEDELEG:  *value = p->medeleg;                         break;
+    case CSR_MIDELEG:  *value = p->mideleg;                         break;
+    case CSR_MIE:      *value = p->mie;                             break;
+    case CSR_MIP:      *value = mip;                                break;
+    case CSR_MTVEC:    *value = p->mtvec;                           break;
+    case CSR_MSCRATCH: *value = p->mscratch;                        break;
+    case CSR_MEPC:     *value = p->mepc;                            break;
+    case CSR_MCAUSE:   *value = p->mcause;                          break;
+    case CSR_MTVAL:    *value = p->mtval;                           break;
+    default:           return false;
+    }
+    return true;
+}
+
+bool CSRFile_write(CSRFile *self, unsigned csr_addr, reg_t value) {
+    assert(self != NULL);
+    priv_state_t *p = &self->priv;
+    if (CSR_READ_ONLY(csr_addr) || CSR_MIN_PRIV(csr_addr) > p->mode) {
+        return false;
+    }
+    reg_t ext = mstatus_ext_mask(self);
+
+    switch (csr_addr) {
+    case CSR_SSTATUS:  p->mstatus  = mstatus_legalize(p->mstatus, value, SSTATUS_MASK & ext);  break;
+    case CSR_SIE:      p->mie      = (p->mie & ~p->mideleg) | (value & p->mideleg);            break;
+    case CSR_SIP:      mip_write(&p->mip, value, MIP_SSIP & p->mideleg);                       break;
+    case CSR_STVEC:    p->stvec    = value & ~(reg_t)0x2;                                      break;
+    case CSR_SSCRATCH: p->sscratch = value;                                                    break;
+    case CSR_SEPC:     p->sepc     = value & ~(reg_t)0x3;                                      break;
+    case CSR_SCAUSE:   p->scause   = value;                                                    break;
+    case CSR_STVAL:    p->stval    = value;                                                    break;
+#if XLEN == 32
+    case CSR_SATP:     p->satp     = value & (SATP_MODE_SV32 | SATP_PPN);                      break;
+#else
+    case CSR_SATP:                                                                             break;
+#endif
+    case CSR_MSTATUS:  p->mstatus  = mstatus_legalize(p->mstatus, value, MSTATUS_WMASK & ext); break;
+    case CSR_MISA:                                                                             break;
+    case CSR_MEDELEG:  p->medeleg  = value & MEDELEG_WMASK;                                    break;
+    case CSR_MIDELEG:  p->mideleg  = value & MIDELEG_WMASK;                                    break;
+    case CSR_MIE:      p->mie      = value & MIE_WMASK;                                        break;
+    case CSR_MIP:      mip_write(&p->mip, value, MIP_WMASK);                                   break;
+    case CSR_MTVEC:    p->mtvec    = value & ~(reg_t)0x2;                                      break;
+    case CSR_MSCRATCH: p->mscratch = value;                                                    break;
+    case CSR_MEPC:     p->mepc     = value & ~(reg_t)0x3;                                      break;
+    case CSR_MCAUSE:   p->mcause   = value;                                                    break;
+    case CSR_MTVAL:    p->mtval    = value;                                                    break;
+    default:           return false;
+    }
+    return true;
+}
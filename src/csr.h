@@ -0,0 +1,201 @@
+#ifndef __CSR_H__
+#define __CSR_H__
+
+#include "arch.h"
+#include "input_log.h"
+#include "iss.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* CSR addresses */
+typedef enum {
+    // F and D (kept by the core, next to the FP registers)
+    CSR_FFLAGS   = 0x001,
+    CSR_FRM      = 0x002,
+    CSR_FCSR     = 0x003,
+    // V (kept by the core, next to the vector registers)
+    CSR_VSTART   = 0x008,
+    CSR_VXSAT    = 0x009,
+    CSR_VXRM     = 0x00a,
+    CSR_VCSR     = 0x00f,
+    CSR_VL       = 0xc20,
+    CSR_VTYPE    = 0xc21,
+    CSR_VLENB    = 0xc22,
+    // Zicntr (unprivileged, read-only)
+    CSR_CYCLE    = 0xc00,
+    CSR_TIME     = 0xc01,
+    CSR_INSTRET  = 0xc02,
+    CSR_CYCLEH   = 0xc80,
+    CSR_TIMEH    = 0xc81,
+    CSR_INSTRETH = 0xc82,
+    // supervisor trap setup/handling and translation
+    CSR_SSTATUS  = 0x100,
+    CSR_SIE      = 0x104,
+    CSR_STVEC    = 0x105,
+    CSR_SSCRATCH = 0x140,
+    CSR_SEPC     = 0x141,
+    CSR_SCAUSE   = 0x142,
+    CSR_STVAL    = 0x143,
+    CSR_SIP      = 0x144,
+    CSR_SATP     = 0x180,
+    // machine trap setup/handling
+    CSR_MSTATUS  = 0x300,
+    CSR_MISA     = 0x301,
+    CSR_MEDELEG  = 0x302,
+    CSR_MIDELEG  = 0x303,
+    CSR_MIE      = 0x304,
+    CSR_MTVEC    = 0x305,
+    CSR_MSCRATCH = 0x340,
+    CSR_MEPC     = 0x341,
+    CSR_MCAUSE   = 0x342,
+    CSR_MTVAL    = 0x343,
+    CSR_MIP      = 0x344,
+    // machine information (read-only)
+    CSR_MHARTID = 0xf14,
+} CSR_ADDR;
+
+// csr[11:10] == 0b11 marks a read-only CSR
+#define CSR_READ_ONLY(addr) ((((addr) >> 10) & 0x3) == 0x3)
+// csr[9:8] is the lowest privilege mode that may access the CSR
+#define CSR_MIN_PRIV(addr) (((addr) >> 8) & 0x3)
+
+// privilege modes
+typedef enum {
+    PRIV_U = 0,
+    PRIV_S = 1,
+    PRIV_M = 3,
+} PRIV_MODE;
+
+// mstatus fields (RV32)
+#define MSTATUS_SIE      (1u << 1)
+#define MSTATUS_MIE      (1u << 3)
+#define MSTATUS_SPIE     (1u << 5)
+#define MSTATUS_MPIE     (1u << 7)
+#define MSTATUS_SPP      (1u << 8)
+#define MSTATUS_VS       (3u << 9) // vector state: Off, Initial, Clean, Dirty
+#define MSTATUS_VS_OFF   (0u << 9)
+#define MSTATUS_VS_INIT  (1u << 9)
+#define MSTATUS_VS_DIRTY (3u << 9)
+#define MSTATUS_MPP      (3u << 11)
+#define MSTATUS_MPP_SHIFT 11
+#define MSTATUS_FS       (3u << 13) // FP state: Off, Initial, Clean, Dirty
+#define MSTATUS_FS_OFF   (0u << 13)
+#define MSTATUS_FS_INIT  (1u << 13)
+#define MSTATUS_FS_DIRTY (3u << 13)
+#define MSTATUS_MPRV     (1u << 17)
+#define MSTATUS_SUM      (1u << 18)
+#define MSTATUS_MXR      (1u << 19)
+#define MSTATUS_SD       ((reg_t)1 << (XLEN - 1)) // read-only, FS or VS == Dirty
+#if XLEN == 64
+// UXL and SXL are read-only, U- and S-mode run at XLEN 64 as well
+#define MSTATUS_UXL      ((reg_t)2 << 32)
+#define MSTATUS_SXL      ((reg_t)2 << 34)
+#endif
+
+// mip/mie bits (interrupt codes), mcause of an interrupt has CAUSE_INTERRUPT
+#define MIP_SSIP (1u << 1)
+#define MIP_MSIP (1u << 3)
+#define MIP_STIP (1u << 5)
+#define MIP_MTIP (1u << 7)
+#define MIP_SEIP (1u << 9)
+#define MIP_MEIP (1u << 11)
+#define CAUSE_INTERRUPT ((reg_t)1 << (XLEN - 1))
+
+// satp fields (Sv32; RV64 only implements Bare)
+#define SATP_MODE_SV32 (1u << 31)
+#define SATP_PPN       0x003fffffu
+
+// synchronous exception causes
+typedef enum {
+    CAUSE_FETCH_MISALIGNED = 0,
+    CAUSE_FETCH_ACCESS     = 1,
+    CAUSE_ILLEGAL_INST     = 2,
+    CAUSE_BREAKPOINT       = 3,
+    CAUSE_LOAD_MISALIGNED  = 4,
+    CAUSE_LOAD_ACCESS      = 5,
+    CAUSE_STORE_MISALIGNED = 6,
+    CAUSE_STORE_ACCESS     = 7,
+    CAUSE_ECALL_U          = 8, // + mode of the caller
+    CAUSE_ECALL_M          = 11,
+    CAUSE_FETCH_PAGE_FAULT = 12,
+    CAUSE_LOAD_PAGE_FAULT  = 13,
+    CAUSE_STORE_PAGE_FAULT = 15,
+} TRAP_CAUSE;
+
+// privileged state of a hart: its mode and the trap/translation CSRs
+typedef struct {
+    reg_t mode;    // current privilege mode (PRIV_MODE)
+    reg_t mstatus; // sstatus is a restricted view of it
+    reg_t medeleg;
+    reg_t mideleg;
+    reg_t mie;
+    reg_t mip; // atomic: the CLINT of other harts sets MSIP/MTIP
+    reg_t mtvec;
+    reg_t mscratch;
+    reg_t mepc;
+    reg_t mcause;
+    reg_t mtval;
+    reg_t stvec;
+    reg_t sscratch;
+    reg_t sepc;
+    reg_t scause;
+    reg_t stval;
+    reg_t satp;
+} priv_state_t;
+
+// extensions of a hart (iss_config_t::isa): the misa letters in bits 0..25,
+// the Z extensions above them
+#define ISA_LETTER(c) (1u << ((c) - 'a'))
+#define ISA_I ISA_LETTER('i')
+#define ISA_A ISA_LETTER('a')
+#define ISA_F ISA_LETTER('f')
+#define ISA_D ISA_LETTER('d')
+#define ISA_V ISA_LETTER('v')
+#define ISA_ZBA (1u << 26)
+#define ISA_ZBB (1u << 27)
+#define ISA_ZBS (1u << 28)
+#define ISA_LETTERS 0x3ffffffu
+#define ISA_ALL (ISA_I | ISA_A | ISA_F | ISA_D | ISA_V | ISA_ZBA | ISA_ZBB | ISA_ZBS)
+
+// the extensions of an ISA string such as "rv32iafdv_zba_zbb_zbs" (NULL:
+// ISA_ALL); return false if it is malformed, of another XLEN, or names an
+// extension that is not implemented
+extern bool isa_parse(const char *isa, uint32_t *ret);
+
+typedef struct {
+    // retired instructions, counted by the core (an instruction that traps
+    // does not retire, see Core::steps for the steps of ISS_step())
+    uint64_t instret;
+    // cycles beyond one per instruction, added by the timing model
+    uint64_t extra_cycles;
+
+    // `time` CSR model
+    iss_time_source_t time_source;
+    uint64_t timebase_hz;
+    uint64_t core_hz;
+    struct timespec host_start;
+    InputLog *input_log; // records/replays the host clock (NULL: off)
+
+    // index of the hart owning the CSRs, 0 unless set by the ISS
+    reg_t hartid;
+
+    // implemented extensions (ISA_*), misa shows the letters
+    uint32_t isa;
+
+    // privileged architecture (M/S/U modes, traps, Sv32)
+    priv_state_t priv;
+} CSRFile;
+
+extern void CSRFile_ctor(CSRFile *self, const iss_config_t *config);
+// return false if the access is illegal (non-existent CSR, read-only, or
+// above the current privilege mode)
+extern bool CSRFile_read(CSRFile *self, unsigned csr_addr, reg_t *value);
+extern bool CSRFile_write(CSRFile *self, unsigned csr_addr, reg_t value);
+// the `time` CSR, and the instructions to retire until it reaches time (an
+// estimate if it follows the host clock or the timing model adds cycles)
+extern uint64_t CSRFile_get_time(const CSRFile *self);
+extern uint64_t CSRFile_instret_until(const CSRFile *self, uint64_t time);
+
+#endif
@@ -0,0 +1,146 @@
+#include "debug.h"
+
+#include "arch.h"
+#include "common.h"
+#include "mmu.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+void Debug_ctor(Debug *self, Halt *halt) {
+    assert((self != NULL) && (halt != NULL));
+    memset(self, 0, sizeof(Debug));
+    self->halt = halt;
+    for (unsigned h = 0; h < ISS_MAX_HARTS; h++) {
+        self->skip_instret[h] = UINT64_MAX;
+    }
+}
+
+/* ---------------------------- points ---------------------------- */
+int Debug_add_breakpoint(Debug *self, addr_t addr) {
+    assert(self != NULL);
+    for (unsigned i = 0; i < self->num_breakpoints; i++) {
+        if (self->breakpoints[i] == addr) {
+            return 0;
+        }
+    }
+    if (self->num_breakpoints == DEBUG_MAX_BREAKPOINTS) {
+        return -1;
+    }
+    self->breakpoints[self->num_breakpoints++] = addr;
+    return 0;
+}
+
+int Debug_remove_breakpoint(Debug *self, addr_t addr) {
+    assert(self != NULL);
+    for (unsigned i = 0; i < self->num_breakpoints; i++) {
+        if (self->breakpoints[i] == addr) {
+            self->breakpoints[i] = self->breakpoints[--self->num_breakpoints];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int Debug_add_watchpoint(Debug *self, addr_t addr, addr_t len, iss_watch_t type) {
+    assert(self != NULL);
+    if (self->num_watchpoints == DEBUG_MAX_WATCHPOINTS || len == 0) {
+        return -1;
+    }
+    self->watchpoints[self->num_watchpoints++] =
+        (debug_watchpoint_t){ .addr = addr, .len = len, .type = type };
+    return 0;
+}
+
+int Debug_remove_watchpoint(Debug *self, addr_t addr, addr_t len, iss_watch_t type) {
+    assert(self != NULL);
+    for (unsigned i = 0; i < self->num_watchpoints; i++) {
+        debug_watchpoint_t *w = &self->watchpoints[i];
+        if (w->addr == addr && w->len == len && w->type == type) {
+            *w = self->watchpoints[--self->num_watchpoints];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// [addr, addr + len) and [base, base + size) overlap (no wrap-around)
+static inline bool overlaps(addr_t addr, addr_t len, addr_t base, addr_t size) {
+    return addr - base < size || base - addr < len;
+}
+
+// the watchpoint fires on accesses of type
+static inline bool watches(const debug_watchpoint_t *w, mmu_access_t type) {
+    return (w->type & ((type == MMU_STORE) ? ISS_WATCH_WRITE : ISS_WATCH_READ)) != 0;
+}
+
+bool Debug_watches_page(const Debug *self, addr_t page, mmu_access_t type) {
+    if (type == MMU_FETCH) {
+        for (unsigned i = 0; i < self->num_breakpoints; i++) {
+            if ((self->breakpoints[i] & ~MMU_PAGE_MASK) == page) {
+                return true;
+            }
+        }
+        return false;
+    }
+    for (unsigned i = 0; i < self->num_watchpoints; i++) {
+        const debug_watchpoint_t *w = &self->watchpoints[i];
+        if (watches(w, type) && overlaps(w->addr, w->len, page, MMU_PAGE_SIZE)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ----------------------------- hits ----------------------------- */
+static void Debug_stop(Debug *self, iss_stop_t stop) {
+    bool expected = false;
+    if (__atomic_compare_exchange_n(&self->stop_pending, &expected, true, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        self->stop = stop;
+        __atomic_store_n(&self->halt->halt_flag, true, __ATOMIC_RELEASE);
+    }
+}
+
+bool Debug_fetch(Debug *self, unsigned hart, addr_t pc, uint64_t instret) {
+    if (pc == self->skip_pc[hart] && instret == self->skip_instret[hart]) {
+        self->skip_instret[hart] = UINT64_MAX;
+        return false;
+    }
+    if (!Debug_is_breakpoint(self, pc)) {
+        return false;
+    }
+    Debug_stop(self, (iss_stop_t){ .reason = ISS_STOP_BREAKPOINT, .hart = hart, .pc = pc,
+                                   .addr = pc });
+    Debug_skip(self, hart, pc, instret);
+    return true;
+}
+
+bool Debug_is_breakpoint(const Debug *self, addr_t pc) {
+    for (unsigned i = 0; i < self->num_breakpoints; i++) {
+        if (self->breakpoints[i] == pc) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Debug_skip(Debug *self, unsigned hart, addr_t pc, uint64_t instret) {
+    self->skip_pc[hart]      = pc;
+    self->skip_instret[hart] = instret;
+}
+
+void Debug_access(Debug *self, unsigned hart, addr_t pc, addr_t addr, unsigned len,
+                  mmu_access_t type) {
+    for (unsigned i = 0; i < self->num_watchpoints; i++) {
+        const debug_watchpoint_t *w = &self->watchpoints[i];
+        if (watches(w, type) && overlaps(w->addr, w->len, addr, len)) {
+            Debug_stop(self, (iss_stop_t){ .reason = ISS_STOP_WATCHPOINT, .hart = hart, .pc = pc,
+                                           .addr = (addr > w->addr) ? addr : w->addr,
+                                           .watch = w->type });
+            return;
+        }
+    }
+}
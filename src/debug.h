@@ -0,0 +1,66 @@
+#ifndef __DEBUG_H__
+#define __DEBUG_H__
+
+#include "arch.h"
+#include "halt.h"
+#include "iss.h"
+#include "mmu.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DEBUG_MAX_BREAKPOINTS 64
+#define DEBUG_MAX_WATCHPOINTS 16
+
+typedef struct {
+    addr_t addr;
+    addr_t len;
+    iss_watch_t type;
+} debug_watchpoint_t;
+
+/*
+ * Breakpoints and watchpoints of a debugger, shared by the harts. They are
+ * checked at page granularity: the MMU does not keep a page holding one in
+ * its TLB (for the access types concerned), so only the accesses to such a
+ * page reach the exact checks below, and other code runs at full speed.
+ * A hit raises the halt flag (like the BBV stop) and is reported by
+ * ISS_step() through ISS_get_stop().
+ */
+typedef struct debug {
+    Halt *halt; // raised to stop the step loop
+
+    addr_t breakpoints[DEBUG_MAX_BREAKPOINTS]; // virtual PCs
+    unsigned num_breakpoints;
+    debug_watchpoint_t watchpoints[DEBUG_MAX_WATCHPOINTS];
+    unsigned num_watchpoints;
+
+    // the stop raised during the current ISS_step(), the first hart wins
+    bool stop_pending;
+    iss_stop_t stop;
+
+    // a hart resuming at the breakpoint it stopped at executes it: the PC
+    // and instret of its last breakpoint stop (instret UINT64_MAX: none)
+    addr_t skip_pc[ISS_MAX_HARTS];
+    uint64_t skip_instret[ISS_MAX_HARTS];
+} Debug;
+
+extern void Debug_ctor(Debug *self, Halt *halt);
+// return -1 if the table is full (add) or there is no such point (remove);
+// the TLBs of the harts must be flushed afterwards
+extern int Debug_add_breakpoint(Debug *self, addr_t addr);
+extern int Debug_remove_breakpoint(Debug *self, addr_t addr);
+extern int Debug_add_watchpoint(Debug *self, addr_t addr, addr_t len, iss_watch_t type);
+extern int Debug_remove_watchpoint(Debug *self, addr_t addr, addr_t len, iss_watch_t type);
+// true if the page holds a point for accesses of type (MMU_fill)
+extern bool Debug_watches_page(const Debug *self, addr_t page, mmu_access_t type);
+// a fetch at pc on a watched page: true if the hart stops before it
+extern bool Debug_fetch(Debug *self, unsigned hart, addr_t pc, uint64_t instret);
+// a load or store of [addr, addr + len) on a watched page; a hit stops the
+// hart after the instruction
+extern void Debug_access(Debug *self, unsigned hart, addr_t pc, addr_t addr, unsigned len,
+                         mmu_access_t type);
+extern bool Debug_is_breakpoint(const Debug *self, addr_t pc);
+// the hart resumes at pc with instret (after a stop there): execute it
+extern void Debug_skip(Debug *self, unsigned hart, addr_t pc, uint64_t instret);
+
+#endif
@@ -0,0 +1,182 @@
+#include "dma.h"
+
+#include "tick.h"
+#include "abstract_mem.h"
+#include "mem_map.h"
+#include "common.h"
+#include "undo.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+// bounce buffer size for devices without host-addressable storage
+#define DMA_CHUNK 256
+
+// the transfer is about to overwrite the len bytes of host memory at dst
+static inline void DMA_undo_save(DMA *self, byte_t *dst, size_t len) {
+    if (unlikely(self->undo != NULL)) {
+        UndoLog_save(self->undo, dst, len);
+    }
+}
+
+static bool DMA_copy(DMA *self) {
+    MemoryMap *mm = self->mem_map;
+    if (!MemoryMap_is_mapped(mm, self->src, self->len) ||
+        !MemoryMap_is_mapped(mm, self->dst, self->len)) {
+        return false;
+    }
+
+    // plain memory on both sides: one host memmove
+    byte_t *src = MemoryMap_host_ptr(mm, self->src, self->len, false);
+    byte_t *dst = MemoryMap_host_ptr(mm, self->dst, self->len, true);
+    if (src != NULL && dst != NULL) {
+        DMA_undo_save(self, dst, self->len);
+        memmove(dst, src, self->len);
+        return true;
+    }
+
+    // otherwise go through the devices chunk by chunk, backward if the
+    // destination overlaps the tail of the source
+    byte_t chunk[DMA_CHUNK];
+    bool backward = (self->dst > self->src) && (self->dst - self->src < self->len);
+    for (reg_t done = 0; done < self->len;) {
+        unsigned n    = (self->len - done < DMA_CHUNK) ? self->len - done : DMA_CHUNK;
+        reg_t offset  = backward ? self->len - done - n : done;
+        if (!MemoryMap_try_load(mm, self->src + offset, n, chunk) ||
+            !MemoryMap_try_store(mm, self->dst + offset, n, chunk)) {
+            return false; // a device does not take accesses of this size
+        }
+        done += n;
+    }
+    return true;
+}
+
+static bool DMA_fill(DMA *self) {
+    MemoryMap *mm = self->mem_map;
+    if (!MemoryMap_is_mapped(mm, self->dst, self->len)) {
+        return false;
+    }
+
+    byte_t *dst = MemoryMap_host_ptr(mm, self->dst, self->len, true);
+    if (dst != NULL) {
+        DMA_undo_save(self, dst, self->len);
+        memset(dst, (int)(self->fill & 0xff), self->len);
+        return true;
+    }
+
+    byte_t chunk[DMA_CHUNK];
+    memset(chunk, (int)(self->fill & 0xff), sizeof(chunk));
+    for (reg_t done = 0; done < self->len;) {
+        unsigned n = (self->len - done < DMA_CHUNK) ? self->len - done : DMA_CHUNK;
+        if (!MemoryMap_try_store(mm, self->dst + done, n, chunk)) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+DECLARE_ABSTRACT_MEM_LOAD(DMA) {
+    Assert(self != NULL, "");
+    Assert(base_addr + length <= DMA_SIZE, "");
+    Assert(length == 4 && (base_addr & 0x3) == 0, "DMA registers only support word access");
+
+    DMA *self_ = container_of(self, DMA, abstract_mem_super);
+    reg_t value = 0;
+    switch (base_addr) {
+    case DMA_REG_SRC:    value = self_->src;    break;
+    case DMA_REG_DST:    value = self_->dst;    break;
+    case DMA_REG_LEN:    value = self_->len;    break;
+    case DMA_REG_CTRL:   value = self_->ctrl;   break;
+    case DMA_REG_FILL:   value = self_->fill;   break;
+    case DMA_REG_STATUS: value = self_->status; break;
+    default:             value = 0;             break;
+    }
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (byte_t)(value >> (8 * i));
+    }
+}
+
+DECLARE_ABSTRACT_MEM_STORE(DMA) {
+    Assert(self != NULL, "");
+    Assert(base_addr + length <= DMA_SIZE, "");
+    Assert(length == 4 && (base_addr & 0x3) == 0, "DMA registers only support word access");
+
+    DMA *self_  = container_of(self, DMA, abstract_mem_super);
+    reg_t value = (reg_t)ref_data[0] | ((reg_t)ref_data[1] << 8) | ((reg_t)ref_data[2] << 16) |
+                  ((reg_t)ref_data[3] << 24);
+
+    // the transfer parameters are locked while busy
+    bool busy = self_->status & DMA_STATUS_BUSY;
+    switch (base_addr) {
+    case DMA_REG_SRC:  self_->src  = busy ? self_->src  : value; break;
+    case DMA_REG_DST:  self_->dst  = busy ? self_->dst  : value; break;
+    case DMA_REG_LEN:  self_->len  = busy ? self_->len  : value; break;
+    case DMA_REG_FILL: self_->fill = busy ? self_->fill : value; break;
+    case DMA_REG_STATUS:
+        self_->status &= ~(value & (DMA_STATUS_DONE | DMA_STATUS_ERROR));
+        break;
+    case DMA_REG_CTRL:
+        if (busy) {
+            break;
+        }
+        self_->ctrl = value;
+        if (value & DMA_CTRL_START) {
+            self_->status          = DMA_STATUS_BUSY;
+            self_->remaining_ticks = DMA_SETUP_TICKS + self_->len / DMA_BYTES_PER_TICK;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+DECLARE_ABSTRACT_MEM_ACCEPTS(DMA) {
+    (void)self, (void)write;
+    return length == 4 && (base_addr & 0x3) == 0;
+}
+
+DECLARE_TICK_TICK(DMA) {
+    DMA *self_ = container_of(self, DMA, tick_super);
+    if (likely(!(self_->status & DMA_STATUS_BUSY))) {
+        return;
+    }
+    if (--self_->remaining_ticks > 0) {
+        return;
+    }
+
+    // the data moves at once when the modeled delay has elapsed
+    bool ok       = (self_->ctrl & DMA_CTRL_FILL) ? DMA_fill(self_) : DMA_copy(self_);
+    self_->ctrl   &= ~DMA_CTRL_START;
+    self_->status = ok ? DMA_STATUS_DONE : DMA_STATUS_ERROR;
+}
+
+void DMA_ctor(DMA *self, MemoryMap *mem_map) {
+    assert((self != NULL) && (mem_map != NULL));
+
+    // Tick vtable initialization
+    Tick_ctor(&self->tick_super);
+    static struct TickVtbl const tickable_vtbl = { .tick = &SIGNATURE_TICK_TICK(DMA) };
+    self->tick_super.vtbl = &tickable_vtbl;
+
+    // AbstractMem vtable initialization
+    AbstractMem_ctor(&self->abstract_mem_super);
+    static struct AbstractMemVtbl const abstract_mem_vtbl = {
+        .load    = &SIGNATURE_ABSTRACT_MEM_LOAD(DMA),
+        .store   = &SIGNATURE_ABSTRACT_MEM_STORE(DMA),
+        .accepts = &SIGNATURE_ABSTRACT_MEM_ACCEPTS(DMA)
+    };
+    self->abstract_mem_super.vtbl = &abstract_mem_vtbl;
+
+    // initialize registers
+    self->mem_map         = mem_map;
+    self->undo            = NULL;
+    self->src             = 0;
+    self->dst             = 0;
+    self->len             = 0;
+    self->ctrl            = 0;
+    self->fill            = 0;
+    self->status          = 0;
+    self->remaining_ticks = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef __DMA_H__
+#define __DMA_H__
+
+#include "arch.h"
+#include "abstract_mem.h"
+#include "mem_map.h"
+#include "tick.h"
+#include "undo.h"
+
+#include <stdbool.h>
+
+#define DMA_MMAP_BASE 0xffffff00
+#define DMA_SIZE 0x20
+
+// register offsets (32-bit registers, word access only)
+#define DMA_REG_SRC 0x00    // source address
+#define DMA_REG_DST 0x04    // destination address
+#define DMA_REG_LEN 0x08    // transfer length in bytes
+#define DMA_REG_CTRL 0x0c   // write DMA_CTRL_* to launch a transfer
+#define DMA_REG_FILL 0x10   // fill value (lowest byte) for DMA_CTRL_FILL
+#define DMA_REG_STATUS 0x14 // DMA_STATUS_*, write 1 to clear DONE/ERROR
+
+#define DMA_CTRL_START 0x1 // launch a transfer
+#define DMA_CTRL_FILL 0x2  // memset DST with FILL instead of copying SRC
+
+#define DMA_STATUS_BUSY 0x1
+#define DMA_STATUS_DONE 0x2
+#define DMA_STATUS_ERROR 0x4
+
+// modeled transfer time: DMA_SETUP_TICKS + LEN / DMA_BYTES_PER_TICK ticks
+#define DMA_SETUP_TICKS 8
+#define DMA_BYTES_PER_TICK 8
+
+typedef struct {
+    // derived base class
+    AbstractMem abstract_mem_super;
+    Tick tick_super;
+
+    // memory map the transfers act on
+    MemoryMap *mem_map;
+    // reverse execution: host memory a transfer writes is saved in it
+    // first (NULL: off)
+    UndoLog *undo;
+
+    // registers
+    reg_t src;
+    reg_t dst;
+    reg_t len;
+    reg_t ctrl;
+    reg_t fill;
+    reg_t status;
+
+    // remaining ticks of the transfer in flight
+    unsigned long remaining_ticks;
+} DMA;
+
+void DMA_ctor(DMA *self, MemoryMap *mem_map);
+
+#endif
@@ -0,0 +1,461 @@
+#include "fpu.h"
+
+#include <fenv.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2_MATH__)
+// float and double arithmetic runs on SSE: set the rounding mode and read the
+// flags in MXCSR directly instead of through fenv (which also touches x87)
+#include <xmmintrin.h>
+#define FPU_HOST_SSE 1
+#define MXCSR_FLAGS 0x003fu
+#define MXCSR_DAZ 0x0040u
+#define MXCSR_RC 0x6000u
+#define MXCSR_FTZ 0x8000u
+// keep the compiler from moving the arithmetic across the MXCSR accesses
+#define FPU_BARRIER(v) __asm__ volatile("" : "+x"(v))
+#else
+#define FPU_HOST_SSE 0
+#endif
+
+// RMM has no host rounding mode: the operation is done in long double toward
+// zero and rounded again, which needs room for the midpoints of double and
+// for 64-bit integers; without it RMM falls back to RNE
+#if LDBL_MANT_DIG >= 64
+#define FPU_HOST_RMM 1
+#else
+#define FPU_HOST_RMM 0
+#endif
+
+/* ----------------------------- bit patterns ----------------------------- */
+static inline float f32(uint32_t bits) {
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static inline double f64(uint64_t bits) {
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static inline uint32_t bits32(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static inline uint64_t bits64(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static inline bool is_nan_s(uint32_t a) {
+    return (a & 0x7fffffffu) > 0x7f800000u;
+}
+
+static inline bool is_nan_d(uint64_t a) {
+    return (a & 0x7fffffffffffffffull) > 0x7ff0000000000000ull;
+}
+
+static inline bool is_snan_s(uint32_t a) {
+    return is_nan_s(a) && !(a & 0x00400000u);
+}
+
+static inline bool is_snan_d(uint64_t a) {
+    return is_nan_d(a) && !(a & 0x0008000000000000ull);
+}
+
+/* ---------------------------- host rounding ---------------------------- */
+static int fpu_fe_round(unsigned rm) {
+    switch (rm) {
+    case FRM_RTZ: return FE_TOWARDZERO;
+    case FRM_RDN: return FE_DOWNWARD;
+    case FRM_RUP: return FE_UPWARD;
+    default:      return FE_TONEAREST;
+    }
+}
+
+static int fpu_fe_enter(int round) {
+    int old = fegetround();
+    fesetround(round);
+    feclearexcept(FE_ALL_EXCEPT);
+    return old;
+}
+
+static unsigned fpu_fe_leave(int old) {
+    int fe = fetestexcept(FE_ALL_EXCEPT);
+    fesetround(old);
+    return ((fe & FE_INVALID) ? FFLAGS_NV : 0) | ((fe & FE_DIVBYZERO) ? FFLAGS_DZ : 0) |
+           ((fe & FE_OVERFLOW) ? FFLAGS_OF : 0) | ((fe & FE_UNDERFLOW) ? FFLAGS_UF : 0) |
+           ((fe & FE_INEXACT) ? FFLAGS_NX : 0);
+}
+
+#if FPU_HOST_SSE
+static uint32_t fpu_sse_enter(unsigned rm) {
+    static const uint32_t rc[4] = { 0x0000, 0x6000, 0x2000, 0x4000 }; // RNE RTZ RDN RUP
+    uint32_t old = _mm_getcsr();
+    _mm_setcsr((old & ~(MXCSR_FLAGS | MXCSR_DAZ | MXCSR_RC | MXCSR_FTZ)) | rc[rm]);
+    return old;
+}
+
+static unsigned fpu_sse_leave(uint32_t old) {
+    uint32_t flags = _mm_getcsr() & MXCSR_FLAGS;
+    _mm_setcsr(old);
+    // IE ZE OE UE PE (the denormal-operand flag has no RISC-V counterpart)
+    return ((flags & 0x01) ? FFLAGS_NV : 0) | ((flags & 0x04) ? FFLAGS_DZ : 0) |
+           ((flags & 0x08) ? FFLAGS_OF : 0) | ((flags & 0x10) ? FFLAGS_UF : 0) |
+           ((flags & 0x20) ? FFLAGS_NX : 0);
+}
+#endif
+
+#if FPU_HOST_RMM
+// round w, the result of a wider computation rounded toward zero (inexact if
+// the exact value lies beyond it), to nearest with ties away from zero in
+// float (dbl false) or double; tininess is detected after rounding
+static long double fpu_round_rmm(long double w, bool inexact, bool dbl, unsigned *fflags) {
+    if (isnan(w) || isinf(w)) {
+        return w;
+    }
+    int mant        = dbl ? DBL_MANT_DIG : FLT_MANT_DIG;
+    int min_exp     = dbl ? DBL_MIN_EXP : FLT_MIN_EXP;
+    long double max = dbl ? DBL_MAX : FLT_MAX;
+    long double min = dbl ? DBL_MIN : FLT_MIN;
+
+    long double mag = fabsl(w);
+    int exp;
+    frexpl(mag, &exp);
+    if (exp < min_exp) {
+        exp = min_exp; // subnormals are spaced like the lowest binade
+    }
+    long double ulp = ldexpl(1.0L, exp - mant);
+    long double t   = truncl(mag / ulp) * ulp;
+    long double rem = mag - t;
+    long double r   = (rem != 0 && rem >= ulp / 2) ? t + ulp : t;
+
+    if (r > max) {
+        *fflags |= FFLAGS_OF | FFLAGS_NX;
+        return copysignl(INFINITY, w);
+    }
+    if (inexact || rem != 0) {
+        *fflags |= FFLAGS_NX;
+        // below the value that rounds up to the smallest normal number
+        if (mag < min - ldexpl(1.0L, min_exp - 2 - mant)) {
+            *fflags |= FFLAGS_UF;
+        }
+    }
+    return copysignl(r, w);
+}
+#endif
+
+/* ------------------------------ arithmetic ------------------------------ */
+#define FPU_EVAL(op, a, b, c, sqrt_fn, fma_fn)  \
+    switch (op) {                               \
+    case FPU_ADD:   return a + b;               \
+    case FPU_SUB:   return a - b;               \
+    case FPU_MUL:   return a * b;               \
+    case FPU_DIV:   return a / b;               \
+    case FPU_SQRT:  return sqrt_fn(a);          \
+    case FPU_MADD:  return fma_fn(a, b, c);     \
+    case FPU_MSUB:  return fma_fn(a, b, -c);    \
+    case FPU_NMSUB: return fma_fn(-a, b, c);    \
+    default:        return fma_fn(-a, b, -c);   \
+    }
+
+static inline float fpu_eval_s(fpu_op_t op, float a, float b, float c) {
+    FPU_EVAL(op, a, b, c, sqrtf, fmaf)
+}
+
+static inline double fpu_eval_d(fpu_op_t op, double a, double b, double c) {
+    FPU_EVAL(op, a, b, c, sqrt, fma)
+}
+
+#if FPU_HOST_RMM
+static inline long double fpu_eval_w(fpu_op_t op, long double a, long double b, long double c) {
+    FPU_EVAL(op, a, b, c, sqrtl, fmal)
+}
+
+// op in long double toward zero, rounded to float or double with RMM
+static long double fpu_rmm(fpu_op_t op, long double a, long double b, long double c, bool dbl,
+                           unsigned *fflags) {
+    volatile long double va = a, vb = b, vc = c, vr;
+    int old         = fpu_fe_enter(FE_TOWARDZERO);
+    vr              = fpu_eval_w(op, va, vb, vc);
+    unsigned flags  = fpu_fe_leave(old);
+    // NV and DZ carry over, the other flags are those of the second rounding
+    *fflags |= flags & (FFLAGS_NV | FFLAGS_DZ);
+    return fpu_round_rmm(vr, (flags & FFLAGS_NX) != 0, dbl, fflags);
+}
+#endif
+
+// fma(0, inf, qNaN) is invalid in RISC-V, IEEE 754 leaves it to the host
+static bool fpu_fma_invalid(fpu_op_t op, double a, double b) {
+    return op >= FPU_MADD && ((isinf(a) && b == 0) || (a == 0 && isinf(b)));
+}
+
+uint32_t fpu_arith_s(fpu_op_t op, uint32_t a, uint32_t b, uint32_t c, unsigned rm,
+                     unsigned *fflags) {
+    float fa = f32(a), fb = f32(b), fc = f32(c), r;
+    if (fpu_fma_invalid(op, fa, fb)) {
+        *fflags |= FFLAGS_NV;
+    }
+#if FPU_HOST_RMM
+    if (rm == FRM_RMM) {
+        // the operands are widened before the fenv window, which quiets sNaNs
+        if (is_snan_s(a) || (op != FPU_SQRT && is_snan_s(b)) || (op >= FPU_MADD && is_snan_s(c))) {
+            *fflags |= FFLAGS_NV;
+        }
+        r = (float)fpu_rmm(op, fa, fb, fc, false, fflags);
+        return isnan(r) ? FPU_NAN_S : bits32(r);
+    }
+#endif
+#if FPU_HOST_SSE
+    if (op < FPU_MADD) {
+        uint32_t old = fpu_sse_enter(rm & 0x3);
+        FPU_BARRIER(fa);
+        FPU_BARRIER(fb);
+        r = fpu_eval_s(op, fa, fb, fc);
+        FPU_BARRIER(r);
+        *fflags |= fpu_sse_leave(old);
+        return isnan(r) ? FPU_NAN_S : bits32(r);
+    }
+#endif
+    volatile float va = fa, vb = fb, vc = fc, vr;
+    int old            = fpu_fe_enter(fpu_fe_round(rm));
+    vr                 = fpu_eval_s(op, va, vb, vc);
+    *fflags |= fpu_fe_leave(old);
+    r = vr;
+    return isnan(r) ? FPU_NAN_S : bits32(r);
+}
+
+uint64_t fpu_arith_d(fpu_op_t op, uint64_t a, uint64_t b, uint64_t c, unsigned rm,
+                     unsigned *fflags) {
+    double fa = f64(a), fb = f64(b), fc = f64(c), r;
+    if (fpu_fma_invalid(op, fa, fb)) {
+        *fflags |= FFLAGS_NV;
+    }
+#if FPU_HOST_RMM
+    if (rm == FRM_RMM) {
+        if (is_snan_d(a) || (op != FPU_SQRT && is_snan_d(b)) || (op >= FPU_MADD && is_snan_d(c))) {
+            *fflags |= FFLAGS_NV;
+        }
+        r = (double)fpu_rmm(op, fa, fb, fc, true, fflags);
+        return isnan(r) ? FPU_NAN_D : bits64(r);
+    }
+#endif
+#if FPU_HOST_SSE
+    if (op < FPU_MADD) {
+        uint32_t old = fpu_sse_enter(rm & 0x3);
+        FPU_BARRIER(fa);
+        FPU_BARRIER(fb);
+        r = fpu_eval_d(op, fa, fb, fc);
+        FPU_BARRIER(r);
+        *fflags |= fpu_sse_leave(old);
+        return isnan(r) ? FPU_NAN_D : bits64(r);
+    }
+#endif
+    volatile double va = fa, vb = fb, vc = fc, vr;
+    int old             = fpu_fe_enter(fpu_fe_round(rm));
+    vr                  = fpu_eval_d(op, va, vb, vc);
+    *fflags |= fpu_fe_leave(old);
+    r = vr;
+    return isnan(r) ? FPU_NAN_D : bits64(r);
+}
+
+/* ------------------------------ conversions ----------------------------- */
+uint32_t fpu_cvt_s_d(uint64_t a, unsigned rm, unsigned *fflags) {
+    if (is_nan_d(a)) {
+        *fflags |= is_snan_d(a) ? FFLAGS_NV : 0;
+        return FPU_NAN_S;
+    }
+    double fa = f64(a);
+    float r;
+#if FPU_HOST_RMM
+    if (rm == FRM_RMM) {
+        return bits32((float)fpu_round_rmm(fa, false, false, fflags));
+    }
+#endif
+#if FPU_HOST_SSE
+    uint32_t old = fpu_sse_enter(rm & 0x3);
+    FPU_BARRIER(fa);
+    r = (float)fa;
+    FPU_BARRIER(r);
+    *fflags |= fpu_sse_leave(old);
+#else
+    volatile double va = fa;
+    volatile float vr;
+    int old = fpu_fe_enter(fpu_fe_round(rm));
+    vr      = (float)va;
+    *fflags |= fpu_fe_leave(old);
+    r = vr;
+#endif
+    return bits32(r);
+}
+
+uint64_t fpu_cvt_d_s(uint32_t a, unsigned *fflags) {
+    if (is_nan_s(a)) {
+        *fflags |= is_snan_s(a) ? FFLAGS_NV : 0;
+        return FPU_NAN_D;
+    }
+    return bits64((double)f32(a)); // exact
+}
+
+// x (a float or double, so exact in long double) to an integer, saturating
+static uint64_t fpu_to_int(long double x, bool wide, bool is_signed, unsigned rm,
+                           unsigned *fflags) {
+    uint64_t max = is_signed ? (wide ? INT64_MAX : INT32_MAX) : (wide ? UINT64_MAX : UINT32_MAX);
+    uint64_t min = is_signed ? (wide ? (uint64_t)INT64_MIN : (uint32_t)INT32_MIN) : 0;
+    if (isnan(x)) {
+        *fflags |= FFLAGS_NV;
+        return max;
+    }
+    long double r;
+    switch (rm) {
+    case FRM_RTZ: r = truncl(x);     break;
+    case FRM_RDN: r = floorl(x);     break;
+    case FRM_RUP: r = ceill(x);      break;
+    case FRM_RMM: r = roundl(x);     break;
+    default:      r = nearbyintl(x); break; // the host mode is always RNE here
+    }
+    long double lo = is_signed ? (wide ? -0x1p63L : -0x1p31L) : 0;
+    long double hi = is_signed ? (wide ? 0x1p63L : 0x1p31L) : (wide ? 0x1p64L : 0x1p32L);
+    if (r < lo || r >= hi) {
+        *fflags |= FFLAGS_NV; // NX is not raised with NV
+        return (x < 0) ? min : max;
+    }
+    if (r != x) {
+        *fflags |= FFLAGS_NX;
+    }
+    uint64_t v = is_signed ? (uint64_t)(int64_t)r : (uint64_t)r;
+    return wide ? v : (uint32_t)v;
+}
+
+uint64_t fpu_cvt_int_s(uint32_t a, bool wide, bool is_signed, unsigned rm, unsigned *fflags) {
+    return fpu_to_int(f32(a), wide, is_signed, rm, fflags);
+}
+
+uint64_t fpu_cvt_int_d(uint64_t a, bool wide, bool is_signed, unsigned rm, unsigned *fflags) {
+    return fpu_to_int(f64(a), wide, is_signed, rm, fflags);
+}
+
+uint32_t fpu_cvt_s_int(uint64_t v, bool is_signed, unsigned rm, unsigned *fflags) {
+#if FPU_HOST_RMM
+    if (rm == FRM_RMM) {
+        long double x = is_signed ? (long double)(int64_t)v : (long double)v;
+        return bits32((float)fpu_round_rmm(x, false, false, fflags));
+    }
+#endif
+    volatile uint64_t vv = v;
+    volatile float vr;
+    int old = fpu_fe_enter(fpu_fe_round(rm));
+    vr      = is_signed ? (float)(int64_t)vv : (float)vv;
+    *fflags |= fpu_fe_leave(old);
+    return bits32(vr);
+}
+
+uint64_t fpu_cvt_d_int(uint64_t v, bool is_signed, unsigned rm, unsigned *fflags) {
+#if FPU_HOST_RMM
+    if (rm == FRM_RMM) {
+        long double x = is_signed ? (long double)(int64_t)v : (long double)v;
+        return bits64((double)fpu_round_rmm(x, false, true, fflags));
+    }
+#endif
+    volatile uint64_t vv = v;
+    volatile double vr;
+    int old = fpu_fe_enter(fpu_fe_round(rm));
+    vr      = is_signed ? (double)(int64_t)vv : (double)vv;
+    *fflags |= fpu_fe_leave(old);
+    return bits64(vr);
+}
+
+/* ------------------------- min/max and compares ------------------------- */
+uint32_t fpu_minmax_s(uint32_t a, uint32_t b, bool max, unsigned *fflags) {
+    if (is_snan_s(a) || is_snan_s(b)) {
+        *fflags |= FFLAGS_NV;
+    }
+    if (is_nan_s(a) && is_nan_s(b)) {
+        return FPU_NAN_S;
+    } else if (is_nan_s(a)) {
+        return b;
+    } else if (is_nan_s(b)) {
+        return a;
+    }
+    // -0 is less than +0
+    bool a_less = f32(a) < f32(b) || (f32(a) == f32(b) && (a >> 31) > (b >> 31));
+    return (a_less != max) ? a : b;
+}
+
+uint64_t fpu_minmax_d(uint64_t a, uint64_t b, bool max, unsigned *fflags) {
+    if (is_snan_d(a) || is_snan_d(b)) {
+        *fflags |= FFLAGS_NV;
+    }
+    if (is_nan_d(a) && is_nan_d(b)) {
+        return FPU_NAN_D;
+    } else if (is_nan_d(a)) {
+        return b;
+    } else if (is_nan_d(b)) {
+        return a;
+    }
+    bool a_less = f64(a) < f64(b) || (f64(a) == f64(b) && (a >> 63) > (b >> 63));
+    return (a_less != max) ? a : b;
+}
+
+// FEQ is a quiet comparison, FLT and FLE signal on any NaN
+static bool fpu_compare(double a, double b, bool nan, bool snan, unsigned funct3,
+                        unsigned *fflags) {
+    if (nan) {
+        if (snan || funct3 != 2) {
+            *fflags |= FFLAGS_NV;
+        }
+        return false;
+    }
+    switch (funct3) {
+    case 0:  return a <= b;
+    case 1:  return a < b;
+    default: return a == b;
+    }
+}
+
+bool fpu_compare_s(uint32_t a, uint32_t b, unsigned funct3, unsigned *fflags) {
+    return fpu_compare(f32(a), f32(b), is_nan_s(a) || is_nan_s(b), is_snan_s(a) || is_snan_s(b),
+                       funct3, fflags);
+}
+
+bool fpu_compare_d(uint64_t a, uint64_t b, unsigned funct3, unsigned *fflags) {
+    return fpu_compare(f64(a), f64(b), is_nan_d(a) || is_nan_d(b), is_snan_d(a) || is_snan_d(b),
+                       funct3, fflags);
+}
+
+/* -------------------------------- fclass -------------------------------- */
+static unsigned fpu_class(bool sign, bool exp_max, bool exp_zero, bool frac_zero, bool quiet) {
+    if (exp_max) {
+        if (!frac_zero) {
+            return quiet ? (1u << 9) : (1u << 8);
+        }
+        return sign ? (1u << 0) : (1u << 7); // infinities
+    }
+    if (exp_zero) {
+        if (frac_zero) {
+            return sign ? (1u << 3) : (1u << 4);
+        }
+        return sign ? (1u << 2) : (1u << 5); // subnormals
+    }
+    return sign ? (1u << 1) : (1u << 6);
+}
+
+unsigned fpu_class_s(uint32_t a) {
+    uint32_t exp = (a >> 23) & 0xff;
+    return fpu_class(a >> 31, exp == 0xff, exp == 0, (a & 0x007fffffu) == 0, a & 0x00400000u);
+}
+
+unsigned fpu_class_d(uint64_t a) {
+    uint64_t exp = (a >> 52) & 0x7ff;
+    return fpu_class(a >> 63, exp == 0x7ff, exp == 0, (a & 0x000fffffffffffffull) == 0,
+                     (a & 0x0008000000000000ull) != 0);
+}
@@ -0,0 +1,71 @@
+#ifndef __FPU_H__
+#define __FPU_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// fflags (accrued exceptions, fcsr[4:0])
+#define FFLAGS_NX 0x01 // inexact
+#define FFLAGS_UF 0x02 // underflow
+#define FFLAGS_OF 0x04 // overflow
+#define FFLAGS_DZ 0x08 // divide by zero
+#define FFLAGS_NV 0x10 // invalid operation
+#define FFLAGS_MASK 0x1f
+
+// rounding modes of frm and of the rm field (FRM_DYN selects frm)
+typedef enum {
+    FRM_RNE = 0, // to nearest, ties to even
+    FRM_RTZ = 1, // toward zero
+    FRM_RDN = 2, // down
+    FRM_RUP = 3, // up
+    FRM_RMM = 4, // to nearest, ties to max magnitude
+    FRM_DYN = 7,
+} fpu_rm_t;
+
+// canonical NaNs (every NaN result is one of them)
+#define FPU_NAN_S 0x7fc00000u
+#define FPU_NAN_D 0x7ff8000000000000ull
+
+typedef enum {
+    FPU_ADD = 0,
+    FPU_SUB,
+    FPU_MUL,
+    FPU_DIV,
+    FPU_SQRT,
+    FPU_MADD,  //   a * b + c
+    FPU_MSUB,  //   a * b - c
+    FPU_NMSUB, // -(a * b) + c
+    FPU_NMADD, // -(a * b) - c
+} fpu_op_t;
+
+/*
+ * F and D on the host FPU. Values are IEEE 754 bit patterns; rm is a valid
+ * rounding mode (not FRM_DYN) and the exceptions are OR'ed into *fflags.
+ * Results follow the RISC-V rules where hosts differ: NaN results are
+ * canonical, conversions to integers saturate, fmin/fmax return the non-NaN
+ * operand, and 0 * inf + qNaN is invalid.
+ */
+extern uint32_t fpu_arith_s(fpu_op_t op, uint32_t a, uint32_t b, uint32_t c, unsigned rm,
+                            unsigned *fflags);
+extern uint64_t fpu_arith_d(fpu_op_t op, uint64_t a, uint64_t b, uint64_t c, unsigned rm,
+                            unsigned *fflags);
+
+extern uint32_t fpu_cvt_s_d(uint64_t a, unsigned rm, unsigned *fflags);
+extern uint64_t fpu_cvt_d_s(uint32_t a, unsigned *fflags);
+// float to a 32- or 64-bit integer (the 32-bit results zero-extended)
+extern uint64_t fpu_cvt_int_s(uint32_t a, bool wide, bool is_signed, unsigned rm, unsigned *fflags);
+extern uint64_t fpu_cvt_int_d(uint64_t a, bool wide, bool is_signed, unsigned rm, unsigned *fflags);
+// integer (already extended to 64 bits per is_signed) to float
+extern uint32_t fpu_cvt_s_int(uint64_t v, bool is_signed, unsigned rm, unsigned *fflags);
+extern uint64_t fpu_cvt_d_int(uint64_t v, bool is_signed, unsigned rm, unsigned *fflags);
+
+extern uint32_t fpu_minmax_s(uint32_t a, uint32_t b, bool max, unsigned *fflags);
+extern uint64_t fpu_minmax_d(uint64_t a, uint64_t b, bool max, unsigned *fflags);
+// funct3 of FLE (0), FLT (1) and FEQ (2)
+extern bool fpu_compare_s(uint32_t a, uint32_t b, unsigned funct3, unsigned *fflags);
+extern bool fpu_compare_d(uint64_t a, uint64_t b, unsigned funct3, unsigned *fflags);
+// fclass: one-hot class of the value
+extern unsigned fpu_class_s(uint32_t a);
+extern unsigned fpu_class_d(uint64_t a);
+
+#endif
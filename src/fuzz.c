@@ -0,0 +1,191 @@
+#include "iss.h"
+#include "common.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// file descriptors of the AFL fork server protocol
+#define FORKSRV_FD 198
+
+// default bound of one execution (hangs end as a normal exit)
+#define FUZZ_MAX_INSTS 10000000ul
+// default number of executions of one forked child
+#define FUZZ_PERSIST_ITERS 1000ul
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n max_insts] [-p iters] elf_file [input_file...]\n", prog);
+    fprintf(stderr, "  Under afl-fuzz (persistent: a forked child resets its ISS for\n");
+    fprintf(stderr, "  up to iters executions):\n");
+    fprintf(stderr, "    afl-fuzz -i in -o out -- %s elf_file @@\n", prog);
+    fprintf(stderr, "  Otherwise runs every input file once and reports its coverage.\n");
+    fprintf(stderr, "  The input is served by the InputFile device; a non-zero exit code\n");
+    fprintf(stderr, "  of the guest is reported to the fuzzer as a crash.\n");
+}
+
+// read the whole test case (stdin if file_name is NULL) into *buffer
+static long read_input(const char *file_name, byte_t **buffer, size_t *capacity) {
+    int fd = (file_name != NULL) ? open(file_name, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        return -1;
+    }
+    if (file_name == NULL) {
+        lseek(fd, 0, SEEK_SET); // afl-fuzz rewrites the same stdin file
+    }
+    size_t size = 0;
+    for (;;) {
+        if (size == *capacity) {
+            *capacity = *capacity ? 2 * *capacity : 4096;
+            *buffer   = realloc(*buffer, *capacity);
+            Assert(*buffer != NULL, "Out of memory");
+        }
+        ssize_t n = read(fd, *buffer + size, *capacity - size);
+        if (n <= 0) {
+            break;
+        }
+        size += (size_t)n;
+    }
+    if (file_name != NULL) {
+        close(fd);
+    }
+    return (long)size;
+}
+
+// one execution from the reset state, return a wait(2)-style status
+static int run_one(ISS *iss, const byte_t *input, size_t size, unsigned long max_insts) {
+    ISS_reset(iss);
+    ISS_set_input(iss, input, size);
+    ISS_step(iss, max_insts);
+
+    arch_state_t state = ISS_get_arch_state(iss);
+    if (ISS_get_halt(iss) && state.gpr[10] != 0) {
+        return SIGABRT; // terminated by a signal: a crash for the fuzzer
+    }
+    return 0;
+}
+
+// a child of the fork server: up to iters executions, stopping itself after
+// each for the server to report it; a crash of the guest (or an abort of the
+// simulator) ends it with a signal, as afl-fuzz expects
+static void persistent_child(ISS *iss, const char *input_file, unsigned long max_insts,
+                             unsigned long iters) {
+    close(FORKSRV_FD);
+    close(FORKSRV_FD + 1);
+    byte_t *input   = NULL;
+    size_t capacity = 0;
+    for (unsigned long i = 0; i < iters; i++) {
+        long size = read_input(input_file, &input, &capacity);
+        if (size >= 0 && run_one(iss, input, (size_t)size, max_insts) != 0) {
+            abort();
+        }
+        if (i + 1 < iters) {
+            raise(SIGSTOP);
+        }
+    }
+    _exit(0);
+}
+
+// the AFL fork server in persistent mode: the pid reported for an execution
+// is that of the child running it, so a timeout kills the child only
+static void fork_server(ISS *iss, const char *input_file, unsigned long max_insts,
+                        unsigned long iters) {
+    pid_t child  = -1;
+    bool stopped = false; // child waits for its next execution
+    uint32_t was_killed;
+    while (read(FORKSRV_FD, &was_killed, 4) == 4) {
+        int status;
+        if (stopped && was_killed) {
+            // afl-fuzz killed it after its last report (a timeout)
+            stopped = false;
+            waitpid(child, &status, 0);
+        }
+        if (stopped) {
+            kill(child, SIGCONT);
+            stopped = false;
+        } else {
+            fflush(stdout);
+            fflush(stderr);
+            child = fork();
+            if (child < 0) {
+                break;
+            }
+            if (child == 0) {
+                persistent_child(iss, input_file, max_insts, iters);
+            }
+        }
+
+        int32_t pid = (int32_t)child;
+        if (write(FORKSRV_FD + 1, &pid, 4) != 4 || waitpid(child, &status, WUNTRACED) < 0) {
+            break;
+        }
+        stopped = WIFSTOPPED(status);
+        int32_t report = stopped ? 0 : status;
+        if (write(FORKSRV_FD + 1, &report, 4) != 4) {
+            break;
+        }
+    }
+    if (child > 0) {
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned long max_insts = FUZZ_MAX_INSTS;
+    unsigned long iters     = FUZZ_PERSIST_ITERS;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+        switch (opt) {
+        case 'n': max_insts = strtoul(optarg, NULL, 0); break;
+        case 'p': iters = strtoul(optarg, NULL, 0);     break;
+        default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.coverage = true;
+    ISS *iss_ptr;
+    Assert(ISS_ctor_with_config(&iss_ptr, argv[optind], &config) == 0, "ISS_ctor failed!");
+    const char *input_file = (optind + 1 < argc) ? argv[optind + 1] : NULL;
+
+    byte_t *input   = NULL;
+    size_t capacity = 0;
+    uint32_t hello  = 0;
+    if (write(FORKSRV_FD + 1, &hello, 4) == 4) {
+        // afl-fuzz: the children reset their copy of the ISS in place
+        fork_server(iss_ptr, input_file, max_insts, (iters != 0) ? iters : 1);
+    } else {
+        // standalone: run every input once
+        size_t map_size;
+        byte_t *map = ISS_get_coverage(iss_ptr, &map_size);
+        for (int i = optind + 1; i < argc; i++) {
+            long size = read_input(argv[i], &input, &capacity);
+            if (size < 0) {
+                fprintf(stderr, "%s: cannot read\n", argv[i]);
+                continue;
+            }
+            memset(map, 0, map_size);
+            int status = run_one(iss_ptr, input, (size_t)size, max_insts);
+            unsigned edges = 0;
+            for (size_t j = 0; j < map_size; j++) {
+                edges += (map[j] != 0);
+            }
+            fprintf(stderr, "%s: %s, %u edges\n", argv[i],
+                    status ? "crash" : (ISS_get_halt(iss_ptr) ? "exit" : "timeout"), edges);
+        }
+    }
+
+    free(input);
+    ISS_dtor(iss_ptr);
+}
@@ -0,0 +1,644 @@
+#include "iss.h"
+
+#include "arch.h"
+#include "common.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * GDB remote serial protocol on top of the ISS API: hart 0 as the only
+ * thread, x0..x31/pc/f0..f31/fflags/frm/fcsr, memory through
+ * ISS_debug_read/write(), Z0/Z1 breakpoints and Z2..Z4 watchpoints (both
+ * kinds of breakpoint are checked at fetch, the code is not patched),
+ * c/s/vCont including range stepping, bs/bc reverse execution (with an undo
+ * log, see ISS_step_back()), and no-ack mode.
+ */
+
+#define GDB_PACKET_MAX 4096
+// instructions between two looks for a Ctrl-C while the guest runs
+#define GDB_RUN_CHUNK 1000000
+#define GDB_INTERRUPT 0x03
+
+// regnums of the target description
+#define GDB_REG_PC 32
+#define GDB_REG_F0 33
+#define GDB_REG_FFLAGS 66
+#define GDB_REG_FRM 67
+#define GDB_REG_FCSR 68
+
+typedef struct {
+    ISS *iss;
+    int fd;
+    bool no_ack;
+    bool interrupted; // a Ctrl-C arrived while the guest ran
+    // input buffer
+    char in[GDB_PACKET_MAX];
+    size_t in_len, in_pos;
+    char stop_reply[64]; // of the last stop, for '?'
+    char packet[GDB_PACKET_MAX];
+    char reply[GDB_PACKET_MAX];
+    char out[GDB_PACKET_MAX + 4]; // framed reply
+} GdbStub;
+
+/* ---------------------------- transport ---------------------------- */
+// accept one connection on a TCP port of localhost or a Unix socket path
+static int gdb_accept(const char *endpoint) {
+    char *end;
+    unsigned long port = strtoul(endpoint, &end, 10);
+    bool tcp           = (*endpoint != '\0' && *end == '\0');
+    int fd             = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int ret;
+    if (tcp) {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr = { .sin_family      = AF_INET,
+                                    .sin_port        = htons((uint16_t)port),
+                                    .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    } else {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(endpoint) >= sizeof(addr.sun_path)) {
+            close(fd);
+            return -1;
+        }
+        strcpy(addr.sun_path, endpoint);
+        unlink(endpoint);
+        ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    if (ret != 0 || listen(fd, 1) != 0) {
+        close(fd);
+        return -1;
+    }
+    LOG("Waiting for GDB on %s %s\n", tcp ? "port" : "socket", endpoint);
+    fflush(stdout);
+    int conn = accept(fd, NULL, NULL);
+    close(fd);
+    if (!tcp) {
+        unlink(endpoint);
+    }
+    if (conn >= 0 && tcp) {
+        int one = 1;
+        setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return conn;
+}
+
+// next byte from the debugger, -1 at EOF
+static int gdb_getc(GdbStub *self) {
+    if (self->in_pos == self->in_len) {
+        ssize_t n;
+        do {
+            n = read(self->fd, self->in, sizeof(self->in));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            return -1;
+        }
+        self->in_len = (size_t)n;
+        self->in_pos = 0;
+    }
+    return (unsigned char)self->in[self->in_pos++];
+}
+
+static bool gdb_write(GdbStub *self, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(self->fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(int c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// receive a packet into buf (NUL-terminated), return its length, or -1 at
+// EOF; a Ctrl-C between packets sets interrupted
+static int gdb_get_packet(GdbStub *self, char *buf) {
+    for (;;) {
+        int c;
+        while ((c = gdb_getc(self)) != '$') {
+            if (c < 0) {
+                return -1;
+            }
+            if (c == GDB_INTERRUPT) {
+                self->interrupted = true;
+            }
+        }
+        int len = 0;
+        uint8_t sum = 0;
+        while ((c = gdb_getc(self)) != '#') {
+            if (c < 0) {
+                return -1;
+            }
+            if (len < GDB_PACKET_MAX - 1) {
+                buf[len++] = (char)c;
+            }
+            sum += (uint8_t)c;
+        }
+        buf[len] = '\0';
+        int hi = gdb_getc(self), lo = gdb_getc(self);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
+        if (self->no_ack) {
+            return len;
+        }
+        if (hex_value(hi) * 16 + hex_value(lo) == sum) {
+            return gdb_write(self, "+", 1) ? len : -1;
+        }
+        if (!gdb_write(self, "-", 1)) {
+            return -1;
+        }
+    }
+}
+
+static bool gdb_put_packet(GdbStub *self, const char *data) {
+    char *out  = self->out;
+    size_t len = strlen(data);
+    Assert(len < GDB_PACKET_MAX, "GDB packet too long");
+    uint8_t sum = 0;
+    out[0]      = '$';
+    for (size_t i = 0; i < len; i++) {
+        out[1 + i] = data[i];
+        sum += (uint8_t)data[i];
+    }
+    out[1 + len] = '#';
+    out[2 + len] = hex_digits[sum >> 4];
+    out[3 + len] = hex_digits[sum & 0xf];
+    for (;;) {
+        if (!gdb_write(self, out, len + 4)) {
+            return false;
+        }
+        if (self->no_ack) {
+            return true;
+        }
+        int c;
+        while ((c = gdb_getc(self)) != '+' && c != '-') {
+            if (c < 0) {
+                return false;
+            }
+            if (c == GDB_INTERRUPT) {
+                self->interrupted = true;
+            }
+        }
+        if (c == '+') {
+            return true;
+        }
+    }
+}
+
+/* ---------------------------- encoding ---------------------------- */
+// little-endian hex of the low `bytes` bytes of v
+static char *put_hex_le(char *p, uint64_t v, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; i++, v >>= 8) {
+        *p++ = hex_digits[(v >> 4) & 0xf];
+        *p++ = hex_digits[v & 0xf];
+    }
+    *p = '\0';
+    return p;
+}
+
+static bool get_hex_le(const char *p, unsigned bytes, uint64_t *v) {
+    *v = 0;
+    for (unsigned i = 0; i < bytes; i++) {
+        int hi = hex_value(p[2 * i]), lo = hex_value(p[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        *v |= (uint64_t)(hi * 16 + lo) << (8 * i);
+    }
+    return true;
+}
+
+// a big-endian hex number such as an address, *end past it
+static uint64_t get_hex(const char *p, const char **end) {
+    uint64_t v = 0;
+    int d;
+    while ((d = hex_value(*p)) >= 0) {
+        v = (v << 4) | (uint64_t)d;
+        p++;
+    }
+    *end = p;
+    return v;
+}
+
+/* ---------------------------- registers --------------------------- */
+static bool gdb_get_reg(const arch_state_t *s, unsigned regnum, uint64_t *v, unsigned *bytes) {
+    *bytes = XLEN / 8;
+    if (regnum < 32) {
+        *v = s->gpr[regnum];
+    } else if (regnum == GDB_REG_PC) {
+        *v = s->current_pc;
+    } else if (regnum >= GDB_REG_F0 && regnum < GDB_REG_F0 + 32) {
+        *v     = s->fpr[regnum - GDB_REG_F0];
+        *bytes = 8;
+    } else if (regnum == GDB_REG_FFLAGS) {
+        *v = s->fcsr & 0x1f;
+    } else if (regnum == GDB_REG_FRM) {
+        *v = (s->fcsr >> 5) & 0x7;
+    } else if (regnum == GDB_REG_FCSR) {
+        *v = s->fcsr & 0xff;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool gdb_set_reg(arch_state_t *s, unsigned regnum, uint64_t v) {
+    if (regnum < 32) {
+        if (regnum != 0) {
+            s->gpr[regnum] = (reg_t)v;
+        }
+    } else if (regnum == GDB_REG_PC) {
+        s->current_pc = (reg_t)v;
+    } else if (regnum >= GDB_REG_F0 && regnum < GDB_REG_F0 + 32) {
+        s->fpr[regnum - GDB_REG_F0] = v;
+    } else if (regnum == GDB_REG_FFLAGS) {
+        s->fcsr = (s->fcsr & ~0x1fu) | (v & 0x1f);
+    } else if (regnum == GDB_REG_FRM) {
+        s->fcsr = (s->fcsr & ~0xe0u) | ((v & 0x7) << 5);
+    } else if (regnum == GDB_REG_FCSR) {
+        s->fcsr = v & 0xff;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// the target description, so that GDB knows XLEN and the FP registers
+static void gdb_target_xml(char *xml, size_t size) {
+    int n = snprintf(xml, size,
+                     "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+                     "<target version=\"1.0\"><architecture>riscv:rv%d</architecture>"
+                     "<feature name=\"org.gnu.gdb.riscv.cpu\">",
+                     XLEN);
+    for (int i = 0; i < 32; i++) {
+        n += snprintf(xml + n, size - n, "<reg name=\"x%d\" bitsize=\"%d\" regnum=\"%d\"/>", i,
+                      XLEN, i);
+    }
+    n += snprintf(xml + n, size - n,
+                  "<reg name=\"pc\" bitsize=\"%d\" type=\"code_ptr\" regnum=\"%d\"/></feature>"
+                  "<feature name=\"org.gnu.gdb.riscv.fpu\">",
+                  XLEN, GDB_REG_PC);
+    for (int i = 0; i < 32; i++) {
+        n += snprintf(xml + n, size - n,
+                      "<reg name=\"f%d\" bitsize=\"64\" type=\"ieee_double\" regnum=\"%d\"/>", i,
+                      GDB_REG_F0 + i);
+    }
+    snprintf(xml + n, size - n,
+             "<reg name=\"fflags\" bitsize=\"32\" regnum=\"%d\"/>"
+             "<reg name=\"frm\" bitsize=\"32\" regnum=\"%d\"/>"
+             "<reg name=\"fcsr\" bitsize=\"32\" regnum=\"%d\"/></feature></target>",
+             GDB_REG_FFLAGS, GDB_REG_FRM, GDB_REG_FCSR);
+}
+
+/* ---------------------------- execution --------------------------- */
+// poll the connection for a Ctrl-C without blocking
+static bool gdb_poll_interrupt(GdbStub *self) {
+    struct pollfd pfd = { .fd = self->fd, .events = POLLIN };
+    while (!self->interrupted &&
+           (self->in_pos < self->in_len || poll(&pfd, 1, 0) > 0)) {
+        int c = gdb_getc(self);
+        if (c < 0) {
+            break;
+        }
+        self->interrupted = (c == GDB_INTERRUPT);
+    }
+    return self->interrupted;
+}
+
+// the stop reply of the last ISS_step(), false if the guest still runs
+static bool gdb_stopped(GdbStub *self) {
+    iss_stop_t stop = ISS_get_stop(self->iss);
+    if (stop.reason == ISS_STOP_BREAKPOINT) {
+        snprintf(self->stop_reply, sizeof(self->stop_reply), "T05thread:1;");
+    } else if (stop.reason == ISS_STOP_WATCHPOINT) {
+        static const char *const kinds[] = { "", "watch", "rwatch", "awatch" };
+        snprintf(self->stop_reply, sizeof(self->stop_reply), "T05%s:%" PRIx64 ";thread:1;",
+                 kinds[stop.watch], (uint64_t)stop.addr);
+    } else if (stop.reason == ISS_STOP_LOG_BEGIN) {
+        snprintf(self->stop_reply, sizeof(self->stop_reply), "T05replaylog:begin;thread:1;");
+    } else if (ISS_get_halt(self->iss)) {
+        snprintf(self->stop_reply, sizeof(self->stop_reply), "W00");
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// execute one instruction, true if it stopped at a point or the halt
+static bool gdb_step(GdbStub *self) {
+    addr_t pc = ISS_get_arch_state(self->iss).current_pc;
+    ISS_step(self->iss, 1);
+    iss_stop_t stop = ISS_get_stop(self->iss);
+    if (stop.reason == ISS_STOP_BREAKPOINT && stop.pc == pc) {
+        ISS_step(self->iss, 1); // nothing executed, resuming executes it
+    }
+    if (gdb_stopped(self)) {
+        return true;
+    }
+    snprintf(self->stop_reply, sizeof(self->stop_reply), "T05thread:1;");
+    return false;
+}
+
+// run while the PC stays in [start, end) (start == end: until a stop)
+static void gdb_run(GdbStub *self, addr_t start, addr_t end) {
+    self->interrupted = false;
+    if (start != end) {
+        do {
+            addr_t pc = ISS_get_arch_state(self->iss).current_pc;
+            if (pc < start || pc >= end || gdb_step(self)) {
+                return;
+            }
+        } while (!gdb_poll_interrupt(self));
+    } else {
+        do {
+            ISS_step(self->iss, GDB_RUN_CHUNK);
+            if (gdb_stopped(self)) {
+                return;
+            }
+        } while (!gdb_poll_interrupt(self));
+    }
+    snprintf(self->stop_reply, sizeof(self->stop_reply), "T02thread:1;");
+}
+
+// bs undoes one instruction, bc undoes up to a point (or the oldest logged)
+static void gdb_reverse(GdbStub *self, bool step) {
+    if (step) {
+        ISS_step_back(self->iss, 1);
+    } else {
+        ISS_reverse_continue(self->iss);
+    }
+    if (!gdb_stopped(self)) {
+        snprintf(self->stop_reply, sizeof(self->stop_reply), "T05thread:1;");
+    }
+}
+
+/* ---------------------------- commands ---------------------------- */
+static void gdb_read_regs(GdbStub *self, char *reply) {
+    arch_state_t s = ISS_get_arch_state(self->iss);
+    for (unsigned r = 0; r <= GDB_REG_PC; r++) {
+        uint64_t v;
+        unsigned bytes;
+        gdb_get_reg(&s, r, &v, &bytes);
+        reply = put_hex_le(reply, v, bytes);
+    }
+}
+
+static bool gdb_write_regs(GdbStub *self, const char *p) {
+    arch_state_t s = ISS_get_arch_state(self->iss);
+    for (unsigned r = 0; r <= GDB_REG_PC && *p != '\0'; r++, p += XLEN / 4) {
+        uint64_t v;
+        if (!get_hex_le(p, XLEN / 8, &v)) {
+            return false;
+        }
+        gdb_set_reg(&s, r, v);
+    }
+    ISS_set_arch_state(self->iss, s);
+    return true;
+}
+
+static void gdb_read_mem(GdbStub *self, const char *p, char *reply) {
+    const char *end;
+    addr_t addr  = (addr_t)get_hex(p, &end);
+    unsigned len = (unsigned)get_hex(end + 1, &end);
+    len          = (len < GDB_PACKET_MAX / 2 - 1) ? len : GDB_PACKET_MAX / 2 - 1;
+    byte_t data[GDB_PACKET_MAX / 2];
+    if (ISS_debug_read(self->iss, addr, len, data) != 0) {
+        strcpy(reply, "E01");
+        return;
+    }
+    for (unsigned i = 0; i < len; i++) {
+        reply = put_hex_le(reply, data[i], 1);
+    }
+}
+
+static void gdb_write_mem(GdbStub *self, const char *p, char *reply) {
+    const char *end;
+    addr_t addr  = (addr_t)get_hex(p, &end);
+    unsigned len = (unsigned)get_hex(end + 1, &end);
+    byte_t data[GDB_PACKET_MAX / 2];
+    uint64_t v;
+    if (*end != ':' || len > sizeof(data)) {
+        strcpy(reply, "E01");
+        return;
+    }
+    for (unsigned i = 0; i < len; i++) {
+        if (!get_hex_le(end + 1 + 2 * i, 1, &v)) {
+            strcpy(reply, "E01");
+            return;
+        }
+        data[i] = (byte_t)v;
+    }
+    strcpy(reply, (ISS_debug_write(self->iss, addr, len, data) == 0) ? "OK" : "E01");
+}
+
+// Z/z type,addr,kind
+static void gdb_point(GdbStub *self, const char *p, bool insert, char *reply) {
+    static const iss_watch_t watch[] = { [2] = ISS_WATCH_WRITE, [3] = ISS_WATCH_READ,
+                                         [4] = ISS_WATCH_ACCESS };
+    const char *end;
+    unsigned type = (unsigned)get_hex(p, &end);
+    addr_t addr   = (addr_t)get_hex(end + 1, &end);
+    addr_t kind   = (addr_t)get_hex(end + 1, &end);
+    int ret;
+    if (type <= 1) {
+        ret = insert ? ISS_add_breakpoint(self->iss, addr) : ISS_remove_breakpoint(self->iss, addr);
+    } else if (type <= 4) {
+        ret = insert ? ISS_add_watchpoint(self->iss, addr, kind, watch[type])
+                     : ISS_remove_watchpoint(self->iss, addr, kind, watch[type]);
+    } else {
+        reply[0] = '\0'; // not supported
+        return;
+    }
+    strcpy(reply, (ret == 0) ? "OK" : "E01");
+}
+
+// qXfer:features:read:target.xml:offset,length
+static void gdb_xfer_features(const char *p, char *reply) {
+    static char xml[8192];
+    if (xml[0] == '\0') {
+        gdb_target_xml(xml, sizeof(xml));
+    }
+    if (strncmp(p, "target.xml:", 11) != 0) {
+        strcpy(reply, "E00");
+        return;
+    }
+    const char *end;
+    size_t off = (size_t)get_hex(p + 11, &end);
+    size_t len = (size_t)get_hex(end + 1, &end);
+    size_t all = strlen(xml);
+    len        = (len < GDB_PACKET_MAX - 2) ? len : GDB_PACKET_MAX - 2;
+    if (off >= all) {
+        strcpy(reply, "l");
+        return;
+    }
+    size_t n = (all - off < len) ? all - off : len;
+    reply[0] = (off + n == all) ? 'l' : 'm';
+    memcpy(reply + 1, xml + off, n);
+    reply[1 + n] = '\0';
+}
+
+// the first action of vCont (the stub has one thread)
+static void gdb_vcont(GdbStub *self, const char *p) {
+    const char *end;
+    if (p[0] == 's' || p[0] == 'S') {
+        gdb_step(self);
+    } else if (p[0] == 'r') {
+        addr_t start = (addr_t)get_hex(p + 1, &end);
+        addr_t stop  = (addr_t)get_hex(end + 1, &end);
+        gdb_run(self, start, (stop > start) ? stop : start + 1);
+    } else {
+        gdb_run(self, 0, 0);
+    }
+}
+
+int ISS_gdb_serve(ISS *self, const char *endpoint) {
+    Assert(self != NULL && endpoint != NULL, "self and endpoint should not be NULL!");
+    GdbStub *stub = calloc(1, sizeof(GdbStub));
+    Assert(stub != NULL, "Out of memory");
+    stub->iss = self;
+    stub->fd  = gdb_accept(endpoint);
+    if (stub->fd < 0) {
+        free(stub);
+        return -1;
+    }
+    strcpy(stub->stop_reply, "S05");
+
+    char *packet = stub->packet, *reply = stub->reply;
+    int ret      = -1;
+    for (;;) {
+        if (gdb_get_packet(stub, packet) < 0) {
+            break;
+        }
+        const char *end;
+        unsigned regnum;
+        uint64_t v;
+        unsigned bytes;
+        arch_state_t s;
+        reply[0] = '\0';
+        switch (packet[0]) {
+        case '?': strcpy(reply, stub->stop_reply);      break;
+        case 'g': gdb_read_regs(stub, reply);           break;
+        case 'G': strcpy(reply, gdb_write_regs(stub, packet + 1) ? "OK" : "E01"); break;
+        case 'p':
+            regnum = (unsigned)get_hex(packet + 1, &end);
+            s      = ISS_get_arch_state(self);
+            if (gdb_get_reg(&s, regnum, &v, &bytes)) {
+                put_hex_le(reply, v, bytes);
+            } else {
+                strcpy(reply, "E01");
+            }
+            break;
+        case 'P':
+            regnum = (unsigned)get_hex(packet + 1, &end);
+            s      = ISS_get_arch_state(self);
+            gdb_get_reg(&s, regnum, &v, &bytes);
+            if (*end == '=' && get_hex_le(end + 1, bytes, &v) && gdb_set_reg(&s, regnum, v)) {
+                ISS_set_arch_state(self, s);
+                strcpy(reply, "OK");
+            } else {
+                strcpy(reply, "E01");
+            }
+            break;
+        case 'm': gdb_read_mem(stub, packet + 1, reply);         break;
+        case 'M': gdb_write_mem(stub, packet + 1, reply);        break;
+        case 'Z': gdb_point(stub, packet + 1, true, reply);      break;
+        case 'z': gdb_point(stub, packet + 1, false, reply);     break;
+        case 'c': gdb_run(stub, 0, 0);  strcpy(reply, stub->stop_reply); break;
+        case 's': gdb_step(stub);       strcpy(reply, stub->stop_reply); break;
+        case 'b':
+            if (packet[1] == 's' || packet[1] == 'c') {
+                gdb_reverse(stub, packet[1] == 's');
+                strcpy(reply, stub->stop_reply);
+            }
+            break;
+        case 'H': strcpy(reply, "OK");                           break;
+        case 'T': strcpy(reply, "OK");                           break;
+        case 'D':
+            gdb_put_packet(stub, "OK");
+            ret = 0;
+            goto out;
+        case 'k':
+            ret = 1;
+            goto out;
+        case 'v':
+            if (strcmp(packet, "vCont?") == 0) {
+                strcpy(reply, "vCont;c;C;s;S;r");
+            } else if (strncmp(packet, "vCont;", 6) == 0) {
+                gdb_vcont(stub, packet + 6);
+                strcpy(reply, stub->stop_reply);
+            } else if (strncmp(packet, "vKill", 5) == 0) {
+                gdb_put_packet(stub, "OK");
+                ret = 1;
+                goto out;
+            }
+            break;
+        case 'q':
+            if (strncmp(packet, "qSupported", 10) == 0) {
+                snprintf(reply, GDB_PACKET_MAX,
+                         "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+;vContSupported+;"
+                         "ReverseStep+;ReverseContinue+",
+                         GDB_PACKET_MAX);
+            } else if (strncmp(packet, "qXfer:features:read:", 20) == 0) {
+                gdb_xfer_features(packet + 20, reply);
+            } else if (strcmp(packet, "qAttached") == 0) {
+                strcpy(reply, "1");
+            } else if (strcmp(packet, "qC") == 0) {
+                strcpy(reply, "QC1");
+            } else if (strcmp(packet, "qfThreadInfo") == 0) {
+                strcpy(reply, "m1");
+            } else if (strcmp(packet, "qsThreadInfo") == 0) {
+                strcpy(reply, "l");
+            }
+            break;
+        case 'Q':
+            if (strcmp(packet, "QStartNoAckMode") == 0) {
+                gdb_put_packet(stub, "OK");
+                stub->no_ack = true;
+                continue;
+            }
+            break;
+        default: break; // unsupported: empty reply
+        }
+        if (!gdb_put_packet(stub, reply)) {
+            break;
+        }
+    }
+out:
+    close(stub->fd);
+    free(stub);
+    return ret;
+}
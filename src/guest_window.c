@@ -0,0 +1,92 @@
+#include "guest_window.h"
+
+#include "arch.h"
+#include "common.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// the window the thread runs guest accesses in (NULL: none)
+static __thread GuestWindow *current_window;
+
+static struct sigaction previous_action;
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+
+static void GuestWindow_handler(int sig, siginfo_t *info, void *context) {
+    GuestWindow *window = current_window;
+    byte_t *addr        = info->si_addr;
+    if (window != NULL && addr >= window->base && addr < window->base + GUEST_WINDOW_SIZE) {
+        window->fault_addr = (addr_t)(addr - window->base);
+        siglongjmp(window->recover, 1);
+    }
+
+    // not a guest access: whoever handled SIGSEGV before does
+    if (previous_action.sa_flags & SA_SIGINFO) {
+        previous_action.sa_sigaction(sig, info, context);
+    } else if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN) {
+        previous_action.sa_handler(sig);
+    } else {
+        // the access faults again on return, and kills the process
+        signal(sig, SIG_DFL);
+    }
+}
+
+static void GuestWindow_install(void) {
+    // SA_NODEFER: the handler leaves with siglongjmp() and SIGSEGV must not
+    // stay blocked (recover does not save the mask, it is cheaper)
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = GuestWindow_handler;
+    action.sa_flags     = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    Assert(sigaction(SIGSEGV, &action, &previous_action) == 0, "Fail to handle SIGSEGV");
+}
+
+/* --------------------------- ctor / dtor --------------------------- */
+int GuestWindow_ctor(GuestWindow *self) {
+    assert(self != NULL);
+    memset(self, 0, sizeof(GuestWindow));
+    if (sizeof(void *) < 8) {
+        return -1;
+    }
+    // address space only: pages are committed as the memories are touched
+    void *base = mmap(NULL, GUEST_WINDOW_SIZE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    self->base = base;
+    pthread_once(&handler_once, GuestWindow_install);
+    return 0;
+}
+
+void GuestWindow_dtor(GuestWindow *self) {
+    assert(self != NULL);
+    munmap(self->base, GUEST_WINDOW_SIZE);
+}
+
+byte_t *GuestWindow_map(GuestWindow *self, addr_t addr, size_t size, bool writable) {
+    assert(self != NULL);
+    Assert((uint64_t)addr + size <= GUEST_WINDOW_SIZE, "0x%" PRIxREG " is out of the window",
+           (reg_t)addr);
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    Assert(mprotect(self->base + addr, size, prot) == 0, "Fail to map 0x%" PRIxREG " in the window",
+           (reg_t)addr);
+    return self->base + addr;
+}
+
+/* ------------------------------ runs ------------------------------- */
+void GuestWindow_enter(GuestWindow *self) {
+    current_window = self;
+}
+
+void GuestWindow_leave(GuestWindow *self) {
+    (void)self;
+    current_window = NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef __GUEST_WINDOW_H__
+#define __GUEST_WINDOW_H__
+
+#include "arch.h"
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// guest physical addresses [0, GUEST_WINDOW_SIZE) are mirrored
+#define GUEST_WINDOW_SIZE ((size_t)1 << 32)
+
+/*
+ * A host reservation mirroring the 32-bit guest physical address space, for
+ * running RAM accesses unchecked: guest address a is at base + a. Only the
+ * memories placed in it with GuestWindow_map() are accessible; every other
+ * page is PROT_NONE and so guards them. A host access to a guard page while
+ * the window is entered raises SIGSEGV, whose handler records the guest
+ * address and jumps back to the sigsetjmp() of recover; a fault elsewhere is
+ * passed on to the handler installed before (or is fatal as usual).
+ */
+typedef struct {
+    byte_t *base;       // guest address 0 on the host
+    sigjmp_buf recover; // where a fault in the window goes
+    addr_t fault_addr;  // guest address of the last fault
+} GuestWindow;
+
+// reserve the window (needs a 64-bit host), install the SIGSEGV handler once
+extern int GuestWindow_ctor(GuestWindow *self);
+extern void GuestWindow_dtor(GuestWindow *self);
+// make the guest range [addr, addr + size) (page aligned) accessible, or
+// read-only unless writable, and return its host address
+extern byte_t *GuestWindow_map(GuestWindow *self, addr_t addr, size_t size, bool writable);
+// the calling thread runs guest accesses in the window until leave, faults
+// in the window go to recover then
+extern void GuestWindow_enter(GuestWindow *self);
+extern void GuestWindow_leave(GuestWindow *self);
+
+#endif
@@ -14,7 +14,7 @@ DECLARE_ABSTRACT_MEM_LOAD(Halt) {
 
     // load into buffer
     Halt *self_ = container_of(self, Halt, super);
-    buffer[0]   = (byte_t)self_->halt_flag;
+    buffer[0]   = (byte_t)__atomic_load_n(&self_->halt_flag, __ATOMIC_ACQUIRE);
 }
 
 DECLARE_ABSTRACT_MEM_STORE(Halt) {
@@ -23,9 +23,14 @@ DECLARE_ABSTRACT_MEM_STORE(Halt) {
     Assert(base_addr + length <= HALT_SIZE, "");
     Assert(length == 1, "");
 
-    // load ref_data into Halt internal flag
-    Halt *self_      = container_of(self, Halt, super);
-    self_->halt_flag = (bool)(ref_data[0] & 0x1);
+    // load ref_data into Halt internal flag (atomic: other harts poll it)
+    Halt *self_ = container_of(self, Halt, super);
+    __atomic_store_n(&self_->halt_flag, (bool)(ref_data[0] & 0x1), __ATOMIC_RELEASE);
+}
+
+DECLARE_ABSTRACT_MEM_ACCEPTS(Halt) {
+    (void)self, (void)base_addr, (void)write;
+    return length == 1;
 }
 
 void Halt_ctor(Halt *self) {
@@ -33,7 +38,9 @@ void Halt_ctor(Halt *self) {
 
     AbstractMem_ctor(&self->super);
     static struct AbstractMemVtbl const vtbl = {
-        .load = &SIGNATURE_ABSTRACT_MEM_LOAD(Halt), .store = &SIGNATURE_ABSTRACT_MEM_STORE(Halt)
+        .load    = &SIGNATURE_ABSTRACT_MEM_LOAD(Halt),
+        .store   = &SIGNATURE_ABSTRACT_MEM_STORE(Halt),
+        .accepts = &SIGNATURE_ABSTRACT_MEM_ACCEPTS(Halt)
     };
     self->super.vtbl = &vtbl;
 
@@ -0,0 +1,236 @@
+#include "host_perf.h"
+
+#include "common.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_PERF_CALIBRATION 64 // readings the bias is the minimum of
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} host_events[HOST_COUNTER_NUM] = {
+    [HOST_CYCLES]        = { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [HOST_INSTRUCTIONS]  = { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [HOST_BRANCH_MISSES] = { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [HOST_CACHE_MISSES]  = { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static const char *const phase_name[HOST_PHASE_NUM] = {
+    "elf load", "fetch", "decode", "execute", "mem dispatch", "device tick",
+};
+
+/* ----------------------------- reading ----------------------------- */
+static long perf_event_open(struct perf_event_attr *attr, int group_fd) {
+    // this thread, any CPU
+    return syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t rdpmc(uint32_t counter) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+    return (uint64_t)hi << 32 | lo;
+}
+
+// the user-space read of the event behind page (see perf_event_open(2)),
+// false if the event is not on a counter right now
+static inline bool HostPerf_rdpmc(void *page, uint64_t *value) {
+    volatile struct perf_event_mmap_page *pc = page;
+    uint32_t seq, index;
+    uint64_t count;
+    do {
+        seq = pc->lock;
+        __asm__ volatile("" ::: "memory");
+        index = pc->index;
+        count = pc->offset;
+        if (index != 0) {
+            unsigned shift = 64 - pc->pmc_width;
+            count += (uint64_t)((int64_t)(rdpmc(index - 1) << shift) >> shift);
+        }
+        __asm__ volatile("" ::: "memory");
+    } while (pc->lock != seq);
+    *value = count;
+    return index != 0;
+}
+#else
+static inline bool HostPerf_rdpmc(void *page, uint64_t *value) {
+    (void)page;
+    (void)value;
+    return false;
+}
+#endif
+
+static inline void HostPerf_read(HostPerf *self, uint64_t *values) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    values[HOST_NS] = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+
+    for (int c = HOST_CYCLES; c < HOST_COUNTER_NUM; c++) {
+        if (self->fd[c] < 0 ||
+            (!(self->rdpmc && HostPerf_rdpmc(self->page[c], &values[c])) &&
+             read(self->fd[c], &values[c], sizeof(uint64_t)) != sizeof(uint64_t))) {
+            values[c] = 0; // not counted: charged nothing
+        }
+    }
+}
+
+void HostPerf_boundary(HostPerf *self) {
+    uint64_t now[HOST_COUNTER_NUM];
+    HostPerf_read(self, now);
+    if (self->depth > 0) {
+        host_phase_t p = self->stack[self->depth - 1];
+        for (int c = 0; c < HOST_COUNTER_NUM; c++) {
+            self->phase[p][c] += now[c] - self->last[c];
+        }
+        self->intervals[p]++;
+    }
+    memcpy(self->last, now, sizeof(now));
+}
+
+/* --------------------------- ctor / dtor --------------------------- */
+void HostPerf_ctor(HostPerf *self) {
+    assert(self != NULL);
+    memset(self, 0, sizeof(HostPerf));
+    self->group_fd  = -1;
+    self->rdpmc     = true;
+    self->countdown = 1;
+    self->rng       = 0x9e3779b97f4a7c15ull;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    self->fd[HOST_NS] = -1;
+    for (int c = HOST_CYCLES; c < HOST_COUNTER_NUM; c++) {
+        struct perf_event_attr attr = {
+            .size           = sizeof(struct perf_event_attr),
+            .type           = host_events[c].type,
+            .config         = host_events[c].config,
+            .exclude_kernel = 1, // the reads themselves are not counted
+            .exclude_hv     = 1,
+        };
+        self->fd[c] = (int)perf_event_open(&attr, self->group_fd);
+        if (self->fd[c] < 0) {
+            fprintf(stderr, "[HOSTPERF] %s not counted: %s\n", host_events[c].name,
+                    strerror(errno));
+            continue;
+        }
+        if (self->group_fd < 0) {
+            self->group_fd = self->fd[c];
+        }
+        self->page[c] = mmap(NULL, (size_t)page_size, PROT_READ, MAP_SHARED, self->fd[c], 0);
+        if (self->page[c] == MAP_FAILED) {
+            self->page[c] = NULL;
+        }
+        self->rdpmc = self->rdpmc && self->page[c] != NULL &&
+                      ((struct perf_event_mmap_page *)self->page[c])->cap_user_rdpmc;
+    }
+
+    // the cost of a reading: the least two back-to-back readings differ by
+    uint64_t a[HOST_COUNTER_NUM], b[HOST_COUNTER_NUM];
+    memset(self->bias, 0xff, sizeof(self->bias));
+    for (int i = 0; i < HOST_PERF_CALIBRATION; i++) {
+        HostPerf_read(self, a);
+        HostPerf_read(self, b);
+        for (int c = 0; c < HOST_COUNTER_NUM; c++) {
+            self->bias[c] = (b[c] - a[c] < self->bias[c]) ? b[c] - a[c] : self->bias[c];
+        }
+    }
+}
+
+void HostPerf_dtor(HostPerf *self) {
+    assert(self != NULL);
+    long page_size = sysconf(_SC_PAGESIZE);
+    for (int c = HOST_CYCLES; c < HOST_COUNTER_NUM; c++) {
+        if (self->page[c] != NULL) {
+            munmap(self->page[c], (size_t)page_size);
+        }
+        if (self->fd[c] >= 0) {
+            close(self->fd[c]);
+        }
+    }
+}
+
+/* ------------------------------ runs ------------------------------- */
+void HostPerf_run_begin(HostPerf *self, uint64_t instret) {
+    self->run_instret = instret;
+    HostPerf_read(self, self->run_start);
+}
+
+void HostPerf_run_end(HostPerf *self, uint64_t instret) {
+    uint64_t now[HOST_COUNTER_NUM];
+    HostPerf_read(self, now);
+    for (int c = 0; c < HOST_COUNTER_NUM; c++) {
+        self->run[c] += now[c] - self->run_start[c];
+    }
+    self->guest_insts += instret - self->run_instret;
+}
+
+void HostPerf_once_begin(HostPerf *self) {
+    HostPerf_read(self, self->last);
+}
+
+void HostPerf_once_end(HostPerf *self, host_phase_t phase) {
+    self->stack[0] = phase;
+    self->depth    = 1;
+    HostPerf_boundary(self);
+    self->depth = 0;
+}
+
+/* ----------------------------- report ------------------------------ */
+// one row: counters per n guest instructions, with the bias of intervals
+// readings taken off
+static void HostPerf_row(const HostPerf *self, const char *name, const uint64_t *counters,
+                         uint64_t intervals, double n) {
+    double v[HOST_COUNTER_NUM];
+    for (int c = 0; c < HOST_COUNTER_NUM; c++) {
+        uint64_t bias = self->bias[c] * intervals;
+        v[c]          = (double)(counters[c] > bias ? counters[c] - bias : 0) / n;
+    }
+    fprintf(stderr, "[HOSTPERF] %-13s %10.2f", name, v[HOST_NS]);
+    for (int c = HOST_CYCLES; c < HOST_COUNTER_NUM; c++) {
+        if (self->fd[c] >= 0) {
+            fprintf(stderr, " %12.2f", v[c]);
+        } else {
+            fprintf(stderr, " %12s", "n/a");
+        }
+    }
+    if (self->fd[HOST_CYCLES] >= 0 && self->fd[HOST_INSTRUCTIONS] >= 0 && v[HOST_CYCLES] > 0) {
+        fprintf(stderr, " %6.2f\n", v[HOST_INSTRUCTIONS] / v[HOST_CYCLES]);
+    } else {
+        fprintf(stderr, " %6s\n", "n/a");
+    }
+}
+
+void HostPerf_report(const HostPerf *self) {
+    assert(self != NULL);
+    fprintf(stderr, "[HOSTPERF] %-13s %10s %12s %12s %12s %12s %6s\n", "", "ns",
+            host_events[HOST_CYCLES].name, host_events[HOST_INSTRUCTIONS].name,
+            host_events[HOST_BRANCH_MISSES].name, host_events[HOST_CACHE_MISSES].name, "IPC");
+    HostPerf_row(self, phase_name[HOST_PHASE_ELF_LOAD], self->phase[HOST_PHASE_ELF_LOAD],
+                 self->intervals[HOST_PHASE_ELF_LOAD], 1.0);
+    if (self->guest_insts == 0) {
+        return;
+    }
+
+    // per guest instruction: the whole run, then the measured phases
+    fprintf(stderr, "[HOSTPERF] per guest instruction (%llu retired, %llu measured):\n",
+            (unsigned long long)self->guest_insts, (unsigned long long)self->sampled);
+    HostPerf_row(self, "step loop", self->run, 0, (double)self->guest_insts);
+    if (self->sampled == 0) {
+        return;
+    }
+    for (int p = HOST_PHASE_FETCH; p < HOST_PHASE_NUM; p++) {
+        HostPerf_row(self, phase_name[p], self->phase[p], self->intervals[p],
+                     (double)self->sampled);
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef __HOST_PERF_H__
+#define __HOST_PERF_H__
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// what the simulator is doing on the host
+typedef enum {
+    HOST_PHASE_ELF_LOAD = 0, // load_elf() in the ctor
+    HOST_PHASE_FETCH,        // Core_fetch() less its memory access
+    HOST_PHASE_DECODE,       // Core_decode()
+    HOST_PHASE_EXECUTE,      // Core_execute() less its memory accesses
+    HOST_PHASE_MEM_DISPATCH, // address translation and MMIO device dispatch
+    HOST_PHASE_DEVICE_TICK,  // ticks of the devices in the step loop
+    HOST_PHASE_NUM,
+} host_phase_t;
+
+// what is counted on the host
+typedef enum {
+    HOST_NS = 0,          // CLOCK_MONOTONIC, always there
+    HOST_CYCLES,          // the rest come from perf_event_open()
+    HOST_INSTRUCTIONS,
+    HOST_BRANCH_MISSES,
+    HOST_CACHE_MISSES,
+    HOST_COUNTER_NUM,
+} host_counter_t;
+
+#define HOST_PERF_MAX_DEPTH 4  // phases nest (memory dispatch in execute)
+#define HOST_PERF_PERIOD    64 // mean distance of the sampled instructions
+
+/*
+ * Host hardware counters attributed to the phases of the simulator, for
+ * telling where the host time of a guest instruction goes. Only compiled in
+ * with the ISS_HOST_PERF CMake option: the hooks below are empty otherwise.
+ *
+ * The counters follow the thread that built the ISS. Reading them at every
+ * phase boundary of every instruction would cost more than the instruction,
+ * so one instruction in about HOST_PERF_PERIOD (at random distances, so that
+ * loops do not alias with the period) is measured, and the phase figures are
+ * averaged over the measured instructions. A phase is charged exclusively: an
+ * inner phase (the memory dispatch of a load) is not counted in the outer
+ * one (execute). The cost of one reading, measured by the ctor, is taken off
+ * every charged interval. Whole ISS_step() calls are counted without sampling
+ * for the host IPC and the cost per guest instruction.
+ */
+typedef struct {
+    int fd[HOST_COUNTER_NUM];     // perf event of the counter (-1: not counted)
+    void *page[HOST_COUNTER_NUM]; // its mmap'd page, for rdpmc (NULL: read())
+    int group_fd;                 // leader of the group of the events
+    bool rdpmc;                   // every event can be read with rdpmc
+    uint64_t bias[HOST_COUNTER_NUM]; // cost of one reading
+
+    bool sampling;     // the current instruction is measured
+    uint64_t countdown; // instructions until the next sampled one
+    uint64_t rng;
+    host_phase_t stack[HOST_PERF_MAX_DEPTH];
+    unsigned depth;
+    uint64_t last[HOST_COUNTER_NUM]; // reading at the last phase boundary
+
+    uint64_t phase[HOST_PHASE_NUM][HOST_COUNTER_NUM];
+    uint64_t intervals[HOST_PHASE_NUM]; // charged intervals of the phase
+    uint64_t sampled;                   // instructions measured
+
+    uint64_t run_start[HOST_COUNTER_NUM];
+    uint64_t run_instret;
+    uint64_t run[HOST_COUNTER_NUM]; // whole ISS_step() calls
+    uint64_t guest_insts;           // retired in them
+} HostPerf;
+
+// open the counters of the calling thread (those the host does not have are
+// left out, the time is always counted)
+extern void HostPerf_ctor(HostPerf *self);
+extern void HostPerf_dtor(HostPerf *self);
+// print the phase breakdown to stderr
+extern void HostPerf_report(const HostPerf *self);
+
+// an ISS_step() call starts / ends, instret is that of the hart
+extern void HostPerf_run_begin(HostPerf *self, uint64_t instret);
+extern void HostPerf_run_end(HostPerf *self, uint64_t instret);
+// measure phase once, outside of the guest instructions (the ELF load)
+extern void HostPerf_once_begin(HostPerf *self);
+extern void HostPerf_once_end(HostPerf *self, host_phase_t phase);
+
+// charge the counters since the last boundary to the current phase
+extern void HostPerf_boundary(HostPerf *self);
+
+// a guest instruction starts: decide whether it is measured
+static inline void HostPerf_inst(HostPerf *self) {
+    if (likely(--self->countdown != 0)) {
+        self->sampling = false;
+        return;
+    }
+    self->rng ^= self->rng << 13;
+    self->rng ^= self->rng >> 7;
+    self->rng ^= self->rng << 17;
+    self->countdown = 1 + self->rng % (2 * HOST_PERF_PERIOD - 1);
+    self->sampling  = true;
+    self->sampled++;
+}
+
+static inline void HostPerf_enter(HostPerf *self, host_phase_t phase) {
+    if (unlikely(self->sampling)) {
+        HostPerf_boundary(self);
+        self->stack[self->depth++] = phase;
+    }
+}
+
+static inline void HostPerf_leave(HostPerf *self) {
+    if (unlikely(self->sampling)) {
+        HostPerf_boundary(self);
+        self->depth--;
+    }
+}
+
+// the hooks in the simulator, empty unless built with ISS_HOST_PERF
+#ifdef ISS_HOST_PERF
+#define HOST_PERF_INST(perf)               HostPerf_inst(perf)
+#define HOST_PERF_ENTER(perf, phase)       HostPerf_enter((perf), (phase))
+#define HOST_PERF_LEAVE(perf)              HostPerf_leave(perf)
+#define HOST_PERF_ONCE_BEGIN(perf)         HostPerf_once_begin(perf)
+#define HOST_PERF_ONCE_END(perf, phase)    HostPerf_once_end((perf), (phase))
+#define HOST_PERF_RUN_BEGIN(perf, instret) HostPerf_run_begin((perf), (instret))
+#define HOST_PERF_RUN_END(perf, instret)   HostPerf_run_end((perf), (instret))
+#else
+#define HOST_PERF_INST(perf)               ((void)0)
+#define HOST_PERF_ENTER(perf, phase)       ((void)0)
+#define HOST_PERF_LEAVE(perf)              ((void)0)
+#define HOST_PERF_ONCE_BEGIN(perf)         ((void)0)
+#define HOST_PERF_ONCE_END(perf, phase)    ((void)0)
+#define HOST_PERF_RUN_BEGIN(perf, instret) ((void)0)
+#define HOST_PERF_RUN_END(perf, instret)   ((void)0)
+#endif
+
+#endif
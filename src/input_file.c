@@ -0,0 +1,202 @@
+#include "input_file.h"
+
+#include "abstract_mem.h"
+#include "common.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// file offset of a window address
+static inline uint64_t InputFile_window_offset(const InputFile *self, addr_t base_addr) {
+    return (uint64_t)self->window * INPUT_WINDOW_SIZE + base_addr;
+}
+
+// copy file bytes [offset, offset + length) into buffer, zeros past the end
+static void InputFile_read(const InputFile *self, uint64_t offset, unsigned length, byte_t *buffer) {
+    unsigned n = 0;
+    if (offset < self->size) {
+        n = (self->size - offset < length) ? (unsigned)(self->size - offset) : length;
+        memcpy(buffer, &self->data[offset], n);
+    }
+    memset(&buffer[n], 0, length - n);
+}
+
+/* ------------------------- register block -------------------------- */
+DECLARE_ABSTRACT_MEM_LOAD(InputFile) {
+    Assert(self != NULL, "");
+    Assert(base_addr + length <= INPUT_FILE_SIZE, "");
+
+    // DATA streams 1, 2 or 4 bytes out of the file
+    InputFile *self_ = container_of(self, InputFile, regs_super);
+    if (base_addr == INPUT_REG_DATA) {
+        Assert(length == 1 || length == 2 || length == 4, "");
+        InputFile_read(self_, self_->cursor, length, buffer);
+        self_->cursor += length;
+        return;
+    }
+
+    Assert(length == 4 && (base_addr & 0x3) == 0, "InputFile registers only support word access");
+    reg_t value = 0;
+    switch (base_addr) {
+    case INPUT_REG_SIZE_LO:   value = (reg_t)self_->size;            break;
+    case INPUT_REG_SIZE_HI:   value = (reg_t)(self_->size >> 32);    break;
+    case INPUT_REG_WINDOW:    value = self_->window;                 break;
+    case INPUT_REG_CURSOR_LO: value = (reg_t)self_->cursor;          break;
+    case INPUT_REG_CURSOR_HI: value = (reg_t)(self_->cursor >> 32);  break;
+    case INPUT_REG_STATUS:
+        value = (self_->cursor >= self_->size) ? INPUT_STATUS_EOF : 0;
+        break;
+    default: value = 0; break;
+    }
+    for (int i = 0; i < 4; i++) {
+        buffer[i] = (byte_t)(value >> (8 * i));
+    }
+}
+
+DECLARE_ABSTRACT_MEM_STORE(InputFile) {
+    Assert(self != NULL, "");
+    Assert(base_addr + length <= INPUT_FILE_SIZE, "");
+    Assert(length == 4 && (base_addr & 0x3) == 0, "InputFile registers only support word access");
+
+    InputFile *self_ = container_of(self, InputFile, regs_super);
+    uint64_t value   = (uint64_t)ref_data[0] | ((uint64_t)ref_data[1] << 8) |
+                     ((uint64_t)ref_data[2] << 16) | ((uint64_t)ref_data[3] << 24);
+    switch (base_addr) {
+    case INPUT_REG_WINDOW: self_->window = (reg_t)value; break;
+    case INPUT_REG_CURSOR_LO:
+        self_->cursor = (self_->cursor & 0xffffffff00000000ull) | value;
+        break;
+    case INPUT_REG_CURSOR_HI:
+        self_->cursor = (self_->cursor & 0xffffffffull) | (value << 32);
+        break;
+    default: break; // read-only registers
+    }
+}
+
+/* ----------------------------- window ------------------------------ */
+// DATA reads 1, 2 or 4 bytes, the other registers are words
+DECLARE_ABSTRACT_MEM_ACCEPTS(InputFile) {
+    (void)self;
+    if (base_addr == INPUT_REG_DATA && !write) {
+        return length == 1 || length == 2 || length == 4;
+    }
+    return length == 4 && (base_addr & 0x3) == 0;
+}
+
+static DECLARE_ABSTRACT_MEM_LOAD(InputWindow) {
+    Assert(self != NULL, "");
+    Assert(base_addr + length <= INPUT_WINDOW_SIZE, "");
+
+    InputFile *self_ = container_of(self, InputFile, window_super);
+    InputFile_read(self_, InputFile_window_offset(self_, base_addr), length, buffer);
+}
+
+static DECLARE_ABSTRACT_MEM_STORE(InputWindow) {
+    Panic("The input window should not be modified!");
+}
+
+static DECLARE_ABSTRACT_MEM_ACCEPTS(InputWindow) {
+    (void)self, (void)base_addr, (void)length;
+    return !write;
+}
+
+static DECLARE_ABSTRACT_MEM_HOST_PTR(InputWindow) {
+    Assert(self != NULL, "");
+    // the file is mapped read-only and the window takes no stores
+    // the file is mapped read-only, and stores to the window are dropped
+    if (write) {
+        return NULL;
+    }
+
+    // zero-copy access for ranges inside the file
+    InputFile *self_ = container_of(self, InputFile, window_super);
+    uint64_t offset  = InputFile_window_offset(self_, base_addr);
+    if (offset > self_->size || self_->size - offset < length) {
+        return NULL;
+    }
+    return (byte_t *)&self_->data[offset];
+}
+
+/* ---------------------------- ctor/dtor ---------------------------- */
+int InputFile_ctor(InputFile *self, const char *file_name) {
+    assert(self != NULL);
+
+    // AbstractMem vtable initialization
+    AbstractMem_ctor(&self->regs_super);
+    static struct AbstractMemVtbl const regs_vtbl = {
+        .load    = &SIGNATURE_ABSTRACT_MEM_LOAD(InputFile),
+        .store   = &SIGNATURE_ABSTRACT_MEM_STORE(InputFile),
+        .accepts = &SIGNATURE_ABSTRACT_MEM_ACCEPTS(InputFile)
+    };
+    self->regs_super.vtbl = &regs_vtbl;
+
+    AbstractMem_ctor(&self->window_super);
+    static struct AbstractMemVtbl const window_vtbl = {
+        .load     = &SIGNATURE_ABSTRACT_MEM_LOAD(InputWindow),
+        .store    = &SIGNATURE_ABSTRACT_MEM_STORE(InputWindow),
+        .host_ptr = &SIGNATURE_ABSTRACT_MEM_HOST_PTR(InputWindow),
+        .accepts  = &SIGNATURE_ABSTRACT_MEM_ACCEPTS(InputWindow)
+    };
+    self->window_super.vtbl = &window_vtbl;
+
+    self->data   = NULL;
+    self->size   = 0;
+    self->mapped = false;
+    self->window = 0;
+    self->cursor = 0;
+    if (file_name == NULL) {
+        return 0;
+    }
+
+    // map the whole file; pages are only read in when the guest touches them
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Fail to open input file %s: %s\n", file_name, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "Fail to stat input file %s: %s\n", file_name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    self->size = (uint64_t)st.st_size;
+    if (self->size > 0) {
+        void *data = mmap(NULL, self->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "Fail to map input file %s: %s\n", file_name, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        madvise(data, self->size, MADV_SEQUENTIAL);
+        self->data   = data;
+        self->mapped = true;
+    }
+    close(fd); // the mapping stays valid
+    return 0;
+}
+
+void InputFile_dtor(InputFile *self) {
+    assert(self != NULL);
+    if (self->mapped) {
+        munmap((void *)self->data, self->size);
+    }
+}
+
+void InputFile_set_data(InputFile *self, const byte_t *data, uint64_t size) {
+    assert((self != NULL) && (data != NULL || size == 0));
+    InputFile_dtor(self);
+    self->data   = data;
+    self->size   = size;
+    self->mapped = false;
+    self->window = 0;
+    self->cursor = 0;
+}
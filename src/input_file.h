@@ -0,0 +1,52 @@
+#ifndef __INPUT_FILE_H__
+#define __INPUT_FILE_H__
+
+#include "arch.h"
+#include "abstract_mem.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// register block
+#define INPUT_FILE_MMAP_BASE 0xffffff40
+#define INPUT_FILE_SIZE 0x20
+// read-only window onto the file
+#define INPUT_WINDOW_MMAP_BASE 0x40000000
+#define INPUT_WINDOW_SIZE 0x10000000
+
+// register offsets (32-bit registers)
+#define INPUT_REG_SIZE_LO 0x00   // file size in bytes
+#define INPUT_REG_SIZE_HI 0x04
+#define INPUT_REG_WINDOW 0x08    // the window shows file offset WINDOW * INPUT_WINDOW_SIZE
+#define INPUT_REG_CURSOR_LO 0x0c // file offset of the next DATA read
+#define INPUT_REG_CURSOR_HI 0x10
+#define INPUT_REG_DATA 0x14      // 1/2/4-byte read at CURSOR, advances CURSOR
+#define INPUT_REG_STATUS 0x18    // INPUT_STATUS_*
+
+#define INPUT_STATUS_EOF 0x1 // CURSOR has reached the end of the file
+
+typedef struct {
+    // derived base classes: the register block and the window are two
+    // separate devices in the memory map
+    AbstractMem regs_super;
+    AbstractMem window_super;
+
+    // the host file, mapped read-only (or a caller-owned buffer)
+    const byte_t *data;
+    uint64_t size;
+    bool mapped; // data is our own mapping
+
+    // registers
+    reg_t window;
+    uint64_t cursor;
+} InputFile;
+
+// return -1 if the file cannot be opened or mapped, file_name may be NULL for
+// an empty device whose contents are set later
+extern int InputFile_ctor(InputFile *self, const char *file_name);
+extern void InputFile_dtor(InputFile *self);
+// serve a caller-owned buffer (e.g. a fuzzer test case) instead of the file,
+// the buffer must stay valid until the next call or the dtor
+extern void InputFile_set_data(InputFile *self, const byte_t *data, uint64_t size);
+
+#endif
@@ -0,0 +1,125 @@
+#include "input_log.h"
+
+#include "abstract_mem.h"
+#include "arch.h"
+#include "common.h"
+#include "halt.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define INPUT_LOG_MAGIC "ISSINPT1"
+
+static const char *const input_kind_name[] = { "device load", "host time", "syscall",
+                                               "syscall data" };
+
+int InputLog_ctor(InputLog *self,
+                  const char *file_name,
+                  bool replay,
+                  const uint64_t *instret,
+                  Halt *halt) {
+    assert((self != NULL) && (file_name != NULL) && (instret != NULL) && (halt != NULL));
+    self->replay   = replay;
+    self->diverged = false;
+    self->instret  = instret;
+    self->last     = *instret;
+    self->halt     = halt;
+
+    self->file = fopen(file_name, replay ? "rb" : "wb");
+    if (self->file == NULL) {
+        fprintf(stderr, "Fail to open input log %s: %s\n", file_name, strerror(errno));
+        return -1;
+    }
+    char magic[8];
+    if (!replay) {
+        fwrite(INPUT_LOG_MAGIC, 1, sizeof(magic), self->file);
+    } else if (fread(magic, 1, sizeof(magic), self->file) != sizeof(magic) ||
+               memcmp(magic, INPUT_LOG_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s is not an input log\n", file_name);
+        fclose(self->file);
+        return -1;
+    }
+    return 0;
+}
+
+void InputLog_dtor(InputLog *self) {
+    assert(self != NULL);
+    if (fclose(self->file) != 0 && !self->replay) {
+        fprintf(stderr, "Fail to write the input log: %s\n", strerror(errno));
+    }
+}
+
+/* ----------------------------- entries ----------------------------- */
+static void InputLog_put_varint(InputLog *self, uint64_t v) {
+    for (; v >= 0x80; v >>= 7) {
+        putc((int)(v & 0x7f) | 0x80, self->file);
+    }
+    putc((int)v, self->file);
+}
+
+static bool InputLog_get_varint(InputLog *self, uint64_t *v) {
+    *v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int c = getc(self->file);
+        if (c == EOF) {
+            return false;
+        }
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the next entry of the log is kind with length bytes at the current
+// instruction: read them into buffer
+static bool InputLog_replay(InputLog *self, uint64_t index, uint64_t tag, void *buffer,
+                            unsigned length) {
+    uint64_t delta, entry_tag;
+    if (!InputLog_get_varint(self, &delta) || !InputLog_get_varint(self, &entry_tag)) {
+        return false;
+    }
+    return self->last + delta == index && entry_tag == tag &&
+           fread(buffer, 1, length, self->file) == length;
+}
+
+void InputLog_input(InputLog *self, input_kind_t kind, void *buffer, unsigned length) {
+    uint64_t index = *self->instret;
+    uint64_t tag   = ((uint64_t)length << 2) | kind;
+    if (!self->replay) {
+        InputLog_put_varint(self, index - self->last);
+        InputLog_put_varint(self, tag);
+        fwrite(buffer, 1, length, self->file);
+        self->last = index;
+        return;
+    }
+    if (likely(!self->diverged) && InputLog_replay(self, index, tag, buffer, length)) {
+        self->last = index;
+        return;
+    }
+
+    // stop at the first input the recorded run did not take
+    memset(buffer, 0, length);
+    if (!self->diverged) {
+        self->diverged = true;
+        fprintf(stderr, "Replay diverged: no %s input of %u bytes at instruction %llu\n",
+                input_kind_name[kind], length, (unsigned long long)index);
+        __atomic_store_n(&self->halt->halt_flag, true, __ATOMIC_RELEASE);
+    }
+}
+
+void InputLog_load(InputLog *self,
+                   const AbstractMem *device,
+                   addr_t offset,
+                   unsigned length,
+                   byte_t *buffer) {
+    if (!self->replay) {
+        AbstractMem_load(device, offset, length, buffer);
+    }
+    InputLog_input(self, INPUT_LOAD, buffer, length);
+}
@@ -0,0 +1,57 @@
+#ifndef __INPUT_LOG_H__
+#define __INPUT_LOG_H__
+
+#include "abstract_mem.h"
+#include "arch.h"
+#include "halt.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// where an input of the run comes from
+typedef enum {
+    INPUT_LOAD = 0,     // load of a nondeterministic device
+    INPUT_TIME,         // host clock behind the `time` CSR
+    INPUT_SYSCALL,      // return value of a syscall served on the host
+    INPUT_SYSCALL_DATA, // bytes such a syscall put into guest memory
+} input_kind_t;
+
+/*
+ * Log of the inputs a run takes from the host, for reproducing it bit-exactly.
+ * Recording appends every input with the retired-instruction count of hart 0
+ * it was taken at; replaying takes the inputs from the log instead of the
+ * host, in the same order. An entry is the varint of the instructions since
+ * the previous entry, the varint of (length << 2 | kind) and the bytes. A
+ * replay asking for an input the log does not have at that instruction (the
+ * run diverged, or went past the end of the log) gets zeros, sets diverged
+ * and raises the halt flag.
+ */
+typedef struct {
+    FILE *file;
+    bool replay;
+    bool diverged;
+    const uint64_t *instret; // index of the inputs
+    uint64_t last;           // index of the previous entry
+    Halt *halt;
+} InputLog;
+
+// record to (or replay from, if replay) file_name
+extern int InputLog_ctor(InputLog *self,
+                         const char *file_name,
+                         bool replay,
+                         const uint64_t *instret,
+                         Halt *halt);
+extern void InputLog_dtor(InputLog *self);
+// length bytes of kind at buffer came from the host (recording), or are
+// overwritten with the ones in the log (replaying)
+extern void InputLog_input(InputLog *self, input_kind_t kind, void *buffer, unsigned length);
+// a load of a nondeterministic device: done by the device and recorded, or
+// replayed without the device
+extern void InputLog_load(InputLog *self,
+                          const AbstractMem *device,
+                          addr_t offset,
+                          unsigned length,
+                          byte_t *buffer);
+
+#endif
@@ -68,7 +68,22 @@ typedef enum {
     JALR   = 0b1100111,
     AUIPC  = 0b0010111,
     LUI    = 0b0110111,
-    // SYSTEM = 0b1110011,
+    SYSTEM = 0b1110011,
+    AMO    = 0b0101111,
+    MISC_MEM = 0b0001111, // FENCE, FENCE.I
+    // RV64 only: 32-bit operations, sign-extending their results
+    OP_IMM_32 = 0b0011011,
+    OP_32     = 0b0111011,
+    // F and D extensions
+    LOAD_FP  = 0b0000111,
+    STORE_FP = 0b0100111,
+    MADD     = 0b1000011,
+    MSUB     = 0b1000111,
+    NMSUB    = 0b1001011,
+    NMADD    = 0b1001111,
+    OP_FP    = 0b1010011,
+    // V extension (vector loads/stores share LOAD_FP and STORE_FP)
+    OP_V     = 0b1010111,
 } OPCODE;
 
 typedef enum {
@@ -108,14 +123,82 @@ typedef enum {
     LWU_FUNC3 = 0b110,
 } LOAD_FUNC3;
 
-/*
 // Note that the SYSTEM type instructions use the I-Type format
 typedef enum {
-    ECALL_FUNC12 = 0b000000000000,
+    ECALL_FUNC12  = 0b000000000000,
     EBREAK_FUNC12 = 0b000000000001,
+    SRET_FUNC12   = 0b000100000010,
+    WFI_FUNC12    = 0b000100000101,
+    MRET_FUNC12   = 0b001100000010,
 } SYSTEM_FUNC12;
- */
 
+// sfence.vma rs1, rs2 (rs1: virtual address, x0 for all)
+#define SFENCE_VMA_FUNC7 0b0001001
+
+// Zicsr: the CSR address is in imm[11:0], the immediate forms take rs1 as zimm
+typedef enum {
+    CSRRW_FUNC3  = 0b001,
+    CSRRS_FUNC3  = 0b010,
+    CSRRC_FUNC3  = 0b011,
+    CSRRWI_FUNC3 = 0b101,
+    CSRRSI_FUNC3 = 0b110,
+    CSRRCI_FUNC3 = 0b111,
+} CSR_FUNC3;
+
+// A extension: funct5 is inst[31:27], inst[26:25] are the aq/rl bits
+typedef enum {
+    AMOADD_FUNC5  = 0b00000,
+    AMOSWAP_FUNC5 = 0b00001,
+    LR_FUNC5      = 0b00010,
+    SC_FUNC5      = 0b00011,
+    AMOXOR_FUNC5  = 0b00100,
+    AMOOR_FUNC5   = 0b01000,
+    AMOAND_FUNC5  = 0b01100,
+    AMOMIN_FUNC5  = 0b10000,
+    AMOMAX_FUNC5  = 0b10100,
+    AMOMINU_FUNC5 = 0b11000,
+    AMOMAXU_FUNC5 = 0b11100,
+} AMO_FUNC5;
+
+// F and D: OP-FP funct7 with the format (0: S, 1: D) in inst[26:25]; the
+// fused multiply-adds have their own opcodes and take the format there too
+typedef enum {
+    FADD_FUNC7     = 0b0000000,
+    FSUB_FUNC7     = 0b0000100,
+    FMUL_FUNC7     = 0b0001000,
+    FDIV_FUNC7     = 0b0001100,
+    FSQRT_FUNC7    = 0b0101100,
+    FSGNJ_FUNC7    = 0b0010000,
+    FMINMAX_FUNC7  = 0b0010100,
+    FCVT_FF_FUNC7  = 0b0100000, // FCVT.S.D / FCVT.D.S
+    FCMP_FUNC7     = 0b1010000,
+    FCVT_IF_FUNC7  = 0b1100000, // float to integer
+    FCVT_FI_FUNC7  = 0b1101000, // integer to float
+    FMV_XF_FUNC7   = 0b1110000, // FMV.X.W/D, FCLASS
+    FMV_FX_FUNC7   = 0b1111000, // FMV.W/D.X
+} FP_FUNC7;
+
+typedef enum {
+    FLW_FUNC3 = 0b010,
+    FLD_FUNC3 = 0b011,
+    // vector element widths 8, 16, 32 and 64
+    VLE8_FUNC3  = 0b000,
+    VLE16_FUNC3 = 0b101,
+    VLE32_FUNC3 = 0b110,
+    VLE64_FUNC3 = 0b111,
+} LOAD_FP_FUNC3;
+
+// funct3 of OP-V: operand categories
+typedef enum {
+    OPIVV_FUNC3 = 0b000, // integer, vector-vector
+    OPFVV_FUNC3 = 0b001,
+    OPMVV_FUNC3 = 0b010, // integer multiply/reduce/mask, vector-vector
+    OPIVI_FUNC3 = 0b011, // integer, vector-immediate
+    OPIVX_FUNC3 = 0b100, // integer, vector-scalar
+    OPFVF_FUNC3 = 0b101,
+    OPMVX_FUNC3 = 0b110,
+    OPCFG_FUNC3 = 0b111, // vsetvli, vsetivli, vsetvl
+} OP_V_FUNC3;
 
 /*
  * Enumerate 37 instructions in total
@@ -169,6 +252,58 @@ typedef enum {
     inst_auipc,
     // LUI
     inst_lui,
+    // SYSTEM
+    inst_ecall,
+    inst_ebreak,
+    // SYSTEM (Zicsr)
+    inst_csrrw,
+    inst_csrrs,
+    inst_csrrc,
+    inst_csrrwi,
+    inst_csrrsi,
+    inst_csrrci,
+    // AMO (A extension)
+    inst_lr_w,
+    inst_sc_w,
+    inst_amoswap_w,
+    inst_amoadd_w,
+    inst_amoxor_w,
+    inst_amoand_w,
+    inst_amoor_w,
+    inst_amomin_w,
+    inst_amomax_w,
+    inst_amominu_w,
+    inst_amomaxu_w,
+    // privileged
+    inst_mret,
+    inst_sret,
+    inst_wfi,
+    inst_sfence_vma,
+    // RV64I
+    inst_ld,
+    inst_lwu,
+    inst_sd,
+    inst_addiw,
+    inst_slliw,
+    inst_srliw,
+    inst_sraiw,
+    inst_addw,
+    inst_subw,
+    inst_sllw,
+    inst_srlw,
+    inst_sraw,
+    // F and D (decoded from the raw instruction by Core_execute_fp())
+    inst_flw,
+    inst_fsw,
+    inst_fld,
+    inst_fsd,
+    inst_fmadd,
+    inst_fmsub,
+    inst_fnmsub,
+    inst_fnmadd,
+    inst_op_fp,
+    // V (decoded from the raw instruction by Core_execute_vector())
+    inst_op_v,
 } inst_enum_t;
 
 #endif
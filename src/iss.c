@@ -3,6 +3,7 @@
 #include "common.h"
 #include "arch.h"
 #include "core.h"
+#include "inst.h"
 #include "load_elf.h"
 #include "mem_map.h"
 #include "tick.h"
@@ -10,11 +11,34 @@
 #include "rom.h"
 #include "halt.h"
 #include "text_buffer.h"
+#include "dma.h"
+#include "clint.h"
+#include "input_file.h"
+#include "input_log.h"
+#include "syscall_proxy.h"
+#include "cache.h"
+#include "timing.h"
+#include "locality.h"
+#include "bbv.h"
+#include "coverage.h"
+#include "debug.h"
+#include "undo.h"
+#include "guest_window.h"
+#include "host_perf.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <setjmp.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 struct iss {
     // core part (RISC-V processor)
@@ -25,32 +49,230 @@ struct iss {
     MainMem main_mem_mmio;
     TextBuffer text_buffer_mmio;
     Halt halt_mmio;
+    DMA dma_mmio;
+    CLINT clint_mmio;
+    InputFile input_file_mmio;
+    bool has_input_file;
+
+    // host services
+    SyscallProxy syscall_proxy;
+
+    // optional models
+    CacheSim cache_sim;
+    bool has_cache_sim;
+    Timing timing;
+    bool has_timing;
+    Locality locality;
+    bool has_locality;
+    BBV bbv;
+    bool has_bbv;
+    const char *state_image; // written when the BBV stops the run
+
+    iss_config_t config; // for the workers of ISS_run_sampled()
+
+    // fuzzing support
+    Coverage coverage;
+    bool has_coverage;
+    iss_state_image_t *reset_image; // state right after the ctor
+
+    // debugger break/watchpoints, attached to every hart
+    Debug debug;
+    // reverse execution
+    UndoLog undo;
+    bool has_undo;
+    // deterministic record/replay of the host inputs
+    InputLog input_log;
+    bool has_input_log;
+    // unchecked RAM accesses of fast_mem
+    GuestWindow guest_window;
+    bool has_guest_window;
+    // host wall time in ISS_step(), see ISS_get_stats()
+    uint64_t step_ns;
+#ifdef ISS_HOST_PERF
+    // host counters of the simulator phases
+    HostPerf host_perf;
+#endif
+
+    // harts 1..num_harts-1 (hart 0 is `core`), see ISS_step_harts()
+    Core *harts;
+    unsigned num_harts;
+    unsigned long hart_quantum;
+    pthread_t *hart_threads; // harts 1.. on threads of their own (NULL: off)
+    struct iss_hart_arg *hart_args;
+    pthread_barrier_t hart_barrier;
+    unsigned long quantum_steps; // instructions of the current quantum (0: stop)
+    unsigned long steps_left;    // instructions per hart left in ISS_step()
+    bool harts_exit;             // the threads return at the next quantum
+};
+
+// what a hart thread runs
+struct iss_hart_arg {
+    ISS *iss;
+    unsigned hart;
+};
+
+#define ISS_STATE_MAGIC "ISSSTAT6"
+
+// a flat copy of the state, so that images are only portable between
+// identical builds (the magic guards against reading garbage)
+struct iss_state_image {
+    char magic[8];
+    unsigned num_harts;
+    struct {
+        arch_state_t arch_state;
+        uint64_t instret;
+        uint64_t extra_cycles;
+        priv_state_t priv;
+        uint64_t timecmp;
+        VectorState vec;
+    } hart[ISS_MAX_HARTS];
+
+    // memories
+    byte_t rom[ROM_SIZE];
+    byte_t main_mem[MAIN_MEM_SIZE];
+
+    // device registers
+    bool text_buffer_valid;
+    byte_t text_buffer;
+    reg_t dma_src, dma_dst, dma_len, dma_ctrl, dma_fill, dma_status;
+    unsigned long dma_remaining_ticks;
+    reg_t input_file_window;
+    uint64_t input_file_cursor;
+    addr_t brk;
 };
 
+void ISS_config_default(iss_config_t *config) {
+    Assert(config != NULL, "config should not be NULL!");
+    memset(config, 0, sizeof(iss_config_t));
+
+    // `time` ticks at 1 MHz on a nominal 100 MHz, CPI = 1 core
+    config->time_source = ISS_TIME_INSTRET;
+    config->timebase_hz = 1000000;
+    config->core_hz     = 100000000;
+
+    // ECALL goes to the host, without file access
+    config->syscall_proxy = true;
+    config->sandbox_dir   = NULL;
+
+    // no input file
+    config->input_file = NULL;
+
+    // no cache model (sizes are 0 after the memset above)
+    config->cache_report = NULL;
+
+    // no timing model
+    config->timing_model  = false;
+    config->timing_config = NULL;
+
+    // no locality analysis, 64-byte blocks and 1M-instruction intervals
+    config->locality_report   = NULL;
+    config->locality_block    = 64;
+    config->locality_interval = 1000000;
+
+    // no basic-block vectors, 10M-instruction intervals, no stop
+    config->bbv_file               = NULL;
+    config->bbv_interval           = 10000000;
+    config->simpoint_stop_interval = -1;
+    config->state_image            = NULL;
+
+    // no sampled execution
+    config->sample_interval = 0;
+    config->sample_jobs     = 0;
+    config->sample_report   = NULL;
+
+    // no coverage
+    config->coverage = false;
+
+    // one hart
+    config->harts        = 1;
+    config->hart_quantum = 1000;
+    config->hart_threads = true;
+
+    // every implemented extension, 128-bit vector registers
+    config->isa  = NULL;
+    config->vlen = 128;
+
+    // no reverse execution
+    config->undo_log_mb = 0;
+
+    // no record/replay
+    config->record_inputs = NULL;
+    config->replay_inputs = NULL;
+
+    // checked memory accesses
+    config->fast_mem = false;
+}
+
+// hart 0 is the core the devices and models are attached to
+static inline Core *ISS_hart(const ISS *self, unsigned hart) {
+    return (hart == 0) ? (Core *)&self->core : &self->harts[hart - 1];
+}
+
+static void *ISS_hart_thread(void *arg);
+
+// attach the optional models selected by config to the core
+static void ISS_attach_models(ISS *self, const iss_config_t *config) {
+    // attach the cache model to the core, plain memories are cacheable
+    self->has_cache_sim = CacheSim_enabled(config);
+    if (self->has_cache_sim) {
+        Assert(CacheSim_ctor(&self->cache_sim, config) == 0, "CacheSim_ctor failed!");
+        CacheSim_add_cacheable(&self->cache_sim, ROM_MMAP_BASE, ROM_MMAP_BASE + ROM_SIZE);
+        CacheSim_add_cacheable(&self->cache_sim, MAIN_MEM_MMAP_BASE,
+                               MAIN_MEM_MMAP_BASE + MAIN_MEM_SIZE);
+        CacheSim_add_cacheable(&self->cache_sim, INPUT_WINDOW_MMAP_BASE,
+                               INPUT_WINDOW_MMAP_BASE + INPUT_WINDOW_SIZE);
+        Core_set_cache_sim(&self->core, &self->cache_sim);
+    }
+
+    // attach the pipeline timing model to the core
+    self->has_timing = config->timing_model;
+    if (self->has_timing) {
+        Assert(Timing_ctor(&self->timing, config->timing_config) == 0, "Timing_ctor failed!");
+        Core_set_timing(&self->core, &self->timing);
+    }
+
+    // attach the locality analysis to the core
+    self->has_locality = (config->locality_report != NULL);
+    if (self->has_locality) {
+        Assert(Locality_ctor(&self->locality, config) == 0, "Locality_ctor failed!");
+        Core_set_locality(&self->core, &self->locality);
+    }
+}
+
 int ISS_ctor(ISS **self, const char *elf_file_name) {
-    assert(self != NULL);
+    iss_config_t config;
+    ISS_config_default(&config);
+    return ISS_ctor_with_config(self, elf_file_name, &config);
+}
+
+int ISS_ctor_with_config(ISS **self, const char *elf_file_name, const iss_config_t *config) {
+    assert((self != NULL) && (config != NULL));
     if (NULL == (*self = malloc(sizeof(struct iss)))) {
         return -1;
     }
 
     ISS *self_ = *self;
     // call constructors
-    Core_ctor(&self_->core);
+    Core_ctor(&self_->core, config);
     ROM_ctor(&self_->rom_mmio);
     MainMem_ctor(&self_->main_mem_mmio);
     TextBuffer_ctor(&self_->text_buffer_mmio);
     Halt_ctor(&self_->halt_mmio);
+    DMA_ctor(&self_->dma_mmio, &self_->core.mem_map);
+    CLINT_ctor(&self_->clint_mmio);
 
     // add ROM into core's mmap
     mmap_unit_t ROM_mmap_unit = { .addr_bound = { .first = ROM_MMAP_BASE,
                                                   .second = ROM_MMAP_BASE + ROM_SIZE },
-                                  .device_ptr = (AbstractMem *)&self_->rom_mmio };
+                                  .device_ptr = (AbstractMem *)&self_->rom_mmio,
+                                  .name       = "ROM" };
     Core_add_device(&self_->core, ROM_mmap_unit);
 
     // add main memory into core's mmap
     mmap_unit_t main_mem_mmap_unit = {
         .addr_bound = { .first = MAIN_MEM_MMAP_BASE, .second = MAIN_MEM_MMAP_BASE + MAIN_MEM_SIZE },
-        .device_ptr = (AbstractMem *)&self_->main_mem_mmio
+        .device_ptr = (AbstractMem *)&self_->main_mem_mmio,
+        .name       = "MainMem"
     };
     Core_add_device(&self_->core, main_mem_mmap_unit);
 
@@ -58,7 +280,8 @@ int ISS_ctor(ISS **self, const char *elf_file_name) {
     mmap_unit_t text_buffer_mmap_unit = {
         .addr_bound = { .first  = TEXT_BUFFER_MMAP_BASE,
                         .second = TEXT_BUFFER_MMAP_BASE + TEXT_BUFFER_SIZE },
-        .device_ptr = (AbstractMem *)&self_->text_buffer_mmio
+        .device_ptr = (AbstractMem *)&self_->text_buffer_mmio,
+        .name       = "TextBuffer"
     };
     Core_add_device(&self_->core, text_buffer_mmap_unit);
 
@@ -67,12 +290,227 @@ mmap_unit_t halt_mmap_unit = {
     .addr_bound = { .first = HALT_MMAP_BASE,
                     .second = HALT_MMAP_BASE + HALT_SIZE - 1 },  // <= here
     .device_ptr = &self_->halt_mmio.super,
+    .name       = "Halt",
 };
     Core_add_device(&self_->core, halt_mmap_unit);
 
-    // load ELF into main memory, and initialize PC
-    load_elf(elf_file_name, self_->rom_mmio.rom, ROM_SIZE,
-             &self_->core.arch_state.current_pc);
+    // add DMA engine into core's mmap
+    mmap_unit_t dma_mmap_unit = {
+        .addr_bound = { .first = DMA_MMAP_BASE, .second = DMA_MMAP_BASE + DMA_SIZE },
+        .device_ptr = &self_->dma_mmio.abstract_mem_super,
+        .name       = "DMA"
+    };
+    Core_add_device(&self_->core, dma_mmap_unit);
+
+    // add the CLINT (timer and software interrupts) into core's mmap
+    mmap_unit_t clint_mmap_unit = {
+        .addr_bound = { .first = CLINT_MMAP_BASE, .second = CLINT_MMAP_BASE + CLINT_SIZE },
+        .device_ptr = &self_->clint_mmio.super,
+        .name       = "CLINT"
+    };
+    Core_add_device(&self_->core, clint_mmap_unit);
+
+    // add input file (register block and window) into core's mmap, fuzzing
+    // feeds the test cases through it
+    self_->has_input_file = (config->input_file != NULL || config->coverage);
+    if (self_->has_input_file) {
+        // a replay takes the loads from the log
+        const char *input_file = (config->replay_inputs != NULL) ? NULL : config->input_file;
+        if (InputFile_ctor(&self_->input_file_mmio, input_file) != 0) {
+            Core_dtor(&self_->core);
+            free(self_);
+            *self = NULL;
+            return -1;
+        }
+        mmap_unit_t input_file_mmap_unit = {
+            .addr_bound = { .first  = INPUT_FILE_MMAP_BASE,
+                            .second = INPUT_FILE_MMAP_BASE + INPUT_FILE_SIZE },
+            .device_ptr       = &self_->input_file_mmio.regs_super,
+            .nondeterministic = true,
+            .name             = "InputFile"
+        };
+        Core_add_device(&self_->core, input_file_mmap_unit);
+        mmap_unit_t input_window_mmap_unit = {
+            .addr_bound = { .first  = INPUT_WINDOW_MMAP_BASE,
+                            .second = INPUT_WINDOW_MMAP_BASE + INPUT_WINDOW_SIZE },
+            .device_ptr       = &self_->input_file_mmio.window_super,
+            .nondeterministic = true,
+            .name             = "InputWindow"
+        };
+        Core_add_device(&self_->core, input_window_mmap_unit);
+    }
+
+    // serve ECALL with the host syscall proxy
+    if (SyscallProxy_ctor(&self_->syscall_proxy, &self_->core.mem_map, &self_->halt_mmio,
+                          config) != 0) {
+        if (self_->has_input_file) {
+            InputFile_dtor(&self_->input_file_mmio);
+        }
+        Core_dtor(&self_->core);
+        free(self_);
+        *self = NULL;
+        return -1;
+    }
+    if (config->syscall_proxy) {
+        Core_set_syscall_proxy(&self_->core, &self_->syscall_proxy);
+    }
+
+    // the other harts share the devices and the syscall proxy of hart 0
+    Assert(config->harts >= 1 && config->harts <= ISS_MAX_HARTS, "harts should be in 1..%d",
+           ISS_MAX_HARTS);
+    Assert(config->hart_quantum > 0, "hart_quantum should not be 0");
+    self_->num_harts    = config->harts;
+    self_->hart_quantum = config->hart_quantum;
+    self_->harts        = NULL;
+    self_->hart_threads = NULL;
+    self_->hart_args    = NULL;
+    if (self_->num_harts > 1) {
+        self_->harts = calloc(self_->num_harts - 1, sizeof(Core));
+        Assert(self_->harts != NULL, "Out of memory");
+        for (unsigned h = 1; h < self_->num_harts; h++) {
+            Core *hart = ISS_hart(self_, h);
+            Core_ctor(hart, config);
+            hart->csr.hartid = h;
+            for (unsigned i = 0; i < self_->core.mem_map.num_device; i++) {
+                Core_add_device(hart, self_->core.mem_map.memory_map_arr[i]);
+            }
+            if (config->syscall_proxy) {
+                Core_set_syscall_proxy(hart, &self_->syscall_proxy);
+            }
+        }
+        self_->text_buffer_mmio.immediate = true;
+    }
+    for (unsigned h = 0; h < self_->num_harts; h++) {
+        CLINT_add_hart(&self_->clint_mmio, ISS_hart(self_, h));
+    }
+
+    // no point is set, so the debugger costs nothing until one is
+    Debug_ctor(&self_->debug, &self_->halt_mmio);
+    for (unsigned h = 0; h < self_->num_harts; h++) {
+        Core_set_debug(ISS_hart(self_, h), &self_->debug);
+    }
+
+    // the undo log of reverse execution
+    self_->has_undo = (config->undo_log_mb != 0);
+    if (self_->has_undo) {
+        Assert(self_->num_harts == 1, "Reverse execution needs one hart");
+        Assert(UndoLog_ctor(&self_->undo, (size_t)config->undo_log_mb << 20) == 0,
+               "UndoLog_ctor failed!");
+        Core_set_undo(&self_->core, &self_->undo);
+        // the syscalls and the DMA transfers of an instruction go with it
+        self_->syscall_proxy.undo = &self_->undo;
+        self_->dma_mmio.undo      = &self_->undo;
+    }
+
+    // the log of the host inputs, indexed by the instructions of hart 0
+    self_->has_input_log = (config->record_inputs != NULL || config->replay_inputs != NULL);
+    if (self_->has_input_log) {
+        Assert(config->record_inputs == NULL || config->replay_inputs == NULL,
+               "Recording and replaying at once");
+        Assert(self_->num_harts == 1 || !config->hart_threads,
+               "Record/replay needs the harts on one thread");
+        Assert(!self_->has_undo && config->sample_interval == 0,
+               "Record/replay needs no undo log and no sampled execution");
+        bool replay           = (config->replay_inputs != NULL);
+        const char *file_name = replay ? config->replay_inputs : config->record_inputs;
+        Assert(InputLog_ctor(&self_->input_log, file_name, replay, &self_->core.csr.instret,
+                             &self_->halt_mmio) == 0,
+               "InputLog_ctor failed!");
+        for (unsigned h = 0; h < self_->num_harts; h++) {
+            Core_set_input_log(ISS_hart(self_, h), &self_->input_log);
+        }
+        self_->syscall_proxy.input_log = &self_->input_log;
+    }
+
+#ifdef ISS_HOST_PERF
+    // the phases are measured in the single-hart step loop only
+    HostPerf_ctor(&self_->host_perf);
+    for (unsigned h = 0; h < self_->num_harts; h++) {
+        Core_set_host_perf(ISS_hart(self_, h), &self_->host_perf);
+    }
+#endif
+
+    // the cache and timing models of a sampled execution run in its workers
+    self_->config = *config;
+    iss_config_t functional = *config;
+    if (config->sample_interval != 0) {
+        functional.l1i.size     = 0;
+        functional.l1d.size     = 0;
+        functional.timing_model = false;
+    }
+    ISS_attach_models(self_, &functional);
+
+    // attach the basic-block vector collection to the core
+    self_->has_bbv     = (config->bbv_file != NULL);
+    self_->state_image = config->state_image;
+    if (self_->has_bbv) {
+        Assert(BBV_ctor(&self_->bbv, config, &self_->halt_mmio) == 0, "BBV_ctor failed!");
+        Core_set_bbv(&self_->core, &self_->bbv);
+    }
+
+    // attach the fuzzing edge coverage to the core
+    self_->has_coverage = config->coverage;
+    if (self_->has_coverage) {
+        Assert(Coverage_ctor(&self_->coverage) == 0, "Coverage_ctor failed!");
+        Core_set_coverage(&self_->core, &self_->coverage);
+    }
+
+    // ROM and main memory move into the guarded window of fast_mem
+    self_->has_guest_window = config->fast_mem;
+    if (self_->has_guest_window) {
+        Assert(self_->num_harts == 1 && !self_->has_undo && !self_->has_cache_sim &&
+                   !self_->has_locality,
+               "fast_mem needs one hart, no undo log and no cache or locality model");
+        Assert(GuestWindow_ctor(&self_->guest_window) == 0, "GuestWindow_ctor failed!");
+        ROM_place(&self_->rom_mmio,
+                  GuestWindow_map(&self_->guest_window, ROM_MMAP_BASE, ROM_SIZE, true));
+        MainMem_place(&self_->main_mem_mmio, GuestWindow_map(&self_->guest_window,
+                                                             MAIN_MEM_MMAP_BASE, MAIN_MEM_SIZE,
+                                                             true));
+        Core_set_window(&self_->core, self_->guest_window.base);
+        Core_add_window_mem(&self_->core, ROM_MMAP_BASE, ROM_SIZE, false); // the code first
+        Core_add_window_mem(&self_->core, MAIN_MEM_MMAP_BASE, MAIN_MEM_SIZE, true);
+    }
+
+    // load ELF into ROM and main memory, and initialize PC; the heap of the
+    // guest starts after its image
+    elf_region_t regions[] = {
+        { .base = ROM_MMAP_BASE, .ptr = self_->rom_mmio.rom, .size = ROM_SIZE },
+        { .base = MAIN_MEM_MMAP_BASE, .ptr = self_->main_mem_mmio.mem, .size = MAIN_MEM_SIZE },
+    };
+    addr_t image_end;
+    HOST_PERF_ONCE_BEGIN(&self_->host_perf);
+    load_elf(elf_file_name, regions, 2, &self_->core.arch_state.current_pc, &image_end);
+    HOST_PERF_ONCE_END(&self_->host_perf, HOST_PHASE_ELF_LOAD);
+    SyscallProxy_set_image_end(&self_->syscall_proxy, image_end);
+    if (self_->has_guest_window) {
+        // guest stores to the ROM fault, and take the checked path
+        GuestWindow_map(&self_->guest_window, ROM_MMAP_BASE, ROM_SIZE, false);
+    }
+    for (unsigned h = 1; h < self_->num_harts; h++) {
+        ISS_hart(self_, h)->arch_state.current_pc = self_->core.arch_state.current_pc;
+    }
+
+    self_->step_ns = 0;
+
+    // the point ISS_reset() goes back to
+    self_->reset_image = ISS_save_state(self_);
+    Assert(self_->reset_image != NULL, "Out of memory");
+
+    // one thread per hart; hart 0 runs on the thread calling ISS_step()
+    if (self_->num_harts > 1 && config->hart_threads) {
+        self_->harts_exit   = false;
+        self_->hart_threads = calloc(self_->num_harts, sizeof(pthread_t));
+        self_->hart_args    = calloc(self_->num_harts, sizeof(struct iss_hart_arg));
+        Assert(self_->hart_threads != NULL && self_->hart_args != NULL, "Out of memory");
+        pthread_barrier_init(&self_->hart_barrier, NULL, self_->num_harts);
+        for (unsigned h = 1; h < self_->num_harts; h++) {
+            self_->hart_args[h] = (struct iss_hart_arg){ .iss = self_, .hart = h };
+            Assert(pthread_create(&self_->hart_threads[h], NULL, ISS_hart_thread,
+                                  &self_->hart_args[h]) == 0,
+                   "Fail to create the thread of hart %u", h);
+        }
+    }
 
     return 0;
 }
@@ -80,27 +518,258 @@ mmap_unit_t halt_mmap_unit = {
 void ISS_dtor(ISS *self) {
     LOG("Calling ISS_dtor to clean up things...");
 
+    // stop the hart threads
+    if (self->hart_threads != NULL) {
+        self->harts_exit = true;
+        pthread_barrier_wait(&self->hart_barrier);
+        for (unsigned h = 1; h < self->num_harts; h++) {
+            pthread_join(self->hart_threads[h], NULL);
+        }
+        pthread_barrier_destroy(&self->hart_barrier);
+        free(self->hart_threads);
+        free(self->hart_args);
+    }
+
+    // report of the models
+    if (self->has_cache_sim) {
+        CacheSim_report(&self->cache_sim);
+        CacheSim_dtor(&self->cache_sim);
+    }
+    if (self->has_timing) {
+        Timing_report(&self->timing);
+        Timing_dtor(&self->timing);
+    }
+    if (self->has_locality) {
+        Locality_report(&self->locality);
+        Locality_dtor(&self->locality);
+    }
+    if (self->has_bbv) {
+        BBV_dtor(&self->bbv);
+    }
+    if (self->has_coverage) {
+        Coverage_dtor(&self->coverage);
+    }
+    if (self->has_undo) {
+        UndoLog_dtor(&self->undo);
+    }
+    if (self->has_input_log) {
+        InputLog_dtor(&self->input_log);
+    }
+#ifdef ISS_HOST_PERF
+    HostPerf_report(&self->host_perf);
+    HostPerf_dtor(&self->host_perf);
+#endif
+    ISS_free_state(self->reset_image);
+
     // core destructor
+    for (unsigned h = 1; h < self->num_harts; h++) {
+        Core_dtor(ISS_hart(self, h));
+    }
+    free(self->harts);
     Core_dtor(&self->core);
+    SyscallProxy_dtor(&self->syscall_proxy);
+    if (self->has_input_file) {
+        InputFile_dtor(&self->input_file_mmio);
+    }
+    if (self->has_guest_window) {
+        GuestWindow_dtor(&self->guest_window);
+    }
     free(self);
 
     /*
-     * self->core is the only one data member whose destructor is must be called
+     * self->core, self->syscall_proxy and self->input_file_mmio are the only
+     * data members whose destructors must be called
      */
 }
 
-void ISS_step(ISS *self, unsigned long n_step) {
-    for (unsigned i = 0; i < n_step; i++) {
+// the BBV halted the run at the start of the selected interval
+static void ISS_stop_at_simpoint(ISS *self) {
+    self->bbv.stop_pending = false;
+    if (self->state_image == NULL) {
+        return;
+    }
+    iss_state_image_t *image = ISS_save_state(self);
+    Assert(image != NULL, "Out of memory");
+    if (ISS_write_state(image, self->state_image) != 0) {
+        fprintf(stderr, "Fail to write state image: %s\n", self->state_image);
+    }
+    ISS_free_state(image);
+}
+
+// a debugger stop ends ISS_step() without halting the guest
+static void ISS_debug_stopped(ISS *self) {
+    self->debug.stop_pending  = false;
+    self->halt_mmio.halt_flag = false;
+}
+
+/* ---------------------------- multi-hart ---------------------------- */
+// run one hart for at most n instructions, like the loop of ISS_step()
+static void ISS_run_hart(ISS *self, Core *hart, unsigned long n) {
+    uint64_t *steps = &hart->steps;
+    uint64_t end    = *steps + n;
+    for (; *steps < end; (*steps)++) {
+        if (unlikely(__atomic_load_n(&self->halt_mmio.halt_flag, __ATOMIC_ACQUIRE))) {
+            return;
+        }
+        Tick_tick(&hart->super);
+    }
+}
+
+// between two quanta, all harts stopped: catch the devices up and size the
+// next quantum (0 ends ISS_step())
+static void ISS_end_quantum(ISS *self) {
+    for (unsigned long i = 0; i < self->quantum_steps; i++) {
+        Tick_tick(&self->text_buffer_mmio.tick_super);
+        Tick_tick(&self->dma_mmio.tick_super);
+    }
+    self->steps_left -= self->quantum_steps;
+    if (self->halt_mmio.halt_flag) {
+        self->quantum_steps = 0;
+    } else {
+        self->quantum_steps = (self->steps_left < self->hart_quantum) ? self->steps_left
+                                                                       : self->hart_quantum;
+    }
+}
+
+// the quanta of one ISS_step() on the thread of hart; the barriers bracket
+// the parallel part, hart 0 does the serial part
+static void ISS_run_quanta(ISS *self, unsigned hart) {
+    for (;;) {
+        pthread_barrier_wait(&self->hart_barrier);
+        if (self->quantum_steps == 0) {
+            return;
+        }
+        ISS_run_hart(self, ISS_hart(self, hart), self->quantum_steps);
+        pthread_barrier_wait(&self->hart_barrier);
+        if (hart == 0) {
+            ISS_end_quantum(self);
+        }
+    }
+}
+
+static void *ISS_hart_thread(void *arg) {
+    struct iss_hart_arg *hart_arg = arg;
+    ISS *self                     = hart_arg->iss;
+    for (;;) {
+        // wait for ISS_step() or ISS_dtor()
+        pthread_barrier_wait(&self->hart_barrier);
+        if (self->harts_exit) {
+            return NULL;
+        }
+        ISS_run_quanta(self, hart_arg->hart);
+    }
+}
+
+static void ISS_step_harts(ISS *self, unsigned long n_step) {
+    if (self->halt_mmio.halt_flag) {
+        return;
+    }
+    self->steps_left    = n_step;
+    self->quantum_steps = (n_step < self->hart_quantum) ? n_step : self->hart_quantum;
+    if (self->hart_threads != NULL) {
+        pthread_barrier_wait(&self->hart_barrier); // start the other threads
+        ISS_run_quanta(self, 0);
+    } else {
+        while (self->quantum_steps != 0) {
+            for (unsigned h = 0; h < self->num_harts; h++) {
+                ISS_run_hart(self, ISS_hart(self, h), self->quantum_steps);
+            }
+            ISS_end_quantum(self);
+        }
+    }
+    if (self->halt_mmio.halt_flag && self->has_bbv && self->bbv.stop_pending) {
+        ISS_stop_at_simpoint(self);
+    }
+    if (unlikely(self->debug.stop_pending)) {
+        ISS_debug_stopped(self);
+    }
+}
+
+static inline uint64_t host_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// the step loop of a single hart, up to step end
+static inline void ISS_run_single(ISS *self, uint64_t end) {
+    uint64_t *steps = &self->core.steps;
+    for (; *steps < end; (*steps)++) {
         // check halt flag
         if (unlikely(self->halt_mmio.halt_flag == true)) {
-            return;
+            if (self->has_bbv && self->bbv.stop_pending) {
+                ISS_stop_at_simpoint(self);
+            }
+            break;
         }
         // tick all tickable devices (includes core itself)
+        HOST_PERF_INST(&self->host_perf);
         Tick_tick(&self->core.super);
+        HOST_PERF_ENTER(&self->host_perf, HOST_PHASE_DEVICE_TICK);
         Tick_tick(&self->text_buffer_mmio.tick_super);
+        Tick_tick(&self->dma_mmio.tick_super);
+        HOST_PERF_LEAVE(&self->host_perf);
     }
 }
 
+// an access of the current instruction faulted in the window: report it if
+// it went astray, and redo the instruction the checked way, which accesses
+// the device there or raises the guest access fault
+static void ISS_window_fault(ISS *self) {
+    Core *core  = &self->core;
+    addr_t addr = self->guest_window.fault_addr;
+#ifdef ISS_HOST_PERF
+    self->host_perf.depth = 0; // the phases the fault left
+#endif
+    if (!MemoryMap_is_mapped(&core->mem_map, addr, 1)) {
+        fprintf(stderr, "[FASTMEM] hart %u: access fault at pc 0x%" PRIxREG
+                        ", address 0x%" PRIxREG "\n",
+                (unsigned)core->csr.hartid, core->arch_state.current_pc, (reg_t)addr);
+    }
+    Core_set_window(core, NULL);
+    ISS_run_single(self, core->steps + 1);
+    Core_set_window(core, self->guest_window.base);
+}
+
+// the step loop with unchecked accesses; after a fault it goes on with the
+// next instruction, as the loop counter (Core::steps) lives in memory
+static void ISS_run_window(ISS *self, uint64_t end) {
+    GuestWindow_enter(&self->guest_window);
+    while (sigsetjmp(self->guest_window.recover, 0) != 0) {
+        ISS_window_fault(self);
+    }
+    ISS_run_single(self, end);
+    GuestWindow_leave(&self->guest_window);
+}
+
+// ISS_step() of a single hart
+static void ISS_step_single(ISS *self, unsigned long n_step) {
+    uint64_t *steps = &self->core.steps;
+    uint64_t end    = (n_step > UINT64_MAX - *steps) ? UINT64_MAX : *steps + n_step;
+    HOST_PERF_RUN_BEGIN(&self->host_perf, self->core.csr.instret);
+    if (self->core.window != NULL) {
+        ISS_run_window(self, end);
+    } else {
+        ISS_run_single(self, end);
+    }
+    HOST_PERF_RUN_END(&self->host_perf, self->core.csr.instret);
+    // (a watchpoint may fire in the last step)
+    if (unlikely(self->debug.stop_pending)) {
+        ISS_debug_stopped(self);
+    }
+}
+
+void ISS_step(ISS *self, unsigned long n_step) {
+    uint64_t start          = host_ns();
+    self->debug.stop.reason = ISS_STOP_NONE;
+    if (unlikely(self->num_harts > 1)) {
+        ISS_step_harts(self, n_step);
+    } else {
+        ISS_step_single(self, n_step);
+    }
+    self->step_ns += host_ns() - start;
+}
+
 arch_state_t ISS_get_arch_state(const ISS *self) {
     Assert(self != NULL, "self should not be NULL!");
     arch_state_t ret = {};
@@ -117,16 +786,650 @@ void ISS_get_main_memory(const ISS *self,
                          const addr_t base_addr,
                          const unsigned int length,
                          byte_t *buffer) {
-    //
+    Assert(self != NULL && buffer != NULL, "self and buffer should not be NULL!");
+    MemoryMap *mem_map = (MemoryMap *)&self->core.mem_map;
+    byte_t *src        = MemoryMap_host_ptr(mem_map, base_addr, length, false);
+    if (src != NULL) {
+        memcpy(buffer, src, length);
+    } else {
+        MemoryMap_generic_load(mem_map, base_addr, length, buffer);
+    }
 }
 
 void ISS_set_main_memory(ISS *self,
                          const addr_t base_addr,
                          const unsigned int length,
                          const byte_t *ref_data) {
-    //
+    Assert(self != NULL && ref_data != NULL, "self and ref_data should not be NULL!");
+    byte_t *dst = MemoryMap_host_ptr(&self->core.mem_map, base_addr, length, true);
+    if (dst != NULL) {
+        memcpy(dst, ref_data, length);
+    } else {
+        MemoryMap_generic_store(&self->core.mem_map, base_addr, length, ref_data);
+    }
 }
 
 bool ISS_get_halt(ISS *self) {
     return self->halt_mmio.halt_flag;
 }
+
+arch_state_t ISS_get_hart_arch_state(const ISS *self, unsigned hart) {
+    Assert(self != NULL, "self should not be NULL!");
+    Assert(hart < self->num_harts, "no hart %u", hart);
+    return ISS_hart(self, hart)->arch_state;
+}
+
+void ISS_get_tlb_stats(const ISS *self, iss_tlb_stats_t *stats) {
+    Assert(self != NULL && stats != NULL, "self and stats should not be NULL!");
+    memset(stats, 0, sizeof(iss_tlb_stats_t));
+    for (unsigned h = 0; h < self->num_harts; h++) {
+        const MMU *mmu = &ISS_hart(self, h)->mmu;
+        for (int type = 0; type < MMU_NUM_ACCESS; type++) {
+            stats->hits[type] += mmu->hits[type];
+            stats->misses[type] += mmu->misses[type];
+        }
+        stats->flushes += mmu->flushes;
+    }
+}
+
+/* ---------------------------- statistics ---------------------------- */
+static iss_inst_class_t opcode_class(unsigned opcode) {
+    switch (opcode) {
+    case LOAD:     return ISS_INST_LOAD;
+    case STORE:    return ISS_INST_STORE;
+    case BRANCH:   return ISS_INST_BRANCH;
+    case JAL:
+    case JALR:     return ISS_INST_JUMP;
+    case AMO:      return ISS_INST_AMO;
+    case MISC_MEM: return ISS_INST_FENCE;
+    case SYSTEM:   return ISS_INST_SYSTEM;
+    case LOAD_FP:
+    case STORE_FP:
+    case MADD:
+    case MSUB:
+    case NMSUB:
+    case NMADD:
+    case OP_FP:    return ISS_INST_FP;
+    case OP_V:     return ISS_INST_VECTOR;
+    default:       return ISS_INST_ALU; // the rest that can retire
+    }
+}
+
+void ISS_get_stats(const ISS *self, iss_stats_t *stats) {
+    Assert(self != NULL && stats != NULL, "self and stats should not be NULL!");
+    memset(stats, 0, sizeof(iss_stats_t));
+    const MemoryMap *mem_map = &self->core.mem_map;
+    stats->num_devices       = (mem_map->num_device < ISS_STATS_MAX_DEVICES) ? mem_map->num_device
+                                                                             : ISS_STATS_MAX_DEVICES;
+    for (unsigned i = 0; i < stats->num_devices; i++) {
+        const mmap_unit_t *unit = &mem_map->memory_map_arr[i];
+        stats->devices[i].name  = unit->name;
+        stats->devices[i].base  = unit->addr_bound.first;
+        stats->devices[i].size  = unit->addr_bound.second - unit->addr_bound.first;
+    }
+    for (unsigned h = 0; h < self->num_harts; h++) {
+        const Core *hart = ISS_hart(self, h);
+        for (unsigned op = 0; op < 128; op++) {
+            stats->inst_class[opcode_class(op)] += hart->stats.opcode[op];
+        }
+        // the instret CSR over the interval, which step back may rewind to
+        // before its start
+        uint64_t start = hart->stats.instret_start;
+        stats->instret += (hart->csr.instret > start) ? hart->csr.instret - start : 0;
+        stats->inst_class[ISS_INST_FP] -= hart->stats.vector_mem;
+        stats->inst_class[ISS_INST_VECTOR] += hart->stats.vector_mem;
+        stats->branches_taken += hart->stats.branches_taken;
+        stats->branches_not_taken += hart->stats.opcode[BRANCH] - hart->stats.branches_taken;
+        for (unsigned i = 0; i < stats->num_devices; i++) {
+            const mmap_count_t *count = &hart->mem_map.count_arr[i];
+            stats->devices[i].loads += count->access[MMU_LOAD];
+            stats->devices[i].stores += count->access[MMU_STORE];
+        }
+    }
+    stats->step_ns = self->step_ns;
+}
+
+void ISS_reset_stats(ISS *self) {
+    Assert(self != NULL, "self should not be NULL!");
+    for (unsigned h = 0; h < self->num_harts; h++) {
+        Core *hart = ISS_hart(self, h);
+        memset(&hart->stats, 0, sizeof(core_stats_t));
+        hart->stats.instret_start = hart->csr.instret;
+        MemoryMap_clear_counts(&hart->mem_map);
+    }
+    self->step_ns = 0;
+}
+
+/* ---------------------------- debugging ---------------------------- */
+// the harts forget the pages they cached before a point changed
+static int ISS_debug_changed(ISS *self, int ret) {
+    for (unsigned h = 0; h < self->num_harts; h++) {
+        MMU_invalidate(&ISS_hart(self, h)->mmu);
+    }
+    // the points are only checked on the TLB path
+    if (self->has_guest_window) {
+        bool points = (self->debug.num_breakpoints + self->debug.num_watchpoints) != 0;
+        Core_set_window(&self->core, points ? NULL : self->guest_window.base);
+    }
+    return ret;
+}
+
+int ISS_add_breakpoint(ISS *self, addr_t addr) {
+    Assert(self != NULL, "self should not be NULL!");
+    return ISS_debug_changed(self, Debug_add_breakpoint(&self->debug, addr));
+}
+
+int ISS_remove_breakpoint(ISS *self, addr_t addr) {
+    Assert(self != NULL, "self should not be NULL!");
+    return ISS_debug_changed(self, Debug_remove_breakpoint(&self->debug, addr));
+}
+
+int ISS_add_watchpoint(ISS *self, addr_t addr, addr_t len, iss_watch_t type) {
+    Assert(self != NULL, "self should not be NULL!");
+    return ISS_debug_changed(self, Debug_add_watchpoint(&self->debug, addr, len, type));
+}
+
+int ISS_remove_watchpoint(ISS *self, addr_t addr, addr_t len, iss_watch_t type) {
+    Assert(self != NULL, "self should not be NULL!");
+    return ISS_debug_changed(self, Debug_remove_watchpoint(&self->debug, addr, len, type));
+}
+
+iss_stop_t ISS_get_stop(const ISS *self) {
+    Assert(self != NULL, "self should not be NULL!");
+    return self->debug.stop;
+}
+
+// host pointer to the plain memory behind [addr, addr + length) within a
+// page, translated like a load of hart 0 (without touching its TLB)
+static byte_t *ISS_debug_ptr(ISS *self, addr_t addr, unsigned length, bool write) {
+    mmu_tlb_entry_t entry;
+    mmu_fault_t fault = MMU_fill(&self->core.mmu, addr, MMU_LOAD, &entry);
+    if (fault != MMU_OK && fault != MMU_DEBUG) {
+        return NULL;
+    }
+    return MemoryMap_page_ptr(&self->core.mem_map, entry.ppage | (addr & MMU_PAGE_MASK), length,
+                              write);
+}
+
+int ISS_debug_read(ISS *self, addr_t addr, unsigned length, byte_t *buffer) {
+    Assert(self != NULL && buffer != NULL, "self and buffer should not be NULL!");
+    while (length > 0) {
+        unsigned n  = (unsigned)(MMU_PAGE_SIZE - (addr & MMU_PAGE_MASK));
+        n           = (n < length) ? n : length;
+        byte_t *src = ISS_debug_ptr(self, addr, n, false);
+        if (src == NULL) {
+            return -1;
+        }
+        memcpy(buffer, src, n);
+        addr += n;
+        buffer += n;
+        length -= n;
+    }
+    return 0;
+}
+
+int ISS_debug_write(ISS *self, addr_t addr, unsigned length, const byte_t *data) {
+    Assert(self != NULL && data != NULL, "self and data should not be NULL!");
+    while (length > 0) {
+        unsigned n  = (unsigned)(MMU_PAGE_SIZE - (addr & MMU_PAGE_MASK));
+        n           = (n < length) ? n : length;
+        byte_t *dst = ISS_debug_ptr(self, addr, n, true);
+        if (dst == NULL) {
+            return -1;
+        }
+        memcpy(dst, data, n);
+        addr += n;
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/* ------------------------ reverse execution ------------------------ */
+// the part of a write watchpoint on one page, at its host address
+typedef struct {
+    const byte_t *host;
+    unsigned len;
+    addr_t addr;
+    iss_watch_t watch;
+} iss_watch_range_t;
+
+// the write watchpoints as hart 0 maps them now (plain memory only), into a
+// malloc'ed array
+static iss_watch_range_t *ISS_watch_ranges(ISS *self, unsigned *num) {
+    const Debug *debug = &self->debug;
+    size_t capacity    = 0;
+    for (unsigned i = 0; i < debug->num_watchpoints; i++) {
+        capacity += debug->watchpoints[i].len / MMU_PAGE_SIZE + 2;
+    }
+    iss_watch_range_t *ranges = malloc((capacity + 1) * sizeof(iss_watch_range_t));
+    Assert(ranges != NULL, "Out of memory");
+    *num = 0;
+    for (unsigned i = 0; i < debug->num_watchpoints; i++) {
+        const debug_watchpoint_t *w = &debug->watchpoints[i];
+        if (!(w->type & ISS_WATCH_WRITE)) {
+            continue;
+        }
+        for (addr_t addr = w->addr, left = w->len; left > 0;) {
+            addr_t n = MMU_PAGE_SIZE - (addr & MMU_PAGE_MASK);
+            n        = (n < left) ? n : left;
+            const byte_t *host = ISS_debug_ptr(self, addr, (unsigned)n, false);
+            if (host != NULL) {
+                ranges[(*num)++] = (iss_watch_range_t){ .host = host, .len = (unsigned)n,
+                                                        .addr = addr, .watch = w->type };
+            }
+            addr += n;
+            left -= n;
+        }
+    }
+    return ranges;
+}
+
+// the undo of hart 0 is over: back to the undone state
+static void ISS_undone(ISS *self, uint64_t undone, iss_stop_reason_t reason) {
+    Core_sync_mmu(&self->core);
+    if (undone != 0) {
+        self->halt_mmio.halt_flag = false;
+    }
+    if (reason != ISS_STOP_NONE) {
+        addr_t pc        = self->core.arch_state.current_pc;
+        self->debug.stop = (iss_stop_t){ .reason = reason, .pc = pc, .addr = pc };
+    }
+}
+
+uint64_t ISS_step_back(ISS *self, uint64_t n) {
+    Assert(self != NULL, "self should not be NULL!");
+    self->debug.stop.reason = ISS_STOP_NONE;
+    uint64_t undone         = 0;
+    while (undone < n && Core_undo(&self->core)) {
+        undone++;
+    }
+    ISS_undone(self, undone, (undone < n) ? ISS_STOP_LOG_BEGIN : ISS_STOP_NONE);
+    return undone;
+}
+
+uint64_t ISS_reverse_continue(ISS *self) {
+    Assert(self != NULL, "self should not be NULL!");
+    self->debug.stop.reason = ISS_STOP_NONE;
+    unsigned num_ranges;
+    iss_watch_range_t *ranges = ISS_watch_ranges(self, &num_ranges);
+    uint64_t undone           = 0;
+    while (Core_undo(&self->core)) {
+        undone++;
+        for (unsigned i = 0; i < num_ranges; i++) {
+            if (UndoLog_undone_wrote(&self->undo, ranges[i].host, ranges[i].len)) {
+                ISS_undone(self, undone, ISS_STOP_WATCHPOINT);
+                self->debug.stop.addr  = ranges[i].addr;
+                self->debug.stop.watch = ranges[i].watch;
+                free(ranges);
+                return undone;
+            }
+        }
+        addr_t pc = self->core.arch_state.current_pc;
+        if (Debug_is_breakpoint(&self->debug, pc)) {
+            // resuming executes the instruction, as after a stop going forward
+            Debug_skip(&self->debug, 0, pc, self->core.csr.instret);
+            ISS_undone(self, undone, ISS_STOP_BREAKPOINT);
+            free(ranges);
+            return undone;
+        }
+    }
+    free(ranges);
+    ISS_undone(self, undone, ISS_STOP_LOG_BEGIN);
+    return undone;
+}
+
+/* -------------------------- record/replay -------------------------- */
+bool ISS_replay_diverged(const ISS *self) {
+    Assert(self != NULL, "self should not be NULL!");
+    return self->has_input_log && self->input_log.diverged;
+}
+
+/* -------------------------- state images --------------------------- */
+iss_state_image_t *ISS_save_state(const ISS *self) {
+    Assert(self != NULL, "self should not be NULL!");
+    iss_state_image_t *image = calloc(1, sizeof(iss_state_image_t));
+    if (image == NULL) {
+        return NULL;
+    }
+    memcpy(image->magic, ISS_STATE_MAGIC, sizeof(image->magic));
+    image->num_harts = self->num_harts;
+    for (unsigned h = 0; h < self->num_harts; h++) {
+        const Core *hart            = ISS_hart(self, h);
+        image->hart[h].arch_state   = hart->arch_state;
+        image->hart[h].instret      = hart->csr.instret;
+        image->hart[h].extra_cycles = hart->csr.extra_cycles;
+        image->hart[h].priv         = hart->csr.priv;
+        image->hart[h].timecmp      = Core_get_timecmp(hart);
+        image->hart[h].vec          = hart->vec;
+    }
+
+    memcpy(image->rom, self->rom_mmio.rom, ROM_SIZE);
+    memcpy(image->main_mem, self->main_mem_mmio.mem, MAIN_MEM_SIZE);
+
+    image->text_buffer_valid   = self->text_buffer_mmio.valid;
+    image->text_buffer         = self->text_buffer_mmio.buffer;
+    image->dma_src             = self->dma_mmio.src;
+    image->dma_dst             = self->dma_mmio.dst;
+    image->dma_len             = self->dma_mmio.len;
+    image->dma_ctrl            = self->dma_mmio.ctrl;
+    image->dma_fill            = self->dma_mmio.fill;
+    image->dma_status          = self->dma_mmio.status;
+    image->dma_remaining_ticks = self->dma_mmio.remaining_ticks;
+    if (self->has_input_file) {
+        image->input_file_window = self->input_file_mmio.window;
+        image->input_file_cursor = self->input_file_mmio.cursor;
+    }
+    image->brk = self->syscall_proxy.brk;
+    return image;
+}
+
+void ISS_restore_state(ISS *self, const iss_state_image_t *image) {
+    Assert(self != NULL && image != NULL, "self and image should not be NULL!");
+    Assert(memcmp(image->magic, ISS_STATE_MAGIC, sizeof(image->magic)) == 0,
+           "Not a state image of this build!");
+    Assert(image->num_harts == self->num_harts, "State image of %u harts, the ISS has %u",
+           image->num_harts, self->num_harts);
+    for (unsigned h = 0; h < self->num_harts; h++) {
+        Core *hart             = ISS_hart(self, h);
+        hart->arch_state       = image->hart[h].arch_state;
+        hart->csr.instret      = image->hart[h].instret;
+        hart->csr.extra_cycles = image->hart[h].extra_cycles;
+        hart->csr.priv         = image->hart[h].priv;
+        hart->vec              = image->hart[h].vec;
+        hart->lr_valid         = false;
+        Core_sync_mmu(hart);
+        Core_set_timecmp(hart, image->hart[h].timecmp);
+    }
+
+    if (self->has_guest_window) {
+        GuestWindow_map(&self->guest_window, ROM_MMAP_BASE, ROM_SIZE, true);
+    }
+    memcpy(self->rom_mmio.rom, image->rom, ROM_SIZE);
+    memcpy(self->main_mem_mmio.mem, image->main_mem, MAIN_MEM_SIZE);
+    if (self->has_guest_window) {
+        GuestWindow_map(&self->guest_window, ROM_MMAP_BASE, ROM_SIZE, false);
+    }
+
+    self->text_buffer_mmio.valid   = image->text_buffer_valid;
+    self->text_buffer_mmio.buffer  = image->text_buffer;
+    self->dma_mmio.src             = image->dma_src;
+    self->dma_mmio.dst             = image->dma_dst;
+    self->dma_mmio.len             = image->dma_len;
+    self->dma_mmio.ctrl            = image->dma_ctrl;
+    self->dma_mmio.fill            = image->dma_fill;
+    self->dma_mmio.status          = image->dma_status;
+    self->dma_mmio.remaining_ticks = image->dma_remaining_ticks;
+    if (self->has_input_file) {
+        self->input_file_mmio.window = image->input_file_window;
+        self->input_file_mmio.cursor = image->input_file_cursor;
+    }
+    self->syscall_proxy.brk   = image->brk;
+    self->halt_mmio.halt_flag = false;
+    if (self->has_undo) {
+        UndoLog_clear(&self->undo);
+    }
+}
+
+void ISS_free_state(iss_state_image_t *image) {
+    free(image);
+}
+
+int ISS_write_state(const iss_state_image_t *image, const char *file_name) {
+    Assert(image != NULL && file_name != NULL, "image and file_name should not be NULL!");
+    FILE *f = fopen(file_name, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    size_t written = fwrite(image, sizeof(iss_state_image_t), 1, f);
+    return (fclose(f) == 0 && written == 1) ? 0 : -1;
+}
+
+iss_state_image_t *ISS_read_state(const char *file_name) {
+    Assert(file_name != NULL, "file_name should not be NULL!");
+    FILE *f = fopen(file_name, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    iss_state_image_t *image = malloc(sizeof(iss_state_image_t));
+    if (image != NULL && (fread(image, sizeof(iss_state_image_t), 1, f) != 1 ||
+                          memcmp(image->magic, ISS_STATE_MAGIC, sizeof(image->magic)) != 0)) {
+        free(image);
+        image = NULL;
+    }
+    fclose(f);
+    return image;
+}
+
+/* ---------------------------- fuzzing ------------------------------ */
+void ISS_reset(ISS *self) {
+    Assert(self != NULL, "self should not be NULL!");
+    ISS_restore_state(self, self->reset_image);
+    SyscallProxy_reset(&self->syscall_proxy);
+}
+
+void ISS_set_input(ISS *self, const byte_t *data, size_t size) {
+    Assert(self != NULL, "self should not be NULL!");
+    Assert(self->has_input_file, "no InputFile device (set input_file or coverage)");
+    InputFile_set_data(&self->input_file_mmio, data, size);
+}
+
+byte_t *ISS_get_coverage(ISS *self, size_t *size) {
+    Assert(self != NULL && size != NULL, "self and size should not be NULL!");
+    *size = self->has_coverage ? COVERAGE_MAP_SIZE : 0;
+    return self->has_coverage ? self->coverage.map : NULL;
+}
+
+/* ----------------------- sampled execution ------------------------ */
+// result of one interval, sent from a worker through a pipe (the record is
+// smaller than PIPE_BUF, so writes of concurrent workers do not interleave)
+typedef struct {
+    uint64_t index;
+    uint64_t start; // instret at the start of the interval
+    uint64_t instructions;
+    uint64_t cycles;
+    uint64_t l1i_accesses, l1i_misses;
+    uint64_t l1d_accesses, l1d_misses;
+    uint64_t l2_accesses, l2_misses;
+    uint64_t branches, branch_mispredicts;
+    bool diverged; // the replay stopped early at a file syscall
+} iss_sample_t;
+
+// replay the next interval with the models attached, then exit (runs in a
+// forked child, so the functional run is unaffected)
+static void ISS_sample_worker(ISS *self, uint64_t index, int fd) {
+    // the functional run produced the guest output already
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    self->syscall_proxy.replay = true;
+    // the functional-run observers must not touch the parent's files
+    Core_set_locality(&self->core, NULL);
+    Core_set_bbv(&self->core, NULL);
+
+    iss_config_t detail    = self->config;
+    detail.cache_report    = NULL;
+    detail.locality_report = NULL;
+    ISS_attach_models(self, &detail);
+    Core_set_window(&self->core, NULL); // the models see every access
+
+    iss_sample_t sample   = { .index = index, .start = self->core.csr.instret };
+    uint64_t extra_cycles = self->core.csr.extra_cycles;
+    ISS_step(self, self->config.sample_interval);
+
+    sample.instructions = self->core.csr.instret - sample.start;
+    sample.cycles       = sample.instructions + self->core.csr.extra_cycles - extra_cycles;
+    if (self->has_cache_sim) {
+        sample.l1i_accesses = self->cache_sim.l1i.accesses;
+        sample.l1i_misses   = self->cache_sim.l1i.misses;
+        sample.l1d_accesses = self->cache_sim.l1d.accesses;
+        sample.l1d_misses   = self->cache_sim.l1d.misses;
+        sample.l2_accesses  = self->cache_sim.l2.accesses;
+        sample.l2_misses    = self->cache_sim.l2.misses;
+    }
+    if (self->has_timing) {
+        sample.branches           = self->timing.branches;
+        sample.branch_mispredicts = self->timing.branch_mispredicts;
+    }
+    sample.diverged = self->syscall_proxy.diverged;
+
+    int status = (write(fd, &sample, sizeof(sample)) == sizeof(sample)) ? 0 : 1;
+    _exit(status); // no atexit handlers or stdio flushes of the parent's state
+}
+
+// collect the finished samples (non-blocking unless the write end is closed)
+static void ISS_sample_drain(int fd, iss_sample_t **samples, size_t *num, size_t *capacity) {
+    iss_sample_t sample;
+    while (read(fd, &sample, sizeof(sample)) == sizeof(sample)) {
+        if (*num == *capacity) {
+            *capacity = *capacity ? 2 * *capacity : 64;
+            *samples  = realloc(*samples, *capacity * sizeof(iss_sample_t));
+            Assert(*samples != NULL, "Out of memory");
+        }
+        (*samples)[(*num)++] = sample;
+    }
+}
+
+static int cmp_sample_index(const void *a, const void *b) {
+    const iss_sample_t *x = a, *y = b;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static double ratio(uint64_t a, uint64_t b) {
+    return b ? (double)a / (double)b : 0.0;
+}
+
+static void ISS_sample_report(const ISS *self, iss_sample_t *samples, size_t num, uint64_t intervals) {
+    qsort(samples, num, sizeof(iss_sample_t), cmp_sample_index);
+
+    FILE *csv = NULL;
+    if (self->config.sample_report != NULL &&
+        NULL == (csv = fopen(self->config.sample_report, "w"))) {
+        fprintf(stderr, "Fail to open sample report file: %s\n", self->config.sample_report);
+    }
+    if (csv != NULL) {
+        fprintf(csv, "interval,start,instructions,cycles,cpi,l1i_misses,l1d_misses,l2_misses,"
+                     "branch_mispredicts,diverged\n");
+    }
+
+    iss_sample_t total = {};
+    unsigned diverged  = 0;
+    for (size_t i = 0; i < num; i++) {
+        const iss_sample_t *s = &samples[i];
+        if (csv != NULL) {
+            fprintf(csv, "%llu,%llu,%llu,%llu,%.4f,%llu,%llu,%llu,%llu,%d\n",
+                    (unsigned long long)s->index, (unsigned long long)s->start,
+                    (unsigned long long)s->instructions, (unsigned long long)s->cycles,
+                    ratio(s->cycles, s->instructions), (unsigned long long)s->l1i_misses,
+                    (unsigned long long)s->l1d_misses, (unsigned long long)s->l2_misses,
+                    (unsigned long long)s->branch_mispredicts, s->diverged);
+        }
+        total.instructions += s->instructions;
+        total.cycles += s->cycles;
+        total.l1i_accesses += s->l1i_accesses;
+        total.l1i_misses += s->l1i_misses;
+        total.l1d_accesses += s->l1d_accesses;
+        total.l1d_misses += s->l1d_misses;
+        total.l2_accesses += s->l2_accesses;
+        total.l2_misses += s->l2_misses;
+        total.branches += s->branches;
+        total.branch_mispredicts += s->branch_mispredicts;
+        diverged += s->diverged;
+    }
+    if (csv != NULL) {
+        fclose(csv);
+    }
+
+    fprintf(stderr, "[SAMPLED] %llu intervals (%zu replayed, %u diverged), %llu instructions, "
+                    "%llu cycles, CPI %.3f\n",
+            (unsigned long long)intervals, num, diverged, (unsigned long long)total.instructions,
+            (unsigned long long)total.cycles, ratio(total.cycles, total.instructions));
+    if (self->has_cache_sim || CacheSim_enabled(&self->config)) {
+        fprintf(stderr, "[SAMPLED] miss rate L1I %.4f, L1D %.4f, L2 %.4f\n",
+                ratio(total.l1i_misses, total.l1i_accesses),
+                ratio(total.l1d_misses, total.l1d_accesses),
+                ratio(total.l2_misses, total.l2_accesses));
+    }
+    if (self->config.timing_model) {
+        fprintf(stderr, "[SAMPLED] %llu branches, mispredict rate %.4f\n",
+                (unsigned long long)total.branches,
+                ratio(total.branch_mispredicts, total.branches));
+    }
+}
+
+// wait for a worker (and for none of the other children of the embedder)
+static void ISS_sample_reap(pid_t pid) {
+    while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+}
+
+int ISS_run_sampled(ISS *self) {
+    Assert(self != NULL, "self should not be NULL!");
+    Assert(self->config.sample_interval != 0, "sample_interval should not be 0");
+    Assert(self->num_harts == 1, "sampled execution of several harts is not supported");
+    long jobs = self->config.sample_jobs ? (long)self->config.sample_jobs
+                                         : sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = (jobs > 0) ? jobs : 1;
+
+    // the running workers, oldest first from workers[oldest]
+    pid_t *workers = malloc(jobs * sizeof(pid_t));
+    int fds[2];
+    if (workers == NULL || pipe(fds) != 0) {
+        free(workers);
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    iss_sample_t *samples = NULL;
+    size_t num = 0, capacity = 0;
+    uint64_t intervals = 0;
+    long running       = 0;
+    long oldest        = 0;
+    int ret            = 0;
+    while (!self->halt_mmio.halt_flag) {
+        // at most `jobs` workers at once; drain first so that none of them
+        // blocks on a full pipe while being waited for
+        if (running == jobs) {
+            ISS_sample_drain(fds[0], &samples, &num, &capacity);
+            ISS_sample_reap(workers[oldest]);
+            oldest = (oldest + 1) % jobs;
+            running -= 1;
+        }
+
+        // the child inherits a copy-on-write image of the whole ISS
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            ISS_sample_worker(self, intervals, fds[1]);
+        }
+        if (pid < 0) {
+            ret = -1;
+            break;
+        }
+        workers[(oldest + running) % jobs] = pid;
+        running += 1;
+        intervals += 1;
+
+        // fast-forward functionally to the next interval
+        ISS_step(self, self->config.sample_interval);
+    }
+
+    // the pipe reaches EOF once every worker has exited
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, 0);
+    ISS_sample_drain(fds[0], &samples, &num, &capacity);
+    close(fds[0]);
+    for (; running > 0; running--) {
+        ISS_sample_reap(workers[oldest]);
+        oldest = (oldest + 1) % jobs;
+    }
+    free(workers);
+
+    ISS_sample_report(self, samples, num, intervals);
+    free(samples);
+    return ret;
+}
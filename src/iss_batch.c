@@ -0,0 +1,571 @@
+#include "iss.h"
+
+#include "arch.h"
+#include "common.h"
+#include "csr.h"
+#include "halt.h"
+#include "inst.h"
+#include "input_file.h"
+#include "load_elf.h"
+#include "main_mem.h"
+#include "rom.h"
+#include "syscall_proxy.h"
+#include "text_buffer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Lockstep interpreter of many instances ("lanes") of one program. The
+ * architectural state is kept as structure of arrays, and every step runs
+ * the instruction at the smallest PC of the running lanes for all lanes at
+ * that PC at once: while the lanes agree this is the whole batch, after a
+ * divergent branch the groups run one after the other until their PCs meet
+ * again (min-PC reconvergence). Register kernels use GCC vector extensions,
+ * compiled for AVX-512, AVX2 and a baseline with runtime dispatch.
+ *
+ * Supported: RV32I, ECALL exit, reads of cycle/instret, code in the (shared)
+ * ROM, a private main memory and input (InputFile and its window) per lane,
+ * TextBuffer (output dropped) and Halt, all as the ISS runs them. Anything
+ * else (other extensions, CSRs and syscalls, devices, and whatever the ISS
+ * traps on) halts the lane with a fault at the instruction.
+ */
+
+#define BATCH_VEC_BYTES 64
+#define BATCH_VEC (BATCH_VEC_BYTES / sizeof(uint32_t))
+// retired counters are 32-bit per step, folded into 64 bits in time
+#define BATCH_FOLD_STEPS (1ul << 31)
+
+typedef uint32_t vec_u __attribute__((vector_size(BATCH_VEC_BYTES)));
+typedef int32_t vec_s __attribute__((vector_size(BATCH_VEC_BYTES)));
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define BATCH_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define BATCH_KERNEL
+#endif
+
+struct iss_batch {
+    unsigned num_lanes; // as requested
+    unsigned lanes;     // padded to a multiple of BATCH_VEC
+    unsigned live;      // lanes not halted yet
+
+    // architectural state, gpr[r * lanes + lane]
+    reg_t *gpr;
+    reg_t *pc;
+    uint32_t *live_mask; // ~0 for running lanes
+    uint32_t *mask;      // ~0 for the lanes of the current step
+    uint32_t *retired;   // retired instructions since the last fold
+    uint64_t *instret;
+    bool *fault;
+    unsigned long steps; // since the last fold
+
+    // memories: shared ROM (code), private main memory and input per lane
+    byte_t rom[ROM_SIZE];
+    byte_t *mem; // lane * MAIN_MEM_SIZE
+    const byte_t **input;
+    uint64_t *input_size;
+    uint64_t *cursor;
+    reg_t *window; // INPUT_REG_WINDOW
+};
+
+/* ------------------------------ lanes ------------------------------ */
+// a halting instruction retires like in ISS_step(), a faulting one does not
+// and the PC stays at it
+static void ISSBatch_halt_lane(ISSBatch *self, unsigned lane, bool fault) {
+    self->live_mask[lane] = 0;
+    self->fault[lane]     = fault;
+    if (fault) {
+        self->mask[lane] = 0;
+    }
+    self->live -= 1;
+}
+
+// the lanes of the step stop at an instruction they cannot execute
+static void ISSBatch_fault_group(ISSBatch *self) {
+    for (unsigned i = 0; i < self->lanes; i++) {
+        if (self->mask[i]) {
+            ISSBatch_halt_lane(self, i, true);
+        }
+    }
+}
+
+static uint64_t ISSBatch_lane_instret(const ISSBatch *self, unsigned lane) {
+    return self->instret[lane] + self->retired[lane];
+}
+
+/* ------------------------- per-lane memory ------------------------- */
+// little-endian value of length bytes at addr, false on an unsupported access
+static bool ISSBatch_load(ISSBatch *self, unsigned lane, addr_t addr, unsigned length, reg_t *value) {
+    byte_t buffer[4] = {};
+    if ((addr & (length - 1)) != 0) {
+        return false; // misaligned
+    }
+    if (addr < ROM_MMAP_BASE + ROM_SIZE && ROM_MMAP_BASE + ROM_SIZE - addr >= length) {
+        memcpy(buffer, &self->rom[addr - ROM_MMAP_BASE], length);
+    } else if (addr >= MAIN_MEM_MMAP_BASE && addr - MAIN_MEM_MMAP_BASE <= MAIN_MEM_SIZE - length) {
+        memcpy(buffer, &self->mem[(size_t)lane * MAIN_MEM_SIZE + (addr - MAIN_MEM_MMAP_BASE)], length);
+    } else if (addr >= INPUT_WINDOW_MMAP_BASE &&
+               addr - INPUT_WINDOW_MMAP_BASE <= INPUT_WINDOW_SIZE - length) {
+        uint64_t offset = (uint64_t)self->window[lane] * INPUT_WINDOW_SIZE +
+                          (addr - INPUT_WINDOW_MMAP_BASE);
+        for (unsigned i = 0; i < length && offset + i < self->input_size[lane]; i++) {
+            buffer[i] = self->input[lane][offset + i];
+        }
+    } else if (addr == INPUT_FILE_MMAP_BASE + INPUT_REG_DATA) {
+        for (unsigned i = 0; i < length && self->cursor[lane] + i < self->input_size[lane]; i++) {
+            buffer[i] = self->input[lane][self->cursor[lane] + i];
+        }
+        self->cursor[lane] += length;
+    } else if (addr >= INPUT_FILE_MMAP_BASE && addr < INPUT_FILE_MMAP_BASE + INPUT_FILE_SIZE &&
+               length == 4) {
+        uint64_t size = self->input_size[lane], cursor = self->cursor[lane];
+        reg_t reg     = 0;
+        switch (addr - INPUT_FILE_MMAP_BASE) {
+        case INPUT_REG_SIZE_LO:   reg = (reg_t)size;                         break;
+        case INPUT_REG_SIZE_HI:   reg = (reg_t)(size >> 32);                 break;
+        case INPUT_REG_WINDOW:    reg = self->window[lane];                  break;
+        case INPUT_REG_CURSOR_LO: reg = (reg_t)cursor;                       break;
+        case INPUT_REG_CURSOR_HI: reg = (reg_t)(cursor >> 32);               break;
+        case INPUT_REG_STATUS:    reg = (cursor >= size) ? INPUT_STATUS_EOF : 0; break;
+        default:                  reg = 0;                                   break;
+        }
+        *value = reg;
+        return true;
+    } else if (addr == TEXT_BUFFER_MMAP_BASE && length == 1) {
+        // nothing buffered, the output of lanes is dropped
+    } else if (addr >= HALT_MMAP_BASE && addr - HALT_MMAP_BASE < HALT_SIZE && length == 1) {
+        // a running lane has not halted
+    } else {
+        return false;
+    }
+    *value = (reg_t)buffer[0] | ((reg_t)buffer[1] << 8) | ((reg_t)buffer[2] << 16) |
+             ((reg_t)buffer[3] << 24);
+    return true;
+}
+
+static bool ISSBatch_store(ISSBatch *self, unsigned lane, addr_t addr, unsigned length, reg_t value) {
+    if ((addr & (length - 1)) != 0) {
+        return false; // misaligned
+    }
+    if (addr >= MAIN_MEM_MMAP_BASE && addr - MAIN_MEM_MMAP_BASE <= MAIN_MEM_SIZE - length) {
+        byte_t *dst = &self->mem[(size_t)lane * MAIN_MEM_SIZE + (addr - MAIN_MEM_MMAP_BASE)];
+        for (unsigned i = 0; i < length; i++) {
+            dst[i] = (byte_t)(value >> (8 * i));
+        }
+    } else if (addr >= HALT_MMAP_BASE && addr - HALT_MMAP_BASE < HALT_SIZE && length == 1) {
+        if (value & 0x1) {
+            ISSBatch_halt_lane(self, lane, false);
+        }
+    } else if (addr == TEXT_BUFFER_MMAP_BASE && length == 1) {
+        // output of lanes is dropped
+    } else if (addr >= INPUT_FILE_MMAP_BASE && addr < INPUT_FILE_MMAP_BASE + INPUT_FILE_SIZE &&
+               length == 4) {
+        uint64_t cursor = self->cursor[lane];
+        switch (addr - INPUT_FILE_MMAP_BASE) {
+        case INPUT_REG_WINDOW:    self->window[lane] = value;                           break;
+        case INPUT_REG_CURSOR_LO: cursor = (cursor & 0xffffffff00000000ull) | value;    break;
+        case INPUT_REG_CURSOR_HI: cursor = (cursor & 0xffffffffull) | ((uint64_t)value << 32); break;
+        default:                  break;
+        }
+        self->cursor[lane] = cursor;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* ------------------------------ step ------------------------------- */
+BATCH_KERNEL static void ISSBatch_step_group(ISSBatch *self) {
+    const unsigned lanes  = self->lanes;
+    const unsigned chunks = lanes / BATCH_VEC;
+    vec_u *P = (vec_u *)self->pc, *L = (vec_u *)self->live_mask, *M = (vec_u *)self->mask;
+    vec_u *R = (vec_u *)self->retired;
+
+    // reconverge at the smallest PC of the running lanes
+    vec_u vmin = P[0] | ~L[0];
+    for (unsigned k = 1; k < chunks; k++) {
+        vec_u v  = P[k] | ~L[k];
+        vec_u lt = (vec_u)(v < vmin);
+        vmin     = (v & lt) | (vmin & ~lt);
+    }
+    reg_t pc = vmin[0];
+    for (unsigned i = 1; i < BATCH_VEC; i++) {
+        pc = (vmin[i] < pc) ? vmin[i] : pc;
+    }
+    for (unsigned k = 0; k < chunks; k++) {
+        M[k] = (vec_u)(P[k] == pc) & L[k];
+    }
+
+    // one fetch and decode for the whole group
+    if (pc > ROM_SIZE - 4 || (pc & 0x3) != 0) {
+        ISSBatch_fault_group(self);
+        return;
+    }
+    reg_t raw = (reg_t)self->rom[pc] | ((reg_t)self->rom[pc + 1] << 8) |
+                ((reg_t)self->rom[pc + 2] << 16) | ((reg_t)self->rom[pc + 3] << 24);
+
+    #define GETBITS(x,hi,lo) (((x) >> (lo)) & ((uint32_t)((1u << ((hi)-(lo)+1)) - 1u)))
+    #define SEXT(val,bits)   ((int32_t)((int32_t)((uint32_t)(val) << (32-(bits))) >> (32-(bits))))
+
+    reg_t opcode = GETBITS(raw, 6, 0);
+    reg_t rd     = GETBITS(raw, 11, 7);
+    reg_t funct3 = GETBITS(raw, 14, 12);
+    reg_t rs1    = GETBITS(raw, 19, 15);
+    reg_t rs2    = GETBITS(raw, 24, 20);
+    reg_t funct7 = GETBITS(raw, 31, 25);
+
+    int32_t imm_i = SEXT(GETBITS(raw, 31, 20), 12);
+    int32_t imm_s = SEXT(((GETBITS(raw,31,25) << 5) | GETBITS(raw,11,7)), 12);
+    int32_t imm_b = SEXT(
+        ((GETBITS(raw, 31,31) << 12) |
+         (GETBITS(raw, 7,7)   << 11) |
+         (GETBITS(raw, 30,25) << 5 ) |
+         (GETBITS(raw, 11,8)  << 1 )),
+        13
+    );
+    reg_t   imm_u = (raw & 0xFFFFF000u);
+    int32_t imm_j = SEXT(
+        ((GETBITS(raw, 31,31) << 20) |
+         (GETBITS(raw, 19,12) << 12) |
+         (GETBITS(raw, 20,20) << 11) |
+         (GETBITS(raw, 30,21) << 1 )),
+        21
+    );
+
+    reg_t *gpr = self->gpr;
+    vec_u *RD  = (vec_u *)&gpr[rd * lanes];
+    vec_u *RS1 = (vec_u *)&gpr[rs1 * lanes];
+    vec_u *RS2 = (vec_u *)&gpr[rs2 * lanes];
+    reg_t pc4  = pc + 4;
+    reg_t npc  = pc4; // next PC of the group, unless the instruction sets P
+
+    // masked register write
+    #define WRITE_RD(k, res)                                        \
+        do {                                                        \
+            if (rd != 0) {                                          \
+                RD[k] = ((res) & M[k]) | (RD[k] & ~M[k]);           \
+            }                                                       \
+        } while (0)
+    // res = expr(a, b) over the group, b from rs2 or the immediate
+    #define ALU(b_expr, expr)                                       \
+        for (unsigned k = 0; k < chunks; k++) {                     \
+            vec_u a = RS1[k], b = (b_expr);                         \
+            (void)b;                                                \
+            WRITE_RD(k, (expr));                                    \
+        }                                                           \
+        break
+    #define ALU_OPS(b_expr, is_sub, is_sra)                                         \
+        switch (funct3) {                                                           \
+        case 0x0: if (is_sub) { ALU(b_expr, a - b); } else { ALU(b_expr, a + b); }  \
+        case 0x1: ALU(b_expr, a << (b & 31));                                       \
+        case 0x2: ALU(b_expr, (vec_u)((vec_s)a < (vec_s)b) & 1);                    \
+        case 0x3: ALU(b_expr, (vec_u)(a < b) & 1);                                  \
+        case 0x4: ALU(b_expr, a ^ b);                                               \
+        case 0x5:                                                                   \
+            if (is_sra) { ALU(b_expr, (vec_u)((vec_s)a >> (vec_s)(b & 31))); }      \
+            else        { ALU(b_expr, a >> (b & 31)); }                             \
+        case 0x6: ALU(b_expr, a | b);                                               \
+        case 0x7: ALU(b_expr, a & b);                                               \
+        }
+
+    switch (opcode) {
+    case OP: {
+        if (funct7 != 0x00 && !(funct7 == 0x20 && (funct3 == 0x0 || funct3 == 0x5))) {
+            ISSBatch_fault_group(self); // M, bit manipulation
+            return;
+        }
+        ALU_OPS(RS2[k], funct7 == 0x20, funct7 == 0x20);
+        break;
+    }
+    case OP_IMM: {
+        if ((funct3 == 0x1 && funct7 != 0x00) ||
+            (funct3 == 0x5 && funct7 != 0x00 && funct7 != 0x20)) {
+            ISSBatch_fault_group(self); // bit manipulation
+            return;
+        }
+        ALU_OPS((vec_u){} + (reg_t)imm_i, false, funct7 == 0x20);
+        break;
+    }
+
+    case LOAD: {
+        if (funct3 == 0x3 || funct3 > 0x5) {
+            ISSBatch_fault_group(self);
+            return;
+        }
+        for (unsigned i = 0; i < lanes; i++) {
+            if (!self->mask[i]) {
+                continue;
+            }
+            unsigned length = 1u << (funct3 & 0x3);
+            reg_t value;
+            if (!ISSBatch_load(self, i, gpr[rs1 * lanes + i] + (reg_t)imm_i, length, &value)) {
+                ISSBatch_halt_lane(self, i, true);
+                continue;
+            }
+            switch (funct3) {
+            case 0x0: value = (reg_t)SEXT(value, 8);  break; // LB
+            case 0x1: value = (reg_t)SEXT(value, 16); break; // LH
+            default:  break;                                 // LW/LBU/LHU
+            }
+            if (rd != 0) {
+                gpr[rd * lanes + i] = value;
+            }
+        }
+        break;
+    }
+    case STORE: {
+        if (funct3 > 0x2) {
+            ISSBatch_fault_group(self);
+            return;
+        }
+        for (unsigned i = 0; i < lanes; i++) {
+            unsigned length = 1u << funct3;
+            if (self->mask[i] && !ISSBatch_store(self, i, gpr[rs1 * lanes + i] + (reg_t)imm_s,
+                                                 length, gpr[rs2 * lanes + i])) {
+                ISSBatch_halt_lane(self, i, true);
+            }
+        }
+        break;
+    }
+
+    case BRANCH: {
+        if (funct3 == 0x2 || funct3 == 0x3) {
+            ISSBatch_fault_group(self);
+            return;
+        }
+        reg_t target = pc + (reg_t)imm_b;
+        for (unsigned k = 0; k < chunks; k++) {
+            vec_u a = RS1[k], b = RS2[k], take;
+            switch (funct3) {
+            case 0x0: take = (vec_u)(a == b);                 break; // BEQ
+            case 0x1: take = (vec_u)(a != b);                 break; // BNE
+            case 0x4: take = (vec_u)((vec_s)a <  (vec_s)b);   break; // BLT
+            case 0x5: take = (vec_u)((vec_s)a >= (vec_s)b);   break; // BGE
+            case 0x6: take = (vec_u)(a <  b);                 break; // BLTU
+            case 0x7: take = (vec_u)(a >= b);                 break; // BGEU
+            default:  take = (vec_u){};                       break;
+            }
+            // lanes going different ways split into two groups here
+            vec_u next = (take & target) | (~take & pc4);
+            P[k]       = (next & M[k]) | (P[k] & ~M[k]);
+            R[k] -= M[k];
+        }
+        return;
+    }
+    case JAL: {
+        for (unsigned k = 0; k < chunks; k++) {
+            WRITE_RD(k, (vec_u){} + pc4);
+        }
+        npc = pc + (reg_t)imm_j;
+        break;
+    }
+    case JALR: {
+        if (funct3 != 0x0) {
+            ISSBatch_fault_group(self);
+            return;
+        }
+        for (unsigned k = 0; k < chunks; k++) {
+            vec_u next = (RS1[k] + (reg_t)imm_i) & ~1u; // before rd is written
+            WRITE_RD(k, (vec_u){} + pc4);
+            P[k] = (next & M[k]) | (P[k] & ~M[k]);
+            R[k] -= M[k];
+        }
+        return;
+    }
+    case AUIPC: {
+        for (unsigned k = 0; k < chunks; k++) {
+            WRITE_RD(k, (vec_u){} + (pc + imm_u));
+        }
+        break;
+    }
+    case LUI: {
+        for (unsigned k = 0; k < chunks; k++) {
+            WRITE_RD(k, (vec_u){} + imm_u);
+        }
+        break;
+    }
+
+    case MISC_MEM: {
+        // FENCE and FENCE.I order nothing for a lane
+        if (funct3 != 0x0 && funct3 != 0x1) {
+            ISSBatch_fault_group(self);
+            return;
+        }
+        break;
+    }
+
+    case SYSTEM: {
+        // only ECALL and reads of the counters (csrr), a lane retires one
+        // instruction per step it takes part in
+        unsigned csr_addr = (unsigned)GETBITS(raw, 31, 20);
+        bool ecall        = (funct3 == 0x0 && csr_addr == ECALL_FUNC12 && rs1 == 0 && rd == 0);
+        bool counter      = ((funct3 & 0x3) >= 0x2 && rs1 == 0 &&
+                             (csr_addr == CSR_CYCLE || csr_addr == CSR_INSTRET ||
+                              csr_addr == CSR_CYCLEH || csr_addr == CSR_INSTRETH));
+        if (!ecall && !counter) {
+            ISSBatch_fault_group(self);
+            return;
+        }
+        for (unsigned i = 0; i < lanes; i++) {
+            if (!self->mask[i]) {
+                continue;
+            }
+            if (ecall) {
+                // the ISS proxies the other syscalls to the host
+                reg_t a7 = gpr[17 * lanes + i];
+                ISSBatch_halt_lane(self, i, a7 != SYS_EXIT && a7 != SYS_EXIT_GROUP);
+            } else if (rd != 0) {
+                uint64_t count = ISSBatch_lane_instret(self, i);
+                bool high      = (csr_addr == CSR_CYCLEH || csr_addr == CSR_INSTRETH);
+                gpr[rd * lanes + i] = high ? (reg_t)(count >> 32) : (reg_t)count;
+            }
+        }
+        break;
+    }
+
+    default:
+        // illegal, or an extension left out of the batch
+        ISSBatch_fault_group(self);
+        return;
+    }
+
+    // the group moves on together
+    for (unsigned k = 0; k < chunks; k++) {
+        P[k] = (((vec_u){} + npc) & M[k]) | (P[k] & ~M[k]);
+        R[k] -= M[k];
+    }
+
+    #undef ALU_OPS
+    #undef ALU
+    #undef WRITE_RD
+    #undef GETBITS
+    #undef SEXT
+}
+
+void ISSBatch_step(ISSBatch *self, unsigned long n_step) {
+    Assert(self != NULL, "self should not be NULL!");
+    for (; n_step > 0 && self->live > 0; n_step--) {
+        ISSBatch_step_group(self);
+        if (unlikely(++self->steps == BATCH_FOLD_STEPS)) {
+            for (unsigned i = 0; i < self->lanes; i++) {
+                self->instret[i] += self->retired[i];
+                self->retired[i] = 0;
+            }
+            self->steps = 0;
+        }
+    }
+}
+
+/* --------------------------- ctor / dtor --------------------------- */
+int ISSBatch_ctor(ISSBatch **self, const char *elf_file_name, unsigned num_lanes) {
+    assert(self != NULL);
+    if (num_lanes == 0 || NULL == (*self = calloc(1, sizeof(struct iss_batch)))) {
+        return -1;
+    }
+    ISSBatch *self_  = *self;
+    unsigned lanes   = (num_lanes + BATCH_VEC - 1) / BATCH_VEC * BATCH_VEC;
+    self_->num_lanes = num_lanes;
+    self_->lanes     = lanes;
+    self_->live      = num_lanes;
+
+    // vector rows are aligned to the vector size
+    size_t row = lanes * sizeof(uint32_t);
+    self_->gpr        = aligned_alloc(BATCH_VEC_BYTES, 32 * row);
+    self_->pc         = aligned_alloc(BATCH_VEC_BYTES, row);
+    self_->live_mask  = aligned_alloc(BATCH_VEC_BYTES, row);
+    self_->mask       = aligned_alloc(BATCH_VEC_BYTES, row);
+    self_->retired    = aligned_alloc(BATCH_VEC_BYTES, row);
+    self_->instret    = calloc(lanes, sizeof(uint64_t));
+    self_->fault      = calloc(lanes, sizeof(bool));
+    self_->mem        = calloc(num_lanes, MAIN_MEM_SIZE);
+    self_->input      = calloc(lanes, sizeof(const byte_t *));
+    self_->input_size = calloc(lanes, sizeof(uint64_t));
+    self_->cursor     = calloc(lanes, sizeof(uint64_t));
+    self_->window     = calloc(lanes, sizeof(reg_t));
+    if (!self_->gpr || !self_->pc || !self_->live_mask || !self_->mask || !self_->retired ||
+        !self_->instret || !self_->fault || !self_->mem || !self_->input || !self_->input_size ||
+        !self_->cursor || !self_->window) {
+        ISSBatch_dtor(self_);
+        *self = NULL;
+        return -1;
+    }
+
+    // every lane starts at the entry of the same program
+    reg_t entry_pc;
+    elf_region_t rom = { .base = ROM_MMAP_BASE, .ptr = self_->rom, .size = ROM_SIZE };
+    load_elf(elf_file_name, &rom, 1, &entry_pc, NULL);
+    memset(self_->gpr, 0, 32 * row);
+    memset(self_->mask, 0, row);
+    memset(self_->retired, 0, row);
+    for (unsigned i = 0; i < lanes; i++) {
+        self_->pc[i]        = entry_pc;
+        self_->live_mask[i] = (i < num_lanes) ? ~0u : 0; // padding never runs
+    }
+    return 0;
+}
+
+void ISSBatch_dtor(ISSBatch *self) {
+    free(self->gpr);
+    free(self->pc);
+    free(self->live_mask);
+    free(self->mask);
+    free(self->retired);
+    free(self->instret);
+    free(self->fault);
+    free(self->mem);
+    free(self->input);
+    free(self->input_size);
+    free(self->cursor);
+    free(self->window);
+    free(self);
+}
+
+/* ---------------------------- accessors ---------------------------- */
+void ISSBatch_set_input(ISSBatch *self, unsigned lane, const byte_t *data, size_t size) {
+    Assert(self != NULL && lane < self->num_lanes, "lane out of range");
+    self->input[lane]      = data;
+    self->input_size[lane] = size;
+    self->cursor[lane]     = 0;
+    self->window[lane]     = 0;
+}
+
+bool ISSBatch_get_halt(const ISSBatch *self, unsigned lane) {
+    Assert(self != NULL && lane < self->num_lanes, "lane out of range");
+    return self->live_mask[lane] == 0;
+}
+
+bool ISSBatch_get_fault(const ISSBatch *self, unsigned lane) {
+    Assert(self != NULL && lane < self->num_lanes, "lane out of range");
+    return self->fault[lane];
+}
+
+uint64_t ISSBatch_get_instret(const ISSBatch *self, unsigned lane) {
+    Assert(self != NULL && lane < self->num_lanes, "lane out of range");
+    return ISSBatch_lane_instret(self, lane);
+}
+
+arch_state_t ISSBatch_get_arch_state(const ISSBatch *self, unsigned lane) {
+    Assert(self != NULL && lane < self->num_lanes, "lane out of range");
+    arch_state_t ret = {};
+    ret.current_pc   = self->pc[lane];
+    for (unsigned r = 0; r < 32; r++) {
+        ret.gpr[r] = self->gpr[r * self->lanes + lane];
+    }
+    return ret;
+}
+
+void ISSBatch_get_main_memory(const ISSBatch *self,
+                              unsigned lane,
+                              const addr_t base_addr,
+                              const unsigned length,
+                              byte_t *buffer) {
+    Assert(self != NULL && lane < self->num_lanes, "lane out of range");
+    Assert(base_addr >= MAIN_MEM_MMAP_BASE && base_addr - MAIN_MEM_MMAP_BASE <= MAIN_MEM_SIZE &&
+               MAIN_MEM_MMAP_BASE + MAIN_MEM_SIZE - base_addr >= length,
+           "range out of main memory");
+    memcpy(buffer, &self->mem[(size_t)lane * MAIN_MEM_SIZE + (base_addr - MAIN_MEM_MMAP_BASE)],
+           length);
+}
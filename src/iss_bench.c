@@ -0,0 +1,530 @@
+#include "iss.h"
+#include "common.h"
+#include "halt.h"
+#include "main_mem.h"
+#include "rom.h"
+#include "rv_asm.h"
+#include "text_buffer.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Throughput benchmark: runs bundled RV32I workloads (assembled with rv_asm.h,
+ * so no cross toolchain is needed) several times each and reports instructions
+ * retired, host ns per instruction, MIPS, ISS_ctor latency and peak RSS as
+ * JSON. The guest output and the ISS log go to /dev/null. With -b, every
+ * workload also runs as one ISSBatch of that many lanes, against as many
+ * ISS runs one after the other.
+ */
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r runs] [-s scale] [-w workload] [-o file] [-f] [-b lanes]\n",
+            prog);
+    fprintf(stderr, "  -r runs   timed runs per workload, after one warm-up (default 5)\n");
+    fprintf(stderr, "  -s scale  multiply the work of every workload (default 1)\n");
+    fprintf(stderr, "  -w name   run this workload only (alu, branchy, stream, mergesort,\n");
+    fprintf(stderr, "            recursion, mmio)\n");
+    fprintf(stderr, "  -o file   write the JSON report to file (default stdout)\n");
+    fprintf(stderr, "  -f        run with unchecked RAM accesses (fast_mem)\n");
+    fprintf(stderr, "  -b lanes  also run lanes copies in lockstep with ISSBatch (RV32 only)\n");
+}
+
+/* ---------------------------- workloads ---------------------------- */
+// x ^= x << 13; x ^= x >> 17; x ^= x << 5 (tmp is clobbered)
+static void XORSHIFT(prog_t *p, unsigned x, unsigned tmp) {
+    SLLI(p, tmp, x, 13);
+    XOR(p, x, x, tmp);
+    SRLI(p, tmp, x, 17);
+    XOR(p, x, x, tmp);
+    SLLI(p, tmp, x, 5);
+    XOR(p, x, x, tmp);
+}
+
+// the instructions retired go to a1 (low) and a2 (high), then halt
+static void epilogue(prog_t *p) {
+    CSRR(p, A1, 0xc02); // instret
+    CSRR(p, A2, 0xc82); // instreth
+    HALT(p);
+    place(p, PROG_MAX_LABELS - 1);
+    J(p, PROG_MAX_LABELS - 1);
+}
+
+// tight register-only ALU loop, 10 instructions per iteration
+static void workload_alu(prog_t *p, unsigned long scale) {
+    enum { LOOP };
+    LI(p, T0, (uint32_t)(4000000 * scale));
+    LI(p, A0, 0x12345678);
+    LI(p, A3, 0x9abcdef1);
+    place(p, LOOP);
+    ADD(p, A0, A0, A3);
+    XOR(p, A3, A3, A0);
+    SLLI(p, A4, A0, 3);
+    SRLI(p, A5, A3, 5);
+    OR(p, A4, A4, A5);
+    SUB(p, A0, A0, A4);
+    ANDI(p, A5, A3, 0xff);
+    XOR(p, A3, A3, A5);
+    ADDI(p, T0, T0, -1);
+    BNE(p, T0, ZERO, LOOP);
+    epilogue(p);
+}
+
+// data-dependent branches on a xorshift sequence (hard to predict)
+static void workload_branchy(prog_t *p, unsigned long scale) {
+    enum { LOOP, SKIP1, SKIP2, SKIP3 };
+    LI(p, T0, (uint32_t)(2000000 * scale));
+    LI(p, A0, 0x2545f491);
+    LI(p, A3, 0x80000000);
+    LI(p, S1, 0);
+    LI(p, S2, 0);
+    LI(p, S3, 0);
+    place(p, LOOP);
+    XORSHIFT(p, A0, T1);
+    ANDI(p, T1, A0, 1);
+    BEQ(p, T1, ZERO, SKIP1);
+    ADDI(p, S1, S1, 1);
+    place(p, SKIP1);
+    ANDI(p, T1, A0, 2);
+    BNE(p, T1, ZERO, SKIP2);
+    ADDI(p, S2, S2, 3);
+    place(p, SKIP2);
+    BLTU(p, A0, A3, SKIP3);
+    XOR(p, S3, S3, A0);
+    place(p, SKIP3);
+    ADDI(p, T0, T0, -1);
+    BNE(p, T0, ZERO, LOOP);
+    ADD(p, A0, S1, S2);
+    XOR(p, A0, A0, S3);
+    epilogue(p);
+}
+
+// dst[i] = src[i] + k over two 16 KB arrays, unrolled by 4
+static void workload_stream(prog_t *p, unsigned long scale) {
+    enum { INIT, PASS, LOOP };
+    const uint32_t src = MAIN_MEM_MMAP_BASE, dst = MAIN_MEM_MMAP_BASE + 0x4000;
+    LI(p, S0, src);
+    LI(p, S2, src + 0x4000);
+    LI(p, A0, 1);
+    MV(p, T2, S0);
+    place(p, INIT);
+    SW(p, A0, 0, T2);
+    ADDI(p, A0, A0, 3);
+    ADDI(p, T2, T2, 4);
+    BNE(p, T2, S2, INIT);
+
+    LI(p, T0, (uint32_t)(2000 * scale));
+    LI(p, A0, 0);
+    place(p, PASS);
+    ADDI(p, A0, A0, 1);
+    MV(p, T2, S0);
+    LI(p, T3, dst);
+    place(p, LOOP);
+    LW(p, A2, 0, T2);
+    LW(p, A3, 4, T2);
+    LW(p, A4, 8, T2);
+    LW(p, A5, 12, T2);
+    ADD(p, A2, A2, A0);
+    ADD(p, A3, A3, A0);
+    ADD(p, A4, A4, A0);
+    ADD(p, A5, A5, A0);
+    SW(p, A2, 0, T3);
+    SW(p, A3, 4, T3);
+    SW(p, A4, 8, T3);
+    SW(p, A5, 12, T3);
+    ADDI(p, T2, T2, 16);
+    ADDI(p, T3, T3, 16);
+    BNE(p, T2, S2, LOOP);
+    ADDI(p, T0, T0, -1);
+    BNE(p, T0, ZERO, PASS);
+    LW(p, A0, -4, T3);
+    epilogue(p);
+}
+
+// bottom-up merge sort of 2048 xorshift words, then a check that they are
+// sorted (a0 = 0 if so)
+static void workload_mergesort(prog_t *p, unsigned long scale) {
+    enum { REPEAT, FILL, WIDTH, RUN, MID_OK, END_OK, MERGE, TAKE_L, TAKE_R, NEXT, RUN_DONE,
+           CHECK, BAD, DONE };
+    const uint32_t n_bytes = 2048 * 4;
+    LI(p, S6, (uint32_t)(100 * scale));
+    LI(p, S5, 0x2545f491);
+    LI(p, S2, n_bytes);
+    place(p, REPEAT);
+    // fill the array with the next xorshift values
+    LI(p, S0, MAIN_MEM_MMAP_BASE);
+    LI(p, S1, MAIN_MEM_MMAP_BASE + n_bytes);
+    MV(p, T2, S0);
+    place(p, FILL);
+    XORSHIFT(p, S5, T1);
+    SW(p, S5, 0, T2);
+    ADDI(p, T2, T2, 4);
+    BNE(p, T2, S1, FILL);
+
+    // s0: source, s1: destination, s3: width in bytes, s4: run start
+    LI(p, S3, 4);
+    place(p, WIDTH);
+    LI(p, S4, 0);
+    place(p, RUN);
+    ADD(p, T1, S4, S3); // end of the left half
+    BLTU(p, T1, S2, MID_OK);
+    MV(p, T1, S2);
+    place(p, MID_OK);
+    ADD(p, T2, T1, S3); // end of the right half
+    BLTU(p, T2, S2, END_OK);
+    MV(p, T2, S2);
+    place(p, END_OK);
+    MV(p, T3, S4); // left
+    MV(p, T4, T1); // right
+    MV(p, T5, S4); // out
+    place(p, MERGE);
+    BGEU(p, T3, T1, TAKE_R);
+    BGEU(p, T4, T2, TAKE_L);
+    ADD(p, A2, S0, T3);
+    LW(p, A3, 0, A2);
+    ADD(p, A2, S0, T4);
+    LW(p, A4, 0, A2);
+    BLTU(p, A4, A3, TAKE_R);
+    place(p, TAKE_L);
+    ADD(p, A2, S0, T3);
+    LW(p, A3, 0, A2);
+    ADD(p, A5, S1, T5);
+    SW(p, A3, 0, A5);
+    ADDI(p, T3, T3, 4);
+    J(p, NEXT);
+    place(p, TAKE_R);
+    BGEU(p, T4, T2, RUN_DONE);
+    ADD(p, A2, S0, T4);
+    LW(p, A4, 0, A2);
+    ADD(p, A5, S1, T5);
+    SW(p, A4, 0, A5);
+    ADDI(p, T4, T4, 4);
+    place(p, NEXT);
+    ADDI(p, T5, T5, 4);
+    J(p, MERGE);
+    place(p, RUN_DONE);
+    MV(p, S4, T2);
+    BLTU(p, S4, S2, RUN);
+    // the destination is the source of the next width
+    MV(p, T0, S0);
+    MV(p, S0, S1);
+    MV(p, S1, T0);
+    SLLI(p, S3, S3, 1);
+    BLTU(p, S3, S2, WIDTH);
+
+    // check the order
+    LI(p, A0, 0);
+    MV(p, T2, S0);
+    ADD(p, T3, S0, S2);
+    ADDI(p, T3, T3, -4);
+    place(p, CHECK);
+    LW(p, A3, 0, T2);
+    LW(p, A4, 4, T2);
+    BLTU(p, A4, A3, BAD);
+    ADDI(p, T2, T2, 4);
+    BNE(p, T2, T3, CHECK);
+    ADDI(p, S6, S6, -1);
+    BNE(p, S6, ZERO, REPEAT);
+    J(p, DONE);
+    place(p, BAD);
+    LI(p, A0, 1);
+    place(p, DONE);
+    epilogue(p);
+}
+
+// naive recursive fib(27) (a0 = 196418), call and stack heavy
+static void workload_recursion(prog_t *p, unsigned long scale) {
+    enum { REPEAT, FIB, BASE, RETURN, DONE };
+    LI(p, SP, MAIN_MEM_MMAP_BASE + MAIN_MEM_SIZE);
+    LI(p, S6, (uint32_t)(3 * scale));
+    place(p, REPEAT);
+    LI(p, A0, 27);
+    JAL(p, RA, FIB);
+    ADDI(p, S6, S6, -1);
+    BNE(p, S6, ZERO, REPEAT);
+    J(p, DONE);
+
+    place(p, FIB);
+    ADDI(p, SP, SP, -12);
+    SW(p, RA, 8, SP);
+    SW(p, S0, 4, SP);
+    SW(p, S1, 0, SP);
+    MV(p, S0, A0);
+    LI(p, T0, 2);
+    BLTU(p, A0, T0, RETURN);
+    ADDI(p, A0, S0, -1);
+    JAL(p, RA, FIB);
+    MV(p, S1, A0);
+    ADDI(p, A0, S0, -2);
+    JAL(p, RA, FIB);
+    ADD(p, A0, A0, S1);
+    place(p, RETURN);
+    LW(p, RA, 8, SP);
+    LW(p, S0, 4, SP);
+    LW(p, S1, 0, SP);
+    ADDI(p, SP, SP, 12);
+    RET(p);
+
+    place(p, DONE);
+    epilogue(p);
+}
+
+// lines of "abc...z\n" through the TextBuffer device
+static void workload_mmio(prog_t *p, unsigned long scale) {
+    enum { LINE, CHAR };
+    LI(p, T0, (uint32_t)(200000 * scale));
+    LI(p, T3, TEXT_BUFFER_MMAP_BASE);
+    LI(p, T4, 'a' + 26);
+    LI(p, T5, '\n');
+    place(p, LINE);
+    LI(p, A3, 'a');
+    place(p, CHAR);
+    SB(p, A3, 0, T3);
+    ADDI(p, A3, A3, 1);
+    BNE(p, A3, T4, CHAR);
+    SB(p, T5, 0, T3);
+    ADDI(p, T0, T0, -1);
+    BNE(p, T0, ZERO, LINE);
+    MV(p, A0, A3);
+    epilogue(p);
+}
+
+typedef struct {
+    const char *name;
+    void (*build)(prog_t *p, unsigned long scale);
+} workload_t;
+
+static const workload_t workloads[] = {
+    { "alu", workload_alu },
+    { "branchy", workload_branchy },
+    { "stream", workload_stream },
+    { "mergesort", workload_mergesort },
+    { "recursion", workload_recursion },
+    { "mmio", workload_mmio },
+};
+
+/* ----------------------------- running ----------------------------- */
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+typedef struct {
+    double ctor_ns;
+    double step_ns;
+    uint64_t instret;
+    reg_t a0;
+} run_result_t;
+
+static run_result_t run_once(const char *elf_file_name, bool fast_mem) {
+    run_result_t r;
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.fast_mem = fast_mem;
+
+    ISS *iss;
+    double t0 = now_ns();
+    Assert(ISS_ctor_with_config(&iss, elf_file_name, &config) == 0, "ISS_ctor failed!");
+    double t1 = now_ns();
+    ISS_step(iss, ~0ul);
+    double t2 = now_ns();
+    Assert(ISS_get_halt(iss), "The workload did not halt");
+
+    arch_state_t state = ISS_get_arch_state(iss);
+    r.ctor_ns          = t1 - t0;
+    r.step_ns          = t2 - t1;
+    r.instret          = (uint64_t)(uint32_t)state.gpr[A1] | ((uint64_t)state.gpr[A2] << 32);
+    r.a0               = state.gpr[A0];
+    ISS_dtor(iss);
+    return r;
+}
+
+#if XLEN == 32
+// one ISSBatch of num_lanes lanes: the time of the lanes together, false if
+// a lane faults or ends differently than the ISS run expected
+static bool run_batch(const char *elf_file_name, unsigned num_lanes, run_result_t expected,
+                      double *step_ns) {
+    ISSBatch *batch;
+    Assert(ISSBatch_ctor(&batch, elf_file_name, num_lanes) == 0, "ISSBatch_ctor failed!");
+    double t0 = now_ns();
+    ISSBatch_step(batch, ~0ul);
+    *step_ns  = now_ns() - t0;
+    bool same = true;
+    for (unsigned lane = 0; lane < num_lanes; lane++) {
+        arch_state_t state = ISSBatch_get_arch_state(batch, lane);
+        uint64_t instret   = (uint64_t)(uint32_t)state.gpr[A1] | ((uint64_t)state.gpr[A2] << 32);
+        same = same && ISSBatch_get_halt(batch, lane) && !ISSBatch_get_fault(batch, lane) &&
+               instret == expected.instret && state.gpr[A0] == expected.a0;
+    }
+    ISSBatch_dtor(batch);
+    return same;
+}
+#endif
+
+typedef struct {
+    double mean, stdev, min, max;
+} summary_t;
+
+static summary_t summarize(const double *x, unsigned n) {
+    summary_t s = { .mean = 0, .stdev = 0, .min = x[0], .max = x[0] };
+    for (unsigned i = 0; i < n; i++) {
+        s.mean += x[i] / n;
+        s.min = fmin(s.min, x[i]);
+        s.max = fmax(s.max, x[i]);
+    }
+    for (unsigned i = 0; i < n; i++) {
+        s.stdev += (x[i] - s.mean) * (x[i] - s.mean);
+    }
+    s.stdev = (n > 1) ? sqrt(s.stdev / (n - 1)) : 0;
+    return s;
+}
+
+static void print_summary(FILE *out, const char *name, summary_t s) {
+    fprintf(out, "\"%s\": {\"mean\": %.3f, \"stdev\": %.3f, \"min\": %.3f, \"max\": %.3f}", name,
+            s.mean, s.stdev, s.min, s.max);
+}
+
+// warm-up plus runs timed runs of one workload, false if they disagree
+static bool bench(FILE *out, const workload_t *w, unsigned runs, unsigned long scale,
+                  const char *elf_file_name, bool fast_mem, unsigned num_lanes) {
+    prog_t prog;
+    prog_init(&prog);
+    w->build(&prog, scale);
+    prog_link(&prog);
+    write_elf(&prog, elf_file_name);
+
+    run_result_t first = run_once(elf_file_name, fast_mem);
+    double *ctor_us    = malloc(runs * sizeof(double));
+    double *ns_inst    = malloc(runs * sizeof(double));
+    double *mips       = malloc(runs * sizeof(double));
+    Assert(ctor_us != NULL && ns_inst != NULL && mips != NULL, "Out of memory");
+    bool same = true;
+    for (unsigned i = 0; i < runs; i++) {
+        run_result_t r = run_once(elf_file_name, fast_mem);
+        same           = same && r.instret == first.instret && r.a0 == first.a0;
+        ctor_us[i]     = r.ctor_ns / 1e3;
+        ns_inst[i]     = r.step_ns / (double)r.instret;
+        mips[i]        = (double)r.instret / r.step_ns * 1e3;
+    }
+
+    fprintf(out, "    {\"name\": \"%s\", \"instret\": %llu, \"a0\": \"0x%llx\", ", w->name,
+            (unsigned long long)first.instret, (unsigned long long)first.a0);
+    fprintf(out, "\"deterministic\": %s,\n     ", same ? "true" : "false");
+    print_summary(out, "ns_per_inst", summarize(ns_inst, runs));
+    fprintf(out, ",\n     ");
+    print_summary(out, "mips", summarize(mips, runs));
+    fprintf(out, ",\n     ");
+    print_summary(out, "ctor_us", summarize(ctor_us, runs));
+#if XLEN == 32
+    if (num_lanes > 0) {
+        // speedup: num_lanes ISS runs back to back against one batch
+        double iss_ns   = summarize(ns_inst, runs).mean * (double)first.instret * num_lanes;
+        double *speedup = malloc(runs * sizeof(double));
+        Assert(speedup != NULL, "Out of memory");
+        bool batch_same = true;
+        for (unsigned i = 0; i < runs; i++) {
+            double step_ns;
+            batch_same = run_batch(elf_file_name, num_lanes, first, &step_ns) && batch_same;
+            mips[i]    = (double)first.instret * num_lanes / step_ns * 1e3;
+            speedup[i] = iss_ns / step_ns;
+        }
+        fprintf(out, ",\n     \"batch\": {\"lanes\": %u, \"same_as_iss\": %s, ", num_lanes,
+                batch_same ? "true" : "false");
+        print_summary(out, "mips", summarize(mips, runs));
+        fprintf(out, ", ");
+        print_summary(out, "speedup", summarize(speedup, runs));
+        fprintf(out, "}");
+        same = same && batch_same;
+        free(speedup);
+    }
+#else
+    (void)num_lanes;
+#endif
+    fprintf(out, "}");
+    free(ctor_us);
+    free(ns_inst);
+    free(mips);
+    return same;
+}
+
+int main(int argc, char **argv) {
+    unsigned runs       = 5;
+    unsigned long scale = 1;
+    const char *only    = NULL;
+    const char *output  = NULL;
+    bool fast_mem       = false;
+    unsigned num_lanes  = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:w:o:fb:")) != -1) {
+        switch (opt) {
+        case 'r': runs = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 's': scale = strtoul(optarg, NULL, 0); break;
+        case 'w': only = optarg; break;
+        case 'o': output = optarg; break;
+        case 'f': fast_mem = true; break;
+        case 'b': num_lanes = (unsigned)strtoul(optarg, NULL, 0); break;
+        default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc || runs == 0 || scale == 0 || (XLEN != 32 && num_lanes > 0)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the report goes to the original stdout, everything else to /dev/null
+    FILE *out = (output != NULL) ? fopen(output, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    Assert(out != NULL, "Fail to open the report");
+    int null_fd = open("/dev/null", O_WRONLY);
+    Assert(null_fd >= 0 && dup2(null_fd, STDOUT_FILENO) >= 0, "Fail to silence stdout");
+    close(null_fd);
+
+    const char *tmp = getenv("TMPDIR");
+    char elf_file_name[4096];
+    snprintf(elf_file_name, sizeof(elf_file_name), "%s/iss_bench_XXXXXX",
+             (tmp != NULL) ? tmp : "/tmp");
+    int elf_fd = mkstemp(elf_file_name);
+    Assert(elf_fd >= 0, "Fail to create a temporary file");
+    close(elf_fd);
+
+    fprintf(out, "{\n  \"bench\": \"iss_bench\",\n  \"xlen\": %d,\n", XLEN);
+#ifdef __OPTIMIZE__
+    fprintf(out, "  \"optimized\": true,\n");
+#else
+    fprintf(out, "  \"optimized\": false,\n");
+#endif
+    fprintf(out, "  \"fast_mem\": %s,\n", fast_mem ? "true" : "false");
+    fprintf(out, "  \"runs\": %u,\n  \"scale\": %lu,\n  \"workloads\": [\n", runs, scale);
+    bool ok    = true;
+    bool comma = false;
+    bool found = false;
+    size_t num = sizeof(workloads) / sizeof(workloads[0]);
+    for (size_t i = 0; i < num; i++) {
+        if (only != NULL && strcmp(only, workloads[i].name) != 0) {
+            continue;
+        }
+        fputs(comma ? ",\n" : "", out);
+        ok    = bench(out, &workloads[i], runs, scale, elf_file_name, fast_mem, num_lanes) && ok;
+        comma = true;
+        found = true;
+        fflush(out);
+    }
+    unlink(elf_file_name);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "\n  ],\n  \"peak_rss_kb\": %ld\n}\n", usage.ru_maxrss);
+    fclose(out);
+    if (!found) {
+        fprintf(stderr, "No workload named %s\n", only);
+        return EXIT_FAILURE;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
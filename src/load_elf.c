@@ -2,7 +2,6 @@
 
 #include "arch.h"
 #include "common.h"
-#include "rom.h"
 
 #ifdef __APPLE__
 #include "elf_compat.h"
@@ -14,14 +13,42 @@
 #include <stdio.h>
 #include <string.h>
 
-void load_elf(const char *file_name, byte_t *buffer, unsigned long buffer_size, reg_t *entry_pc) {
+// the ELF class follows XLEN
+#if XLEN == 64
+#define ELF_CLASS ELFCLASS64
+typedef Elf64_Ehdr elf_ehdr_t;
+typedef Elf64_Phdr elf_phdr_t;
+#else
+#define ELF_CLASS ELFCLASS32
+typedef Elf32_Ehdr elf_ehdr_t;
+typedef Elf32_Phdr elf_phdr_t;
+#endif
+
+// host address of the segment [paddr, paddr + memsz), NULL if it does not
+// fall into a region
+static byte_t *
+elf_segment_ptr(const elf_region_t *regions, unsigned num_regions, uint64_t paddr, uint64_t memsz) {
+    for (unsigned i = 0; i < num_regions; i++) {
+        const elf_region_t *r = &regions[i];
+        if (paddr >= r->base && paddr - r->base <= r->size && memsz <= r->size - (paddr - r->base)) {
+            return r->ptr + (paddr - r->base);
+        }
+    }
+    return NULL;
+}
+
+void load_elf(const char *file_name,
+              const elf_region_t *regions,
+              unsigned num_regions,
+              reg_t *entry_pc,
+              addr_t *image_end) {
     /* try to open ELF file */
     FILE *f = fopen(file_name, "rb");
     Assert(f != NULL, "Fail to open file: %s", file_name);
 
     /* read ELF header */
-    Elf32_Ehdr elf_header;
-    if (fread(&elf_header, sizeof(Elf32_Ehdr), 1, f) != 1) {
+    elf_ehdr_t elf_header;
+    if (fread(&elf_header, sizeof(elf_ehdr_t), 1, f) != 1) {
         Panic("Failed to load ELF header from the file: %s\n", file_name);
         goto end;
     }
@@ -33,8 +60,8 @@ void load_elf(const char *file_name, byte_t *buffer, unsigned long buffer_size,
     }
 
     /* check ELF Class (32 or 64-bits) */
-    if (elf_header.e_ident[EI_CLASS] != ELFCLASS32) {
-        Panic("Only 32-bits ELF files are supported");
+    if (elf_header.e_ident[EI_CLASS] != ELF_CLASS) {
+        Panic("Only %d-bits ELF files are supported", XLEN);
         goto end;
     }
 
@@ -47,38 +74,54 @@ void load_elf(const char *file_name, byte_t *buffer, unsigned long buffer_size,
     /* get the entry-point of the ELF file */
     reg_t entry = elf_header.e_entry;
     *entry_pc   = entry;
-    LOG("Initialize Program Counter: 0x%08x\n", entry);
+    LOG("Initialize Program Counter: 0x%" PRIxREG "\n", entry);
+
+    addr_t end = 0;
 
     /* try to read Program Header */
     for (int i = 0; i < elf_header.e_phnum; i++) {
         /* try to load program header of each sections */
-        if (fseek(f, elf_header.e_phoff + i * sizeof(Elf32_Phdr), SEEK_SET) != 0) {
+        if (fseek(f, elf_header.e_phoff + i * sizeof(elf_phdr_t), SEEK_SET) != 0) {
             Panic("fail to load program header");
             goto end;
         }
-        Elf32_Phdr prog_header;
-        if (fread(&prog_header, sizeof(Elf32_Phdr), 1, f) != 1) {
+        elf_phdr_t prog_header;
+        if (fread(&prog_header, sizeof(elf_phdr_t), 1, f) != 1) {
             Panic("Fail to read the file: %s", file_name);
             goto end;
         }
 
+        if (prog_header.p_type == PT_LOAD && prog_header.p_memsz > 0 &&
+            prog_header.p_paddr + prog_header.p_memsz > end) {
+            end = (addr_t)(prog_header.p_paddr + prog_header.p_memsz);
+        }
+
         /* try to load each "loadable" sections into buffer */
         if (prog_header.p_type == PT_LOAD && prog_header.p_filesz > 0) {
             if (fseek(f, prog_header.p_offset, SEEK_SET) != 0) {
                 fprintf(stderr, "Fail to seek the file\n");
                 goto end;
             }
-            LOG("Load a lodable segment with p_paddr 0x%08x, p_memsz 0x%08x "
-                "and p_filesz: 0x%08x\n",
-                prog_header.p_paddr, prog_header.p_memsz, prog_header.p_filesz);
-            if (fread(&buffer[prog_header.p_paddr - ROM_MMAP_BASE],
-                      prog_header.p_filesz, 1, f) != 1) {
+            LOG("Load a lodable segment with p_paddr 0x%" PRIxREG ", p_memsz 0x%" PRIxREG
+                " and p_filesz: 0x%" PRIxREG "\n",
+                (reg_t)prog_header.p_paddr, (reg_t)prog_header.p_memsz,
+                (reg_t)prog_header.p_filesz);
+            byte_t *dst = elf_segment_ptr(regions, num_regions, prog_header.p_paddr,
+                                          prog_header.p_memsz);
+            Assert(dst != NULL && prog_header.p_filesz <= prog_header.p_memsz,
+                   "The segment at 0x%" PRIxREG " is not in ROM or main memory",
+                   (reg_t)prog_header.p_paddr);
+            if (fread(dst, prog_header.p_filesz, 1, f) != 1) {
                 fprintf(stderr, "Failed to load section in ELF file\n");
                 goto end;
             }
         }
     }
 
+    if (image_end != NULL) {
+        *image_end = end;
+    }
+
 end:
     fclose(f);
 }
@@ -3,7 +3,22 @@
 
 #include "arch.h"
 
-extern void
-load_elf(const char *file_name, byte_t *buffer, unsigned long buffer_size, reg_t *entry_pc);
+#include <stddef.h>
+
+// a memory the segments may go to: guest [base, base + size) is at ptr
+typedef struct {
+    addr_t base;
+    byte_t *ptr;
+    size_t size;
+} elf_region_t;
+
+// load the segments of file_name into the regions (a segment must fall into
+// one of them); the entry point goes to *entry_pc, and the end of the highest
+// segment (its memory size, so the .bss included) to *image_end unless NULL
+extern void load_elf(const char *file_name,
+                     const elf_region_t *regions,
+                     unsigned num_regions,
+                     reg_t *entry_pc,
+                     addr_t *image_end);
 
 #endif
@@ -0,0 +1,316 @@
+#include "locality.h"
+
+#include "arch.h"
+#include "common.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOCALITY_TABLE_INIT 4096
+#define LOCALITY_TREE_INIT (1u << 20)
+
+static inline unsigned hash32(uint32_t key) {
+    return (unsigned)(key * 2654435761u);
+}
+
+/* -------------------------- Fenwick tree --------------------------- */
+static inline void tree_add(locality_stream_t *s, uint64_t index, int32_t delta) {
+    for (; index <= s->tree_size; index += index & (~index + 1)) {
+        s->tree[index] += (uint32_t)delta;
+    }
+}
+
+static inline uint64_t tree_prefix(const locality_stream_t *s, uint64_t index) {
+    uint64_t sum = 0;
+    for (; index > 0; index -= index & (~index + 1)) {
+        sum += s->tree[index];
+    }
+    return sum;
+}
+
+/* ------------------------- access streams -------------------------- */
+static int locality_stream_ctor(locality_stream_t *s, const char *name) {
+    memset(s, 0, sizeof(locality_stream_t));
+    s->name      = name;
+    s->capacity  = LOCALITY_TABLE_INIT;
+    s->blocks    = calloc(s->capacity, sizeof(locality_block_t));
+    s->tree_size = LOCALITY_TREE_INIT;
+    s->tree      = calloc(s->tree_size + 1, sizeof(uint32_t));
+    return (s->blocks == NULL || s->tree == NULL) ? -1 : 0;
+}
+
+static void locality_stream_dtor(locality_stream_t *s) {
+    free(s->blocks);
+    free(s->tree);
+}
+
+static locality_block_t *locality_stream_find(locality_stream_t *s, addr_t block, bool *found);
+
+static void locality_stream_grow(locality_stream_t *s) {
+    locality_block_t *old = s->blocks;
+    unsigned old_capacity = s->capacity;
+    s->capacity *= 2;
+    s->count  = 0;
+    s->blocks = calloc(s->capacity, sizeof(locality_block_t));
+    Assert(s->blocks != NULL, "Out of memory");
+    for (unsigned i = 0; i < old_capacity; i++) {
+        if (old[i].used) {
+            bool found;
+            *locality_stream_find(s, old[i].block, &found) = old[i];
+        }
+    }
+    free(old);
+}
+
+// find the entry of block, or insert an empty one
+static locality_block_t *locality_stream_find(locality_stream_t *s, addr_t block, bool *found) {
+    if (unlikely(2 * (s->count + 1) > s->capacity)) {
+        locality_stream_grow(s);
+    }
+    unsigned mask = s->capacity - 1;
+    unsigned i    = hash32(block) & mask;
+    while (s->blocks[i].used && s->blocks[i].block != block) {
+        i = (i + 1) & mask;
+    }
+    *found = s->blocks[i].used;
+    if (!*found) {
+        s->blocks[i].used     = true;
+        s->blocks[i].block    = block;
+        s->blocks[i].interval = UINT32_MAX;
+        s->count += 1;
+    }
+    return &s->blocks[i];
+}
+
+static int cmp_block_time(const void *a, const void *b) {
+    const locality_block_t *x = *(locality_block_t *const *)a, *y = *(locality_block_t *const *)b;
+    return (x->time > y->time) - (x->time < y->time);
+}
+
+// the timestamps ran out: renumber the live blocks 0..count-1 in order
+static void locality_stream_compact(locality_stream_t *s) {
+    locality_block_t **live = malloc(s->count * sizeof(locality_block_t *));
+    Assert(live != NULL, "Out of memory");
+    unsigned n = 0;
+    for (unsigned i = 0; i < s->capacity; i++) {
+        if (s->blocks[i].used) {
+            live[n++] = &s->blocks[i];
+        }
+    }
+    qsort(live, n, sizeof(locality_block_t *), cmp_block_time);
+
+    // keep at least half of the tree free for new timestamps
+    while (2 * (uint64_t)n > s->tree_size) {
+        s->tree_size *= 2;
+    }
+    free(s->tree);
+    s->tree = calloc(s->tree_size + 1, sizeof(uint32_t));
+    Assert(s->tree != NULL, "Out of memory");
+    for (unsigned i = 0; i < n; i++) {
+        live[i]->time = i;
+        tree_add(s, i + 1, 1);
+    }
+    s->now = n;
+    free(live);
+}
+
+static void locality_stream_access(locality_stream_t *s, addr_t block, uint32_t interval) {
+    if (unlikely(s->now == s->tree_size)) {
+        locality_stream_compact(s);
+    }
+
+    bool found;
+    locality_block_t *entry = locality_stream_find(s, block, &found);
+    s->accesses += 1;
+    if (found) {
+        // distinct blocks touched since the previous access to this one
+        uint64_t distance = tree_prefix(s, s->now) - tree_prefix(s, entry->time + 1);
+        unsigned bucket   = distance ? 1 + (63 - __builtin_clzll(distance)) : 0;
+        s->histogram[bucket < LOCALITY_REUSE_BUCKETS ? bucket : LOCALITY_REUSE_BUCKETS - 1] += 1;
+        tree_add(s, entry->time + 1, -1);
+    } else {
+        s->cold += 1;
+    }
+    entry->time = s->now;
+    tree_add(s, s->now + 1, 1);
+    s->now += 1;
+
+    if (entry->interval != interval) {
+        entry->interval = interval;
+        s->interval_blocks += 1;
+    }
+}
+
+/* ------------------------- stride detection ------------------------ */
+static locality_stride_t *Locality_stride_find(Locality *self, reg_t pc) {
+    if (unlikely(2 * (self->stride_count + 1) > self->stride_capacity)) {
+        locality_stride_t *old = self->strides;
+        unsigned old_capacity  = self->stride_capacity;
+        self->stride_capacity *= 2;
+        self->stride_count = 0;
+        self->strides      = calloc(self->stride_capacity, sizeof(locality_stride_t));
+        Assert(self->strides != NULL, "Out of memory");
+        for (unsigned i = 0; i < old_capacity; i++) {
+            if (old[i].used) {
+                *Locality_stride_find(self, old[i].pc) = old[i];
+            }
+        }
+        free(old);
+    }
+    unsigned mask = self->stride_capacity - 1;
+    unsigned i    = hash32(pc >> 2) & mask;
+    while (self->strides[i].used && self->strides[i].pc != pc) {
+        i = (i + 1) & mask;
+    }
+    if (!self->strides[i].used) {
+        self->strides[i].used = true;
+        self->strides[i].pc   = pc;
+        self->stride_count += 1;
+    }
+    return &self->strides[i];
+}
+
+/* ------------------------------ hooks ------------------------------ */
+void Locality_fetch(Locality *self, reg_t pc) {
+    locality_stream_access(&self->inst, pc >> self->block_shift, self->interval_id);
+
+    // close the working-set interval
+    self->instructions += 1;
+    if (unlikely(self->instructions % self->interval == 0)) {
+        if (self->wss_csv != NULL) {
+            fprintf(self->wss_csv, "%u,%llu,%llu,%llu\n", self->interval_id,
+                    (unsigned long long)self->instructions,
+                    (unsigned long long)self->inst.interval_blocks,
+                    (unsigned long long)self->data.interval_blocks);
+        }
+        self->inst.interval_blocks = 0;
+        self->data.interval_blocks = 0;
+        self->interval_id += 1;
+    }
+}
+
+void Locality_load(Locality *self, reg_t pc, addr_t addr) {
+    locality_stream_access(&self->data, addr >> self->block_shift, self->interval_id);
+
+    locality_stride_t *entry = Locality_stride_find(self, pc);
+    int32_t stride           = (int32_t)(addr - entry->last_addr);
+    if (entry->accesses > 0) {
+        if (entry->accesses > 1 && stride == entry->stride) {
+            entry->strided += 1;
+            entry->confidence += 1;
+        } else {
+            entry->confidence = 0;
+        }
+        entry->stride = stride;
+    }
+    entry->last_addr = addr;
+    entry->accesses += 1;
+}
+
+void Locality_store(Locality *self, reg_t pc, addr_t addr) {
+    (void)pc;
+    locality_stream_access(&self->data, addr >> self->block_shift, self->interval_id);
+}
+
+/* --------------------------- ctor / dtor --------------------------- */
+static FILE *Locality_open_csv(const Locality *self, const char *suffix) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%s.csv", self->report_prefix, suffix);
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Fail to open locality report file: %s\n", path);
+    }
+    return f;
+}
+
+int Locality_ctor(Locality *self, const iss_config_t *config) {
+    assert((self != NULL) && (config != NULL));
+    memset(self, 0, sizeof(Locality));
+
+    unsigned granularity = config->locality_block;
+    if (granularity == 0 || (granularity & (granularity - 1)) != 0 || config->locality_interval == 0) {
+        fprintf(stderr, "Locality: the block size should be a power of two and the interval > 0\n");
+        return -1;
+    }
+    self->block_shift   = (unsigned)__builtin_ctz(granularity);
+    self->interval      = config->locality_interval;
+    self->report_prefix = config->locality_report;
+
+    self->stride_capacity = LOCALITY_TABLE_INIT;
+    self->strides         = calloc(self->stride_capacity, sizeof(locality_stride_t));
+    if (self->strides == NULL || locality_stream_ctor(&self->inst, "inst") != 0 ||
+        locality_stream_ctor(&self->data, "data") != 0) {
+        Locality_dtor(self);
+        return -1;
+    }
+
+    if (NULL != (self->wss_csv = Locality_open_csv(self, "wss"))) {
+        fprintf(self->wss_csv, "interval,end_instruction,inst_blocks,data_blocks\n");
+    }
+    return 0;
+}
+
+void Locality_dtor(Locality *self) {
+    assert(self != NULL);
+    locality_stream_dtor(&self->inst);
+    locality_stream_dtor(&self->data);
+    free(self->strides);
+    if (self->wss_csv != NULL) {
+        fclose(self->wss_csv);
+    }
+}
+
+static int cmp_stride_accesses(const void *a, const void *b) {
+    const locality_stride_t *x = a, *y = b;
+    return (x->accesses < y->accesses) - (x->accesses > y->accesses);
+}
+
+void Locality_report(Locality *self) {
+    assert(self != NULL);
+
+    // reuse-distance histograms: one row per bucket, cold misses as "inf"
+    FILE *f = Locality_open_csv(self, "reuse");
+    if (f != NULL) {
+        fprintf(f, "stream,min_distance,max_distance,count\n");
+        locality_stream_t *streams[] = { &self->inst, &self->data };
+        for (int s = 0; s < 2; s++) {
+            for (unsigned b = 0; b < LOCALITY_REUSE_BUCKETS; b++) {
+                uint64_t lo = b ? (1ull << (b - 1)) : 0;
+                uint64_t hi = b ? (1ull << b) - 1 : 0;
+                fprintf(f, "%s,%llu,%llu,%llu\n", streams[s]->name, (unsigned long long)lo,
+                        (unsigned long long)hi, (unsigned long long)streams[s]->histogram[b]);
+            }
+            fprintf(f, "%s,inf,inf,%llu\n", streams[s]->name, (unsigned long long)streams[s]->cold);
+        }
+        fclose(f);
+    }
+
+    // per load PC strides, most frequent loads first
+    if (NULL != (f = Locality_open_csv(self, "stride"))) {
+        locality_stride_t *rows = malloc(self->stride_count * sizeof(locality_stride_t));
+        Assert(rows != NULL || self->stride_count == 0, "Out of memory");
+        unsigned n = 0;
+        for (unsigned i = 0; i < self->stride_capacity; i++) {
+            if (self->strides[i].used) {
+                rows[n++] = self->strides[i];
+            }
+        }
+        qsort(rows, n, sizeof(locality_stride_t), cmp_stride_accesses);
+        fprintf(f, "pc,accesses,last_stride,strided_fraction\n");
+        for (unsigned i = 0; i < n; i++) {
+            fprintf(f, "0x%" PRIxREG ",%llu,%d,%.4f\n", rows[i].pc, (unsigned long long)rows[i].accesses,
+                    rows[i].stride, (double)rows[i].strided / (double)rows[i].accesses);
+        }
+        free(rows);
+        fclose(f);
+    }
+
+    fprintf(stderr, "[LOCALITY] inst: %llu accesses, %u distinct blocks; data: %llu accesses, %u distinct "
+                    "blocks\n",
+            (unsigned long long)self->inst.accesses, self->inst.count,
+            (unsigned long long)self->data.accesses, self->data.count);
+}
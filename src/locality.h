@@ -0,0 +1,83 @@
+#ifndef __LOCALITY_H__
+#define __LOCALITY_H__
+
+#include "arch.h"
+#include "iss.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// log2 buckets of reuse distance: [0], [1], [2, 3], [4, 7], ...
+#define LOCALITY_REUSE_BUCKETS 34
+
+// last access of a block (open-addressing hash table entry)
+typedef struct {
+    addr_t block;
+    bool used;
+    uint32_t interval; // last interval the block was touched in
+    uint64_t time;     // (compacted) timestamp of the last access
+} locality_block_t;
+
+// reuse distance and working set of one access stream
+typedef struct {
+    const char *name;
+
+    locality_block_t *blocks;
+    unsigned capacity; // power of two
+    unsigned count;
+
+    // Fenwick tree over timestamps: 1 marks the latest access of a block,
+    // so the reuse distance is a range sum (Bennett-Kruskal)
+    uint32_t *tree;
+    uint64_t tree_size; // power of two
+    uint64_t now;
+
+    // statistics
+    uint64_t accesses;
+    uint64_t cold;
+    uint64_t histogram[LOCALITY_REUSE_BUCKETS];
+    uint64_t interval_blocks; // working set of the current interval
+} locality_stream_t;
+
+// stride detector of one load PC
+typedef struct {
+    reg_t pc;
+    bool used;
+    addr_t last_addr;
+    int32_t stride;      // last observed stride
+    uint32_t confidence; // consecutive repeats of stride
+    uint64_t accesses;
+    uint64_t strided; // accesses predicted by the previous stride
+} locality_stride_t;
+
+typedef struct {
+    unsigned block_shift; // log2(granularity)
+    uint64_t interval;    // instructions per working-set interval
+
+    locality_stream_t inst;
+    locality_stream_t data;
+
+    locality_stride_t *strides;
+    unsigned stride_capacity;
+    unsigned stride_count;
+
+    // working-set samples
+    uint64_t instructions;
+    uint32_t interval_id;
+    FILE *wss_csv;
+
+    const char *report_prefix;
+} Locality;
+
+extern int Locality_ctor(Locality *self, const iss_config_t *config);
+extern void Locality_dtor(Locality *self);
+// observe accesses (called from the fetch and LOAD/STORE paths)
+extern void Locality_fetch(Locality *self, reg_t pc);
+extern void Locality_load(Locality *self, reg_t pc, addr_t addr);
+extern void Locality_store(Locality *self, reg_t pc, addr_t addr);
+// write <prefix>.reuse.csv and <prefix>.stride.csv (<prefix>.wss.csv is
+// written while running)
+extern void Locality_report(Locality *self);
+
+#endif
@@ -1,14 +1,121 @@
 #include "iss.h"
 #include "common.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-s sandbox_dir] [-i input_file] [-c cache_csv] [-t timing_cfg] "
+            "[-l locality_prefix] [-b bbv_file] [-I interval] [-S stop_interval] [-o image] "
+            "[-r image] [-n max_insts] [-p interval] [-j jobs] [-P sample_csv] [-H harts] "
+            "[-q quantum] [-D] [-a isa] [-V vlen] [-g endpoint] [-u mb] elf_file\n",
+            prog);
+    fprintf(stderr, "  -s dir   allow guest file access (ECALL) below dir\n");
+    fprintf(stderr, "  -i file  map file into the guest through the InputFile device\n");
+    fprintf(stderr, "  -c file  model 32K L1I/L1D + 256K L2 caches, per-PC CSV to file\n");
+    fprintf(stderr, "  -t file  model pipeline timing (file: key = value, \"-\" for defaults)\n");
+    fprintf(stderr, "  -l pre   locality analysis, CSV files to pre.{reuse,wss,stride}.csv\n");
+    fprintf(stderr, "  -b file  SimPoint basic-block vectors to file (.bb)\n");
+    fprintf(stderr, "  -I n     instructions per BBV interval (default 10000000)\n");
+    fprintf(stderr, "  -S k     halt at the start of BBV interval k\n");
+    fprintf(stderr, "  -o file  write the state image at the halt of -S to file\n");
+    fprintf(stderr, "  -r file  start from a state image instead of the ELF entry\n");
+    fprintf(stderr, "  -n n     run at most n instructions\n");
+    fprintf(stderr, "  -p n     sampled execution: replay every n instructions in parallel\n");
+    fprintf(stderr, "           workers with the -c/-t models (-n does not apply)\n");
+    fprintf(stderr, "  -j n     at most n workers (default: online CPUs)\n");
+    fprintf(stderr, "  -P file  per-interval CSV of the sampled execution\n");
+    fprintf(stderr, "  -H n     run n harts, one host thread each\n");
+    fprintf(stderr, "  -q n     instructions per hart between synchronizations (default 1000)\n");
+    fprintf(stderr, "  -D       deterministic: interleave the harts on one thread\n");
+    fprintf(stderr, "  -a isa   ISA string, e.g. rv32iafdv_zba_zbb_zbs (default: all)\n");
+    fprintf(stderr, "  -V n     bits per vector register (default 128)\n");
+    fprintf(stderr, "  -g ep    wait for GDB on ep (a TCP port or a Unix socket path)\n");
+    fprintf(stderr, "  -u mb    keep an undo log of mb MB for reverse execution (one hart)\n");
+    fprintf(stderr, "  -T       the time CSR follows the host clock\n");
+    fprintf(stderr, "  -R file  record the inputs from the host (devices, clock, syscalls)\n");
+    fprintf(stderr, "  -Y file  replay the inputs recorded with -R instead of the host\n");
+    fprintf(stderr, "  -F       unchecked RAM accesses in a guarded host window (one hart)\n");
+}
+
 int main(int argc, char **argv) {
-    // check argc
-    Assert(argc == 2, "The number of arguments should be 2");
+    // parse options
+    iss_config_t config;
+    ISS_config_default(&config);
+    const char *restore_image = NULL;
+    const char *gdb_endpoint  = NULL;
+    unsigned long max_insts   = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:i:c:t:l:b:I:S:o:r:n:p:j:P:H:q:Da:V:g:u:TR:Y:F")) != -1) {
+        switch (opt) {
+        case 's': config.sandbox_dir = optarg; break;
+        case 'i': config.input_file = optarg;  break;
+        case 'c': {
+            iss_cache_config_t l1 = { .size = 32 * 1024, .ways = 8, .line_size = 64,
+                                      .replacement = ISS_CACHE_LRU, .write_back = true,
+                                      .write_allocate = true };
+            config.l1i          = l1;
+            config.l1d          = l1;
+            config.l2           = l1;
+            config.l2.size      = 256 * 1024;
+            config.cache_report = optarg;
+            break;
+        }
+        case 't':
+            config.timing_model  = true;
+            config.timing_config = (strcmp(optarg, "-") == 0) ? NULL : optarg;
+            break;
+        case 'l': config.locality_report = optarg; break;
+        case 'b': config.bbv_file = optarg; break;
+        case 'I': config.bbv_interval = strtoul(optarg, NULL, 0); break;
+        case 'S': config.simpoint_stop_interval = strtol(optarg, NULL, 0); break;
+        case 'o': config.state_image = optarg; break;
+        case 'r': restore_image = optarg; break;
+        case 'n': max_insts = strtoul(optarg, NULL, 0); break;
+        case 'p': config.sample_interval = strtoul(optarg, NULL, 0); break;
+        case 'j': config.sample_jobs = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'P': config.sample_report = optarg; break;
+        case 'H': config.harts = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'q': config.hart_quantum = strtoul(optarg, NULL, 0); break;
+        case 'D': config.hart_threads = false; break;
+        case 'a': config.isa = optarg; break;
+        case 'V': config.vlen = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'g': gdb_endpoint = optarg; break;
+        case 'u': config.undo_log_mb = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'T': config.time_source = ISS_TIME_HOST; break;
+        case 'R': config.record_inputs = optarg; break;
+        case 'Y': config.replay_inputs = optarg; break;
+        case 'F': config.fast_mem = true; break;
+        default:  usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
 
     // main body
     ISS *iss_ptr;
-    Assert(ISS_ctor(&iss_ptr, argv[1]) == 0, "ISS_ctor failed!");
-    ISS_step(iss_ptr, -1);
+    Assert(ISS_ctor_with_config(&iss_ptr, argv[optind], &config) == 0, "ISS_ctor failed!");
+    if (restore_image != NULL) {
+        iss_state_image_t *image = ISS_read_state(restore_image);
+        Assert(image != NULL, "Fail to read state image %s", restore_image);
+        ISS_restore_state(iss_ptr, image);
+        ISS_free_state(image);
+    }
+    // a detached debugger leaves the guest running on
+    int killed = 0;
+    if (gdb_endpoint != NULL) {
+        killed = ISS_gdb_serve(iss_ptr, gdb_endpoint);
+        Assert(killed >= 0, "Fail to serve GDB on %s", gdb_endpoint);
+    }
+    if (!killed && config.sample_interval != 0) {
+        Assert(ISS_run_sampled(iss_ptr) == 0, "ISS_run_sampled failed!");
+    } else if (!killed) {
+        ISS_step(iss_ptr, max_insts);
+    }
 
     // end of main
     ISS_dtor(iss_ptr);
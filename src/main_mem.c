@@ -26,16 +26,38 @@ DECLARE_ABSTRACT_MEM_STORE(MainMem) {
     }
 }
 
+DECLARE_ABSTRACT_MEM_HOST_PTR(MainMem) {
+    (void)write;
+    Assert(self != NULL, "");
+    Assert(base_addr + length <= MAIN_MEM_SIZE, "");
+
+    MainMem *self_ = container_of(self, MainMem, super);
+    return &self_->mem[base_addr];
+}
+
+DECLARE_ABSTRACT_MEM_PAGE_PTR(MainMem) {
+    return SIGNATURE_ABSTRACT_MEM_HOST_PTR(MainMem)(self, base_addr, length, write);
+}
+
 void MainMem_ctor(MainMem *self) {
     assert((self != NULL) && "MainMem *self ptr should not be NULL!");
 
     // initlaize base class
     AbstractMem_ctor(&self->super);
     static struct AbstractMemVtbl const vtbl = {
-        .load  = &SIGNATURE_ABSTRACT_MEM_LOAD(MainMem),
-        .store = &SIGNATURE_ABSTRACT_MEM_STORE(MainMem)
+        .load     = &SIGNATURE_ABSTRACT_MEM_LOAD(MainMem),
+        .store    = &SIGNATURE_ABSTRACT_MEM_STORE(MainMem),
+        .host_ptr = &SIGNATURE_ABSTRACT_MEM_HOST_PTR(MainMem),
+        .page_ptr = &SIGNATURE_ABSTRACT_MEM_PAGE_PTR(MainMem)
     };
     self->super.vtbl = &vtbl;
     // initialize self->mem
-    memset(&self->mem, 0, sizeof(byte_t) * MAIN_MEM_SIZE);
+    self->mem = self->storage;
+    memset(self->mem, 0, sizeof(byte_t) * MAIN_MEM_SIZE);
+}
+
+void MainMem_place(MainMem *self, byte_t *mem) {
+    assert(self != NULL && mem != NULL);
+    memcpy(mem, self->mem, MAIN_MEM_SIZE);
+    self->mem = mem;
 }
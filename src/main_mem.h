@@ -9,9 +9,13 @@
 
 typedef struct {
     AbstractMem super;
-    byte_t mem[MAIN_MEM_SIZE];
+    byte_t *mem; // MAIN_MEM_SIZE bytes: storage, unless placed elsewhere
+    byte_t storage[MAIN_MEM_SIZE];
 } MainMem;
 
 extern void MainMem_ctor(MainMem *self);
+// move the contents to mem (MAIN_MEM_SIZE bytes), which backs the memory
+// from now on
+extern void MainMem_place(MainMem *self, byte_t *mem);
 
 #endif
@@ -2,24 +2,37 @@
 #include "abstract_mem.h"
 #include "common.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
 int MemoryMap_ctor(MemoryMap *self) {
     assert(self != NULL);
     self->num_device     = 0;
     self->memory_map_arr = NULL;
+    self->count_arr      = NULL;
+    self->input_log      = NULL;
     return 0;
 }
 
 void MemoryMap_dtor(MemoryMap *self) {
     assert(self != NULL);
     free(self->memory_map_arr);
+    free(self->count_arr);
 }
 
 int MemoryMap_add_device(MemoryMap *self, mmap_unit_t new_mem_map_unit) {
     assert(self != NULL);
 
+    // the counts of the new device start at zero
+    mmap_count_t *counts = realloc(self->count_arr, (self->num_device + 1) * sizeof(mmap_count_t));
+    if (counts == NULL) {
+        return -1;
+    }
+    self->count_arr                   = counts;
+    self->count_arr[self->num_device] = (mmap_count_t){ { 0 } };
+
     if (self->num_device == 0) {
         if (NULL == (self->memory_map_arr = malloc(sizeof(mmap_unit_t)))) {
             return -1;
@@ -46,42 +59,153 @@ int MemoryMap_add_device(MemoryMap *self, mmap_unit_t new_mem_map_unit) {
     return 0;
 }
 
-void MemoryMap_generic_load(MemoryMap *self, addr_t base_addr, unsigned length, byte_t *buffer) {
-    assert(self != NULL);
-
-    // search in self->memory_map_arr
+static mmap_unit_t *MemoryMap_search(MemoryMap *self, addr_t base_addr, unsigned length) {
+    // later devices take precedence over earlier ones
     mmap_unit_t *mmap_unit_ptr = NULL;
     for (int i = 0; i < self->num_device; i++) {
-        if ((base_addr >= self->memory_map_arr[i].addr_bound.first) &&
-            (base_addr + length <= self->memory_map_arr[i].addr_bound.second)) {
+        // written as differences so that base_addr + length cannot wrap around
+        addr_t first = self->memory_map_arr[i].addr_bound.first;
+        addr_t size  = self->memory_map_arr[i].addr_bound.second - first;
+        if ((base_addr >= first) && (length <= size) && (base_addr - first <= size - length)) {
             mmap_unit_ptr = &self->memory_map_arr[i];
         }
     }
+    return mmap_unit_ptr;
+}
 
-    Assert(mmap_unit_ptr != NULL, "MMIO search failed! The requested address is: 0x%08x, length is: %d",
-           base_addr, length);
+// the loads of the device go through the input log, so they may not bypass
+// the device through host pointers
+static inline bool MemoryMap_logged(const MemoryMap *self, const mmap_unit_t *mmap_unit_ptr) {
+    return mmap_unit_ptr->nondeterministic && self->input_log != NULL;
+}
+
+// the device of an access, NULL if none or if the device does not take it
+static mmap_unit_t *
+MemoryMap_search_access(MemoryMap *self, addr_t base_addr, unsigned length, bool write) {
+    mmap_unit_t *mmap_unit_ptr = MemoryMap_search(self, base_addr, length);
+    if (mmap_unit_ptr != NULL &&
+        !AbstractMem_accepts(mmap_unit_ptr->device_ptr,
+                             base_addr - mmap_unit_ptr->addr_bound.first, length, write)) {
+        return NULL;
+    }
+    return mmap_unit_ptr;
+}
+
+bool MemoryMap_is_mapped(MemoryMap *self, addr_t base_addr, unsigned length) {
+    assert(self != NULL);
+    base_addr = MemoryMap_fold(base_addr);
+    return MemoryMap_search(self, base_addr, length) != NULL;
+}
 
-    // call generic load function of the device
+// the load/store of a found device
+static void MemoryMap_unit_load(MemoryMap *self, mmap_unit_t *mmap_unit_ptr, addr_t base_addr,
+                                unsigned length, byte_t *buffer) {
+    if (unlikely(MemoryMap_logged(self, mmap_unit_ptr))) {
+        InputLog_load(self->input_log, mmap_unit_ptr->device_ptr,
+                      base_addr - mmap_unit_ptr->addr_bound.first, length, buffer);
+        return;
+    }
     AbstractMem_load(mmap_unit_ptr->device_ptr,
                      base_addr - mmap_unit_ptr->addr_bound.first, length, buffer);
 }
 
+static void MemoryMap_unit_store(mmap_unit_t *mmap_unit_ptr, addr_t base_addr, unsigned length,
+                                 const byte_t *ref_data) {
+    AbstractMem_store(mmap_unit_ptr->device_ptr,
+                      base_addr - mmap_unit_ptr->addr_bound.first, length, ref_data);
+}
+
+bool MemoryMap_try_load(MemoryMap *self, addr_t base_addr, unsigned length, byte_t *buffer) {
+    assert(self != NULL);
+    base_addr = MemoryMap_fold(base_addr);
+    mmap_unit_t *mmap_unit_ptr = MemoryMap_search_access(self, base_addr, length, false);
+    if (mmap_unit_ptr == NULL) {
+        return false;
+    }
+    MemoryMap_unit_load(self, mmap_unit_ptr, base_addr, length, buffer);
+    return true;
+}
+
+bool MemoryMap_try_store(MemoryMap *self, addr_t base_addr, unsigned length, const byte_t *ref_data) {
+    assert(self != NULL);
+    base_addr = MemoryMap_fold(base_addr);
+    mmap_unit_t *mmap_unit_ptr = MemoryMap_search_access(self, base_addr, length, true);
+    if (mmap_unit_ptr == NULL) {
+        return false;
+    }
+    MemoryMap_unit_store(mmap_unit_ptr, base_addr, length, ref_data);
+    return true;
+}
+
+void MemoryMap_generic_load(MemoryMap *self, addr_t base_addr, unsigned length, byte_t *buffer) {
+    Assert(MemoryMap_try_load(self, base_addr, length, buffer),
+           "MMIO access failed! The requested address is: 0x%" PRIxREG ", length is: %d", base_addr, length);
+}
+
 void MemoryMap_generic_store(MemoryMap *self, addr_t base_addr, unsigned length, const byte_t *ref_data) {
+    Assert(MemoryMap_try_store(self, base_addr, length, ref_data),
+           "MMIO access failed! The requested address is: 0x%" PRIxREG ", length is: %d", base_addr, length);
+}
+
+byte_t *MemoryMap_host_ptr(MemoryMap *self, addr_t base_addr, unsigned length, bool write) {
     assert(self != NULL);
+    base_addr = MemoryMap_fold(base_addr);
 
     // search in self->memory_map_arr
-    mmap_unit_t *mmap_unit_ptr = NULL;
-    for (int i = 0; i < self->num_device; i++) {
-        if ((base_addr >= self->memory_map_arr[i].addr_bound.first) &&
-            (base_addr + length <= self->memory_map_arr[i].addr_bound.second)) {
-            mmap_unit_ptr = &self->memory_map_arr[i];
-        }
+    mmap_unit_t *mmap_unit_ptr = MemoryMap_search(self, base_addr, length);
+
+    if (mmap_unit_ptr == NULL || MemoryMap_logged(self, mmap_unit_ptr)) {
+        return NULL;
     }
+    return AbstractMem_host_ptr(mmap_unit_ptr->device_ptr,
+                                base_addr - mmap_unit_ptr->addr_bound.first, length, write);
+}
 
-    Assert(mmap_unit_ptr != NULL, "MMIO search failed! The requested address is: 0x%08x, length is: %d",
-           base_addr, length);
+byte_t *MemoryMap_page_ptr(MemoryMap *self, addr_t base_addr, unsigned length, bool write) {
+    assert(self != NULL);
+    base_addr = MemoryMap_fold(base_addr);
 
-    // call generic store function of the device
-    AbstractMem_store(mmap_unit_ptr->device_ptr,
-                      base_addr - mmap_unit_ptr->addr_bound.first, length, ref_data);
+    mmap_unit_t *mmap_unit_ptr = MemoryMap_search(self, base_addr, length);
+    if (mmap_unit_ptr == NULL || MemoryMap_logged(self, mmap_unit_ptr)) {
+        return NULL;
+    }
+    return AbstractMem_page_ptr(mmap_unit_ptr->device_ptr,
+                                base_addr - mmap_unit_ptr->addr_bound.first, length, write);
+}
+
+/* -------------------------- guest accesses -------------------------- */
+bool MemoryMap_guest_load(MemoryMap *self, addr_t base_addr, unsigned length, byte_t *buffer) {
+    assert(self != NULL);
+    base_addr = MemoryMap_fold(base_addr);
+    mmap_unit_t *mmap_unit_ptr = MemoryMap_search_access(self, base_addr, length, false);
+    if (mmap_unit_ptr == NULL) {
+        return false;
+    }
+    self->count_arr[mmap_unit_ptr - self->memory_map_arr].access[1]++;
+    MemoryMap_unit_load(self, mmap_unit_ptr, base_addr, length, buffer);
+    return true;
+}
+
+bool MemoryMap_guest_store(MemoryMap *self, addr_t base_addr, unsigned length, const byte_t *ref_data) {
+    assert(self != NULL);
+    base_addr = MemoryMap_fold(base_addr);
+    mmap_unit_t *mmap_unit_ptr = MemoryMap_search_access(self, base_addr, length, true);
+    if (mmap_unit_ptr == NULL) {
+        return false;
+    }
+    self->count_arr[mmap_unit_ptr - self->memory_map_arr].access[2]++;
+    MemoryMap_unit_store(mmap_unit_ptr, base_addr, length, ref_data);
+    return true;
+}
+
+mmap_count_t *MemoryMap_count_ptr(MemoryMap *self, addr_t base_addr, unsigned length) {
+    assert(self != NULL);
+    base_addr = MemoryMap_fold(base_addr);
+    mmap_unit_t *mmap_unit_ptr = MemoryMap_search(self, base_addr, length);
+    return (mmap_unit_ptr == NULL) ? NULL : &self->count_arr[mmap_unit_ptr - self->memory_map_arr];
+}
+
+void MemoryMap_clear_counts(MemoryMap *self) {
+    assert(self != NULL);
+    memset(self->count_arr, 0, self->num_device * sizeof(mmap_count_t));
 }
@@ -3,6 +3,10 @@
 
 #include "abstract_mem.h"
 #include "arch.h"
+#include "input_log.h"
+
+#include <stdbool.h>
+#include <stdint.h>
 
 typedef struct {
     addr_t first;
@@ -11,21 +15,68 @@ typedef struct {
 typedef struct {
     addr_pair_t addr_bound;
     AbstractMem *device_ptr;
+    bool nondeterministic; // its loads are inputs from the host, see InputLog
+    const char *name;      // for statistics
 } mmap_unit_t;
+// guest accesses of a device: loads and stores at the index of their
+// mmu_access_t (fetches are not counted); plain memory is counted by the
+// TLB, devices by the MemoryMap_guest_ functions
+typedef struct {
+    uint64_t access[3];
+} mmap_count_t;
 typedef struct {
     unsigned num_device;
     mmap_unit_t *memory_map_arr;
+    mmap_count_t *count_arr; // per device
+    // records/replays the loads of nondeterministic devices (NULL: off)
+    InputLog *input_log;
 } MemoryMap;
 
+// the physical address space is 32 bits wide; on RV64, where lui and li
+// sign-extend, the addresses from 0x80000000 up are also reached through
+// their sign extension (0xffffffff80000000 and up), which this folds back
+static inline addr_t MemoryMap_fold(addr_t addr) {
+#if XLEN == 64
+    return ((addr >> 31) == 0x1ffffffffull) ? (addr & 0xffffffffull) : addr;
+#else
+    return addr;
+#endif
+}
+
 /* Public APIs */
+// the addresses given are physical; on RV64 the sign extension of a 32-bit
+// address (bit 31 set) is the same address, see MemoryMap_fold()
 // member functions
 extern int MemoryMap_ctor(MemoryMap *self);
 extern void MemoryMap_dtor(MemoryMap *self);
 extern int MemoryMap_add_device(MemoryMap *self, mmap_unit_t new_device);
-// generic load/store APIs
+// true if [base_addr, base_addr + length) falls into one device
+extern bool MemoryMap_is_mapped(MemoryMap *self, addr_t base_addr, unsigned length);
+// generic load/store APIs; the try_ forms return false instead of asserting
+// when the range is not mapped or its device does not take the access (guest
+// accesses fault on it)
+extern bool MemoryMap_try_load(MemoryMap *self, addr_t base_addr, unsigned length, byte_t *buffer);
+extern bool
+MemoryMap_try_store(MemoryMap *self, addr_t base_addr, unsigned length, const byte_t *ref_data);
 extern void
 MemoryMap_generic_load(MemoryMap *self, addr_t base_addr, unsigned length, byte_t *buffer);
 extern void
 MemoryMap_generic_store(MemoryMap *self, addr_t base_addr, unsigned length, const byte_t *ref_data);
+// host pointer to [base_addr, base_addr + length), or NULL if the range is not
+// backed by plain memory (or its loads are logged, or it is read-only and write)
+extern byte_t *
+MemoryMap_host_ptr(MemoryMap *self, addr_t base_addr, unsigned length, bool write);
+// host pointer the TLB may keep, see AbstractMemVtbl::page_ptr
+extern byte_t *MemoryMap_page_ptr(MemoryMap *self, addr_t base_addr, unsigned length, bool write);
+// the try_ forms for accesses of the guest, which are counted
+extern bool
+MemoryMap_guest_load(MemoryMap *self, addr_t base_addr, unsigned length, byte_t *buffer);
+extern bool
+MemoryMap_guest_store(MemoryMap *self, addr_t base_addr, unsigned length, const byte_t *ref_data);
+// the access counts of the device [base_addr, base_addr + length) falls
+// into (NULL if none)
+extern mmap_count_t *MemoryMap_count_ptr(MemoryMap *self, addr_t base_addr, unsigned length);
+// forget the access counts
+extern void MemoryMap_clear_counts(MemoryMap *self);
 
 #endif
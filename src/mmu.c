@@ -0,0 +1,195 @@
+#include "mmu.h"
+
+#include "arch.h"
+#include "common.h"
+#include "csr.h"
+#include "debug.h"
+#include "mem_map.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Sv32 page table entries
+#define PTE_V (1u << 0)
+#define PTE_R (1u << 1)
+#define PTE_W (1u << 2)
+#define PTE_X (1u << 3)
+#define PTE_U (1u << 4)
+#define PTE_A (1u << 6)
+#define PTE_D (1u << 7)
+#define PTE_PPN_SHIFT 10
+#define SV32_LEVELS 2
+#define SV32_VPN_BITS 10
+
+// physical page numbers are 22 bits, addresses above 4 GiB do not exist here
+#define PPN_LIMIT (1u << (32 - MMU_PAGE_SHIFT))
+
+/* ---------------------------- context ---------------------------- */
+// translated contexts are 1 | mode << 1 | SUM << 3 | MXR << 4
+static uint32_t MMU_context(reg_t mode, reg_t mstatus, reg_t satp) {
+    if (mode == PRIV_M || !(satp & SATP_MODE_SV32)) {
+        return 0;
+    }
+    return 1u | ((mode & 0x1) << 1) | (((mstatus & MSTATUS_SUM) != 0) << 3) |
+           (((mstatus & MSTATUS_MXR) != 0) << 4);
+}
+
+void MMU_set_context(MMU *self, reg_t mode, reg_t mstatus, reg_t satp) {
+    assert(self != NULL);
+    // loads and stores of M-mode run in MPP with MPRV set
+    reg_t data_mode = (mode == PRIV_M && (mstatus & MSTATUS_MPRV))
+                          ? (mstatus & MSTATUS_MPP) >> MSTATUS_MPP_SHIFT
+                          : mode;
+    self->ctx[MMU_FETCH] = MMU_context(mode, mstatus, satp);
+    self->ctx[MMU_LOAD]  = MMU_context(data_mode, mstatus, satp);
+    self->ctx[MMU_STORE] = self->ctx[MMU_LOAD];
+    if (satp != self->satp) {
+        self->satp = satp;
+        MMU_flush(self, false, 0);
+    }
+}
+
+void MMU_invalidate(MMU *self) {
+    assert(self != NULL);
+    memset(self->tlb, 0xff, sizeof(self->tlb)); // all tags MMU_TLB_INVALID
+}
+
+void MMU_flush(MMU *self, bool vaddr_valid, addr_t vaddr) {
+    assert(self != NULL);
+    self->flushes++;
+    if (!vaddr_valid) {
+        MMU_invalidate(self);
+        return;
+    }
+    addr_t page = vaddr & ~MMU_PAGE_MASK;
+    for (int type = 0; type < MMU_NUM_ACCESS; type++) {
+        mmu_tlb_entry_t *entry =
+            &self->tlb[type][(vaddr >> MMU_PAGE_SHIFT) & (MMU_TLB_ENTRIES - 1)];
+        if ((entry->tag & ~MMU_PAGE_MASK) == page) {
+            entry->tag = MMU_TLB_INVALID;
+        }
+    }
+}
+
+/* ------------------------- page-table walk ------------------------ */
+static bool MMU_load_pte(MMU *self, addr_t pte_addr, uint32_t *pte) {
+    byte_t b[4];
+    if (!MemoryMap_try_load(self->mem_map, pte_addr, 4, b)) {
+        return false;
+    }
+    *pte = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) |
+           ((uint32_t)b[3] << 24);
+    return true;
+}
+
+// translate the page of vaddr in the context ctx into *ppage
+static mmu_fault_t MMU_walk(MMU *self, addr_t vaddr, mmu_access_t type, uint32_t ctx,
+                            addr_t *ppage) {
+    reg_t mode = (ctx >> 1) & 0x1;
+    bool sum   = (ctx >> 3) & 0x1;
+    bool mxr   = (ctx >> 4) & 0x1;
+
+    uint32_t ppn    = self->satp & SATP_PPN;
+    uint32_t pte    = 0;
+    addr_t pte_addr = 0;
+    int level       = SV32_LEVELS - 1;
+    for (;; level--) {
+        if (ppn >= PPN_LIMIT) {
+            return MMU_ACCESS_FAULT;
+        }
+        uint32_t vpn_i = (vaddr >> (MMU_PAGE_SHIFT + level * SV32_VPN_BITS)) &
+                         ((1u << SV32_VPN_BITS) - 1);
+        pte_addr = (ppn << MMU_PAGE_SHIFT) + vpn_i * 4;
+        if (!MMU_load_pte(self, pte_addr, &pte)) {
+            return MMU_ACCESS_FAULT;
+        }
+        if (!(pte & PTE_V) || (!(pte & PTE_R) && (pte & PTE_W))) {
+            return MMU_PAGE_FAULT;
+        }
+        ppn = pte >> PTE_PPN_SHIFT;
+        if (pte & (PTE_R | PTE_X)) {
+            break; // leaf
+        }
+        if (level == 0) {
+            return MMU_PAGE_FAULT;
+        }
+    }
+
+    // permissions of the leaf
+    if (mode == PRIV_U ? !(pte & PTE_U) : ((pte & PTE_U) && (type == MMU_FETCH || !sum))) {
+        return MMU_PAGE_FAULT;
+    }
+    switch (type) {
+    case MMU_FETCH: if (!(pte & PTE_X)) return MMU_PAGE_FAULT; break;
+    case MMU_LOAD:  if (!(pte & PTE_R) && !(mxr && (pte & PTE_X))) return MMU_PAGE_FAULT; break;
+    default:        if (!(pte & PTE_W)) return MMU_PAGE_FAULT; break;
+    }
+    // a megapage must be aligned
+    if (level == 1 && (ppn & ((1u << SV32_VPN_BITS) - 1)) != 0) {
+        return MMU_PAGE_FAULT;
+    }
+
+    // the hardware sets A and D (stores only enter the TLB with D set)
+    uint32_t ad = PTE_A | ((type == MMU_STORE) ? PTE_D : 0);
+    if ((pte & ad) != ad) {
+        pte |= ad;
+        byte_t b[4] = { (byte_t)pte, (byte_t)(pte >> 8), (byte_t)(pte >> 16), (byte_t)(pte >> 24) };
+        byte_t *host;
+        if (unlikely(self->undo != NULL) &&
+            (host = MemoryMap_host_ptr(self->mem_map, pte_addr, 4, true)) != NULL) {
+            UndoLog_save(self->undo, host, 4);
+        }
+        if (!MemoryMap_try_store(self->mem_map, pte_addr, 4, b)) {
+            return MMU_ACCESS_FAULT;
+        }
+    }
+
+    if (level == 1) {
+        ppn |= (vaddr >> MMU_PAGE_SHIFT) & ((1u << SV32_VPN_BITS) - 1);
+    }
+    if (ppn >= PPN_LIMIT) {
+        return MMU_ACCESS_FAULT;
+    }
+    *ppage = ppn << MMU_PAGE_SHIFT;
+    return MMU_OK;
+}
+
+mmu_fault_t MMU_fill(MMU *self, addr_t vaddr, mmu_access_t type, mmu_tlb_entry_t *entry) {
+    uint32_t ctx = self->ctx[type];
+    addr_t ppage = MemoryMap_fold(vaddr & ~MMU_PAGE_MASK); // bare
+    if (ctx != 0) {
+        mmu_fault_t fault = MMU_walk(self, vaddr, type, ctx, &ppage);
+        if (fault != MMU_OK) {
+            return fault;
+        }
+    }
+    entry->tag   = (vaddr & ~MMU_PAGE_MASK) | ctx;
+    entry->ppage = ppage;
+    entry->host  = MemoryMap_page_ptr(self->mem_map, ppage, MMU_PAGE_SIZE, type == MMU_STORE);
+    entry->count = &self->uncounted;
+    if (entry->host != NULL) {
+        entry->count = &MemoryMap_count_ptr(self->mem_map, ppage, MMU_PAGE_SIZE)->access[type];
+    }
+    if (unlikely(self->debug != NULL) &&
+        Debug_watches_page(self->debug, vaddr & ~MMU_PAGE_MASK, type)) {
+        entry->tag = MMU_TLB_INVALID;
+        return MMU_DEBUG;
+    }
+    return MMU_OK;
+}
+
+/* ------------------------------ ctor ------------------------------ */
+void MMU_ctor(MMU *self, MemoryMap *mem_map) {
+    assert((self != NULL) && (mem_map != NULL));
+    self->mem_map = mem_map;
+    self->debug   = NULL;
+    self->undo    = NULL;
+    memset(self->ctx, 0, sizeof(self->ctx));
+    self->satp = 0;
+    memset(self->hits, 0, sizeof(self->hits));
+    memset(self->misses, 0, sizeof(self->misses));
+    MMU_flush(self, false, 0);
+    self->flushes = 0;
+}
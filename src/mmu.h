@@ -0,0 +1,108 @@
+#ifndef __MMU_H__
+#define __MMU_H__
+
+#include "arch.h"
+#include "common.h"
+#include "mem_map.h"
+#include "undo.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MMU_PAGE_SHIFT 12
+#define MMU_PAGE_SIZE ((addr_t)1 << MMU_PAGE_SHIFT)
+#define MMU_PAGE_MASK (MMU_PAGE_SIZE - 1)
+#define MMU_TLB_ENTRIES 256 // per access type, power of two
+
+// tag of an empty entry, real tags are page | ctx with ctx < 2^MMU_CTX_BITS
+// (the context fits below the page offset, at any XLEN)
+#define MMU_TLB_INVALID ((addr_t)-1)
+#define MMU_CTX_BITS 5
+
+typedef enum {
+    MMU_FETCH = 0,
+    MMU_LOAD,
+    MMU_STORE, // also AMOs
+    MMU_NUM_ACCESS,
+} mmu_access_t;
+
+typedef enum {
+    MMU_OK = 0,
+    MMU_PAGE_FAULT,
+    MMU_ACCESS_FAULT,
+    MMU_DEBUG, // translated, but the page holds a debugger point (see Debug)
+} mmu_fault_t;
+
+struct debug;
+
+// one translated page; the tag includes the context (mode, SUM, MXR) the
+// permissions were checked in, so that mode switches need no flush
+typedef struct {
+    addr_t tag;
+    addr_t ppage; // physical address of the page
+    byte_t *host; // host address of the page (NULL: not plain memory)
+    uint64_t *count; // load/store count of its device (plain memory only)
+} mmu_tlb_entry_t;
+
+// Sv32 translation with a direct-mapped software TLB per access type; bare
+// (untranslated) accesses are cached as well, for their host pointers
+typedef struct {
+    MemoryMap *mem_map; // physical memory, for page-table walks
+
+    mmu_tlb_entry_t tlb[MMU_NUM_ACCESS][MMU_TLB_ENTRIES];
+
+    // break/watchpoints, their pages never stay in the TLB (NULL: none)
+    const struct debug *debug;
+    // saves the A/D updates of the walks (NULL: no reverse execution)
+    UndoLog *undo;
+
+    // translation context, see MMU_set_context()
+    uint32_t ctx[MMU_NUM_ACCESS]; // 0: bare
+    reg_t satp;
+
+    // statistics
+    uint64_t hits[MMU_NUM_ACCESS];
+    uint64_t misses[MMU_NUM_ACCESS];
+    uint64_t flushes;
+    uint64_t uncounted; // count of the pages that are not plain memory
+} MMU;
+
+extern void MMU_ctor(MMU *self, MemoryMap *mem_map);
+// the privilege mode and the mstatus/satp CSRs changed
+extern void MMU_set_context(MMU *self, reg_t mode, reg_t mstatus, reg_t satp);
+// sfence.vma: forget every page (vaddr_valid false) or the page of vaddr
+extern void MMU_flush(MMU *self, bool vaddr_valid, addr_t vaddr);
+// forget every page for a change the guest does not see (e.g. a new
+// breakpoint), unlike MMU_flush() it is not counted
+extern void MMU_invalidate(MMU *self);
+// TLB miss: walk the page table and refill the entry (which is left invalid
+// on MMU_DEBUG, so that the next access to the page misses again)
+extern mmu_fault_t MMU_fill(MMU *self, addr_t vaddr, mmu_access_t type, mmu_tlb_entry_t *entry);
+
+// translate vaddr (an access not crossing a page) into *paddr, and *host if
+// the page is plain memory (NULL otherwise); MMU_DEBUG translates as well
+static inline mmu_fault_t
+MMU_translate(MMU *self, addr_t vaddr, mmu_access_t type, addr_t *paddr, byte_t **host) {
+    addr_t page            = vaddr & ~MMU_PAGE_MASK;
+    mmu_tlb_entry_t *entry = &self->tlb[type][(vaddr >> MMU_PAGE_SHIFT) & (MMU_TLB_ENTRIES - 1)];
+    mmu_fault_t fault      = MMU_OK;
+    if (unlikely(entry->tag != (page | self->ctx[type]))) {
+        self->misses[type]++;
+        fault = MMU_fill(self, vaddr, type, entry);
+        if (fault != MMU_OK && fault != MMU_DEBUG) {
+            return fault;
+        }
+    } else {
+        self->hits[type]++;
+    }
+    if (type != MMU_FETCH) { // (a constant where this is inlined)
+        (*entry->count)++;
+    }
+    addr_t offset = vaddr & MMU_PAGE_MASK;
+    *paddr        = entry->ppage | offset;
+    *host         = (entry->host != NULL) ? entry->host + offset : NULL;
+    return fault;
+}
+
+#endif
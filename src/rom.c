@@ -21,15 +21,39 @@ DECLARE_ABSTRACT_MEM_STORE(ROM) {
     Panic("ROM should not be modified!");
 }
 
+DECLARE_ABSTRACT_MEM_PAGE_PTR(ROM) {
+    Assert(self != NULL, "self should not be NULL");
+    Assert(base_addr + length <= ROM_SIZE, "Memory Map Range Error!");
+
+    // stores must still reach ROM_AbstractMem_store()
+    ROM *self_ = container_of(self, ROM, super);
+    return write ? NULL : &self_->rom[base_addr];
+}
+
+DECLARE_ABSTRACT_MEM_ACCEPTS(ROM) {
+    (void)self, (void)base_addr, (void)length;
+    return !write;
+}
+
 void ROM_ctor(ROM *self) {
     assert(self != NULL);
     AbstractMem_ctor(&self->super);
     static struct AbstractMemVtbl const vtbl = {
-        .load = &SIGNATURE_ABSTRACT_MEM_LOAD(ROM), .store = &SIGNATURE_ABSTRACT_MEM_STORE(ROM)
+        .load     = &SIGNATURE_ABSTRACT_MEM_LOAD(ROM),
+        .store    = &SIGNATURE_ABSTRACT_MEM_STORE(ROM),
+        .page_ptr = &SIGNATURE_ABSTRACT_MEM_PAGE_PTR(ROM),
+        .accepts  = &SIGNATURE_ABSTRACT_MEM_ACCEPTS(ROM)
     };
     self->super.vtbl = &vtbl; // replace vtbl of base class
 
     // initialize boot rom code
     // onl one instruction in boot rom: jal x1, 0x80000000
+    self->rom = self->storage;
     memset(self->rom, 0, sizeof(byte_t) * ROM_SIZE);
 }
+
+void ROM_place(ROM *self, byte_t *rom) {
+    assert(self != NULL && rom != NULL);
+    memcpy(rom, self->rom, ROM_SIZE);
+    self->rom = rom;
+}
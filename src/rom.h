@@ -11,10 +11,13 @@ typedef struct {
     // parent class
     AbstractMem super;
 
-    // the rom itself
-    byte_t rom[ROM_SIZE];
+    // the rom itself, ROM_SIZE bytes: storage, unless placed elsewhere
+    byte_t *rom;
+    byte_t storage[ROM_SIZE];
 } ROM;
 
 extern void ROM_ctor(ROM *self);
+// move the contents to rom (ROM_SIZE bytes), which backs the ROM from now on
+extern void ROM_place(ROM *self, byte_t *rom);
 
 #endif
@@ -0,0 +1,284 @@
+#ifndef __RV_ASM_H__
+#define __RV_ASM_H__
+
+#include "arch.h"
+#include "common.h"
+#include "halt.h"
+#include "main_mem.h"
+#include "rom.h"
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * A tiny RISC-V assembler for the guest programs that the benchmark and the
+ * regression tests generate, so that no cross toolchain is needed. The code
+ * goes to the start of the ROM, and an optional data segment to the bottom
+ * of the main memory. Branches, jumps and LA refer to labels (small integers
+ * of the caller, placed with place()), which prog_link() resolves once the
+ * program is complete.
+ */
+
+// register names of the ABI
+enum {
+    ZERO, RA, SP, GP, TP, T0, T1, T2, S0, S1, A0, A1, A2, A3, A4, A5,
+    A6, A7, S2, S3, S4, S5, S6, S7, S8, S9, S10, S11, T3, T4, T5, T6,
+};
+
+#define PROG_MAX_INSTS (ROM_SIZE / 4)
+#define PROG_MAX_LABELS 32
+#define PROG_MAX_FIXUPS 64
+#define PROG_DATA_SIZE 0x1000
+
+// a program in the ROM, and optionally a data segment at the bottom of the
+// main memory (data_memsz 0: none)
+typedef struct {
+    uint32_t code[PROG_MAX_INSTS];
+    unsigned n;
+    int label[PROG_MAX_LABELS]; // instruction index (-1: not placed yet)
+    struct {
+        unsigned at;
+        unsigned label;
+    } fixup[PROG_MAX_FIXUPS];
+    unsigned num_fixups;
+    byte_t data[PROG_DATA_SIZE];
+    unsigned data_filesz;
+    unsigned data_memsz;
+} prog_t;
+
+static inline void prog_init(prog_t *p) {
+    memset(p, 0, sizeof(prog_t));
+    memset(p->label, -1, sizeof(p->label));
+}
+
+static inline void emit(prog_t *p, uint32_t inst) {
+    Assert(p->n < PROG_MAX_INSTS, "The program does not fit into the ROM");
+    p->code[p->n++] = inst;
+}
+
+// the address of the instruction emitted next
+static inline uint32_t HERE(const prog_t *p) {
+    return ROM_MMAP_BASE + p->n * 4;
+}
+
+static inline void place(prog_t *p, unsigned label) {
+    Assert(label < PROG_MAX_LABELS, "Label %u is out of range", label);
+    p->label[label] = (int)p->n;
+}
+
+/* ----------------------------- encoding ---------------------------- */
+static inline uint32_t enc_r(unsigned f7, unsigned rs2, unsigned rs1, unsigned f3, unsigned rd,
+                             unsigned op) {
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static inline uint32_t enc_i(int32_t imm, unsigned rs1, unsigned f3, unsigned rd, unsigned op) {
+    return ((uint32_t)imm << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static inline uint32_t enc_s(int32_t imm, unsigned rs2, unsigned rs1, unsigned f3) {
+    uint32_t u = (uint32_t)imm;
+    return ((u >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | ((u & 0x1f) << 7) | 0x23;
+}
+
+static inline uint32_t b_imm(int32_t offset) {
+    uint32_t u = (uint32_t)offset;
+    return (((u >> 12) & 1) << 31) | (((u >> 5) & 0x3f) << 25) | (((u >> 1) & 0xf) << 8) |
+           (((u >> 11) & 1) << 7);
+}
+
+static inline uint32_t j_imm(int32_t offset) {
+    uint32_t u = (uint32_t)offset;
+    return (((u >> 20) & 1) << 31) | (((u >> 1) & 0x3ff) << 21) | (((u >> 11) & 1) << 20) |
+           (((u >> 12) & 0xff) << 12);
+}
+
+/* ------------------------------ labels ----------------------------- */
+// the instruction emitted next refers to label
+static inline void prog_ref(prog_t *p, unsigned label) {
+    Assert(p->num_fixups < PROG_MAX_FIXUPS, "Too many label references");
+    p->fixup[p->num_fixups].at    = p->n;
+    p->fixup[p->num_fixups].label = label;
+    p->num_fixups++;
+}
+
+// resolve the label references (branch and jump offsets, and the absolute
+// address of LA), which are dropped then: linking again does nothing
+static inline void prog_link(prog_t *p) {
+    for (unsigned i = 0; i < p->num_fixups; i++) {
+        unsigned at = p->fixup[i].at;
+        int target  = p->label[p->fixup[i].label];
+        Assert(target >= 0, "Label %u is not placed", p->fixup[i].label);
+        int32_t offset = (target - (int)at) * 4;
+        uint32_t addr  = ROM_MMAP_BASE + (uint32_t)target * 4;
+        switch (p->code[at] & 0x7f) {
+        case 0x6f: p->code[at] |= j_imm(offset); break;
+        case 0x63: p->code[at] |= b_imm(offset); break;
+        default:
+            p->code[at] |= (addr + 0x800) & 0xfffff000u;
+            p->code[at + 1] |= (addr & 0xfff) << 20;
+            break;
+        }
+    }
+    p->num_fixups = 0;
+}
+
+/* --------------------------- instructions -------------------------- */
+// clang-format off
+#define ADD(p, rd, a, b)    emit(p, enc_r(0x00, b, a, 0, rd, 0x33))
+#define SUB(p, rd, a, b)    emit(p, enc_r(0x20, b, a, 0, rd, 0x33))
+#define SLL(p, rd, a, b)    emit(p, enc_r(0x00, b, a, 1, rd, 0x33))
+#define SLTU(p, rd, a, b)   emit(p, enc_r(0x00, b, a, 3, rd, 0x33))
+#define XOR(p, rd, a, b)    emit(p, enc_r(0x00, b, a, 4, rd, 0x33))
+#define SRL(p, rd, a, b)    emit(p, enc_r(0x00, b, a, 5, rd, 0x33))
+#define OR(p, rd, a, b)     emit(p, enc_r(0x00, b, a, 6, rd, 0x33))
+#define AND(p, rd, a, b)    emit(p, enc_r(0x00, b, a, 7, rd, 0x33))
+#define MUL(p, rd, a, b)    emit(p, enc_r(0x01, b, a, 0, rd, 0x33))
+#define ADDI(p, rd, a, i)   emit(p, enc_i(i, a, 0, rd, 0x13))
+#define SLLI(p, rd, a, i)   emit(p, enc_i(i, a, 1, rd, 0x13))
+#define XORI(p, rd, a, i)   emit(p, enc_i(i, a, 4, rd, 0x13))
+#define SRLI(p, rd, a, i)   emit(p, enc_i(i, a, 5, rd, 0x13))
+#define ORI(p, rd, a, i)    emit(p, enc_i(i, a, 6, rd, 0x13))
+#define ANDI(p, rd, a, i)   emit(p, enc_i(i, a, 7, rd, 0x13))
+#define MV(p, rd, a)        ADDI(p, rd, a, 0)
+#define NOP(p)              ADDI(p, ZERO, ZERO, 0)
+#define LUI(p, rd, u)       emit(p, ((uint32_t)(u) & 0xfffff000u) | ((uint32_t)(rd) << 7) | 0x37)
+#define LB(p, rd, i, a)     emit(p, enc_i(i, a, 0, rd, 0x03))
+#define LH(p, rd, i, a)     emit(p, enc_i(i, a, 1, rd, 0x03))
+#define LW(p, rd, i, a)     emit(p, enc_i(i, a, 2, rd, 0x03))
+#define LBU(p, rd, i, a)    emit(p, enc_i(i, a, 4, rd, 0x03))
+#define SB(p, rs, i, a)     emit(p, enc_s(i, rs, a, 0))
+#define SH(p, rs, i, a)     emit(p, enc_s(i, rs, a, 1))
+#define SW(p, rs, i, a)     emit(p, enc_s(i, rs, a, 2))
+#define SD(p, rs, i, a)     emit(p, enc_s(i, rs, a, 3)) // RV64
+#define LR_W(p, rd, a)      emit(p, enc_r(0x08, 0, a, 2, rd, 0x2f))
+#define SC_W(p, rd, b, a)   emit(p, enc_r(0x0c, b, a, 2, rd, 0x2f))
+#define AMOADD(p, rd, b, a) emit(p, enc_r(0x00, b, a, 2, rd, 0x2f))
+#define JALR(p, rd, a, i)   emit(p, enc_i(i, a, 0, rd, 0x67))
+#define RET(p)              JALR(p, ZERO, RA, 0)
+#define BR(p, f3, a, b, l)  (prog_ref(p, l), emit(p, enc_r(0, b, a, f3, 0, 0x63)))
+#define BEQ(p, a, b, l)     BR(p, 0, a, b, l)
+#define BNE(p, a, b, l)     BR(p, 1, a, b, l)
+#define BLT(p, a, b, l)     BR(p, 4, a, b, l)
+#define BGE(p, a, b, l)     BR(p, 5, a, b, l)
+#define BLTU(p, a, b, l)    BR(p, 6, a, b, l)
+#define BGEU(p, a, b, l)    BR(p, 7, a, b, l)
+#define JAL(p, rd, l)       (prog_ref(p, l), emit(p, ((unsigned)(rd) << 7) | 0x6f))
+#define J(p, l)             JAL(p, ZERO, l)
+#define CSRR(p, rd, csr)    emit(p, enc_i(csr, ZERO, 2, rd, 0x73))
+#define CSRW(p, csr, rs)    emit(p, enc_i(csr, rs, 1, ZERO, 0x73))
+#define CSRS(p, csr, rs)    emit(p, enc_i(csr, rs, 2, ZERO, 0x73))
+#define CSRC(p, csr, rs)    emit(p, enc_i(csr, rs, 3, ZERO, 0x73))
+#define ECALL(p)            emit(p, 0x00000073)
+#define EBREAK(p)           emit(p, 0x00100073)
+#define MRET(p)             emit(p, 0x30200073)
+#define SRET(p)             emit(p, 0x10200073)
+#define SFENCE_VMA(p, a, b) emit(p, enc_r(0x09, b, a, 0, ZERO, 0x73))
+#define FENCE(p)            emit(p, 0x0ff0000f)
+// clang-format on
+
+/* ----------------------------- vector ------------------------------ */
+// vtype of vsetvli: SEW 8 << sew, LMUL 1 << lmul (5, 6, 7: 1/8, 1/4, 1/2)
+#define VTYPE(sew, lmul) (((sew) << 3) | (lmul))
+// the width field of a vector load/store of eew bits
+#define VWIDTH(eew) ((eew) == 8 ? 0u : (eew) == 16 ? 5u : (eew) == 32 ? 6u : 7u)
+
+// vm 1: unmasked, 0: masked by v0
+// clang-format off
+#define VSETVLI(p, rd, a, vt)          emit(p, enc_i(vt, a, 7, rd, 0x57))
+#define VMEM(p, op, eew, v, a, lu, vm) emit(p, enc_r((vm), lu, a, VWIDTH(eew), v, op))
+#define VLE(p, eew, vd, a, vm)         VMEM(p, 0x07, eew, vd, a, 0x00, vm)
+#define VSE(p, eew, vs, a, vm)         VMEM(p, 0x27, eew, vs, a, 0x00, vm)
+#define VLM(p, vd, a)                  VMEM(p, 0x07, 8, vd, a, 0x0b, 1)
+// OP-V of funct6 and funct3 (0 VV, 2 MVV, 3 VI, 4 VX, 6 MVX), src1 is vs1,
+// rs1 or the immediate
+#define VOP(p, f6, f3, vd, vs2, src1, vm) \
+    emit(p, enc_r(((f6) << 1) | (vm), vs2, (unsigned)(src1) & 0x1f, f3, vd, 0x57))
+// clang-format on
+
+// li rd, value (sign-extended from 32 bits, as lui does on RV64)
+static inline void LI(prog_t *p, unsigned rd, uint32_t value) {
+    uint32_t lo = value & 0xfff;
+    uint32_t hi = (value + 0x800) & 0xfffff000u; // addi sign-extends lo
+    if (hi == 0) {
+        ADDI(p, rd, ZERO, (int32_t)(lo << 20) >> 20);
+        return;
+    }
+    LUI(p, rd, hi);
+    if (lo != 0) {
+        ADDI(p, rd, rd, (int32_t)(lo << 20) >> 20);
+    }
+}
+
+// la rd, label
+static inline void LA(prog_t *p, unsigned rd, unsigned label) {
+    prog_ref(p, label);
+    LUI(p, rd, 0);
+    ADDI(p, rd, rd, 0);
+}
+
+// store 1 to the Halt device (clobbers t0 and t1)
+static inline void HALT(prog_t *p) {
+    LI(p, T0, HALT_MMAP_BASE);
+    LI(p, T1, 1);
+    SB(p, T1, 0, T0);
+}
+
+/* ------------------------------- ELF ------------------------------- */
+#if XLEN == 64
+#define ELF_CLASS ELFCLASS64
+typedef Elf64_Ehdr elf_ehdr_t;
+typedef Elf64_Phdr elf_phdr_t;
+#else
+#define ELF_CLASS ELFCLASS32
+typedef Elf32_Ehdr elf_ehdr_t;
+typedef Elf32_Phdr elf_phdr_t;
+#endif
+
+// the linked program as an ELF of the XLEN: the code at the start of the
+// ROM, the data segment at the bottom of the main memory
+static inline void write_elf(const prog_t *p, const char *file_name) {
+    unsigned num_phdrs = (p->data_memsz != 0) ? 2 : 1;
+    elf_ehdr_t ehdr    = {
+        .e_ident     = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELF_CLASS, ELFDATA2LSB, EV_CURRENT },
+        .e_type      = ET_EXEC,
+        .e_machine   = EM_RISCV,
+        .e_version   = EV_CURRENT,
+        .e_entry     = ROM_MMAP_BASE,
+        .e_phoff     = sizeof(elf_ehdr_t),
+        .e_ehsize    = sizeof(elf_ehdr_t),
+        .e_phentsize = sizeof(elf_phdr_t),
+        .e_phnum     = (uint16_t)num_phdrs,
+    };
+    size_t offset     = sizeof(elf_ehdr_t) + num_phdrs * sizeof(elf_phdr_t);
+    elf_phdr_t phdr[] = {
+        { .p_type   = PT_LOAD,
+          .p_offset = offset,
+          .p_vaddr  = ROM_MMAP_BASE,
+          .p_paddr  = ROM_MMAP_BASE,
+          .p_filesz = p->n * 4,
+          .p_memsz  = p->n * 4,
+          .p_flags  = PF_R | PF_X,
+          .p_align  = 4 },
+        { .p_type   = PT_LOAD,
+          .p_offset = offset + p->n * 4,
+          .p_vaddr  = MAIN_MEM_MMAP_BASE,
+          .p_paddr  = MAIN_MEM_MMAP_BASE,
+          .p_filesz = p->data_filesz,
+          .p_memsz  = p->data_memsz,
+          .p_flags  = PF_R | PF_W,
+          .p_align  = 4 },
+    };
+    FILE *f = fopen(file_name, "wb");
+    Assert(f != NULL, "Fail to create %s", file_name);
+    fwrite(&ehdr, sizeof(ehdr), 1, f);
+    fwrite(phdr, sizeof(elf_phdr_t), num_phdrs, f);
+    fwrite(p->code, 4, p->n, f);
+    fwrite(p->data, 1, p->data_filesz, f);
+    int err = fclose(f);
+    Assert(err == 0, "Fail to write %s", file_name);
+}
+
+#endif
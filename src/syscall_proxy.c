@@ -0,0 +1,514 @@
+#include "syscall_proxy.h"
+
+#include "arch.h"
+#include "common.h"
+#include "halt.h"
+#include "main_mem.h"
+#include "mem_map.h"
+#include "undo.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+
+// open() flags of newlib, translated to the host ones
+#define NEWLIB_O_ACCMODE 0x0003
+#define NEWLIB_O_APPEND 0x0008
+#define NEWLIB_O_CREAT 0x0200
+#define NEWLIB_O_TRUNC 0x0400
+#define NEWLIB_O_EXCL 0x0800
+#define NEWLIB_AT_FDCWD -100
+
+// register names of the syscall ABI
+#define A0 10
+#define A1 11
+#define A2 12
+#define A3 13
+#define A7 17
+
+// newlib's rv32 struct timeval: 64-bit tv_sec, 32-bit tv_usec
+#define GUEST_TIMEVAL_SIZE 16
+
+// the heap starts on a page after the ELF image
+#define BRK_ALIGN 0x1000
+
+/* ----------------------- guest memory access ----------------------- */
+// the len bytes of host memory at dst are about to be overwritten
+static inline void SyscallProxy_undo_save(SyscallProxy *self, void *dst, size_t len) {
+    if (unlikely(self->undo != NULL)) {
+        UndoLog_save(self->undo, dst, len);
+    }
+}
+
+// copy [addr, addr + len) of the guest into dst in one shot
+static bool SyscallProxy_copy_in(SyscallProxy *self, addr_t addr, unsigned len, void *dst) {
+    if (len == 0) {
+        return true;
+    }
+    byte_t *src = MemoryMap_host_ptr(self->mem_map, addr, len, false);
+    if (src != NULL) {
+        memcpy(dst, src, len);
+        return true;
+    }
+    return MemoryMap_try_load(self->mem_map, addr, len, dst);
+}
+
+// copy src into [addr, addr + len) of the guest in one shot
+static bool
+SyscallProxy_copy_out(SyscallProxy *self, addr_t addr, unsigned len, const void *src) {
+    if (len == 0) {
+        return true;
+    }
+    byte_t *dst = MemoryMap_host_ptr(self->mem_map, addr, len, true);
+    if (dst != NULL) {
+        SyscallProxy_undo_save(self, dst, len);
+        memcpy(dst, src, len);
+        return true;
+    }
+    return MemoryMap_try_store(self->mem_map, addr, len, src);
+}
+
+// copy a NUL-terminated string of the guest into dst (at most size bytes)
+static bool SyscallProxy_copy_in_str(SyscallProxy *self, addr_t addr, char *dst, unsigned size) {
+    for (unsigned i = 0; i < size; i++) {
+        if (!SyscallProxy_copy_in(self, addr + i, 1, &dst[i])) {
+            return false;
+        }
+        if (dst[i] == '\0') {
+            return true;
+        }
+    }
+    return false; // too long
+}
+
+/* ----------------------------- helpers ----------------------------- */
+static int SyscallProxy_host_fd(SyscallProxy *self, reg_t guest_fd) {
+    if (guest_fd >= SYSCALL_MAX_FD) {
+        return -1;
+    }
+    return self->host_fd[guest_fd];
+}
+
+// reject paths which may leave the sandbox directory
+static bool sandbox_path_ok(const char *path) {
+    if (path[0] == '\0' || path[0] == '/') {
+        return false;
+    }
+    for (const char *p = path; p != NULL; p = strchr(p, '/')) {
+        p += (*p == '/');
+        if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// open path under the sandbox directory dirfd: no component may be a
+// symbolic link, so a link cannot lead out of it (-1 with errno on failure)
+static int sandbox_openat(int dirfd, const char *path, int flags, mode_t mode) {
+#ifdef SYS_openat2
+    struct open_how how = {
+        .flags   = (uint64_t)flags,
+        .mode    = (flags & O_CREAT) ? mode : 0,
+        .resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS,
+    };
+    int fd = (int)syscall(SYS_openat2, dirfd, path, &how, sizeof(how));
+    if (fd >= 0 || errno != ENOSYS) {
+        return fd;
+    }
+#endif
+    // no openat2() (before Linux 5.6): walk the directories one by one
+    char name[PATH_MAX];
+    int dir = dirfd;
+    for (const char *p = path;;) {
+        while (*p == '/') {
+            p++;
+        }
+        const char *slash = strchr(p, '/');
+        size_t len        = (slash != NULL) ? (size_t)(slash - p) : strlen(p);
+        memcpy(name, p, len);
+        name[len] = '\0';
+        p += len;
+        while (*p == '/') {
+            p++;
+        }
+
+        bool last = (*p == '\0');
+        int fd    = last ? openat(dir, name, flags | O_NOFOLLOW, mode)
+                         : openat(dir, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        int err   = errno;
+        if (dir != dirfd) {
+            close(dir);
+        }
+        if (fd < 0 || last) {
+            errno = err;
+            return fd;
+        }
+        dir = fd;
+    }
+}
+
+static int newlib_to_host_flags(reg_t flags) {
+    int ret = 0;
+    switch (flags & NEWLIB_O_ACCMODE) {
+    case 0:  ret = O_RDONLY; break;
+    case 1:  ret = O_WRONLY; break;
+    default: ret = O_RDWR;   break;
+    }
+    ret |= (flags & NEWLIB_O_APPEND) ? O_APPEND : 0;
+    ret |= (flags & NEWLIB_O_CREAT) ? O_CREAT : 0;
+    ret |= (flags & NEWLIB_O_TRUNC) ? O_TRUNC : 0;
+    ret |= (flags & NEWLIB_O_EXCL) ? O_EXCL : 0;
+    return ret;
+}
+
+/* ---------------------------- syscalls ----------------------------- */
+static long SyscallProxy_write(SyscallProxy *self, reg_t fd, addr_t buf, reg_t count) {
+    int host_fd = SyscallProxy_host_fd(self, fd);
+    if (host_fd < 0) {
+        return -EBADF;
+    }
+    if (!MemoryMap_is_mapped(self->mem_map, buf, count)) {
+        return -EFAULT;
+    }
+
+    // write straight from guest memory when it is host-addressable
+    byte_t *src = MemoryMap_host_ptr(self->mem_map, buf, count, false);
+    byte_t *bounce = NULL;
+    if (src == NULL) {
+        if (NULL == (src = bounce = malloc(count))) {
+            return -ENOMEM;
+        }
+        if (!SyscallProxy_copy_in(self, buf, count, bounce)) {
+            free(bounce);
+            return -EFAULT;
+        }
+    }
+
+    long ret;
+    if (host_fd == STDOUT_FILENO || host_fd == STDERR_FILENO) {
+        // go through stdio to keep the order with TextBuffer's output
+        FILE *stream = (host_fd == STDOUT_FILENO) ? stdout : stderr;
+        ret          = (long)fwrite(src, 1, count, stream);
+    } else {
+        ret = write(host_fd, src, count);
+        ret = (ret < 0) ? -errno : ret;
+    }
+    free(bounce);
+    return ret;
+}
+
+static long SyscallProxy_read(SyscallProxy *self, reg_t fd, addr_t buf, reg_t count) {
+    int host_fd = SyscallProxy_host_fd(self, fd);
+    if (host_fd < 0) {
+        return -EBADF;
+    }
+    if (!MemoryMap_is_mapped(self->mem_map, buf, count)) {
+        return -EFAULT;
+    }
+    if (host_fd == STDIN_FILENO) {
+        fflush(stdout);
+    }
+
+    // read straight into guest memory when it is host-addressable
+    byte_t *dst = MemoryMap_host_ptr(self->mem_map, buf, count, true);
+    if (dst != NULL) {
+        SyscallProxy_undo_save(self, dst, count);
+        long ret = read(host_fd, dst, count);
+        return (ret < 0) ? -errno : ret;
+    }
+
+    byte_t *bounce = malloc(count);
+    if (bounce == NULL) {
+        return -ENOMEM;
+    }
+    long ret = read(host_fd, bounce, count);
+    if (ret < 0) {
+        ret = -errno;
+    } else if (!SyscallProxy_copy_out(self, buf, (unsigned)ret, bounce)) {
+        ret = -EFAULT;
+    }
+    free(bounce);
+    return ret;
+}
+
+static long SyscallProxy_open(SyscallProxy *self, addr_t path_addr, reg_t flags, reg_t mode) {
+    if (self->sandbox_dirfd < 0) {
+        return -EACCES;
+    }
+    char path[PATH_MAX];
+    if (!SyscallProxy_copy_in_str(self, path_addr, path, sizeof(path))) {
+        return -EFAULT;
+    }
+    if (!sandbox_path_ok(path)) {
+        return -EACCES;
+    }
+
+    // find a free guest fd
+    int guest_fd = -1;
+    for (int i = 0; i < SYSCALL_MAX_FD; i++) {
+        if (self->host_fd[i] < 0) {
+            guest_fd = i;
+            break;
+        }
+    }
+    if (guest_fd < 0) {
+        return -EMFILE;
+    }
+
+    int host_fd =
+        sandbox_openat(self->sandbox_dirfd, path, newlib_to_host_flags(flags), (mode_t)mode);
+    if (host_fd < 0) {
+        return -errno;
+    }
+    self->host_fd[guest_fd] = host_fd;
+    return guest_fd;
+}
+
+static long SyscallProxy_close(SyscallProxy *self, reg_t fd) {
+    int host_fd = SyscallProxy_host_fd(self, fd);
+    if (host_fd < 0) {
+        return -EBADF;
+    }
+    self->host_fd[fd] = -1;
+    // never close the host's standard streams
+    if (host_fd <= STDERR_FILENO) {
+        return 0;
+    }
+    return (close(host_fd) < 0) ? -errno : 0;
+}
+
+static long SyscallProxy_lseek(SyscallProxy *self, reg_t fd, reg_t offset, reg_t whence) {
+    int host_fd = SyscallProxy_host_fd(self, fd);
+    if (host_fd < 0) {
+        return -EBADF;
+    }
+    off_t ret = lseek(host_fd, (off_t)(sreg_t)offset, (int)whence);
+    return (ret < 0) ? -errno : (long)ret;
+}
+
+static long SyscallProxy_brk(SyscallProxy *self, addr_t addr) {
+    // brk(0) (or any out-of-range request) reports the current break
+    if (addr >= self->brk_base && addr <= self->brk_limit) {
+        SyscallProxy_undo_save(self, &self->brk, sizeof(self->brk));
+        self->brk = addr;
+    }
+    return (long)self->brk;
+}
+
+static long SyscallProxy_gettimeofday(SyscallProxy *self, addr_t tv_addr) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    byte_t guest_tv[GUEST_TIMEVAL_SIZE] = {};
+    uint64_t sec        = (uint64_t)tv.tv_sec;
+    uint32_t usec       = (uint32_t)tv.tv_usec;
+    for (int i = 0; i < 8; i++) {
+        guest_tv[i] = (byte_t)(sec >> (8 * i));
+    }
+    for (int i = 0; i < 4; i++) {
+        guest_tv[8 + i] = (byte_t)(usec >> (8 * i));
+    }
+    return SyscallProxy_copy_out(self, tv_addr, sizeof(guest_tv), guest_tv) ? 0 : -EFAULT;
+}
+
+/* ------------------------ ctor / dtor / handle --------------------- */
+int SyscallProxy_ctor(SyscallProxy *self,
+                      MemoryMap *mem_map,
+                      Halt *halt,
+                      const iss_config_t *config) {
+    assert((self != NULL) && (mem_map != NULL) && (halt != NULL) && (config != NULL));
+
+    self->mem_map  = mem_map;
+    self->halt     = halt;
+    self->replay    = false;
+    self->diverged  = false;
+    self->input_log = NULL;
+    self->undo      = NULL;
+    pthread_mutex_init(&self->lock, NULL);
+
+    // the standard streams are inherited from the host
+    for (int i = 0; i < SYSCALL_MAX_FD; i++) {
+        self->host_fd[i] = -1;
+    }
+    self->host_fd[0] = STDIN_FILENO;
+    self->host_fd[1] = STDOUT_FILENO;
+    self->host_fd[2] = STDERR_FILENO;
+
+    self->sandbox_dirfd = -1;
+    if (config->sandbox_dir != NULL) {
+        self->sandbox_dirfd = open(config->sandbox_dir, O_RDONLY | O_DIRECTORY);
+        if (self->sandbox_dirfd < 0) {
+            fprintf(stderr, "Fail to open sandbox directory %s: %s\n", config->sandbox_dir,
+                    strerror(errno));
+            return -1;
+        }
+    }
+
+    // the heap grows upward from the bottom of main memory, until the ELF
+    // image says where it ends
+    self->brk       = MAIN_MEM_MMAP_BASE;
+    self->brk_base  = MAIN_MEM_MMAP_BASE;
+    self->brk_limit = MAIN_MEM_MMAP_BASE + MAIN_MEM_SIZE;
+    return 0;
+}
+
+void SyscallProxy_set_image_end(SyscallProxy *self, addr_t image_end) {
+    assert(self != NULL);
+    addr_t base = MAIN_MEM_MMAP_BASE;
+    if (image_end > MAIN_MEM_MMAP_BASE && image_end <= self->brk_limit) {
+        base = (addr_t)((image_end + BRK_ALIGN - 1) & ~(addr_t)(BRK_ALIGN - 1));
+        base = (base < self->brk_limit) ? base : self->brk_limit;
+    }
+    self->brk      = base;
+    self->brk_base = base;
+}
+
+void SyscallProxy_reset(SyscallProxy *self) {
+    assert(self != NULL);
+    for (int i = STDERR_FILENO + 1; i < SYSCALL_MAX_FD; i++) {
+        if (self->host_fd[i] > STDERR_FILENO) {
+            close(self->host_fd[i]);
+        }
+        self->host_fd[i] = -1;
+    }
+    self->host_fd[0] = STDIN_FILENO;
+    self->host_fd[1] = STDOUT_FILENO;
+    self->host_fd[2] = STDERR_FILENO;
+}
+
+void SyscallProxy_dtor(SyscallProxy *self) {
+    assert(self != NULL);
+    SyscallProxy_reset(self);
+    if (self->sandbox_dirfd >= 0) {
+        close(self->sandbox_dirfd);
+    }
+    pthread_mutex_destroy(&self->lock);
+}
+
+static void SyscallProxy_serve(SyscallProxy *self, reg_t *gpr) {
+    long ret = 0;
+    if (unlikely(self->replay)) {
+        switch (gpr[A7]) {
+        case SYS_WRITE:
+            // the original run did the output already
+            gpr[A0] = gpr[A2];
+            return;
+        case SYS_READ:
+        case SYS_OPEN:
+        case SYS_OPENAT:
+        case SYS_LSEEK:
+            // file offsets are shared with the original run
+            self->diverged = true;
+            __atomic_store_n(&self->halt->halt_flag, true, __ATOMIC_RELEASE);
+            return;
+        default:
+            break;
+        }
+    }
+    switch (gpr[A7]) {
+    case SYS_WRITE: ret = SyscallProxy_write(self, gpr[A0], gpr[A1], gpr[A2]); break;
+    case SYS_READ:  ret = SyscallProxy_read(self, gpr[A0], gpr[A1], gpr[A2]);  break;
+    case SYS_OPEN:  ret = SyscallProxy_open(self, gpr[A0], gpr[A1], gpr[A2]);  break;
+    case SYS_OPENAT:
+        // only paths relative to the (sandboxed) working directory
+        ret = ((int32_t)gpr[A0] == NEWLIB_AT_FDCWD)
+                  ? SyscallProxy_open(self, gpr[A1], gpr[A2], gpr[A3])
+                  : -EBADF;
+        break;
+    case SYS_CLOSE: ret = SyscallProxy_close(self, gpr[A0]);                    break;
+    case SYS_LSEEK: ret = SyscallProxy_lseek(self, gpr[A0], gpr[A1], gpr[A2]); break;
+    case SYS_BRK:   ret = SyscallProxy_brk(self, gpr[A0]);                      break;
+    case SYS_GETTIMEOFDAY: ret = SyscallProxy_gettimeofday(self, gpr[A0]);      break;
+    case SYS_EXIT:
+    case SYS_EXIT_GROUP:
+        // a0 keeps the exit code
+        fflush(stdout);
+        __atomic_store_n(&self->halt->halt_flag, true, __ATOMIC_RELEASE);
+        return;
+    default:
+        ret = -ENOSYS;
+        break;
+    }
+    gpr[A0] = (reg_t)ret;
+}
+
+// the syscalls whose result depends on the host
+static bool syscall_from_host(reg_t num) {
+    switch (num) {
+    case SYS_WRITE:
+    case SYS_READ:
+    case SYS_OPEN:
+    case SYS_OPENAT:
+    case SYS_CLOSE:
+    case SYS_LSEEK:
+    case SYS_GETTIMEOFDAY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// the return value and the bytes the host put into guest memory are inputs
+// of the run: recorded after serving the syscall, or replayed instead of it
+static void SyscallProxy_serve_logged(SyscallProxy *self, reg_t *gpr) {
+    InputLog *log = self->input_log;
+    reg_t num     = gpr[A7];
+    reg_t a0      = gpr[A0];
+    reg_t a1      = gpr[A1];
+    if (!log->replay) {
+        SyscallProxy_serve(self, gpr);
+    } else if (num == SYS_WRITE && (a0 == STDOUT_FILENO || a0 == STDERR_FILENO)) {
+        SyscallProxy_write(self, a0, a1, gpr[A2]);
+    }
+    uint64_t ret = (uint64_t)(sreg_t)gpr[A0];
+    InputLog_input(log, INPUT_SYSCALL, &ret, sizeof(ret));
+    gpr[A0] = (reg_t)ret;
+
+    addr_t buf   = 0;
+    unsigned len = 0;
+    if (num == SYS_READ && (sreg_t)ret > 0) {
+        buf = a1;
+        len = (unsigned)ret;
+    } else if (num == SYS_GETTIMEOFDAY && ret == 0) {
+        buf = a0;
+        len = GUEST_TIMEVAL_SIZE;
+    }
+    if (len == 0 || log->diverged) {
+        return;
+    }
+    byte_t *data = malloc(len);
+    Assert(data != NULL, "Out of memory");
+    if (!log->replay) {
+        SyscallProxy_copy_in(self, buf, len, data);
+    }
+    InputLog_input(log, INPUT_SYSCALL_DATA, data, len);
+    if (log->replay) {
+        SyscallProxy_copy_out(self, buf, len, data);
+    }
+    free(data);
+}
+
+void SyscallProxy_handle(SyscallProxy *self, reg_t *gpr) {
+    assert((self != NULL) && (gpr != NULL));
+    pthread_mutex_lock(&self->lock);
+    if (unlikely(self->input_log != NULL) && syscall_from_host(gpr[A7])) {
+        SyscallProxy_serve_logged(self, gpr);
+    } else {
+        SyscallProxy_serve(self, gpr);
+    }
+    pthread_mutex_unlock(&self->lock);
+}
@@ -0,0 +1,76 @@
+#ifndef __SYSCALL_PROXY_H__
+#define __SYSCALL_PROXY_H__
+
+#include "arch.h"
+#include "halt.h"
+#include "input_log.h"
+#include "iss.h"
+#include "mem_map.h"
+#include "undo.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// syscall numbers of the newlib/libgloss RISC-V port (passed in a7)
+typedef enum {
+    SYS_OPENAT       = 56,
+    SYS_CLOSE        = 57,
+    SYS_LSEEK        = 62,
+    SYS_READ         = 63,
+    SYS_WRITE        = 64,
+    SYS_EXIT         = 93,
+    SYS_EXIT_GROUP   = 94,
+    SYS_GETTIMEOFDAY = 169,
+    SYS_BRK          = 214,
+    SYS_OPEN         = 1024,
+} SYSCALL_NUM;
+
+#define SYSCALL_MAX_FD 32
+
+// host side of ECALL: proxies newlib syscalls onto the host
+typedef struct {
+    MemoryMap *mem_map; // guest memory, for copying syscall buffers
+    Halt *halt;         // raised by exit()
+
+    // guest fd -> host fd (-1 if unused)
+    int host_fd[SYSCALL_MAX_FD];
+    int sandbox_dirfd; // files are opened relative to it (-1: no file access)
+
+    // program break for brk(), in [brk_base, brk_limit]
+    addr_t brk;
+    addr_t brk_base;
+    addr_t brk_limit;
+
+    // replaying an interval of a run (sampled execution): writes are
+    // dropped, and syscalls whose effect on the host cannot be repeated
+    // halt the replay and set diverged
+    bool replay;
+    bool diverged;
+
+    // records the answers of the host, or replays them without the host
+    // (but the output to the standard streams), see InputLog (NULL: off)
+    InputLog *input_log;
+
+    // reverse execution: the guest memory a syscall writes is saved in it
+    // first, like the stores of the hart (NULL: off)
+    UndoLog *undo;
+
+    // serializes the syscalls of harts running on different threads
+    pthread_mutex_t lock;
+} SyscallProxy;
+
+extern int SyscallProxy_ctor(SyscallProxy *self,
+                             MemoryMap *mem_map,
+                             Halt *halt,
+                             const iss_config_t *config);
+extern void SyscallProxy_dtor(SyscallProxy *self);
+// the loaded image of the guest ends at image_end: the heap starts at the
+// next page (at the bottom of main memory if the image is not there)
+extern void SyscallProxy_set_image_end(SyscallProxy *self, addr_t image_end);
+// close the files opened by the guest and give back the standard streams
+// (for reusing the ISS on a new run)
+extern void SyscallProxy_reset(SyscallProxy *self);
+// serve the syscall in a7 with arguments a0-a3, the return value goes to a0
+extern void SyscallProxy_handle(SyscallProxy *self, reg_t *gpr);
+
+#endif
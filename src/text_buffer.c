@@ -22,8 +22,18 @@ DECLARE_ABSTRACT_MEM_STORE(TextBuffer) {
     Assert(length == 1, "");
 
     TextBuffer *self_ = container_of(self, TextBuffer, abstract_mem_super);
-    self_->buffer     = ref_data[0];
-    self_->valid      = true;
+    if (self_->immediate) {
+        putchar(ref_data[0]);
+        return;
+    }
+    self_->buffer = ref_data[0];
+    self_->valid  = true;
+}
+
+// the buffer holds a single character
+DECLARE_ABSTRACT_MEM_ACCEPTS(TextBuffer) {
+    (void)self, (void)base_addr, (void)write;
+    return length == 1;
 }
 
 DECLARE_TICK_TICK(TextBuffer) {
@@ -46,12 +56,14 @@ void TextBuffer_ctor(TextBuffer *self) {
     // AbstractMem vtable initialization
     AbstractMem_ctor(&self->abstract_mem_super);
     static struct AbstractMemVtbl const abstract_mem_vtbl = {
-        .load  = &SIGNATURE_ABSTRACT_MEM_LOAD(TextBuffer),
-        .store = &SIGNATURE_ABSTRACT_MEM_STORE(TextBuffer)
+        .load    = &SIGNATURE_ABSTRACT_MEM_LOAD(TextBuffer),
+        .store   = &SIGNATURE_ABSTRACT_MEM_STORE(TextBuffer),
+        .accepts = &SIGNATURE_ABSTRACT_MEM_ACCEPTS(TextBuffer)
     };
     self->abstract_mem_super.vtbl = &abstract_mem_vtbl;
 
     // initialize buffer and valid
-    self->buffer = 0;
-    self->valid  = false;
+    self->buffer    = 0;
+    self->valid     = false;
+    self->immediate = false;
 }
@@ -17,6 +17,9 @@ typedef struct {
     // buffer for "one" character (one byte)
     bool valid;
     byte_t buffer;
+    // print on store instead of on tick (harts on several threads store
+    // concurrently, while the buffer holds one character only)
+    bool immediate;
 } TextBuffer;
 
 void TextBuffer_ctor(TextBuffer *self);
@@ -0,0 +1,350 @@
+#include "timing.h"
+
+#include "arch.h"
+#include "inst.h"
+#include "common.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const class_name[TIMING_CLASS_NUM] = {
+    [TIMING_CLASS_ALU] = "alu",       [TIMING_CLASS_LOAD] = "load",
+    [TIMING_CLASS_STORE] = "store",   [TIMING_CLASS_BRANCH] = "branch",
+    [TIMING_CLASS_JUMP] = "jump",     [TIMING_CLASS_CSR] = "csr",
+    [TIMING_CLASS_SYSTEM] = "system",
+};
+
+static inline bool is_pow2(unsigned x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+// x1 (ra) and x5 (t0) are the link registers of the calling convention
+static inline bool is_link(reg_t r) {
+    return r == 1 || r == 5;
+}
+
+/* ---------------------------- config ----------------------------- */
+// parse "key = value" lines, '#' starts a comment
+static int Timing_parse_config(Timing *self, const char *config_file) {
+    FILE *f = fopen(config_file, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Fail to open timing config file: %s\n", config_file);
+        return -1;
+    }
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_no += 1;
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char key[64], value[64];
+        int n = sscanf(line, " %63[^= \t] = %63s", key, value);
+        if (n <= 0) {
+            continue; // blank line
+        }
+        if (n != 2) {
+            fprintf(stderr, "%s:%d: expected \"key = value\"\n", config_file, line_no);
+            fclose(f);
+            return -1;
+        }
+
+        unsigned long number = strtoul(value, NULL, 0);
+        bool known            = true;
+        if (strncmp(key, "latency.", 8) == 0) {
+            known = false;
+            for (int c = 0; c < TIMING_CLASS_NUM; c++) {
+                if (strcmp(key + 8, class_name[c]) == 0) {
+                    self->latency[c] = (unsigned)number;
+                    known            = true;
+                }
+            }
+        } else if (strcmp(key, "mispredict_penalty") == 0) {
+            self->mispredict_penalty = (unsigned)number;
+        } else if (strcmp(key, "btb_miss_penalty") == 0) {
+            self->btb_miss_penalty = (unsigned)number;
+        } else if (strcmp(key, "bht_entries") == 0) {
+            self->bht_entries = (unsigned)number;
+        } else if (strcmp(key, "ghr_bits") == 0) {
+            self->ghr_bits = (unsigned)number;
+        } else if (strcmp(key, "btb_entries") == 0) {
+            self->btb_entries = (unsigned)number;
+        } else if (strcmp(key, "ras_entries") == 0) {
+            self->ras_entries = (unsigned)number;
+        } else if (strcmp(key, "predictor") == 0) {
+            if (strcmp(value, "static") == 0) {
+                self->predictor = BPRED_STATIC;
+            } else if (strcmp(value, "bimodal") == 0) {
+                self->predictor = BPRED_BIMODAL;
+            } else if (strcmp(value, "gshare") == 0) {
+                self->predictor = BPRED_GSHARE;
+            } else {
+                known = false;
+            }
+        } else {
+            known = false;
+        }
+        if (!known) {
+            fprintf(stderr, "%s:%d: unknown setting %s = %s\n", config_file, line_no, key, value);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/* --------------------------- predictors -------------------------- */
+static inline unsigned Timing_bht_index(const Timing *self, reg_t pc) {
+    unsigned index = (unsigned)(pc >> 2);
+    if (self->predictor == BPRED_GSHARE) {
+        index ^= self->ghr;
+    }
+    return index & (self->bht_entries - 1);
+}
+
+static bool Timing_predict_taken(const Timing *self, reg_t pc, reg_t target) {
+    if (self->predictor == BPRED_STATIC) {
+        return target < pc;
+    }
+    return self->bht[Timing_bht_index(self, pc)] >= 2;
+}
+
+static void Timing_train(Timing *self, reg_t pc, bool taken) {
+    if (self->predictor != BPRED_STATIC) {
+        uint8_t *counter = &self->bht[Timing_bht_index(self, pc)];
+        if (taken && *counter < 3) {
+            *counter += 1;
+        } else if (!taken && *counter > 0) {
+            *counter -= 1;
+        }
+    }
+    self->ghr = ((self->ghr << 1) | taken) & ((1u << self->ghr_bits) - 1);
+}
+
+// true if the BTB supplies the right target
+static bool Timing_btb_lookup(Timing *self, reg_t pc, reg_t target) {
+    unsigned i = (unsigned)(pc >> 2) & (self->btb_entries - 1);
+    bool hit   = (self->btb_tag[i] == pc) && (self->btb_target[i] == target);
+    self->btb_tag[i]    = pc;
+    self->btb_target[i] = target;
+    return hit;
+}
+
+static void Timing_ras_push(Timing *self, reg_t ret_addr) {
+    self->ras[self->ras_top % self->ras_entries] = ret_addr;
+    self->ras_top += 1;
+}
+
+static bool Timing_ras_pop(Timing *self, reg_t target) {
+    if (self->ras_top == 0) {
+        return false;
+    }
+    self->ras_top -= 1;
+    return self->ras[self->ras_top % self->ras_entries] == target;
+}
+
+// penalty cycles of a control transfer
+static unsigned
+Timing_control(Timing *self, uint32_t raw, reg_t rd, reg_t rs1, reg_t pc, reg_t next_pc) {
+    reg_t fallthrough = pc + 4;
+    switch (raw & 0x7f) {
+    case BRANCH: {
+        // B-type immediate, for the direction of the static predictor
+        uint32_t imm = ((raw >> 31) & 0x1) << 12 | ((raw >> 7) & 0x1) << 11 |
+                       ((raw >> 25) & 0x3f) << 5 | ((raw >> 8) & 0xf) << 1;
+        reg_t target = pc + (reg_t)((int32_t)(imm << 19) >> 19);
+        bool taken   = (next_pc != fallthrough);
+        self->branches += 1;
+        bool predicted = Timing_predict_taken(self, pc, target);
+        Timing_train(self, pc, taken);
+        if (predicted != taken) {
+            self->branch_mispredicts += 1;
+            return self->mispredict_penalty;
+        }
+        if (taken && !Timing_btb_lookup(self, pc, next_pc)) {
+            self->btb_misses += 1;
+            return self->btb_miss_penalty;
+        }
+        return 0;
+    }
+    case JAL: {
+        self->jumps += 1;
+        if (is_link(rd)) {
+            Timing_ras_push(self, fallthrough);
+        }
+        if (!Timing_btb_lookup(self, pc, next_pc)) {
+            self->btb_misses += 1;
+            return self->btb_miss_penalty;
+        }
+        return 0;
+    }
+    case JALR: {
+        self->jumps += 1;
+        // returns are predicted by the RAS, other indirect jumps by the BTB
+        bool hit = (rd == 0 && is_link(rs1)) ? Timing_ras_pop(self, next_pc)
+                                             : Timing_btb_lookup(self, pc, next_pc);
+        if (is_link(rd)) {
+            Timing_ras_push(self, fallthrough);
+        }
+        if (!hit) {
+            self->jump_mispredicts += 1;
+            return self->mispredict_penalty;
+        }
+        return 0;
+    }
+    default:
+        return 0;
+    }
+}
+
+/* ---------------------------- retire ----------------------------- */
+unsigned Timing_retire(Timing *self, uint32_t raw, reg_t pc, reg_t next_pc) {
+    reg_t opcode = raw & 0x7f;
+    reg_t rd     = (raw >> 7) & 0x1f;
+    reg_t funct3 = (raw >> 12) & 0x7;
+    reg_t rs1    = (raw >> 15) & 0x1f;
+    reg_t rs2    = (raw >> 20) & 0x1f;
+
+    // operands read in EX (rs2 of a store is only needed in MEM)
+    timing_class_t cls = TIMING_CLASS_ALU;
+    bool use_rs1 = false, use_rs2 = false, store_data = false, write_rd = true;
+    switch (opcode) {
+    case OP:     use_rs1 = use_rs2 = true;                              break;
+    case OP_IMM: use_rs1 = true;                                        break;
+    case LUI:
+    case AUIPC:                                                         break;
+    case LOAD:   use_rs1 = true; cls = TIMING_CLASS_LOAD;               break;
+    case STORE:
+        use_rs1 = store_data = true;
+        write_rd = false;
+        cls      = TIMING_CLASS_STORE;
+        break;
+    case BRANCH:
+        use_rs1 = use_rs2 = true;
+        write_rd = false;
+        cls      = TIMING_CLASS_BRANCH;
+        break;
+    case JAL:    cls = TIMING_CLASS_JUMP;                               break;
+    case JALR:   use_rs1 = true; cls = TIMING_CLASS_JUMP;               break;
+    case SYSTEM:
+        use_rs1 = (funct3 & 0x4) == 0 && funct3 != 0;
+        cls     = (funct3 == 0) ? TIMING_CLASS_SYSTEM : TIMING_CLASS_CSR;
+        break;
+    default:     write_rd = false;                                      break;
+    }
+    self->instructions += 1;
+    self->class_count[cls] += 1;
+
+    // wait for the operands (x0 is always ready)
+    uint64_t issue  = self->cycle;
+    bool load_cause = false;
+    if (use_rs1 && self->reg_ready[rs1] > issue) {
+        issue      = self->reg_ready[rs1];
+        load_cause = self->reg_from_load[rs1];
+    }
+    if (use_rs2 && self->reg_ready[rs2] > issue) {
+        issue      = self->reg_ready[rs2];
+        load_cause = self->reg_from_load[rs2];
+    }
+    if (store_data && self->reg_ready[rs2] > issue + 1) {
+        issue      = self->reg_ready[rs2] - 1;
+        load_cause = self->reg_from_load[rs2];
+    }
+    unsigned stall = (unsigned)(issue - self->cycle);
+    if (load_cause) {
+        self->load_use_stalls += stall;
+    } else {
+        self->raw_stalls += stall;
+    }
+
+    if (write_rd && rd != 0) {
+        self->reg_ready[rd]     = issue + self->latency[cls];
+        self->reg_from_load[rd] = (cls == TIMING_CLASS_LOAD);
+    }
+
+    unsigned penalty = Timing_control(self, raw, rd, rs1, pc, next_pc);
+    self->control_penalty += penalty;
+
+    self->cycle = issue + 1 + penalty;
+    return stall + penalty;
+}
+
+/* -------------------------- ctor / dtor -------------------------- */
+int Timing_ctor(Timing *self, const char *config_file) {
+    assert(self != NULL);
+    memset(self, 0, sizeof(Timing));
+
+    // defaults: classic 5-stage pipeline with full forwarding
+    for (int c = 0; c < TIMING_CLASS_NUM; c++) {
+        self->latency[c] = 1;
+    }
+    self->latency[TIMING_CLASS_LOAD] = 2; // one load-use bubble
+    self->mispredict_penalty         = 2;
+    self->btb_miss_penalty           = 1;
+    self->predictor                  = BPRED_GSHARE;
+    self->bht_entries                = 1024;
+    self->ghr_bits                   = 10;
+    self->btb_entries                = 256;
+    self->ras_entries                = 8;
+
+    if (config_file != NULL && Timing_parse_config(self, config_file) != 0) {
+        return -1;
+    }
+    if (!is_pow2(self->bht_entries) || !is_pow2(self->btb_entries) || self->ras_entries == 0 ||
+        self->ghr_bits > 31) {
+        fprintf(stderr, "Timing: bht_entries/btb_entries should be powers of two, "
+                        "ras_entries > 0 and ghr_bits < 32\n");
+        return -1;
+    }
+
+    self->bht        = calloc(self->bht_entries, sizeof(uint8_t));
+    self->btb_tag    = calloc(self->btb_entries, sizeof(reg_t));
+    self->btb_target = calloc(self->btb_entries, sizeof(reg_t));
+    self->ras        = calloc(self->ras_entries, sizeof(reg_t));
+    if (self->bht == NULL || self->btb_tag == NULL || self->btb_target == NULL || self->ras == NULL) {
+        Timing_dtor(self);
+        return -1;
+    }
+    // weakly taken
+    memset(self->bht, 2, self->bht_entries);
+    // an empty BTB entry must not match PC 0
+    memset(self->btb_tag, 0xff, self->btb_entries * sizeof(reg_t));
+    return 0;
+}
+
+void Timing_dtor(Timing *self) {
+    assert(self != NULL);
+    free(self->bht);
+    free(self->btb_tag);
+    free(self->btb_target);
+    free(self->ras);
+}
+
+void Timing_report(const Timing *self) {
+    assert(self != NULL);
+    double n = self->instructions ? (double)self->instructions : 1.0;
+
+    fprintf(stderr, "[TIMING] cycles %llu, instructions %llu, CPI %.3f\n",
+            (unsigned long long)self->cycle, (unsigned long long)self->instructions,
+            (double)self->cycle / n);
+    fprintf(stderr, "[TIMING] CPI breakdown: base 1.000, load-use %.3f, RAW %.3f, control %.3f\n",
+            (double)self->load_use_stalls / n, (double)self->raw_stalls / n,
+            (double)self->control_penalty / n);
+    fprintf(stderr,
+            "[TIMING] branches %llu (mispredicted %llu), jumps %llu (mispredicted %llu), "
+            "BTB misses %llu\n",
+            (unsigned long long)self->branches, (unsigned long long)self->branch_mispredicts,
+            (unsigned long long)self->jumps, (unsigned long long)self->jump_mispredicts,
+            (unsigned long long)self->btb_misses);
+    for (int c = 0; c < TIMING_CLASS_NUM; c++) {
+        fprintf(stderr, "[TIMING]   %-6s %llu\n", class_name[c],
+                (unsigned long long)self->class_count[c]);
+    }
+}
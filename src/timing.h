@@ -0,0 +1,73 @@
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+#include "arch.h"
+#include "iss.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// branch direction predictors
+typedef enum {
+    BPRED_STATIC = 0, // backward taken, forward not taken
+    BPRED_BIMODAL,    // 2-bit counters indexed by PC
+    BPRED_GSHARE,     // 2-bit counters indexed by PC ^ global history
+} bpred_kind_t;
+
+// instruction classes with their own latency
+typedef enum {
+    TIMING_CLASS_ALU = 0,
+    TIMING_CLASS_LOAD,
+    TIMING_CLASS_STORE,
+    TIMING_CLASS_BRANCH,
+    TIMING_CLASS_JUMP,
+    TIMING_CLASS_CSR,
+    TIMING_CLASS_SYSTEM,
+    TIMING_CLASS_NUM,
+} timing_class_t;
+
+typedef struct {
+    // parameters (see Timing_ctor() for the config file keys)
+    unsigned latency[TIMING_CLASS_NUM]; // cycles until the result can be forwarded
+    unsigned mispredict_penalty;        // wrong direction or target, resolved in EX
+    unsigned btb_miss_penalty;          // right direction but target known only in ID
+    bpred_kind_t predictor;
+    unsigned bht_entries; // power of two
+    unsigned ghr_bits;
+    unsigned btb_entries; // power of two
+    unsigned ras_entries;
+
+    // pipeline state: cycle in which each register can be consumed in EX
+    uint64_t cycle;
+    uint64_t reg_ready[32];
+    bool reg_from_load[32];
+
+    // predictor state
+    uint8_t *bht;
+    uint32_t ghr;
+    reg_t *btb_tag;
+    reg_t *btb_target;
+    reg_t *ras;
+    unsigned ras_top;
+
+    // statistics
+    uint64_t instructions;
+    uint64_t class_count[TIMING_CLASS_NUM];
+    uint64_t load_use_stalls;
+    uint64_t raw_stalls;
+    uint64_t branches;
+    uint64_t branch_mispredicts;
+    uint64_t jumps;
+    uint64_t jump_mispredicts;
+    uint64_t btb_misses;
+    uint64_t control_penalty;
+} Timing;
+
+extern int Timing_ctor(Timing *self, const char *config_file);
+extern void Timing_dtor(Timing *self);
+// account one retired instruction, return its cycles beyond the first one
+extern unsigned Timing_retire(Timing *self, uint32_t raw, reg_t pc, reg_t next_pc);
+// print cycle count and CPI breakdown to stderr
+extern void Timing_report(const Timing *self);
+
+#endif
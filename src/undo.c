@@ -0,0 +1,91 @@
+#include "undo.h"
+
+#include "arch.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int UndoLog_ctor(UndoLog *self, size_t size) {
+    assert(self != NULL);
+    memset(self, 0, sizeof(UndoLog));
+    self->capacity = size / sizeof(undo_entry_t);
+    if (self->capacity == 0) {
+        return -1;
+    }
+    self->entries = malloc(self->capacity * sizeof(undo_entry_t));
+    return (self->entries == NULL) ? -1 : 0;
+}
+
+void UndoLog_dtor(UndoLog *self) {
+    assert(self != NULL);
+    free(self->entries);
+}
+
+void UndoLog_clear(UndoLog *self) {
+    self->next       = 0;
+    self->count      = 0;
+    self->num_insts  = 0;
+    self->num_undone = 0;
+}
+
+static inline void UndoLog_push(UndoLog *self, byte_t *ptr, uint64_t old, unsigned len) {
+    undo_entry_t *e = &self->entries[self->next];
+    if (self->count == self->capacity) {
+        self->num_insts -= (e->ptr == NULL); // the oldest instruction is lost
+    } else {
+        self->count++;
+    }
+    *e         = (undo_entry_t){ .ptr = ptr, .old = old, .len = len };
+    self->next = (self->next + 1 == self->capacity) ? 0 : self->next + 1;
+}
+
+void UndoLog_mark(UndoLog *self, reg_t pc) {
+    UndoLog_push(self, NULL, pc, 0);
+    self->num_insts++;
+}
+
+void UndoLog_save(UndoLog *self, void *ptr, size_t len) {
+    byte_t *p = ptr;
+    for (size_t n; len > 0; p += n, len -= n) {
+        uint64_t old = 0;
+        n            = (len < sizeof(old)) ? len : sizeof(old);
+        memcpy(&old, p, n);
+        UndoLog_push(self, p, old, (unsigned)n);
+    }
+}
+
+bool UndoLog_undo(UndoLog *self, reg_t *pc) {
+    if (self->num_insts == 0) {
+        return false;
+    }
+    // the mark of the instruction is in the ring, so the walk ends there
+    self->num_undone = 0;
+    for (;;) {
+        self->next = ((self->next == 0) ? self->capacity : self->next) - 1;
+        self->count--;
+        const undo_entry_t *e = &self->entries[self->next];
+        if (e->ptr == NULL) {
+            self->num_insts--;
+            *pc = (reg_t)e->old;
+            break;
+        }
+        memcpy(e->ptr, &e->old, e->len);
+        self->num_undone++;
+    }
+    self->undone = (self->next + 1 == self->capacity) ? 0 : self->next + 1;
+    return true;
+}
+
+bool UndoLog_undone_wrote(const UndoLog *self, const byte_t *ptr, size_t size) {
+    for (size_t i = 0, k = self->undone; i < self->num_undone; i++) {
+        const undo_entry_t *e = &self->entries[k];
+        if (e->ptr < ptr + size && ptr < e->ptr + e->len) {
+            return true;
+        }
+        k = (k + 1 == self->capacity) ? 0 : k + 1;
+    }
+    return false;
+}
@@ -0,0 +1,53 @@
+#ifndef __UNDO_H__
+#define __UNDO_H__
+
+#include "arch.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// an entry of the undo log: up to 8 bytes that were at ptr, or the mark
+// starting an instruction (ptr NULL, old is its PC)
+typedef struct {
+    byte_t *ptr;
+    uint64_t old;
+    unsigned len;
+} undo_entry_t;
+
+/*
+ * Undo log of a hart for reverse execution. Before an instruction writes a
+ * register or memory, the bytes it overwrites are saved in a ring of fixed
+ * entries (host addresses, so registers and RAM are alike); undoing the
+ * instruction copies them back, newest first. When the ring is full, the
+ * oldest entries are overwritten and with them the oldest instructions can
+ * no longer be undone.
+ */
+typedef struct {
+    undo_entry_t *entries;
+    size_t capacity;
+    size_t next;        // entry written next
+    size_t count;       // entries in the ring
+    uint64_t num_insts; // marks in the ring: instructions that can be undone
+    // entries of the instruction undone last, [undone, undone + num_undone)
+    // modulo the capacity (valid until the next save)
+    size_t undone;
+    size_t num_undone;
+} UndoLog;
+
+// a ring of size bytes (at least one entry)
+extern int UndoLog_ctor(UndoLog *self, size_t size);
+extern void UndoLog_dtor(UndoLog *self);
+// forget every instruction (the state changed by other means)
+extern void UndoLog_clear(UndoLog *self);
+
+// an instruction at pc starts
+extern void UndoLog_mark(UndoLog *self, reg_t pc);
+// the len bytes at ptr are about to be overwritten
+extern void UndoLog_save(UndoLog *self, void *ptr, size_t len);
+// undo the last instruction and return its PC in *pc; false if there is none
+extern bool UndoLog_undo(UndoLog *self, reg_t *pc);
+// the instruction undone last wrote some of the size bytes at ptr
+extern bool UndoLog_undone_wrote(const UndoLog *self, const byte_t *ptr, size_t size);
+
+#endif
@@ -0,0 +1,221 @@
+#include "vector.h"
+
+#include "arch.h"
+#include "common.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The kernels run a guest vector operation as a loop over host vectors of
+ * VEC_HOST_BYTES (GCC vector extensions), compiled for AVX2 and a baseline
+ * with runtime dispatch; register groups are contiguous, so the loop does
+ * not care about LMUL. Results past the n-th element are garbage, the core
+ * only copies the elements it may write.
+ */
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define VEC_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define VEC_KERNEL
+#endif
+
+void Vector_ctor(VectorState *self, unsigned vlen) {
+    assert(self != NULL);
+    Assert(vlen >= 64 && vlen <= ISS_VLEN_MAX && (vlen & (vlen - 1)) == 0,
+           "vlen should be a power of two in 64..%d", ISS_VLEN_MAX);
+    memset(self, 0, sizeof(*self));
+    self->vlenb = vlen / 8;
+    self->vtype = VTYPE_VILL;
+}
+
+void Vector_set_vtype(VectorState *self, reg_t vtype, reg_t avl) {
+    assert(self != NULL);
+    unsigned vlmul = vtype & VTYPE_VLMUL;
+    unsigned vsew  = (vtype & VTYPE_VSEW) >> VTYPE_VSEW_SHIFT;
+    unsigned sew   = 8u << vsew;
+    bool ok        = !(vtype & ~(reg_t)(VTYPE_VLMUL | VTYPE_VSEW | VTYPE_VTA | VTYPE_VMA)) &&
+              vsew <= 3 && vlmul != 4;
+    unsigned vlmax;
+    if (vlmul & 0x4) {
+        // LMUL 1/8, 1/4 or 1/2, which must still hold an element of ELEN
+        unsigned div = 1u << (8 - vlmul);
+        ok           = ok && sew * div <= 64;
+        vlmax        = self->vlenb * 8 / sew / div;
+    } else {
+        vlmax = (self->vlenb * 8 << vlmul) / sew;
+    }
+    self->vstart = 0;
+    if (!ok) {
+        self->vtype = VTYPE_VILL;
+        self->vl    = 0;
+        return;
+    }
+    self->vtype = vtype;
+    self->vl    = (avl < vlmax) ? avl : vlmax;
+}
+
+/* -------------------------------- kernels ------------------------------- */
+// load a host vector of type T at p (any alignment)
+#define VLOAD(T, p) (*(const T *)(p))
+
+#define VEC_LOOP(T, expr)                                                  \
+    for (unsigned off = 0; off < bytes; off += VEC_HOST_BYTES) {           \
+        T a = VLOAD(T, vs2 + off);                                         \
+        T b = (vs1 != NULL) ? VLOAD(T, vs1 + off) : s;                     \
+        (void)a;                                                           \
+        *(T *)(dst + off) = (expr);                                        \
+    }                                                                      \
+    break;
+
+// select a where m is all ones, b where it is zero
+#define VSELECT(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+
+#define VEC_KERNELS(bits)                                                                      \
+    typedef uint##bits##_t vu##bits                                                            \
+        __attribute__((vector_size(VEC_HOST_BYTES), aligned(1), may_alias));                  \
+    typedef int##bits##_t vs##bits                                                             \
+        __attribute__((vector_size(VEC_HOST_BYTES), aligned(1), may_alias));                  \
+                                                                                               \
+    VEC_KERNEL static void alu##bits(vop_t op, byte_t *dst, const byte_t *vs2, const byte_t *vs1, \
+                                     uint64_t scalar, const byte_t *vd, unsigned n) {          \
+        const unsigned bytes = n * (bits / 8);                                                 \
+        const vu##bits s     = (vu##bits){} + (uint##bits##_t)scalar;                          \
+        const vu##bits sh    = (vu##bits){} + (bits - 1);                                      \
+        switch (op) {                                                                          \
+        case VOP_ADD:  VEC_LOOP(vu##bits, a + b)                                               \
+        case VOP_SUB:  VEC_LOOP(vu##bits, a - b)                                               \
+        case VOP_RSUB: VEC_LOOP(vu##bits, b - a)                                               \
+        case VOP_AND:  VEC_LOOP(vu##bits, a & b)                                               \
+        case VOP_OR:   VEC_LOOP(vu##bits, a | b)                                               \
+        case VOP_XOR:  VEC_LOOP(vu##bits, a ^ b)                                               \
+        case VOP_MINU: VEC_LOOP(vu##bits, VSELECT((vu##bits)(a < b), a, b))                    \
+        case VOP_MIN:  VEC_LOOP(vu##bits, VSELECT((vu##bits)((vs##bits)a < (vs##bits)b), a, b)) \
+        case VOP_MAXU: VEC_LOOP(vu##bits, VSELECT((vu##bits)(a > b), a, b))                    \
+        case VOP_MAX:  VEC_LOOP(vu##bits, VSELECT((vu##bits)((vs##bits)a > (vs##bits)b), a, b)) \
+        case VOP_SLL:  VEC_LOOP(vu##bits, a << (b & sh))                                       \
+        case VOP_SRL:  VEC_LOOP(vu##bits, a >> (b & sh))                                       \
+        case VOP_SRA:  VEC_LOOP(vu##bits, (vu##bits)((vs##bits)a >> (vs##bits)(b & sh)))       \
+        case VOP_MUL:  VEC_LOOP(vu##bits, a * b)                                               \
+        case VOP_MACC: VEC_LOOP(vu##bits, VLOAD(vu##bits, vd + off) + a * b)                   \
+        default:       VEC_LOOP(vu##bits, b)                                                   \
+        }                                                                                      \
+    }                                                                                          \
+                                                                                               \
+    VEC_KERNEL static void cmp##bits(vop_t op, uint64_t *dst, const byte_t *vs2,               \
+                                     const byte_t *vs1, uint64_t scalar, unsigned n) {         \
+        const unsigned lanes = VEC_HOST_BYTES / (bits / 8);                                    \
+        const vu##bits s     = (vu##bits){} + (uint##bits##_t)scalar;                          \
+        for (unsigned i = 0; i < n; i += lanes) {                                              \
+            vu##bits a = VLOAD(vu##bits, vs2 + i * (bits / 8));                                \
+            vu##bits b = (vs1 != NULL) ? VLOAD(vu##bits, vs1 + i * (bits / 8)) : s;            \
+            vs##bits m;                                                                        \
+            switch (op) {                                                                      \
+            case VOP_MSEQ:  m = (a == b);                           break;                     \
+            case VOP_MSNE:  m = (a != b);                           break;                     \
+            case VOP_MSLTU: m = (a < b);                            break;                     \
+            case VOP_MSLT:  m = ((vs##bits)a < (vs##bits)b);        break;                     \
+            case VOP_MSLEU: m = (a <= b);                           break;                     \
+            case VOP_MSLE:  m = ((vs##bits)a <= (vs##bits)b);       break;                     \
+            case VOP_MSGTU: m = (a > b);                            break;                     \
+            default:        m = ((vs##bits)a > (vs##bits)b);        break;                     \
+            }                                                                                  \
+            uint64_t w = 0;                                                                    \
+            for (unsigned k = 0; k < lanes; k++) {                                             \
+                w |= (uint64_t)(m[k] & 1) << k;                                                \
+            }                                                                                  \
+            dst[i / 64] |= w << (i % 64);                                                      \
+        }                                                                                      \
+    }                                                                                          \
+                                                                                               \
+    static inline uint##bits##_t red_op##bits(vop_t op, uint##bits##_t a, uint##bits##_t b) {  \
+        switch (op) {                                                                          \
+        case VOP_ADD:  return a + b;                                                           \
+        case VOP_AND:  return a & b;                                                           \
+        case VOP_OR:   return a | b;                                                           \
+        case VOP_XOR:  return a ^ b;                                                           \
+        case VOP_MINU: return (a < b) ? a : b;                                                 \
+        case VOP_MIN:  return ((int##bits##_t)a < (int##bits##_t)b) ? a : b;                   \
+        case VOP_MAXU: return (a > b) ? a : b;                                                 \
+        default:       return ((int##bits##_t)a > (int##bits##_t)b) ? a : b;                   \
+        }                                                                                      \
+    }                                                                                          \
+                                                                                               \
+    VEC_KERNEL static uint64_t red##bits(vop_t op, const byte_t *vs2, const byte_t *mask,      \
+                                         uint64_t init, unsigned n) {                          \
+        const unsigned lanes = VEC_HOST_BYTES / (bits / 8);                                    \
+        uint##bits##_t acc   = (uint##bits##_t)init;                                           \
+        unsigned i           = 0;                                                              \
+        if (mask == NULL && n >= lanes) {                                                      \
+            /* whole host vectors, folded at the end (the ops commute) */                      \
+            vu##bits v = VLOAD(vu##bits, vs2);                                                 \
+            for (i = lanes; i + lanes <= n; i += lanes) {                                      \
+                vu##bits b = VLOAD(vu##bits, vs2 + i * (bits / 8));                            \
+                switch (op) {                                                                  \
+                case VOP_ADD:  v += b;                                                         \
+                    break;                                                                     \
+                case VOP_AND:  v &= b;                                                         \
+                    break;                                                                     \
+                case VOP_OR:   v |= b;                                                         \
+                    break;                                                                     \
+                case VOP_XOR:  v ^= b;                                                         \
+                    break;                                                                     \
+                case VOP_MINU: v = VSELECT((vu##bits)(v < b), v, b);                           \
+                    break;                                                                     \
+                case VOP_MIN:  v = VSELECT((vu##bits)((vs##bits)v < (vs##bits)b), v, b);       \
+                    break;                                                                     \
+                case VOP_MAXU: v = VSELECT((vu##bits)(v > b), v, b);                           \
+                    break;                                                                     \
+                default:       v = VSELECT((vu##bits)((vs##bits)v > (vs##bits)b), v, b);       \
+                    break;                                                                     \
+                }                                                                              \
+            }                                                                                  \
+            for (unsigned k = 0; k < lanes; k++) {                                             \
+                acc = red_op##bits(op, acc, v[k]);                                             \
+            }                                                                                  \
+        }                                                                                      \
+        for (; i < n; i++) {                                                                   \
+            if (mask == NULL || vector_mask_bit(mask, i)) {                                    \
+                acc = red_op##bits(op, acc, (uint##bits##_t)vector_get(vs2, bits, i));         \
+            }                                                                                  \
+        }                                                                                      \
+        return acc;                                                                            \
+    }
+
+VEC_KERNELS(8)
+VEC_KERNELS(16)
+VEC_KERNELS(32)
+VEC_KERNELS(64)
+
+/* ------------------------------- dispatch ------------------------------- */
+void Vector_alu(vop_t op, unsigned sew, byte_t *dst, const byte_t *vs2, const byte_t *vs1,
+                uint64_t scalar, const byte_t *vd, unsigned n) {
+    switch (sew) {
+    case 8:  alu8(op, dst, vs2, vs1, scalar, vd, n);  break;
+    case 16: alu16(op, dst, vs2, vs1, scalar, vd, n); break;
+    case 32: alu32(op, dst, vs2, vs1, scalar, vd, n); break;
+    default: alu64(op, dst, vs2, vs1, scalar, vd, n); break;
+    }
+}
+
+void Vector_compare(vop_t op, unsigned sew, uint64_t *dst, const byte_t *vs2, const byte_t *vs1,
+                    uint64_t scalar, unsigned n) {
+    switch (sew) {
+    case 8:  cmp8(op, dst, vs2, vs1, scalar, n);  break;
+    case 16: cmp16(op, dst, vs2, vs1, scalar, n); break;
+    case 32: cmp32(op, dst, vs2, vs1, scalar, n); break;
+    default: cmp64(op, dst, vs2, vs1, scalar, n); break;
+    }
+}
+
+uint64_t Vector_reduce(vop_t op, unsigned sew, const byte_t *vs2, const byte_t *mask,
+                       uint64_t init, unsigned n) {
+    switch (sew) {
+    case 8:  return red8(op, vs2, mask, init, n);
+    case 16: return red16(op, vs2, mask, init, n);
+    case 32: return red32(op, vs2, mask, init, n);
+    default: return red64(op, vs2, mask, init, n);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef __VECTOR_H__
+#define __VECTOR_H__
+
+#include "arch.h"
+#include "iss.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Subset of the V extension (RVV 1.0): vset{i}vl{i}, unit-stride and strided
+ * loads/stores (and vlm/vsm), integer add/sub/logical/shift/min/max/mul,
+ * vmacc, compares, vmerge/vmv, reductions, mask logicals, vcpop/vfirst/vid
+ * and vmv.x.s/vmv.s.x; ELEN is 64, tails and masked-off elements are left
+ * undisturbed. Fixed point, widening/narrowing, permutes, segments and
+ * indexed accesses are not there (illegal instruction).
+ */
+
+// bytes of a host SIMD register (AVX2); kernels process whole host vectors,
+// so buffers they read or write have this much slack at the end
+#define VEC_HOST_BYTES 32
+#define VLENB_MAX (ISS_VLEN_MAX / 8)
+// 64-bit words of a compare result (at most VLEN elements, for SEW 8 LMUL 8)
+#define VEC_MASK_WORDS (ISS_VLEN_MAX / 64)
+
+// vtype fields
+#define VTYPE_VLMUL 0x7u
+#define VTYPE_VSEW_SHIFT 3
+#define VTYPE_VSEW (0x7u << VTYPE_VSEW_SHIFT)
+#define VTYPE_VTA (1u << 6)
+#define VTYPE_VMA (1u << 7)
+#define VTYPE_VILL ((reg_t)1 << (XLEN - 1))
+
+// vector state of a hart; elements are stored little-endian, as in memory,
+// so that unit-stride accesses are plain copies (little-endian hosts only)
+typedef struct {
+    // v0..v31 back to back, so that a register group is one run of bytes
+    // (the kernels do not need it aligned)
+    byte_t v[32 * VLENB_MAX + VEC_HOST_BYTES];
+    unsigned vlenb; // bytes per register (VLEN / 8)
+    reg_t vl;
+    reg_t vtype;
+    reg_t vstart;
+    reg_t vxrm; // fixed point is not implemented, the CSRs just hold values
+    reg_t vxsat;
+} VectorState;
+
+// integer operations of the kernels: dst = vs2 op (vs1 or scalar)
+typedef enum {
+    VOP_ADD = 0,
+    VOP_SUB,
+    VOP_RSUB, // (vs1 or scalar) - vs2
+    VOP_AND,
+    VOP_OR,
+    VOP_XOR,
+    VOP_MINU,
+    VOP_MIN,
+    VOP_MAXU,
+    VOP_MAX,
+    VOP_SLL,
+    VOP_SRL,
+    VOP_SRA,
+    VOP_MUL,
+    VOP_MACC, // vd + vs2 * (vs1 or scalar)
+    VOP_MV,   // vs1 or scalar
+    // compares, one mask bit per element
+    VOP_MSEQ,
+    VOP_MSNE,
+    VOP_MSLTU,
+    VOP_MSLT,
+    VOP_MSLEU,
+    VOP_MSLE,
+    VOP_MSGTU,
+    VOP_MSGT,
+} vop_t;
+
+extern void Vector_ctor(VectorState *self, unsigned vlen);
+// vsetvl{i}: set vtype (vill if unsupported) and vl = min(avl, VLMAX)
+extern void Vector_set_vtype(VectorState *self, reg_t vtype, reg_t avl);
+// SEW in bits (vtype is valid)
+static inline unsigned Vector_sew(const VectorState *self) {
+    return 8u << ((self->vtype & VTYPE_VSEW) >> VTYPE_VSEW_SHIFT);
+}
+// registers of a group (1 for fractional LMUL)
+static inline unsigned Vector_lmul_regs(const VectorState *self) {
+    unsigned vlmul = self->vtype & VTYPE_VLMUL;
+    return (vlmul & 0x4) ? 1 : 1u << vlmul;
+}
+
+static inline byte_t *Vector_reg(VectorState *self, unsigned r) {
+    return &self->v[r * self->vlenb];
+}
+
+static inline bool vector_mask_bit(const byte_t *mask, unsigned i) {
+    return (mask[i / 8] >> (i % 8)) & 1;
+}
+
+static inline void vector_set_mask_bit(byte_t *mask, unsigned i, bool value) {
+    mask[i / 8] = (byte_t)((mask[i / 8] & ~(1u << (i % 8))) | ((unsigned)value << (i % 8)));
+}
+
+// element i of sew bits, zero-extended
+static inline uint64_t vector_get(const byte_t *base, unsigned sew, unsigned i) {
+    uint64_t v = 0;
+    memcpy(&v, base + i * (sew / 8), sew / 8);
+    return v;
+}
+
+static inline void vector_set(byte_t *base, unsigned sew, unsigned i, uint64_t v) {
+    memcpy(base + i * (sew / 8), &v, sew / 8);
+}
+
+// the first n elements of dst = op(vs2, vs1) (vs1 NULL: the scalar), vd is
+// the accumulator of VOP_MACC; dst is written in whole host vectors
+extern void Vector_alu(vop_t op, unsigned sew, byte_t *dst, const byte_t *vs2, const byte_t *vs1,
+                       uint64_t scalar, const byte_t *vd, unsigned n);
+// the first n bits of the zeroed bitmap dst = compare op of vs2 and vs1/scalar
+extern void Vector_compare(vop_t op, unsigned sew, uint64_t *dst, const byte_t *vs2,
+                           const byte_t *vs1, uint64_t scalar, unsigned n);
+// op (ADD, AND, OR, XOR, MIN[U], MAX[U]) over init and the first n elements
+// of vs2 whose bit in mask is set (mask NULL: all)
+extern uint64_t Vector_reduce(vop_t op, unsigned sew, const byte_t *vs2, const byte_t *mask,
+                              uint64_t init, unsigned n);
+
+#endif
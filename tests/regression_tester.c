@@ -0,0 +1,2209 @@
+#include "arch.h"
+#include "iss.h"
+#include "clint.h"
+#include "common.h"
+#include "csr.h"
+#include "dma.h"
+#include "halt.h"
+#include "host_perf.h"
+#include "input_file.h"
+#include "main_mem.h"
+#include "mmu.h"
+#include "rom.h"
+#include "rv_asm.h"
+#include "text_buffer.h"
+#include "vector.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#ifdef ISS_HOST_PERF
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#endif
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef ISS_HOST_PERF
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#endif
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Regression tests of the host services and run modes that the riscv-tests
+ * do not cover. The guest programs are assembled with rv_asm.h (no cross
+ * toolchain), written to a temporary ELF and run to the halt;
+ * `RegressionTester name` runs one test and fails with a message on stderr.
+ */
+
+/* ------------------------- program helpers ------------------------- */
+// where TRAP_RECORDER() records the traps, from the bottom of main memory
+#define PROG_RECORDS 0x8000
+// a record is (mcause, mtval, mepc, 0)
+#define PROG_RECORD_SIZE 16
+// the label of the trap handler of TRAP_RECORDER()
+#define TRAP_HANDLER (PROG_MAX_LABELS - 1)
+
+// syscall num with a0..a2 (a0 gets the result)
+static void SYSCALL(prog_t *p, unsigned num, uint32_t a0, uint32_t a1, uint32_t a2) {
+    LI(p, A0, a0);
+    LI(p, A1, a1);
+    LI(p, A2, a2);
+    LI(p, A7, num);
+    ECALL(p);
+}
+
+// a trap handler that records mcause, mtval and mepc into main memory (s11
+// points to the next record) and resumes after the trapping instruction;
+// TRAP_RECORDER() installs it at the start of the program, and
+// TRAP_RECORDER_HANDLER() emits it after its end
+static void TRAP_RECORDER(prog_t *p) {
+    LA(p, T0, TRAP_HANDLER);
+    CSRW(p, 0x305, T0); // mtvec
+    LI(p, S11, MAIN_MEM_MMAP_BASE + PROG_RECORDS);
+}
+
+static void TRAP_RECORDER_HANDLER(prog_t *p) {
+    place(p, TRAP_HANDLER);
+    CSRR(p, T6, 0x342); // mcause
+    SW(p, T6, 0, S11);
+    CSRR(p, T6, 0x343); // mtval
+    SW(p, T6, 4, S11);
+    CSRR(p, T6, 0x341); // mepc
+    SW(p, T6, 8, S11);
+    ADDI(p, S11, S11, PROG_RECORD_SIZE);
+    ADDI(p, T6, T6, 4);
+    CSRW(p, 0x341, T6);
+    MRET(p);
+}
+
+/* ----------------------------- running ----------------------------- */
+// a temporary file name from template (ending in XXXXXX), created empty
+static void temp_name(char *name, size_t size, const char *template) {
+    const char *tmp = getenv("TMPDIR");
+    snprintf(name, size, "%s/%s", (tmp != NULL) ? tmp : "/tmp", template);
+    int fd = mkstemp(name);
+    Assert(fd >= 0, "Fail to create a temporary file");
+    close(fd);
+}
+
+// a temporary input file holding size bytes of data
+static void write_input(char *name, size_t size, const void *data, size_t data_size) {
+    temp_name(name, size, "regression_input_XXXXXX");
+    FILE *f = fopen(name, "wb");
+    Assert(f != NULL && fwrite(data, 1, data_size, f) == data_size && fclose(f) == 0,
+           "Fail to write %s", name);
+}
+
+// the ISS of p (linked here) under config, ready to run (the ELF is deleted
+// right away)
+static ISS *prog_iss(prog_t *p, const iss_config_t *config) {
+    prog_link(p);
+    char elf_file_name[4096];
+    temp_name(elf_file_name, sizeof(elf_file_name), "regression_XXXXXX");
+    write_elf(p, elf_file_name);
+    ISS *iss;
+    int err = ISS_ctor_with_config(&iss, elf_file_name, config);
+    unlink(elf_file_name);
+    Assert(err == 0, "ISS_ctor failed!");
+    return iss;
+}
+
+// run to the halt (at most max_insts instructions)
+static arch_state_t run_to_halt(ISS *iss, unsigned long max_insts) {
+    ISS_step(iss, max_insts);
+    Assert(ISS_get_halt(iss), "The test program did not halt");
+    return ISS_get_arch_state(iss);
+}
+
+// the i-th record of TRAP_RECORDER() is (cause, tval), of the instruction
+// at epc unless it is ~0u
+#define CHECK_TRAP_AT(iss, i, cause, tval, epc)                                               \
+    do {                                                                                      \
+        uint32_t rec[3];                                                                      \
+        ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE + PROG_RECORDS + PROG_RECORD_SIZE * (i),  \
+                            12, (byte_t *)rec);                                               \
+        CHECK(rec[0] == (cause) && rec[1] == (tval) && ((epc) == ~0u || rec[2] == (epc)),     \
+              "trap %d: cause %u, tval 0x%x, epc 0x%x", (i), rec[0], rec[1], rec[2]);         \
+    } while (0)
+#define CHECK_TRAP(iss, i, cause, tval) CHECK_TRAP_AT(iss, i, cause, tval, ~0u)
+// the number of records of TRAP_RECORDER() in the final state s (s11 holds
+// a sign-extended address on RV64)
+#define NUM_TRAPS(s) \
+    (((uint32_t)(s).gpr[S11] - MAIN_MEM_MMAP_BASE - PROG_RECORDS) / PROG_RECORD_SIZE)
+
+#define CHECK(cond, ...)                           \
+    do {                                           \
+        if (!(cond)) {                             \
+            fprintf(stderr, "FAIL: " __VA_ARGS__); \
+            fprintf(stderr, "\n");                 \
+            return false;                          \
+        }                                          \
+    } while (0)
+
+/* ------------------------------ tests ------------------------------ */
+// the heap starts on the page after the image, .bss included
+static bool test_brk(void) {
+    prog_t p;
+    prog_init(&p);
+    p.data_filesz = 4;
+    p.data_memsz  = 0x1234;
+    SYSCALL(&p, 214, 0, 0, 0); // brk(0)
+    MV(&p, S0, A0);
+    SYSCALL(&p, 214, MAIN_MEM_MMAP_BASE, 0, 0); // below the break: refused
+    MV(&p, S1, A0);
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = run_to_halt(iss, 1000);
+    ISS_dtor(iss);
+    CHECK(s.gpr[S0] == MAIN_MEM_MMAP_BASE + 0x2000, "brk(0) = 0x%" PRIxREG, s.gpr[S0]);
+    CHECK(s.gpr[S1] == s.gpr[S0], "brk below the image = 0x%" PRIxREG, s.gpr[S1]);
+    return true;
+}
+
+// a symbolic link in the sandbox does not lead out of it, not even as a
+// directory on the way
+static bool test_sandbox_symlink(void) {
+    char root[4096], path[4096 + 32];
+    const char *tmp = getenv("TMPDIR");
+    snprintf(root, sizeof(root), "%s/regression_XXXXXX", (tmp != NULL) ? tmp : "/tmp");
+    Assert(mkdtemp(root) != NULL, "Fail to create a temporary directory");
+    snprintf(path, sizeof(path), "%s/sandbox", root);
+    Assert(mkdir(path, 0700) == 0, "Fail to create %s", path);
+    snprintf(path, sizeof(path), "%s/outside", root);
+    Assert(mkdir(path, 0700) == 0, "Fail to create %s", path);
+    snprintf(path, sizeof(path), "%s/outside/secret", root);
+    fclose(fopen(path, "w"));
+    snprintf(path, sizeof(path), "%s/sandbox/file", root);
+    fclose(fopen(path, "w"));
+    snprintf(path, sizeof(path), "%s/sandbox/d", root);
+    Assert(symlink("../outside", path) == 0, "Fail to create %s", path);
+    snprintf(path, sizeof(path), "%s/sandbox/s", root);
+    Assert(symlink("../outside/secret", path) == 0, "Fail to create %s", path);
+
+    prog_t p;
+    prog_init(&p);
+    const char names[] = "file\0d/secret\0s\0";
+    memcpy(p.data, names, sizeof(names));
+    p.data_filesz = p.data_memsz = sizeof(names);
+    SYSCALL(&p, 1024, MAIN_MEM_MMAP_BASE, 0, 0); // open("file")
+    MV(&p, S0, A0);
+    SYSCALL(&p, 1024, MAIN_MEM_MMAP_BASE + 5, 0, 0); // open("d/secret")
+    MV(&p, S1, A0);
+    SYSCALL(&p, 1024, MAIN_MEM_MMAP_BASE + 14, 0, 0); // open("s")
+    MV(&p, S2, A0);
+    HALT(&p);
+
+    snprintf(path, sizeof(path), "%s/sandbox", root);
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.sandbox_dir = path;
+    ISS *iss           = prog_iss(&p, &config);
+    arch_state_t s     = run_to_halt(iss, 1000);
+    ISS_dtor(iss);
+
+    const char *files[] = { "sandbox/s", "sandbox/d", "sandbox/file", "outside/secret",
+                            "sandbox", "outside", "" };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        remove(path);
+    }
+    CHECK((sreg_t)s.gpr[S0] >= 0, "open(\"file\") = %ld", (long)(sreg_t)s.gpr[S0]);
+    CHECK((sreg_t)s.gpr[S1] < 0, "open(\"d/secret\") = %ld", (long)(sreg_t)s.gpr[S1]);
+    CHECK((sreg_t)s.gpr[S2] < 0, "open(\"s\") = %ld", (long)(sreg_t)s.gpr[S2]);
+    return true;
+}
+
+// a device access of a width the device lacks (or a store to a read-only
+// memory) is an access fault of the guest, and a DMA transfer to such a
+// device ends in an error
+static bool test_device_access_fault(void) {
+    char input_file_name[4096];
+    write_input(input_file_name, sizeof(input_file_name), "0123456789abcdef", 16);
+
+    enum { WAIT };
+    prog_t p;
+    prog_init(&p);
+    TRAP_RECORDER(&p);
+    LI(&p, T1, TEXT_BUFFER_MMAP_BASE);
+    SW(&p, ZERO, 0, T1);
+    LW(&p, T2, 0, T1);
+    LI(&p, T1, DMA_MMAP_BASE);
+    SB(&p, ZERO, DMA_REG_SRC, T1);
+    LB(&p, T2, DMA_REG_SRC, T1);
+    LI(&p, T1, ROM_MMAP_BASE + 0x100);
+    SW(&p, ZERO, 0, T1);
+    LI(&p, T1, INPUT_WINDOW_MMAP_BASE);
+    SW(&p, ZERO, 0, T1);
+
+    // copy 8 bytes to the TextBuffer
+    LI(&p, T1, DMA_MMAP_BASE);
+    LI(&p, T2, MAIN_MEM_MMAP_BASE);
+    SW(&p, T2, DMA_REG_SRC, T1);
+    LI(&p, T2, TEXT_BUFFER_MMAP_BASE);
+    SW(&p, T2, DMA_REG_DST, T1);
+    LI(&p, T2, 8);
+    SW(&p, T2, DMA_REG_LEN, T1);
+    LI(&p, T2, DMA_CTRL_START);
+    SW(&p, T2, DMA_REG_CTRL, T1);
+    place(&p, WAIT);
+    LW(&p, T2, DMA_REG_STATUS, T1);
+    ANDI(&p, T3, T2, DMA_STATUS_BUSY);
+    BNE(&p, T3, ZERO, WAIT);
+    MV(&p, S0, T2);
+    HALT(&p);
+    TRAP_RECORDER_HANDLER(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.input_file = input_file_name;
+    ISS *iss          = prog_iss(&p, &config);
+    arch_state_t s    = run_to_halt(iss, 10000);
+    unlink(input_file_name);
+    CHECK_TRAP(iss, 0, 7, TEXT_BUFFER_MMAP_BASE);
+    CHECK_TRAP(iss, 1, 5, TEXT_BUFFER_MMAP_BASE);
+    CHECK_TRAP(iss, 2, 7, DMA_MMAP_BASE + DMA_REG_SRC);
+    CHECK_TRAP(iss, 3, 5, DMA_MMAP_BASE + DMA_REG_SRC);
+    CHECK_TRAP(iss, 4, 7, ROM_MMAP_BASE + 0x100);
+    CHECK_TRAP(iss, 5, 7, INPUT_WINDOW_MMAP_BASE);
+    ISS_dtor(iss);
+    CHECK(NUM_TRAPS(s) == 6, "%u traps", NUM_TRAPS(s));
+    CHECK(s.gpr[S0] == DMA_STATUS_ERROR, "DMA status 0x%x", (unsigned)s.gpr[S0]);
+    return true;
+}
+
+// DMA transfers and syscalls writing to the read-only input window fail
+// and leave it as it is
+static bool test_input_window_write(void) {
+    char input_file_name[4096];
+    write_input(input_file_name, sizeof(input_file_name), "0123456789abcdef", 16);
+
+    enum { WAIT_FILL, WAIT_COPY };
+    prog_t p;
+    prog_init(&p);
+    const char name[] = "regression_input_XXXXXX";
+    memcpy(p.data, name, sizeof(name));
+    p.data_filesz = p.data_memsz = sizeof(name);
+    // fill, then copy into the window
+    LI(&p, T1, DMA_MMAP_BASE);
+    LI(&p, T2, INPUT_WINDOW_MMAP_BASE);
+    SW(&p, T2, DMA_REG_DST, T1);
+    LI(&p, T2, 8);
+    SW(&p, T2, DMA_REG_LEN, T1);
+    LI(&p, T2, DMA_CTRL_START | DMA_CTRL_FILL);
+    SW(&p, T2, DMA_REG_CTRL, T1);
+    place(&p, WAIT_FILL);
+    LW(&p, T2, DMA_REG_STATUS, T1);
+    ANDI(&p, T3, T2, DMA_STATUS_BUSY);
+    BNE(&p, T3, ZERO, WAIT_FILL);
+    MV(&p, S0, T2);
+    LI(&p, T2, DMA_STATUS_DONE | DMA_STATUS_ERROR);
+    SW(&p, T2, DMA_REG_STATUS, T1);
+    LI(&p, T2, MAIN_MEM_MMAP_BASE);
+    SW(&p, T2, DMA_REG_SRC, T1);
+    LI(&p, T2, DMA_CTRL_START);
+    SW(&p, T2, DMA_REG_CTRL, T1);
+    place(&p, WAIT_COPY);
+    LW(&p, T2, DMA_REG_STATUS, T1);
+    ANDI(&p, T3, T2, DMA_STATUS_BUSY);
+    BNE(&p, T3, ZERO, WAIT_COPY);
+    MV(&p, S1, T2);
+    // read the input file (from the sandbox) into the window
+    SYSCALL(&p, 1024, MAIN_MEM_MMAP_BASE, 0, 0);
+    LI(&p, A1, INPUT_WINDOW_MMAP_BASE);
+    LI(&p, A2, 8);
+    LI(&p, A7, 63);
+    ECALL(&p);
+    MV(&p, S2, A0);
+    LI(&p, T1, INPUT_WINDOW_MMAP_BASE);
+    LW(&p, S3, 0, T1);
+    HALT(&p);
+
+    // the sandbox is the directory of the input file, which the guest opens
+    char *slash = strrchr(input_file_name, '/');
+    memcpy(p.data, slash + 1, sizeof(name));
+    *slash = '\0';
+    char sandbox_dir[4096];
+    snprintf(sandbox_dir, sizeof(sandbox_dir), "%s", input_file_name);
+    *slash = '/';
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.input_file  = input_file_name;
+    config.sandbox_dir = sandbox_dir;
+    ISS *iss           = prog_iss(&p, &config);
+    arch_state_t s     = run_to_halt(iss, 10000);
+    ISS_dtor(iss);
+    unlink(input_file_name);
+    CHECK(s.gpr[S0] == DMA_STATUS_ERROR, "DMA fill status 0x%x", (unsigned)s.gpr[S0]);
+    CHECK(s.gpr[S1] == DMA_STATUS_ERROR, "DMA copy status 0x%x", (unsigned)s.gpr[S1]);
+    CHECK((sreg_t)s.gpr[S2] == -14, "read() = %ld", (long)(sreg_t)s.gpr[S2]); // -EFAULT
+    CHECK(s.gpr[S3] == 0x33323130, "window reads 0x%x", (unsigned)s.gpr[S3]);
+    return true;
+}
+
+// ISS_run_sampled() waits for its workers only, the other children of the
+// embedder are left to it
+static bool test_sampled_children(void) {
+    enum { LOOP };
+    prog_t p;
+    prog_init(&p);
+    LI(&p, T0, 2000);
+    place(&p, LOOP);
+    ADDI(&p, T0, T0, -1);
+    BNE(&p, T0, ZERO, LOOP);
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.sample_interval = 1000;
+    config.sample_jobs     = 2;
+    ISS *iss               = prog_iss(&p, &config);
+    pid_t child            = fork();
+    if (child == 0) {
+        _exit(42);
+    }
+    Assert(child > 0, "Fail to fork");
+    int err = ISS_run_sampled(iss);
+    ISS_dtor(iss);
+
+    int status;
+    pid_t pid = waitpid(child, &status, 0);
+    CHECK(err == 0, "ISS_run_sampled() = %d", err);
+    CHECK(pid == child && WIFEXITED(status) && WEXITSTATUS(status) == 42,
+          "the child of the embedder was reaped by ISS_run_sampled()");
+    return true;
+}
+
+// stepping back over an ECALL read, a DMA fill and gettimeofday() rewinds the
+// main memory they wrote
+#define UNDO_BUF_SIZE 32
+#define UNDO_TV 0x40
+
+static bool test_step_back_host_writes(void) {
+    char input_file_name[4096];
+    write_input(input_file_name, sizeof(input_file_name), "0123456789abcdef", 16);
+    int fd = open(input_file_name, O_RDONLY);
+    Assert(fd >= 0 && dup2(fd, STDIN_FILENO) == STDIN_FILENO, "Fail to redirect stdin");
+    close(fd);
+    unlink(input_file_name);
+
+    enum { WAIT };
+    prog_t p;
+    prog_init(&p);
+    memset(p.data, 'p', UNDO_BUF_SIZE);
+    p.data_filesz = UNDO_BUF_SIZE;
+    p.data_memsz  = UNDO_TV + 16;
+    SYSCALL(&p, 63, 0, MAIN_MEM_MMAP_BASE, 16); // read(0, buf, 16)
+    reg_t ecall_pc = HERE(&p) - 4;
+    MV(&p, S0, A0);
+    LI(&p, T1, DMA_MMAP_BASE);
+    LI(&p, T2, MAIN_MEM_MMAP_BASE);
+    SW(&p, T2, DMA_REG_DST, T1);
+    LI(&p, T2, UNDO_BUF_SIZE);
+    SW(&p, T2, DMA_REG_LEN, T1);
+    LI(&p, T2, 0x5a);
+    SW(&p, T2, DMA_REG_FILL, T1);
+    LI(&p, T2, DMA_CTRL_START | DMA_CTRL_FILL);
+    SW(&p, T2, DMA_REG_CTRL, T1);
+    place(&p, WAIT);
+    LW(&p, T2, DMA_REG_STATUS, T1);
+    ANDI(&p, T3, T2, DMA_STATUS_BUSY);
+    BNE(&p, T3, ZERO, WAIT);
+    SYSCALL(&p, 169, MAIN_MEM_MMAP_BASE + UNDO_TV, 0, 0); // gettimeofday(tv, NULL)
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.undo_log_mb = 1;
+    ISS *iss           = prog_iss(&p, &config);
+    arch_state_t s     = run_to_halt(iss, 10000);
+    byte_t buf[UNDO_BUF_SIZE], tv[16], zero[16] = { 0 }, expected[UNDO_BUF_SIZE];
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE, UNDO_BUF_SIZE, buf);
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE + UNDO_TV, 16, tv);
+    memset(expected, 0x5a, UNDO_BUF_SIZE);
+    bool ran = s.gpr[S0] == 16 && memcmp(buf, expected, UNDO_BUF_SIZE) == 0 &&
+               memcmp(tv, zero, 16) != 0;
+
+    // back to the instruction after the read: the read data only
+    while (s.current_pc != ecall_pc + 4 && ISS_step_back(iss, 1) == 1) {
+        s = ISS_get_arch_state(iss);
+    }
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE, UNDO_BUF_SIZE, buf);
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE + UNDO_TV, 16, tv);
+    memcpy(expected, "0123456789abcdef", 16);
+    memset(expected + 16, 'p', UNDO_BUF_SIZE - 16);
+    bool after_read = s.current_pc == ecall_pc + 4 &&
+                      memcmp(buf, expected, UNDO_BUF_SIZE) == 0 && memcmp(tv, zero, 16) == 0;
+
+    // and over the read
+    uint64_t undone = ISS_step_back(iss, 1);
+    s               = ISS_get_arch_state(iss);
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE, UNDO_BUF_SIZE, buf);
+    ISS_dtor(iss);
+    memset(expected, 'p', UNDO_BUF_SIZE);
+    CHECK(ran, "the program did not read, fill and get the time");
+    CHECK(after_read, "stepping back to the read leaves 0x%" PRIxREG ", \"%.32s\"",
+          s.current_pc, (const char *)buf);
+    CHECK(undone == 1 && s.current_pc == ecall_pc && s.gpr[A0] == 0,
+          "stepping back over the read leaves pc 0x%" PRIxREG ", a0 0x%" PRIxREG, s.current_pc,
+          s.gpr[A0]);
+    CHECK(memcmp(buf, expected, UNDO_BUF_SIZE) == 0, "the read data is still there: \"%.32s\"",
+          (const char *)buf);
+    return true;
+}
+
+// under fast_mem, stray loads and stores and stores to the ROM raise precise
+// access faults, and the ROM/RAM accesses are counted as without it
+#define STRAY_ADDR 0x10000000
+
+// run p to the halt, with or without fast_mem
+static void fast_mem_run(prog_t *p, bool fast_mem, iss_stats_t *stats, ISS **iss) {
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.fast_mem = fast_mem;
+    *iss            = prog_iss(p, &config);
+    run_to_halt(*iss, 10000);
+    ISS_get_stats(*iss, stats);
+}
+
+static bool test_fast_mem_stray(void) {
+    prog_t p;
+    prog_init(&p);
+    TRAP_RECORDER(&p);
+    LI(&p, T1, STRAY_ADDR);
+    uint32_t load_pc = HERE(&p);
+    LW(&p, T2, 0, T1);
+    uint32_t store_pc = HERE(&p);
+    SW(&p, ZERO, 4, T1);
+    LI(&p, T1, ROM_MMAP_BASE + 0x100);
+    uint32_t rom_pc = HERE(&p);
+    SW(&p, ZERO, 0, T1);
+    LI(&p, T1, MAIN_MEM_MMAP_BASE);
+    SW(&p, T1, 0, T1);
+    LW(&p, T2, 0, T1);
+    LW(&p, T2, 4, T1);
+    HALT(&p);
+    TRAP_RECORDER_HANDLER(&p);
+
+    ISS *iss;
+    iss_stats_t checked, fast;
+    fast_mem_run(&p, false, &checked, &iss);
+    ISS_dtor(iss);
+    fast_mem_run(&p, true, &fast, &iss);
+    arch_state_t s = ISS_get_arch_state(iss);
+    CHECK_TRAP_AT(iss, 0, 5, STRAY_ADDR, load_pc);
+    CHECK_TRAP_AT(iss, 1, 7, STRAY_ADDR + 4, store_pc);
+    CHECK_TRAP_AT(iss, 2, 7, ROM_MMAP_BASE + 0x100, rom_pc);
+    ISS_dtor(iss);
+    CHECK(NUM_TRAPS(s) == 3, "%u traps", NUM_TRAPS(s));
+    CHECK(fast.instret == checked.instret, "instret %llu, %llu without fast_mem",
+          (unsigned long long)fast.instret, (unsigned long long)checked.instret);
+    for (unsigned i = 0; i < fast.num_devices; i++) {
+        const iss_device_stats_t *d = &fast.devices[i], *c = &checked.devices[i];
+        CHECK(d->loads == c->loads && d->stores == c->stores,
+              "%s: %llu loads, %llu stores, %llu and %llu without fast_mem", d->name,
+              (unsigned long long)d->loads, (unsigned long long)d->stores,
+              (unsigned long long)c->loads, (unsigned long long)c->stores);
+        if (d->base == MAIN_MEM_MMAP_BASE) {
+            // the records of the handler (3 stores each) and the program
+            CHECK(d->loads == 2 && d->stores == 3 * 3 + 1, "%s: %llu loads, %llu stores",
+                  d->name, (unsigned long long)d->loads, (unsigned long long)d->stores);
+        }
+    }
+    return true;
+}
+
+// LR/SC and AMOs work on the main memory, and raise the access fault on a
+// device or the ROM, which have no host word to update atomically
+static bool test_amo_device(void) {
+    prog_t p;
+    prog_init(&p);
+    TRAP_RECORDER(&p);
+    LI(&p, T1, CLINT_MMAP_BASE + CLINT_MSIP);
+    LI(&p, T3, 1);
+    uint32_t clint_pc = HERE(&p);
+    AMOADD(&p, T2, T3, T1);
+    uint32_t lr_pc = HERE(&p);
+    LR_W(&p, T2, T1);
+    uint32_t sc_pc = HERE(&p);
+    SC_W(&p, T2, T3, T1);
+    LI(&p, T1, ROM_MMAP_BASE + 0x100);
+    uint32_t rom_pc = HERE(&p);
+    AMOADD(&p, T2, T3, T1);
+    // main memory: 5 + 5, then back to 5 with LR/SC
+    LI(&p, T1, MAIN_MEM_MMAP_BASE);
+    LI(&p, T3, 5);
+    SW(&p, T3, 0, T1);
+    AMOADD(&p, S0, T3, T1);
+    LR_W(&p, S1, T1);
+    SC_W(&p, S2, T3, T1);
+    LW(&p, S3, 0, T1);
+    HALT(&p);
+    TRAP_RECORDER_HANDLER(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = run_to_halt(iss, 10000);
+    CHECK_TRAP_AT(iss, 0, 7, CLINT_MMAP_BASE + CLINT_MSIP, clint_pc);
+    CHECK_TRAP_AT(iss, 1, 5, CLINT_MMAP_BASE + CLINT_MSIP, lr_pc);
+    CHECK_TRAP_AT(iss, 2, 7, CLINT_MMAP_BASE + CLINT_MSIP, sc_pc);
+    CHECK_TRAP_AT(iss, 3, 7, ROM_MMAP_BASE + 0x100, rom_pc);
+    ISS_dtor(iss);
+    CHECK(NUM_TRAPS(s) == 4, "%u traps", NUM_TRAPS(s));
+    CHECK(s.gpr[S0] == 5 && s.gpr[S1] == 10 && s.gpr[S2] == 0 && s.gpr[S3] == 5,
+          "amoadd.w %u, lr.w %u, sc.w %u, memory %u", (unsigned)s.gpr[S0], (unsigned)s.gpr[S1],
+          (unsigned)s.gpr[S2], (unsigned)s.gpr[S3]);
+    return true;
+}
+
+// an instruction that traps does not retire: instret counts the handler
+// only (10 instructions), and the csrr before the trap
+static bool test_trap_not_retired(void) {
+    prog_t p;
+    prog_init(&p);
+    TRAP_RECORDER(&p);
+    LI(&p, T1, STRAY_ADDR);
+    CSRR(&p, S0, 0xc02); // instret
+    LW(&p, T2, 0, T1);
+    CSRR(&p, S1, 0xc02);
+    HALT(&p);
+    TRAP_RECORDER_HANDLER(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = run_to_halt(iss, 1000);
+    CHECK_TRAP(iss, 0, 5, STRAY_ADDR);
+    ISS_dtor(iss);
+    CHECK(s.gpr[S1] - s.gpr[S0] == 1 + 10, "instret advanced by %u",
+          (unsigned)(s.gpr[S1] - s.gpr[S0]));
+    return true;
+}
+
+// ISS_get_stats() counts the instructions retired since ISS_reset_stats()
+// as the instret CSR does, trapped ones not, and every one in a class
+#define STATS_LOOPS 20
+
+static bool test_stats_interval(void) {
+    enum { LOOP };
+    prog_t p;
+    prog_init(&p);
+    TRAP_RECORDER(&p);
+    uint32_t start_pc = HERE(&p);
+    CSRR(&p, S0, 0xc02); // instret
+    CSRR(&p, S2, 0xc00); // cycle
+    LI(&p, T1, STRAY_ADDR);
+    LI(&p, T3, STATS_LOOPS);
+    place(&p, LOOP);
+    LW(&p, T2, 0, T1);
+    ADDI(&p, T3, T3, -1);
+    BNE(&p, T3, ZERO, LOOP);
+    CSRR(&p, S1, 0xc02);
+    CSRR(&p, S3, 0xc00);
+    unsigned halt_insts = p.n;
+    HALT(&p);
+    halt_insts = p.n - halt_insts;
+    TRAP_RECORDER_HANDLER(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = ISS_get_arch_state(iss);
+    unsigned steps = 0;
+    for (; s.current_pc != start_pc; steps++) {
+        ISS_step(iss, 1);
+        s = ISS_get_arch_state(iss);
+    }
+    iss_stats_t before, stats;
+    ISS_get_stats(iss, &before);
+    ISS_reset_stats(iss);
+    s = run_to_halt(iss, 10000);
+    ISS_get_stats(iss, &stats);
+    ISS_dtor(iss);
+    uint64_t classes = 0;
+    for (unsigned i = 0; i < ISS_INST_CLASS_NUM; i++) {
+        classes += stats.inst_class[i];
+    }
+    unsigned long long interval = s.gpr[S1] - s.gpr[S0];
+    CHECK(NUM_TRAPS(s) == STATS_LOOPS, "%u traps", NUM_TRAPS(s));
+    CHECK(before.instret == steps, "instret %llu before the reset, after %u steps",
+          (unsigned long long)before.instret, steps);
+    // csrr, csrr, li, li, then the handler, addi and bne in every loop
+    CHECK(interval == 4 + STATS_LOOPS * (10 + 2), "the instret CSR advanced by %llu", interval);
+    CHECK(s.gpr[S3] - s.gpr[S2] == interval, "the cycle CSR advanced by %llu",
+          (unsigned long long)(s.gpr[S3] - s.gpr[S2]));
+    CHECK(stats.instret == interval + 2 + halt_insts && classes == stats.instret,
+          "stats: instret %llu, by class %llu, the CSR %llu", (unsigned long long)stats.instret,
+          (unsigned long long)classes, interval);
+    return true;
+}
+
+// the V subset under several SEW/LMUL settings, with a tail (vl below
+// VLMAX) and masked-off elements left undisturbed, checked against the
+// same operations on the host for the VLEN of the ISS
+#define VEC_A 0x000     // source bytes
+#define VEC_B 0x200     // source bytes
+#define VEC_SENT 0x400  // VEC_SENTINEL bytes, what the tails must keep
+#define VEC_MASK 0x600  // v0 of the masked instructions
+#define VEC_OUT 0x800   // a VEC_AREA per case
+#define VEC_AREA 0x200
+#define VEC_SENTINEL 0xee
+
+static bool vector_run(unsigned vlen) {
+    prog_t p;
+    prog_init(&p);
+    for (unsigned i = 0; i < VEC_AREA; i++) {
+        p.data[VEC_A + i]    = (byte_t)(i * 7 + 3);
+        p.data[VEC_B + i]    = (byte_t)((i * 13 + 1) ^ 0x5a);
+        p.data[VEC_SENT + i] = VEC_SENTINEL;
+    }
+    for (unsigned i = 0; i < 0x40; i++) {
+        p.data[VEC_MASK + i] = (byte_t)(0xa5 ^ (i * 0x11));
+    }
+    p.data_filesz = VEC_MASK + 0x40;
+    p.data_memsz  = VEC_OUT + 6 * VEC_AREA;
+    LI(&p, S0, MAIN_MEM_MMAP_BASE + VEC_A);
+    LI(&p, S1, MAIN_MEM_MMAP_BASE + VEC_B);
+    LI(&p, S2, MAIN_MEM_MMAP_BASE + VEC_SENT);
+    LI(&p, S3, MAIN_MEM_MMAP_BASE + VEC_MASK);
+    LI(&p, S4, MAIN_MEM_MMAP_BASE + VEC_OUT);
+
+    // e8 m1: vadd.vv with vl = VLMAX - 5
+    VSETVLI(&p, S9, ZERO, VTYPE(0, 0));
+    VLE(&p, 8, 3, S2, 1);
+    VLE(&p, 8, 1, S0, 1);
+    VLE(&p, 8, 2, S1, 1);
+    ADDI(&p, T1, S9, -5);
+    VSETVLI(&p, T2, T1, VTYPE(0, 0));
+    VOP(&p, 0x00, 0, 3, 1, 2, 1); // vadd.vv v3, v1, v2
+    VSETVLI(&p, T0, ZERO, VTYPE(0, 0));
+    VSE(&p, 8, 3, S4, 1);
+    ADDI(&p, S4, S4, VEC_AREA);
+
+    // e16 m2, masked: vsub.vx and vmerge.vim
+    VSETVLI(&p, T0, ZERO, VTYPE(1, 1));
+    VLE(&p, 16, 4, S2, 1);
+    VLE(&p, 16, 6, S0, 1);
+    VLM(&p, 0, S3);
+    LI(&p, T1, 1000);
+    VOP(&p, 0x02, 4, 4, 6, T1, 0); // vsub.vx v4, v6, t1, v0.t
+    VSE(&p, 16, 4, S4, 1);
+    ADDI(&p, S4, S4, VEC_AREA);
+    VOP(&p, 0x17, 3, 8, 6, 7, 0); // vmerge.vim v8, v6, 7, v0
+    VSE(&p, 16, 8, S4, 1);
+    ADDI(&p, S4, S4, VEC_AREA);
+
+    // e32 m4: vmul.vv, vmacc.vx, then vredsum.vs into s5
+    VSETVLI(&p, T0, ZERO, VTYPE(2, 2));
+    VLE(&p, 32, 8, S0, 1);
+    VLE(&p, 32, 12, S1, 1);
+    VOP(&p, 0x25, 2, 16, 8, 12, 1); // vmul.vv v16, v8, v12
+    LI(&p, T1, 3);
+    VOP(&p, 0x2d, 6, 16, 8, T1, 1); // vmacc.vx v16, t1, v8
+    VSE(&p, 32, 16, S4, 1);
+    ADDI(&p, S4, S4, VEC_AREA);
+    VOP(&p, 0x10, 6, 20, 0, ZERO, 1);  // vmv.s.x v20, zero
+    VOP(&p, 0x00, 2, 20, 16, 20, 1);   // vredsum.vs v20, v16, v20
+    VOP(&p, 0x10, 2, S5, 20, 0x00, 1); // vmv.x.s s5, v20
+
+    // e64 m1: vadd.vx of -5 with vl = VLMAX - 1
+    VSETVLI(&p, T0, ZERO, VTYPE(3, 0));
+    VLE(&p, 64, 1, S2, 1);
+    VLE(&p, 64, 2, S0, 1);
+    ADDI(&p, T1, T0, -1);
+    VSETVLI(&p, T2, T1, VTYPE(3, 0));
+    LI(&p, T3, (uint32_t)-5);
+    VOP(&p, 0x00, 4, 1, 2, T3, 1); // vadd.vx v1, v2, t3
+    VSETVLI(&p, T0, ZERO, VTYPE(3, 0));
+    VSE(&p, 64, 1, S4, 1);
+    ADDI(&p, S4, S4, VEC_AREA);
+
+    // e8 mf2: vmsltu.vx, vcpop.m and vfirst.m of it, vid.v
+    VSETVLI(&p, S8, ZERO, VTYPE(0, 7));
+    VLE(&p, 8, 1, S0, 1);
+    LI(&p, T1, 0x40);
+    VOP(&p, 0x1a, 4, 2, 1, T1, 1);     // vmsltu.vx v2, v1, t1
+    VOP(&p, 0x10, 2, S6, 2, 0x10, 1);  // vcpop.m s6, v2
+    VOP(&p, 0x10, 2, S7, 2, 0x11, 1);  // vfirst.m s7, v2
+    VOP(&p, 0x14, 2, 3, 0, 0x11, 1);   // vid.v v3
+    VSE(&p, 8, 3, S4, 1);
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.vlen    = vlen;
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = run_to_halt(iss, 10000);
+    static byte_t out[6][VEC_AREA];
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE + VEC_OUT, sizeof(out), out[0]);
+    ISS_dtor(iss);
+
+    const byte_t *a = p.data + VEC_A, *b = p.data + VEC_B, *mask = p.data + VEC_MASK;
+    unsigned vlenb = vlen / 8;
+    CHECK(s.gpr[S9] == vlenb && s.gpr[S8] == vlenb / 2, "VLMAX %u (e8 m1), %u (e8 mf2)",
+          (unsigned)s.gpr[S9], (unsigned)s.gpr[S8]);
+    for (unsigned i = 0; i < vlenb; i++) {
+        uint64_t want = (i < vlenb - 5) ? (byte_t)(a[i] + b[i]) : VEC_SENTINEL;
+        CHECK(out[0][i] == want, "e8 m1 vadd.vv [%u] = 0x%x", i, out[0][i]);
+    }
+    for (unsigned i = 0; i < vlenb; i++) {
+        bool on       = vector_mask_bit(mask, i);
+        uint64_t sub  = on ? (uint16_t)(vector_get(a, 16, i) - 1000) : 0xeeee;
+        uint64_t merg = on ? 7 : vector_get(a, 16, i);
+        CHECK(vector_get(out[1], 16, i) == sub, "e16 m2 vsub.vx [%u] = 0x%llx", i,
+              (unsigned long long)vector_get(out[1], 16, i));
+        CHECK(vector_get(out[2], 16, i) == merg, "e16 m2 vmerge.vim [%u] = 0x%llx", i,
+              (unsigned long long)vector_get(out[2], 16, i));
+    }
+    uint32_t sum = 0;
+    for (unsigned i = 0; i < vlenb; i++) {
+        uint32_t x = (uint32_t)vector_get(a, 32, i), y = (uint32_t)vector_get(b, 32, i);
+        uint32_t want = x * y + 3 * x;
+        sum += want;
+        CHECK(vector_get(out[3], 32, i) == want, "e32 m4 vmul/vmacc [%u] = 0x%llx", i,
+              (unsigned long long)vector_get(out[3], 32, i));
+    }
+    CHECK((uint32_t)s.gpr[S5] == sum, "e32 m4 vredsum = 0x%x, not 0x%x", (unsigned)s.gpr[S5],
+          sum);
+    for (unsigned i = 0; i < vlenb / 8; i++) {
+        uint64_t want = (i + 1 < vlenb / 8) ? vector_get(a, 64, i) - 5 : 0xeeeeeeeeeeeeeeeeull;
+        CHECK(vector_get(out[4], 64, i) == want, "e64 m1 vadd.vx [%u] = 0x%llx", i,
+              (unsigned long long)vector_get(out[4], 64, i));
+    }
+    unsigned count = 0, first = ~0u;
+    for (unsigned i = 0; i < vlenb / 2; i++) {
+        if (a[i] < 0x40) {
+            count++;
+            first = (first == ~0u) ? i : first;
+        }
+        CHECK(out[5][i] == i, "e8 mf2 vid.v [%u] = %u", i, out[5][i]);
+    }
+    CHECK(s.gpr[S6] == count && (uint32_t)s.gpr[S7] == first, "vcpop.m %u, vfirst.m %d",
+          (unsigned)s.gpr[S6], (int)s.gpr[S7]);
+    return true;
+}
+
+static bool test_vector(void) {
+    return vector_run(128); // the default VLEN
+}
+
+static bool test_vector_vlen512(void) {
+    return vector_run(512);
+}
+
+// Zba/Zbb/Zbs: every instruction on a few operand pairs, against a plain
+// reference on the host
+enum {
+    ZB_SH1ADD, ZB_SH2ADD, ZB_SH3ADD, ZB_ANDN, ZB_ORN, ZB_XNOR, ZB_CLZ, ZB_CTZ, ZB_CPOP,
+    ZB_MIN, ZB_MINU, ZB_MAX, ZB_MAXU, ZB_SEXT_B, ZB_SEXT_H, ZB_ZEXT_H, ZB_ROL, ZB_ROR,
+    ZB_ORC_B, ZB_REV8, ZB_BCLR, ZB_BEXT, ZB_BINV, ZB_BSET,
+#if XLEN == 64
+    ZB_ADD_UW, ZB_SH1ADD_UW, ZB_SH2ADD_UW, ZB_SH3ADD_UW, ZB_SLLI_UW, ZB_ROLW, ZB_RORW,
+    ZB_CLZW, ZB_CTZW, ZB_CPOPW,
+#endif
+};
+
+typedef struct {
+    const char *name;
+    uint32_t insn; // rd, rs1 and rs2 left 0
+    unsigned op;   // ZB_*
+    bool imm;      // the second operand is the immediate imm
+    reg_t imm_value;
+} zb_case_t;
+
+static inline reg_t zb_rol(reg_t v, unsigned sh, unsigned width) {
+    reg_t mask = (width == XLEN) ? ~(reg_t)0 : (((reg_t)1 << width) - 1);
+    v &= mask;
+    return sh ? ((v << sh) | (v >> (width - sh))) & mask : v;
+}
+
+static reg_t zb_ref(unsigned op, reg_t a, reg_t b) {
+    unsigned sh = b & (XLEN - 1);
+    reg_t res   = 0;
+    switch (op) {
+    case ZB_SH1ADD: return (a << 1) + b;
+    case ZB_SH2ADD: return (a << 2) + b;
+    case ZB_SH3ADD: return (a << 3) + b;
+    case ZB_ANDN:   return a & ~b;
+    case ZB_ORN:    return a | ~b;
+    case ZB_XNOR:   return ~(a ^ b);
+    case ZB_CLZ:
+        for (int i = XLEN - 1; i >= 0 && !((a >> i) & 1); i--) res++;
+        return res;
+    case ZB_CTZ:
+        for (unsigned i = 0; i < XLEN && !((a >> i) & 1); i++) res++;
+        return res;
+    case ZB_CPOP:
+        for (unsigned i = 0; i < XLEN; i++) res += (a >> i) & 1;
+        return res;
+    case ZB_MIN:    return ((sreg_t)a < (sreg_t)b) ? a : b;
+    case ZB_MINU:   return (a < b) ? a : b;
+    case ZB_MAX:    return ((sreg_t)a > (sreg_t)b) ? a : b;
+    case ZB_MAXU:   return (a > b) ? a : b;
+    case ZB_SEXT_B: return (reg_t)(sreg_t)(int8_t)a;
+    case ZB_SEXT_H: return (reg_t)(sreg_t)(int16_t)a;
+    case ZB_ZEXT_H: return a & 0xffff;
+    case ZB_ROL:    return zb_rol(a, sh, XLEN);
+    case ZB_ROR:    return zb_rol(a, (XLEN - sh) % XLEN, XLEN);
+    case ZB_ORC_B:
+        for (unsigned i = 0; i < XLEN; i += 8) res |= ((a >> i) & 0xff) ? (reg_t)0xff << i : 0;
+        return res;
+    case ZB_REV8:
+        for (unsigned i = 0; i < XLEN; i += 8) res |= ((a >> i) & 0xff) << (XLEN - 8 - i);
+        return res;
+    case ZB_BCLR:   return a & ~((reg_t)1 << sh);
+    case ZB_BEXT:   return (a >> sh) & 1;
+    case ZB_BINV:   return a ^ ((reg_t)1 << sh);
+    case ZB_BSET:   return a | ((reg_t)1 << sh);
+#if XLEN == 64
+    case ZB_ADD_UW:    return (uint32_t)a + b;
+    case ZB_SH1ADD_UW: return ((reg_t)(uint32_t)a << 1) + b;
+    case ZB_SH2ADD_UW: return ((reg_t)(uint32_t)a << 2) + b;
+    case ZB_SH3ADD_UW: return ((reg_t)(uint32_t)a << 3) + b;
+    case ZB_SLLI_UW:   return (reg_t)(uint32_t)a << sh;
+    case ZB_ROLW:      return (reg_t)(int32_t)zb_rol(a, b & 31, 32);
+    case ZB_RORW:      return (reg_t)(int32_t)zb_rol(a, (32 - (b & 31)) % 32, 32);
+    case ZB_CLZW:      return zb_ref(ZB_CLZ, (reg_t)(uint32_t)a << 32 | 0xffffffffu, 0);
+    case ZB_CTZW:      return zb_ref(ZB_CTZ, a | (reg_t)1 << 32, 0);
+    case ZB_CPOPW:     return zb_ref(ZB_CPOP, (uint32_t)a, 0);
+#endif
+    default: Panic("Unknown Zb* operation %u", op);
+    }
+}
+
+// (rs1, rs2) pairs, sign-extended from 32 bits: a sign bit, zero (clz/ctz
+// of XLEN), shift amounts past 31, and bytes that are zero and not
+static const uint32_t ZB_OPERANDS[][2] = {
+    { 0x8000f0a5u, 0x00000005u },
+    { 0x00000000u, 0x0000001fu },
+    { 0x7ff01200u, 0xffffffe1u },
+    { 0x00ff0080u, 0x80000000u },
+};
+#define ZB_NUM_OPERANDS (sizeof(ZB_OPERANDS) / sizeof(ZB_OPERANDS[0]))
+#define ZB_OUT 0x000 // a register per case and pair, in the data segment
+#if XLEN == 64
+#define SREG SD
+#else
+#define SREG SW
+#endif
+
+static bool test_bitmanip(void) {
+    // clang-format off
+    const zb_case_t cases[] = {
+        { "sh1add", enc_r(0x10, 0, 0, 2, 0, 0x33), ZB_SH1ADD, false, 0 },
+        { "sh2add", enc_r(0x10, 0, 0, 4, 0, 0x33), ZB_SH2ADD, false, 0 },
+        { "sh3add", enc_r(0x10, 0, 0, 6, 0, 0x33), ZB_SH3ADD, false, 0 },
+        { "andn",   enc_r(0x20, 0, 0, 7, 0, 0x33), ZB_ANDN,   false, 0 },
+        { "orn",    enc_r(0x20, 0, 0, 6, 0, 0x33), ZB_ORN,    false, 0 },
+        { "xnor",   enc_r(0x20, 0, 0, 4, 0, 0x33), ZB_XNOR,   false, 0 },
+        { "clz",    enc_i(0x600, 0, 1, 0, 0x13),   ZB_CLZ,    true,  0 },
+        { "ctz",    enc_i(0x601, 0, 1, 0, 0x13),   ZB_CTZ,    true,  0 },
+        { "cpop",   enc_i(0x602, 0, 1, 0, 0x13),   ZB_CPOP,   true,  0 },
+        { "min",    enc_r(0x05, 0, 0, 4, 0, 0x33), ZB_MIN,    false, 0 },
+        { "minu",   enc_r(0x05, 0, 0, 5, 0, 0x33), ZB_MINU,   false, 0 },
+        { "max",    enc_r(0x05, 0, 0, 6, 0, 0x33), ZB_MAX,    false, 0 },
+        { "maxu",   enc_r(0x05, 0, 0, 7, 0, 0x33), ZB_MAXU,   false, 0 },
+        { "sext.b", enc_i(0x604, 0, 1, 0, 0x13),   ZB_SEXT_B, true,  0 },
+        { "sext.h", enc_i(0x605, 0, 1, 0, 0x13),   ZB_SEXT_H, true,  0 },
+#if XLEN == 64
+        { "zext.h", enc_r(0x04, 0, 0, 4, 0, 0x3b), ZB_ZEXT_H, true,  0 },
+#else
+        { "zext.h", enc_r(0x04, 0, 0, 4, 0, 0x33), ZB_ZEXT_H, true,  0 },
+#endif
+        { "rol",    enc_r(0x30, 0, 0, 1, 0, 0x33), ZB_ROL,    false, 0 },
+        { "ror",    enc_r(0x30, 0, 0, 5, 0, 0x33), ZB_ROR,    false, 0 },
+        { "rori",   enc_i(0x600 | 13, 0, 5, 0, 0x13), ZB_ROR, true,  13 },
+        { "orc.b",  enc_i(0x287, 0, 5, 0, 0x13),   ZB_ORC_B,  true,  0 },
+        { "rev8",   enc_i(0x680 | (XLEN - 8), 0, 5, 0, 0x13), ZB_REV8, true, 0 },
+        { "bclr",   enc_r(0x24, 0, 0, 1, 0, 0x33), ZB_BCLR,   false, 0 },
+        { "bclri",  enc_i(0x480 | 31, 0, 1, 0, 0x13), ZB_BCLR, true, 31 },
+        { "bext",   enc_r(0x24, 0, 0, 5, 0, 0x33), ZB_BEXT,   false, 0 },
+        { "bexti",  enc_i(0x480 | 4, 0, 5, 0, 0x13), ZB_BEXT, true,  4 },
+        { "binv",   enc_r(0x34, 0, 0, 1, 0, 0x33), ZB_BINV,   false, 0 },
+        { "binvi",  enc_i(0x680 | (XLEN - 3), 0, 1, 0, 0x13), ZB_BINV, true, XLEN - 3 },
+        { "bset",   enc_r(0x14, 0, 0, 1, 0, 0x33), ZB_BSET,   false, 0 },
+        { "bseti",  enc_i(0x280 | (XLEN - 1), 0, 1, 0, 0x13), ZB_BSET, true, XLEN - 1 },
+#if XLEN == 64
+        { "add.uw",    enc_r(0x04, 0, 0, 0, 0, 0x3b), ZB_ADD_UW,    false, 0 },
+        { "sh1add.uw", enc_r(0x10, 0, 0, 2, 0, 0x3b), ZB_SH1ADD_UW, false, 0 },
+        { "sh2add.uw", enc_r(0x10, 0, 0, 4, 0, 0x3b), ZB_SH2ADD_UW, false, 0 },
+        { "sh3add.uw", enc_r(0x10, 0, 0, 6, 0, 0x3b), ZB_SH3ADD_UW, false, 0 },
+        { "slli.uw",   enc_i(0x080 | 35, 0, 1, 0, 0x1b), ZB_SLLI_UW, true, 35 },
+        { "rolw",      enc_r(0x30, 0, 0, 1, 0, 0x3b), ZB_ROLW,      false, 0 },
+        { "rorw",      enc_r(0x30, 0, 0, 5, 0, 0x3b), ZB_RORW,      false, 0 },
+        { "roriw",     enc_i(0x600 | 9, 0, 5, 0, 0x1b), ZB_RORW,    true,  9 },
+        { "clzw",      enc_i(0x600, 0, 1, 0, 0x1b),   ZB_CLZW,      true,  0 },
+        { "ctzw",      enc_i(0x601, 0, 1, 0, 0x1b),   ZB_CTZW,      true,  0 },
+        { "cpopw",     enc_i(0x602, 0, 1, 0, 0x1b),   ZB_CPOPW,     true,  0 },
+#endif
+    };
+    // clang-format on
+    const unsigned num_cases = sizeof(cases) / sizeof(cases[0]);
+
+    prog_t p;
+    prog_init(&p);
+    p.data_memsz = num_cases * ZB_NUM_OPERANDS * sizeof(reg_t);
+    // the pairs in (s0, s1), (s2, s3), ...; the results go from s8 on
+    static const unsigned rs[ZB_NUM_OPERANDS][2] = { { S0, S1 }, { S2, S3 }, { S4, S5 },
+                                                     { S6, S7 } };
+    for (unsigned j = 0; j < ZB_NUM_OPERANDS; j++) {
+        LI(&p, rs[j][0], ZB_OPERANDS[j][0]);
+        LI(&p, rs[j][1], ZB_OPERANDS[j][1]);
+    }
+    LI(&p, S8, MAIN_MEM_MMAP_BASE + ZB_OUT);
+    for (unsigned i = 0; i < num_cases; i++) {
+        for (unsigned j = 0; j < ZB_NUM_OPERANDS; j++) {
+            emit(&p, cases[i].insn | (A0 << 7) | (rs[j][0] << 15) |
+                         (cases[i].imm ? 0 : rs[j][1] << 20));
+            SREG(&p, A0, (i * ZB_NUM_OPERANDS + j) * sizeof(reg_t), S8);
+        }
+    }
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss = prog_iss(&p, &config);
+    run_to_halt(iss, 10000);
+    reg_t out[64 * ZB_NUM_OPERANDS];
+    Assert(num_cases * ZB_NUM_OPERANDS <= sizeof(out) / sizeof(out[0]), "Too many cases");
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE + ZB_OUT, p.data_memsz, (byte_t *)out);
+    ISS_dtor(iss);
+    for (unsigned i = 0; i < num_cases; i++) {
+        for (unsigned j = 0; j < ZB_NUM_OPERANDS; j++) {
+            reg_t a    = (reg_t)(sreg_t)(int32_t)ZB_OPERANDS[j][0];
+            reg_t b    = cases[i].imm ? cases[i].imm_value
+                                      : (reg_t)(sreg_t)(int32_t)ZB_OPERANDS[j][1];
+            reg_t want = zb_ref(cases[i].op, a, b);
+            reg_t got  = out[i * ZB_NUM_OPERANDS + j];
+            CHECK(got == want, "%s 0x%llx, 0x%llx = 0x%llx, not 0x%llx", cases[i].name,
+                  (unsigned long long)a, (unsigned long long)b, (unsigned long long)got,
+                  (unsigned long long)want);
+        }
+    }
+    return true;
+}
+
+// the ISA strings of iss_config_t::isa: malformed ones, the other XLEN and
+// unimplemented extensions are refused
+static bool test_isa_string(void) {
+    static const struct {
+        const char *isa; // "%d" is XLEN
+        bool ok;
+        uint32_t exts;
+    } cases[] = {
+        { "rv%di", true, ISA_I },
+        { "rv%diafdv_zba_zbb_zbs", true, ISA_ALL },
+        { "RV%dIAF_Zbb", true, ISA_I | ISA_A | ISA_F | ISA_ZBB },
+        { "rv%di_zicsr_zifencei_zicntr", true, ISA_I },
+        { "rv%d", false, 0 },         // no base
+        { "rv%da", false, 0 },        // no I
+        { "rv%di2p0", false, 0 },     // versions are not parsed
+        { "rv%di_", false, 0 },       // empty Z name
+        { "rv%dizba", false, 0 },     // Z extensions go after a '_'
+        { "rv%did", false, 0 },       // D without F
+        { "rv%dim", false, 0 },       // M is not implemented
+        { "rv%di_zbc", false, 0 },    // neither is Zbc
+        { "rv%di_zbbx", false, 0 },   // names match whole
+        { "rv%di_xfoo", false, 0 },   // nor non-standard extensions
+        { "rv128i", false, 0 },       // the other XLENs
+        { XLEN == 32 ? "rv64i" : "rv32i", false, 0 },
+    };
+    uint32_t exts;
+    CHECK(isa_parse(NULL, &exts) && exts == ISA_ALL, "NULL gives 0x%x", exts);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char isa[64];
+        snprintf(isa, sizeof(isa), cases[i].isa, XLEN);
+        exts    = 0;
+        bool ok = isa_parse(isa, &exts);
+        CHECK(ok == cases[i].ok && (!ok || exts == cases[i].exts), "%s: %s, 0x%x", isa,
+              ok ? "accepted" : "refused", exts);
+    }
+    return true;
+}
+
+// an extension left out of the ISA string makes its instructions illegal
+// (mtval is the instruction) while the others keep running
+static bool test_isa_deselect(void) {
+    prog_t p;
+    prog_init(&p);
+    TRAP_RECORDER(&p);
+    LI(&p, A1, 0x00f0);
+    LI(&p, A2, 0x0003);
+    uint32_t clz    = enc_i(0x600, A1, 1, A0, 0x13); // clz a0, a1
+    uint32_t clz_pc = HERE(&p);
+    emit(&p, clz);
+    emit(&p, enc_r(0x10, A2, A1, 2, S0, 0x33)); // sh1add s0, a1, a2
+    emit(&p, enc_r(0x14, A2, A1, 1, S1, 0x33)); // bset s1, a1, a2
+    HALT(&p);
+    TRAP_RECORDER_HANDLER(&p);
+
+    char isa[32];
+    snprintf(isa, sizeof(isa), "rv%diafdv_zba_zbs", XLEN); // no Zbb
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.isa     = isa;
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = run_to_halt(iss, 1000);
+    CHECK(NUM_TRAPS(s) == 1, "%u traps", NUM_TRAPS(s));
+    CHECK_TRAP_AT(iss, 0, 2, clz, clz_pc);
+    ISS_dtor(iss);
+    CHECK(s.gpr[S0] == 0x1e3 && s.gpr[S1] == 0xf8, "sh1add 0x%x, bset 0x%x",
+          (unsigned)s.gpr[S0], (unsigned)s.gpr[S1]);
+    return true;
+}
+
+// the L1D model on a known pattern: two passes over a capacity's worth of
+// lines (misses, then hits), and three lines of one set round-robin in two
+// ways (LRU misses every time), counted per load PC in the cache report
+#define CACHE_FIT (MAIN_MEM_MMAP_BASE + 0x1000)
+#define CACHE_THRASH (MAIN_MEM_MMAP_BASE + 0x2000)
+#define CACHE_SIZE 1024
+#define CACHE_WAYS 2
+#define CACHE_LINE 64
+#define CACHE_ROUNDS 4
+
+static bool test_cache_counts(void) {
+    enum { PASS, LINE, ROUND, WAY };
+    prog_t p;
+    prog_init(&p);
+    LI(&p, S2, 2);
+    place(&p, PASS);
+    LI(&p, T0, CACHE_FIT);
+    LI(&p, T1, CACHE_SIZE / CACHE_LINE);
+    place(&p, LINE);
+    uint32_t fit_pc = HERE(&p);
+    LW(&p, T2, 0, T0);
+    ADDI(&p, T0, T0, CACHE_LINE);
+    ADDI(&p, T1, T1, -1);
+    BNE(&p, T1, ZERO, LINE);
+    ADDI(&p, S2, S2, -1);
+    BNE(&p, S2, ZERO, PASS);
+    LI(&p, S2, CACHE_ROUNDS);
+    place(&p, ROUND);
+    LI(&p, T0, CACHE_THRASH);
+    LI(&p, T1, CACHE_WAYS + 1);
+    place(&p, WAY);
+    uint32_t thrash_pc = HERE(&p);
+    LW(&p, T2, 0, T0);
+    ADDI(&p, T0, T0, CACHE_SIZE / CACHE_WAYS); // the next line of the set
+    ADDI(&p, T1, T1, -1);
+    BNE(&p, T1, ZERO, WAY);
+    ADDI(&p, S2, S2, -1);
+    BNE(&p, S2, ZERO, ROUND);
+    HALT(&p);
+
+    char report[4096];
+    temp_name(report, sizeof(report), "regression_cache_XXXXXX");
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.l1d = (iss_cache_config_t){ .size        = CACHE_SIZE,
+                                       .ways        = CACHE_WAYS,
+                                       .line_size   = CACHE_LINE,
+                                       .replacement = ISS_CACHE_LRU,
+                                       .write_back  = true };
+    config.cache_report = report;
+    ISS *iss            = prog_iss(&p, &config);
+    run_to_halt(iss, 10000);
+    ISS_dtor(iss); // writes the report
+
+    unsigned long long fit[2] = { 0, 0 }, thrash[2] = { 0, 0 };
+    FILE *f = fopen(report, "r");
+    Assert(f != NULL, "Fail to open %s", report);
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char name[8];
+        unsigned long long pc, accesses, misses;
+        if (sscanf(line, "%7[^,],0x%llx,%llu,%llu", name, &pc, &accesses, &misses) != 4 ||
+            strcmp(name, "L1D") != 0) {
+            continue;
+        }
+        unsigned long long *row = (pc == fit_pc) ? fit : (pc == thrash_pc) ? thrash : NULL;
+        CHECK(row != NULL, "L1D accesses at pc 0x%llx", pc);
+        row[0] = accesses;
+        row[1] = misses;
+    }
+    fclose(f);
+    unlink(report);
+    const unsigned lines = CACHE_SIZE / CACHE_LINE;
+    CHECK(fit[0] == 2 * lines && fit[1] == lines, "fitting loads: %llu accesses, %llu misses",
+          fit[0], fit[1]);
+    CHECK(thrash[0] == CACHE_ROUNDS * (CACHE_WAYS + 1) && thrash[1] == thrash[0],
+          "thrashing loads: %llu accesses, %llu misses", thrash[0], thrash[1]);
+    return true;
+}
+
+// the timing model under the static predictor: a forward branch taken
+// costs the mispredict penalty over one not taken, and a backward loop
+// branch a BTB miss (first taken) plus a mispredict (the exit), in the
+// cycle CSR
+#define TIMING_MISPREDICT 5
+#define TIMING_BTB_MISS 3
+
+static bool test_timing_mispredict(void) {
+    enum { NOT_TAKEN, TAKEN, LOOP };
+    prog_t p;
+    prog_init(&p);
+    CSRR(&p, S0, 0xc00); // cycle
+    BNE(&p, ZERO, ZERO, NOT_TAKEN);
+    place(&p, NOT_TAKEN);
+    CSRR(&p, S1, 0xc00);
+    BEQ(&p, ZERO, ZERO, TAKEN);
+    NOP(&p); // skipped
+    place(&p, TAKEN);
+    CSRR(&p, S2, 0xc00);
+    LI(&p, T1, 2);
+    CSRR(&p, S3, 0xc00);
+    place(&p, LOOP);
+    ADDI(&p, T1, T1, -1);
+    BNE(&p, T1, ZERO, LOOP);
+    CSRR(&p, S4, 0xc00);
+    HALT(&p);
+
+    char timing_config[4096];
+    temp_name(timing_config, sizeof(timing_config), "regression_timing_XXXXXX");
+    FILE *f = fopen(timing_config, "w");
+    Assert(f != NULL, "Fail to write %s", timing_config);
+    fprintf(f, "predictor = static\nmispredict_penalty = %d\nbtb_miss_penalty = %d\n",
+            TIMING_MISPREDICT, TIMING_BTB_MISS);
+    fclose(f);
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.timing_model  = true;
+    config.timing_config = timing_config;
+    ISS *iss             = prog_iss(&p, &config);
+    arch_state_t s       = run_to_halt(iss, 1000);
+    ISS_dtor(iss);
+    unlink(timing_config);
+
+    // csrr and a branch each
+    reg_t not_taken = s.gpr[S1] - s.gpr[S0], taken = s.gpr[S2] - s.gpr[S1];
+    // csrr and two iterations of addi and bne
+    reg_t loop = s.gpr[S4] - s.gpr[S3];
+    CHECK(not_taken == 2 && taken == not_taken + TIMING_MISPREDICT,
+          "forward branch: %u cycles not taken, %u taken", (unsigned)not_taken,
+          (unsigned)taken);
+    CHECK(loop == 5 + TIMING_BTB_MISS + TIMING_MISPREDICT, "loop of two: %u cycles",
+          (unsigned)loop);
+    return true;
+}
+
+// the locality report of a fixed-stride loop: LOCALITY_PASSES passes over
+// LOCALITY_BLOCKS blocks, so every access after the first pass reuses its
+// block at distance LOCALITY_BLOCKS - 1, and the load PC keeps its stride
+// but at the wrap-arounds
+#define LOCALITY_DATA (MAIN_MEM_MMAP_BASE + 0x1000)
+#define LOCALITY_BLOCK 64
+#define LOCALITY_BLOCKS 16
+#define LOCALITY_PASSES 3
+
+static bool test_locality_stride(void) {
+    enum { PASS, LINE };
+    prog_t p;
+    prog_init(&p);
+    LI(&p, S2, LOCALITY_PASSES);
+    place(&p, PASS);
+    LI(&p, T0, LOCALITY_DATA);
+    LI(&p, T1, LOCALITY_BLOCKS);
+    place(&p, LINE);
+    uint32_t load_pc = HERE(&p);
+    LW(&p, T2, 0, T0);
+    ADDI(&p, T0, T0, LOCALITY_BLOCK);
+    ADDI(&p, T1, T1, -1);
+    BNE(&p, T1, ZERO, LINE);
+    ADDI(&p, S2, S2, -1);
+    BNE(&p, S2, ZERO, PASS);
+    HALT(&p); // one more data block, the halt register
+
+    char prefix[4096], path[4200];
+    temp_name(prefix, sizeof(prefix), "regression_locality_XXXXXX");
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.locality_report   = prefix;
+    config.locality_block    = LOCALITY_BLOCK;
+    config.locality_interval = 1000;
+    ISS *iss                 = prog_iss(&p, &config);
+    run_to_halt(iss, 10000);
+    ISS_dtor(iss); // writes the report
+
+    // the data rows of <prefix>.reuse.csv
+    unsigned long long reused = 0, cold = 0, elsewhere = 0;
+    snprintf(path, sizeof(path), "%s.reuse.csv", prefix);
+    FILE *f = fopen(path, "r");
+    Assert(f != NULL, "Fail to open %s", path);
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long long lo, hi, count;
+        if (sscanf(line, "data,%llu,%llu,%llu", &lo, &hi, &count) == 3) {
+            bool ours = (lo <= LOCALITY_BLOCKS - 1 && LOCALITY_BLOCKS - 1 <= hi);
+            *(ours ? &reused : &elsewhere) += count;
+        } else if (sscanf(line, "data,inf,inf,%llu", &count) == 1) {
+            cold = count;
+        }
+    }
+    fclose(f);
+    unlink(path);
+    // the load of <prefix>.stride.csv
+    unsigned long long pc = 0, accesses = 0;
+    int stride        = 0;
+    double fraction   = 0;
+    snprintf(path, sizeof(path), "%s.stride.csv", prefix);
+    f = fopen(path, "r");
+    Assert(f != NULL, "Fail to open %s", path);
+    while (fgets(line, sizeof(line), f) != NULL &&
+           (sscanf(line, "0x%llx,%llu,%d,%lf", &pc, &accesses, &stride, &fraction) != 4 ||
+            pc != load_pc)) {
+    }
+    fclose(f);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s.wss.csv", prefix);
+    unlink(path);
+    unlink(prefix);
+
+    const unsigned loads = LOCALITY_PASSES * LOCALITY_BLOCKS;
+    CHECK(cold == LOCALITY_BLOCKS + 1 && reused == loads - LOCALITY_BLOCKS && elsewhere == 0,
+          "data reuse: %llu cold, %llu at distance %d, %llu elsewhere", cold, reused,
+          LOCALITY_BLOCKS - 1, elsewhere);
+    // no stride yet at the first two loads, nor right after each wrap-around
+    const unsigned strided = loads - 2 - 2 * (LOCALITY_PASSES - 1);
+    CHECK(pc == load_pc && accesses == loads && stride == LOCALITY_BLOCK &&
+              fraction > (strided - 0.5) / loads && fraction < (strided + 0.5) / loads,
+          "load at 0x%llx: %llu accesses, stride %d, %.4f strided", pc, accesses, stride,
+          fraction);
+    return true;
+}
+
+// a state image saved in the middle of a run, written to a file and read
+// back into a fresh ISS finishes the run as the original does (registers,
+// CSRs, the vector unit and memory); a file of another magic is refused
+#define STATE_SAVE_AT 60
+#define STATE_OUT 0x100
+#define STATE_MEM 0x400
+#define STATE_MAGIC "ISSSTAT6"
+
+static bool test_state_image(void) {
+    enum { LOOP };
+    prog_t p;
+    prog_init(&p);
+    for (unsigned i = 0; i < 16; i++) {
+        p.data[i] = (byte_t)(0xa0 + i);
+    }
+    p.data_filesz = 16;
+    p.data_memsz  = STATE_MEM;
+    LI(&p, T0, 0x5a5a);
+    CSRW(&p, 0x340, T0); // mscratch
+    VSETVLI(&p, T0, ZERO, VTYPE(2, 0));
+    LI(&p, T1, MAIN_MEM_MMAP_BASE);
+    VLE(&p, 32, 1, T1, 1);
+    LI(&p, S0, 1);
+    LI(&p, S1, MAIN_MEM_MMAP_BASE + STATE_OUT);
+    LI(&p, S2, 32);
+    place(&p, LOOP); // xorshift, every value stored
+    SLLI(&p, T2, S0, 13);
+    XOR(&p, S0, S0, T2);
+    SRLI(&p, T2, S0, 17);
+    XOR(&p, S0, S0, T2);
+    SLLI(&p, T2, S0, 5);
+    XOR(&p, S0, S0, T2);
+    SW(&p, S0, 0, S1);
+    ADDI(&p, S1, S1, 4);
+    ADDI(&p, S2, S2, -1);
+    BNE(&p, S2, ZERO, LOOP);
+    CSRR(&p, S3, 0x340);
+    CSRR(&p, S4, 0xc02); // instret
+    VSE(&p, 32, 1, S1, 1);
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss = prog_iss(&p, &config);
+    ISS_step(iss, STATE_SAVE_AT);
+    CHECK(!ISS_get_halt(iss), "The program halted before the save");
+    arch_state_t saved       = ISS_get_arch_state(iss);
+    iss_state_image_t *image = ISS_save_state(iss);
+    char state_file[4096];
+    temp_name(state_file, sizeof(state_file), "regression_state_XXXXXX");
+    CHECK(image != NULL && ISS_write_state(image, state_file) == 0, "Fail to write the image");
+    ISS_free_state(image);
+    arch_state_t want = run_to_halt(iss, 10000);
+    static byte_t want_mem[STATE_MEM], got_mem[STATE_MEM];
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE, STATE_MEM, want_mem);
+    ISS_dtor(iss);
+
+    // a fresh ISS with its main memory scribbled over, which the image and
+    // the rest of the run must overwrite
+    iss = prog_iss(&p, &config);
+    memset(got_mem, 0xff, STATE_MEM);
+    ISS_set_main_memory(iss, MAIN_MEM_MMAP_BASE, STATE_MEM, got_mem);
+    image = ISS_read_state(state_file);
+    CHECK(image != NULL, "Fail to read the image back");
+    ISS_restore_state(iss, image);
+    ISS_free_state(image);
+    arch_state_t restored = ISS_get_arch_state(iss);
+    arch_state_t got      = run_to_halt(iss, 10000);
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE, STATE_MEM, got_mem);
+    ISS_dtor(iss);
+
+    // the file starts with the magic; any other is not an image
+    FILE *f = fopen(state_file, "r+b");
+    char magic[8];
+    CHECK(f != NULL && fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+              memcmp(magic, STATE_MAGIC, sizeof(magic)) == 0,
+          "The image does not start with %s", STATE_MAGIC);
+    rewind(f);
+    fputc('X', f);
+    fclose(f);
+    image = ISS_read_state(state_file);
+    unlink(state_file);
+    CHECK(image == NULL, "An image of another magic was read");
+
+    CHECK(restored.current_pc == saved.current_pc && saved.current_pc != ROM_MMAP_BASE &&
+              memcmp(restored.gpr, saved.gpr, sizeof(saved.gpr)) == 0,
+          "saved at pc 0x%llx, restored at 0x%llx", (unsigned long long)saved.current_pc,
+          (unsigned long long)restored.current_pc);
+    CHECK(got.current_pc == want.current_pc, "pc 0x%llx, restored 0x%llx",
+          (unsigned long long)want.current_pc, (unsigned long long)got.current_pc);
+    for (unsigned r = 1; r < 32; r++) {
+        CHECK(got.gpr[r] == want.gpr[r], "x%u 0x%llx, restored 0x%llx", r,
+              (unsigned long long)want.gpr[r], (unsigned long long)got.gpr[r]);
+    }
+    CHECK(want.gpr[S3] == 0x5a5a, "mscratch 0x%x", (unsigned)want.gpr[S3]);
+    CHECK(memcmp(got_mem, want_mem, STATE_MEM) == 0 &&
+              memcmp(want_mem + STATE_OUT + 32 * 4, p.data, 16) == 0,
+          "The main memory differs");
+    return true;
+}
+
+// DMA transfers move exactly their bytes: a copy of an odd length to an
+// unaligned destination and a fill of the lowest byte of FILL, each
+// busy for a while and then DONE, with the bytes around them untouched
+#define DMA_TEST_COPY_DST 0x103
+#define DMA_TEST_COPY_LEN 37
+#define DMA_TEST_FILL_DST 0x201
+#define DMA_TEST_FILL_LEN 13
+#define DMA_TEST_MEM 0x300
+
+static bool test_dma_copy_fill(void) {
+    enum { WAIT_COPY, WAIT_FILL };
+    prog_t p;
+    prog_init(&p);
+    for (unsigned i = 0; i < 64; i++) {
+        p.data[i] = (byte_t)(i * 5 + 1);
+    }
+    p.data_filesz = 64;
+    p.data_memsz  = DMA_TEST_MEM;
+    LI(&p, T1, DMA_MMAP_BASE);
+    LI(&p, T2, MAIN_MEM_MMAP_BASE);
+    SW(&p, T2, DMA_REG_SRC, T1);
+    LI(&p, T2, MAIN_MEM_MMAP_BASE + DMA_TEST_COPY_DST);
+    SW(&p, T2, DMA_REG_DST, T1);
+    LI(&p, T2, DMA_TEST_COPY_LEN);
+    SW(&p, T2, DMA_REG_LEN, T1);
+    LI(&p, T2, DMA_CTRL_START);
+    SW(&p, T2, DMA_REG_CTRL, T1);
+    place(&p, WAIT_COPY); // s2 counts the polls that saw BUSY
+    LW(&p, T2, DMA_REG_STATUS, T1);
+    ANDI(&p, T3, T2, DMA_STATUS_BUSY);
+    ADD(&p, S2, S2, T3);
+    BNE(&p, T3, ZERO, WAIT_COPY);
+    MV(&p, S0, T2);
+    LI(&p, T2, DMA_STATUS_DONE | DMA_STATUS_ERROR);
+    SW(&p, T2, DMA_REG_STATUS, T1);
+    LI(&p, T2, MAIN_MEM_MMAP_BASE + DMA_TEST_FILL_DST);
+    SW(&p, T2, DMA_REG_DST, T1);
+    LI(&p, T2, DMA_TEST_FILL_LEN);
+    SW(&p, T2, DMA_REG_LEN, T1);
+    LI(&p, T2, 0x1235c);
+    SW(&p, T2, DMA_REG_FILL, T1);
+    LI(&p, T2, DMA_CTRL_START | DMA_CTRL_FILL);
+    SW(&p, T2, DMA_REG_CTRL, T1);
+    place(&p, WAIT_FILL);
+    LW(&p, T2, DMA_REG_STATUS, T1);
+    ANDI(&p, T3, T2, DMA_STATUS_BUSY);
+    ADD(&p, S3, S3, T3);
+    BNE(&p, T3, ZERO, WAIT_FILL);
+    MV(&p, S1, T2);
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = run_to_halt(iss, 10000);
+    static byte_t mem[DMA_TEST_MEM];
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE, DMA_TEST_MEM, mem);
+    ISS_dtor(iss);
+
+    CHECK(s.gpr[S0] == DMA_STATUS_DONE && s.gpr[S1] == DMA_STATUS_DONE,
+          "copy status 0x%x, fill status 0x%x", (unsigned)s.gpr[S0], (unsigned)s.gpr[S1]);
+    CHECK(s.gpr[S2] > 0 && s.gpr[S3] > 0, "busy for %u and %u polls", (unsigned)s.gpr[S2],
+          (unsigned)s.gpr[S3]);
+    for (unsigned i = 64; i < DMA_TEST_MEM; i++) {
+        unsigned copy = i - DMA_TEST_COPY_DST, fill = i - DMA_TEST_FILL_DST;
+        byte_t want   = (copy < DMA_TEST_COPY_LEN) ? p.data[copy]
+                        : (fill < DMA_TEST_FILL_LEN) ? 0x5c
+                                                     : 0;
+        CHECK(mem[i] == want, "byte 0x%x is 0x%02x, not 0x%02x", i, mem[i], want);
+    }
+    CHECK(memcmp(mem, p.data, 64) == 0, "The copy changed its source");
+    return true;
+}
+
+// the counters read back through csrr: instret counts the instructions
+// retired before the csrr, cycle equals it without the timing model, time
+// is cycle scaled from core_hz to timebase_hz (ISS_TIME_INSTRET), the high
+// halves of RV32 are 0, and the counters cannot be written
+#define COUNTER_NOPS 20
+#define COUNTER_CORE_HZ 100
+#define COUNTER_TIMEBASE_HZ 10
+
+static bool test_counter_csrs(void) {
+    prog_t p;
+    prog_init(&p);
+    TRAP_RECORDER(&p);
+    uint64_t first = (HERE(&p) - ROM_MMAP_BASE) / 4; // instructions before
+    CSRR(&p, S0, 0xc00); // cycle
+    CSRR(&p, S1, 0xc02); // instret
+    CSRR(&p, S2, 0xc01); // time
+    for (unsigned i = 0; i < COUNTER_NOPS; i++) {
+        NOP(&p);
+    }
+    CSRR(&p, S3, 0xc00);
+    CSRR(&p, S4, 0xc02);
+    CSRR(&p, S5, 0xc01);
+#if XLEN == 32
+    LI(&p, S6, 1);
+    LI(&p, S7, 1);
+    LI(&p, S8, 1);
+    CSRR(&p, S6, 0xc80); // cycleh
+    CSRR(&p, S7, 0xc82); // instreth
+    CSRR(&p, S8, 0xc81); // timeh
+#endif
+    uint32_t csrw_cycle = enc_i(0xc00, T0, 1, ZERO, 0x73);
+    emit(&p, csrw_cycle); // illegal
+    HALT(&p);
+    TRAP_RECORDER_HANDLER(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.time_source = ISS_TIME_INSTRET;
+    config.core_hz     = COUNTER_CORE_HZ;
+    config.timebase_hz = COUNTER_TIMEBASE_HZ;
+    ISS *iss           = prog_iss(&p, &config);
+    arch_state_t s     = run_to_halt(iss, 1000);
+    CHECK(NUM_TRAPS(s) == 1, "%u traps", NUM_TRAPS(s));
+    CHECK_TRAP(iss, 0, 2, csrw_cycle);
+    ISS_dtor(iss);
+
+    const uint64_t scale = COUNTER_CORE_HZ / COUNTER_TIMEBASE_HZ;
+    const uint64_t later = first + 3 + COUNTER_NOPS;
+    CHECK(s.gpr[S0] == first && s.gpr[S1] == first + 1 && s.gpr[S2] == (first + 2) / scale,
+          "cycle %u, instret %u, time %u at instruction %u", (unsigned)s.gpr[S0],
+          (unsigned)s.gpr[S1], (unsigned)s.gpr[S2], (unsigned)first);
+    CHECK(s.gpr[S3] == later && s.gpr[S4] == later + 1 && s.gpr[S5] == (later + 2) / scale,
+          "cycle %u, instret %u, time %u at instruction %u", (unsigned)s.gpr[S3],
+          (unsigned)s.gpr[S4], (unsigned)s.gpr[S5], (unsigned)later);
+#if XLEN == 32
+    CHECK(s.gpr[S6] == 0 && s.gpr[S7] == 0 && s.gpr[S8] == 0, "cycleh %u, instreth %u, timeh %u",
+          (unsigned)s.gpr[S6], (unsigned)s.gpr[S7], (unsigned)s.gpr[S8]);
+#endif
+    return true;
+}
+
+#ifdef ISS_HOST_PERF
+// with perf_event_open() failing (ENOSYS from a seccomp filter, as in a
+// container without it) only the time is counted: the other counters are
+// left unopened and charged nothing, and the ISS still runs and reports
+static bool host_perf_fallback_child(void) {
+    struct sock_filter filter[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_perf_event_open, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+    };
+    struct sock_fprog fprog = { .len = sizeof(filter) / sizeof(filter[0]), .filter = filter };
+    Assert(prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+               prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &fprog) == 0,
+           "Fail to install the seccomp filter");
+
+    HostPerf perf;
+    HostPerf_ctor(&perf);
+    for (int c = HOST_CYCLES; c < HOST_COUNTER_NUM; c++) {
+        CHECK(perf.fd[c] == -1 && perf.page[c] == NULL, "counter %d opened", c);
+    }
+    HostPerf_once_begin(&perf);
+    HostPerf_once_end(&perf, HOST_PHASE_ELF_LOAD);
+    HostPerf_run_begin(&perf, 0);
+    for (int i = 0; i < 1000; i++) {
+        HostPerf_inst(&perf);
+        HostPerf_enter(&perf, HOST_PHASE_EXECUTE);
+        HostPerf_enter(&perf, HOST_PHASE_MEM_DISPATCH);
+        HostPerf_leave(&perf);
+        HostPerf_leave(&perf);
+    }
+    HostPerf_run_end(&perf, 1000);
+    CHECK(perf.sampled > 0 && perf.guest_insts == 1000 && perf.run[HOST_NS] > 0,
+          "%llu sampled, %llu retired, %llu ns", (unsigned long long)perf.sampled,
+          (unsigned long long)perf.guest_insts, (unsigned long long)perf.run[HOST_NS]);
+    for (int c = HOST_CYCLES; c < HOST_COUNTER_NUM; c++) {
+        CHECK(perf.run[c] == 0, "counter %d: %llu in the run", c,
+              (unsigned long long)perf.run[c]);
+        for (int p = 0; p < HOST_PHASE_NUM; p++) {
+            CHECK(perf.phase[p][c] == 0, "counter %d: %llu in phase %d", c,
+                  (unsigned long long)perf.phase[p][c], p);
+        }
+    }
+    HostPerf_report(&perf);
+    HostPerf_dtor(&perf);
+
+    enum { LOOP };
+    prog_t p;
+    prog_init(&p);
+    LI(&p, S0, 100);
+    place(&p, LOOP);
+    ADDI(&p, S0, S0, -1);
+    BNE(&p, S0, ZERO, LOOP);
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = run_to_halt(iss, 1000);
+    ISS_dtor(iss);
+    CHECK(s.gpr[S0] == 0, "s0 = %u", (unsigned)s.gpr[S0]);
+    return true;
+}
+
+static bool test_host_perf_fallback(void) {
+    pid_t child = fork();
+    if (child == 0) {
+        _exit(host_perf_fallback_child() ? 0 : 1);
+    }
+    Assert(child > 0, "Fail to fork");
+
+    int status;
+    pid_t pid = waitpid(child, &status, 0);
+    CHECK(pid == child && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+          "the run without perf_event_open() failed (status 0x%x)", status);
+    return true;
+}
+#endif
+
+// record and replay: a run reading the host clock (ISS_TIME_HOST) and the
+// input file is replayed from its log, with the file deleted, into the same
+// registers and memory; a replay reading past the log diverges
+#define REPLAY_READS 8
+#define REPLAY_OUT 0x100 // (time, data) per read, in the main memory
+
+static void replay_prog(prog_t *p, unsigned reads) {
+    enum { LOOP };
+    prog_init(p);
+    LI(p, S0, INPUT_FILE_MMAP_BASE);
+    LI(p, S1, MAIN_MEM_MMAP_BASE + REPLAY_OUT);
+    LI(p, S2, reads);
+    LW(p, S4, INPUT_REG_SIZE_LO, S0);
+    place(p, LOOP);
+    CSRR(p, T1, 0xc01); // time
+    LW(p, T2, INPUT_REG_DATA, S0);
+    SW(p, T1, 0, S1);
+    SW(p, T2, 4, S1);
+    ADD(p, S3, S3, T1);
+    XOR(p, S5, S5, T2);
+    ADDI(p, S1, S1, 8);
+    ADDI(p, S2, S2, -1);
+    BNE(p, S2, ZERO, LOOP);
+    HALT(p);
+}
+
+// run p recording to (or replaying from) log, into *s and out
+static bool replay_run(prog_t *p, const char *input, const char *log, bool replay,
+                       arch_state_t *s, byte_t *out, size_t out_size) {
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.time_source = ISS_TIME_HOST;
+    config.input_file  = input;
+    if (replay) {
+        config.replay_inputs = log;
+    } else {
+        config.record_inputs = log;
+    }
+    ISS *iss = prog_iss(p, &config);
+    ISS_step(iss, 10000);
+    bool halted = ISS_get_halt(iss), diverged = ISS_replay_diverged(iss);
+    *s          = ISS_get_arch_state(iss);
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE + REPLAY_OUT, out_size, out);
+    ISS_dtor(iss);
+    Assert(halted, "The test program did not halt");
+    return diverged;
+}
+
+static bool test_record_replay(void) {
+    static const char data[4 * REPLAY_READS + 1] = "0123456789abcdefghijklmnopqrstuv";
+    char input_file_name[4096], log_file_name[4096];
+    write_input(input_file_name, sizeof(input_file_name), data, 4 * REPLAY_READS);
+    temp_name(log_file_name, sizeof(log_file_name), "regression_log_XXXXXX");
+    prog_t p;
+    replay_prog(&p, REPLAY_READS);
+    arch_state_t rec, rep;
+    uint32_t rec_out[2 * REPLAY_READS], rep_out[2 * REPLAY_READS];
+    bool rec_diverged =
+        replay_run(&p, input_file_name, log_file_name, false, &rec, (byte_t *)rec_out,
+                   sizeof(rec_out));
+    unlink(input_file_name);
+    bool rep_diverged = replay_run(&p, input_file_name, log_file_name, true, &rep,
+                                   (byte_t *)rep_out, sizeof(rep_out));
+    // one more read than recorded
+    replay_prog(&p, REPLAY_READS + 1);
+    arch_state_t longer;
+    uint32_t longer_out[2 * (REPLAY_READS + 1)];
+    bool longer_diverged = replay_run(&p, input_file_name, log_file_name, true, &longer,
+                                      (byte_t *)longer_out, sizeof(longer_out));
+    unlink(log_file_name);
+
+    CHECK(!rec_diverged && !rep_diverged, "a run diverged: record %d, replay %d",
+          rec_diverged, rep_diverged);
+    CHECK(rec.gpr[S4] == 4 * REPLAY_READS, "file size %u", (unsigned)rec.gpr[S4]);
+    for (unsigned i = 0; i < REPLAY_READS; i++) {
+        CHECK(memcmp(&rec_out[2 * i + 1], data + 4 * i, 4) == 0, "read %u: 0x%x", i,
+              rec_out[2 * i + 1]);
+    }
+    CHECK(memcmp(rec_out, rep_out, sizeof(rec_out)) == 0, "the replay read other inputs");
+    for (unsigned r = 1; r < 32; r++) {
+        CHECK(rec.gpr[r] == rep.gpr[r], "x%u 0x%llx, replayed 0x%llx", r,
+              (unsigned long long)rec.gpr[r], (unsigned long long)rep.gpr[r]);
+    }
+    CHECK(rec.current_pc == rep.current_pc, "pc 0x%llx, replayed 0x%llx",
+          (unsigned long long)rec.current_pc, (unsigned long long)rep.current_pc);
+    CHECK(longer_diverged, "a replay past the end of the log did not diverge");
+    return true;
+}
+
+// the debugger API: a breakpoint stops before its instruction, a single
+// step from there executes it, and a write watchpoint stops after the store
+// (a load of the same bytes does not fire it); points are on the virtual
+// addresses the guest uses, sign-extended by li on RV64
+#define DEBUG_DATA (MAIN_MEM_MMAP_BASE + 0x100)
+#define DEBUG_WATCH ((addr_t)(sreg_t)(int32_t)(DEBUG_DATA + 4))
+
+static bool test_debugger(void) {
+    prog_t p;
+    prog_init(&p);
+    LI(&p, S0, DEBUG_DATA);
+    LI(&p, A0, 0);
+    uint32_t bp_pc = HERE(&p);
+    ADDI(&p, A0, A0, 1);
+    ADDI(&p, A1, A0, 10);
+    uint32_t store_pc = HERE(&p);
+    SW(&p, A1, 4, S0);
+    LW(&p, A2, 4, S0);
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss = prog_iss(&p, &config);
+    CHECK(ISS_add_breakpoint(iss, bp_pc) == 0, "Fail to add the breakpoint");
+    ISS_step(iss, 1000);
+    iss_stop_t stop = ISS_get_stop(iss);
+    arch_state_t s  = ISS_get_arch_state(iss);
+    CHECK(!ISS_get_halt(iss) && stop.reason == ISS_STOP_BREAKPOINT && stop.pc == bp_pc &&
+              stop.addr == bp_pc && s.current_pc == bp_pc && s.gpr[A0] == 0,
+          "breakpoint: reason %d, pc 0x%x, at pc 0x%x with a0 %u", stop.reason,
+          (unsigned)stop.pc, (unsigned)s.current_pc, (unsigned)s.gpr[A0]);
+
+    ISS_step(iss, 1); // over the breakpoint
+    stop = ISS_get_stop(iss);
+    s    = ISS_get_arch_state(iss);
+    CHECK(stop.reason == ISS_STOP_NONE && s.current_pc == bp_pc + 4 && s.gpr[A0] == 1,
+          "step: reason %d, at pc 0x%x with a0 %u", stop.reason, (unsigned)s.current_pc,
+          (unsigned)s.gpr[A0]);
+    CHECK(ISS_remove_breakpoint(iss, bp_pc) == 0 && ISS_remove_breakpoint(iss, bp_pc) == -1,
+          "Fail to remove the breakpoint once");
+
+    CHECK(ISS_add_watchpoint(iss, DEBUG_WATCH, 4, ISS_WATCH_WRITE) == 0,
+          "Fail to add the watchpoint");
+    ISS_step(iss, 1000);
+    stop = ISS_get_stop(iss);
+    s    = ISS_get_arch_state(iss);
+    uint32_t stored;
+    ISS_get_main_memory(iss, DEBUG_DATA + 4, 4, (byte_t *)&stored);
+    CHECK(!ISS_get_halt(iss) && stop.reason == ISS_STOP_WATCHPOINT && stop.pc == store_pc &&
+              stop.addr == DEBUG_WATCH && stop.watch == ISS_WATCH_WRITE &&
+              s.current_pc == store_pc + 4 && stored == 11,
+          "watchpoint: reason %d, pc 0x%x, addr 0x%x, at pc 0x%x with %u stored", stop.reason,
+          (unsigned)stop.pc, (unsigned)stop.addr, (unsigned)s.current_pc, stored);
+
+    ISS_step(iss, 1000);
+    stop = ISS_get_stop(iss);
+    s    = ISS_get_arch_state(iss);
+    CHECK(ISS_get_halt(iss) && stop.reason == ISS_STOP_NONE && s.gpr[A2] == 11,
+          "end: halt %d, reason %d, a2 %u", ISS_get_halt(iss), stop.reason,
+          (unsigned)s.gpr[A2]);
+    ISS_dtor(iss);
+    return true;
+}
+
+#if XLEN == 32
+// Sv32 under M, S and U: page faults of each access type, medeleg sending
+// them to S-mode (and the rest to M-mode), SUM, MXR, MPRV, and sfence.vma
+// dropping a stale TLB entry; RV64 only implements Bare translation
+#define SV32_ROOT (MAIN_MEM_MMAP_BASE + 0x1000) // page-table pages
+#define SV32_L0 (MAIN_MEM_MMAP_BASE + 0x2000)
+#define SV32_D0 (MAIN_MEM_MMAP_BASE + 0x3000) // data pages
+#define SV32_D1 (MAIN_MEM_MMAP_BASE + 0x4000)
+#define SV32_VA 0x10000000u  // the 4 KiB pages of SV32_L0
+#define SV32_U_CODE 0x400000 // the ROM again, as user pages
+#define SV32_D0_VALUE 0x11111111u
+#define SV32_D1_VALUE 0x22222222u
+// Sv32 PTEs of the physical address pa
+#define PTE(pa, flags) ((((uint32_t)(pa) >> 12) << 10) | (flags))
+#define PTE_V 0x01
+#define PTE_R 0x02
+#define PTE_W 0x04
+#define PTE_X 0x08
+#define PTE_U 0x10
+
+// the SV32_VA pages (SV32_L0 entries)
+enum {
+    SV32_S_PAGE,  // D0, RW
+    SV32_U_PAGE,  // D1, RW, user
+    SV32_X_PAGE,  // D0, execute only
+    SV32_NO_PAGE, // invalid
+    SV32_R_PAGE,  // D0, read only
+    SV32_NX_PAGE, // D0, read only (no fetch)
+    SV32_REMAP,   // D0, then D1
+};
+
+static void SV32_STORE(prog_t *p, uint32_t addr, uint32_t value) {
+    LI(p, T0, addr);
+    LI(p, T1, value);
+    SW(p, T1, 0, T0);
+}
+
+// lw rd from va
+static void SV32_LOAD(prog_t *p, unsigned rd, uint32_t va) {
+    LI(p, T0, va);
+    LW(p, rd, 0, T0);
+}
+
+static bool test_privilege_sv32(void) {
+    enum { S_CODE, U_CODE, S_HANDLER, S_RESUME, M_RECORD, DONE };
+    prog_t p;
+    prog_init(&p);
+    p.data_memsz = SV32_D1 + MMU_PAGE_SIZE - MAIN_MEM_MMAP_BASE;
+    LA(&p, T0, TRAP_HANDLER);
+    CSRW(&p, 0x305, T0); // mtvec
+    LA(&p, T0, S_HANDLER);
+    CSRW(&p, 0x105, T0); // stvec
+    LI(&p, S11, MAIN_MEM_MMAP_BASE + PROG_RECORDS);
+    // the ROM as supervisor and user megapages, the main memory as a
+    // supervisor megapage, and SV32_VA through SV32_L0
+    SV32_STORE(&p, SV32_ROOT + 4 * (ROM_MMAP_BASE >> 22),
+               PTE(ROM_MMAP_BASE, PTE_V | PTE_R | PTE_X));
+    SV32_STORE(&p, SV32_ROOT + 4 * (SV32_U_CODE >> 22),
+               PTE(ROM_MMAP_BASE, PTE_V | PTE_R | PTE_X | PTE_U));
+    SV32_STORE(&p, SV32_ROOT + 4 * (MAIN_MEM_MMAP_BASE >> 22),
+               PTE(MAIN_MEM_MMAP_BASE, PTE_V | PTE_R | PTE_W));
+    SV32_STORE(&p, SV32_ROOT + 4 * (SV32_VA >> 22), PTE(SV32_L0, PTE_V));
+    SV32_STORE(&p, SV32_L0 + 4 * SV32_S_PAGE, PTE(SV32_D0, PTE_V | PTE_R | PTE_W));
+    SV32_STORE(&p, SV32_L0 + 4 * SV32_U_PAGE, PTE(SV32_D1, PTE_V | PTE_R | PTE_W | PTE_U));
+    SV32_STORE(&p, SV32_L0 + 4 * SV32_X_PAGE, PTE(SV32_D0, PTE_V | PTE_X));
+    SV32_STORE(&p, SV32_L0 + 4 * SV32_R_PAGE, PTE(SV32_D0, PTE_V | PTE_R));
+    SV32_STORE(&p, SV32_L0 + 4 * SV32_NX_PAGE, PTE(SV32_D0, PTE_V | PTE_R));
+    SV32_STORE(&p, SV32_L0 + 4 * SV32_REMAP, PTE(SV32_D0, PTE_V | PTE_R | PTE_W));
+    SV32_STORE(&p, SV32_D0, SV32_D0_VALUE);
+    SV32_STORE(&p, SV32_D1, SV32_D1_VALUE);
+    // page faults go to S-mode, ecalls and illegal instructions stay in M
+    LI(&p, T0, (1u << 12) | (1u << 13) | (1u << 15));
+    CSRW(&p, 0x302, T0); // medeleg
+    LI(&p, T0, 0x80000000u | (SV32_ROOT >> 12));
+    CSRW(&p, 0x180, T0); // satp
+    LI(&p, T0, 0x1800);
+    CSRC(&p, 0x300, T0);
+    LI(&p, T0, 0x0800);
+    CSRS(&p, 0x300, T0); // MPP = S
+    LA(&p, T0, S_CODE);
+    CSRW(&p, 0x341, T0);
+    MRET(&p);
+
+    place(&p, S_CODE);
+    SV32_LOAD(&p, S0, SV32_VA + SV32_S_PAGE * MMU_PAGE_SIZE);
+    SV32_LOAD(&p, T2, SV32_VA + SV32_U_PAGE * MMU_PAGE_SIZE); // fault: SUM is clear
+    LI(&p, T0, 1u << 18);
+    CSRS(&p, 0x100, T0); // SUM
+    SV32_LOAD(&p, S1, SV32_VA + SV32_U_PAGE * MMU_PAGE_SIZE);
+    SV32_LOAD(&p, T2, SV32_VA + SV32_X_PAGE * MMU_PAGE_SIZE); // fault: MXR is clear
+    LI(&p, T0, 1u << 19);
+    CSRS(&p, 0x100, T0); // MXR
+    SV32_LOAD(&p, S2, SV32_VA + SV32_X_PAGE * MMU_PAGE_SIZE);
+    CSRC(&p, 0x100, T0);
+    SV32_LOAD(&p, T2, SV32_VA + SV32_NO_PAGE * MMU_PAGE_SIZE); // fault
+    LI(&p, T0, SV32_VA + SV32_R_PAGE * MMU_PAGE_SIZE);
+    SW(&p, ZERO, 0, T0); // fault
+    LI(&p, T0, SV32_VA + SV32_NX_PAGE * MMU_PAGE_SIZE);
+    JALR(&p, RA, T0, 0); // fault, the handler resumes at ra
+    // the TLB keeps the old translation of SV32_REMAP until sfence.vma
+    SV32_LOAD(&p, S3, SV32_VA + SV32_REMAP * MMU_PAGE_SIZE);
+    SV32_STORE(&p, SV32_L0 + 4 * SV32_REMAP, PTE(SV32_D1, PTE_V | PTE_R | PTE_W));
+    SV32_LOAD(&p, S4, SV32_VA + SV32_REMAP * MMU_PAGE_SIZE);
+    LI(&p, T2, SV32_VA + SV32_REMAP * MMU_PAGE_SIZE);
+    SFENCE_VMA(&p, T2, ZERO);
+    SV32_LOAD(&p, S5, SV32_VA + SV32_REMAP * MMU_PAGE_SIZE);
+    ECALL(&p); // to M-mode and back
+    // to U-mode, in the user megapage of the ROM
+    LI(&p, T0, 0x100);
+    CSRC(&p, 0x100, T0); // SPP = U
+    LA(&p, T0, U_CODE);
+    LI(&p, T1, SV32_U_CODE);
+    ADD(&p, T0, T0, T1);
+    CSRW(&p, 0x141, T0); // sepc
+    SRET(&p);
+
+    place(&p, U_CODE);
+    SV32_LOAD(&p, S6, SV32_VA + SV32_U_PAGE * MMU_PAGE_SIZE);
+    SV32_LOAD(&p, T2, SV32_VA + SV32_S_PAGE * MMU_PAGE_SIZE); // fault: not a user page
+    uint32_t csrr_sstatus = enc_i(0x100, ZERO, 2, T2, 0x73);
+    emit(&p, csrr_sstatus); // illegal in U-mode
+    ECALL(&p);           // to M-mode, which goes on at DONE
+
+    // M-mode with MPRV: loads and stores are translated in MPP
+    place(&p, DONE);
+    LI(&p, T0, 0x1800);
+    CSRC(&p, 0x300, T0);
+    LI(&p, T0, (1u << 17) | 0x0800);
+    CSRS(&p, 0x300, T0); // MPRV, MPP = S
+    SV32_LOAD(&p, S7, SV32_VA + SV32_S_PAGE * MMU_PAGE_SIZE);
+    LI(&p, T0, 0x1800);
+    CSRC(&p, 0x300, T0); // MPP = U
+    SV32_LOAD(&p, T2, SV32_VA + SV32_S_PAGE * MMU_PAGE_SIZE); // fault, in M-mode
+    LI(&p, T0, 1u << 17);
+    CSRC(&p, 0x300, T0);
+    HALT(&p);
+
+    // records as TRAP_RECORDER_HANDLER() does, with 1 (S) or 0 (M) last;
+    // the S-mode handler resumes a fetch fault at ra, the M-mode one ends
+    // the program at an ecall from U-mode
+    place(&p, S_HANDLER);
+    CSRR(&p, T6, 0x142); // scause
+    SW(&p, T6, 0, S11);
+    CSRR(&p, T6, 0x143); // stval
+    SW(&p, T6, 4, S11);
+    CSRR(&p, T6, 0x141); // sepc
+    SW(&p, T6, 8, S11);
+    LI(&p, T5, 1);
+    SW(&p, T5, 12, S11);
+    ADDI(&p, S11, S11, PROG_RECORD_SIZE);
+    ADDI(&p, T6, T6, 4);
+    CSRR(&p, T5, 0x142);
+    ADDI(&p, T5, T5, -12);
+    BNE(&p, T5, ZERO, S_RESUME);
+    MV(&p, T6, RA);
+    place(&p, S_RESUME);
+    CSRW(&p, 0x141, T6);
+    SRET(&p);
+
+    place(&p, TRAP_HANDLER);
+    CSRR(&p, T6, 0x342); // mcause
+    SW(&p, T6, 0, S11);
+    ADDI(&p, T6, T6, -8);
+    BNE(&p, T6, ZERO, M_RECORD);
+    SW(&p, ZERO, 4, S11);
+    ADDI(&p, S11, S11, PROG_RECORD_SIZE);
+    J(&p, DONE);
+    place(&p, M_RECORD);
+    CSRR(&p, T6, 0x343); // mtval
+    SW(&p, T6, 4, S11);
+    CSRR(&p, T6, 0x341); // mepc
+    SW(&p, T6, 8, S11);
+    SW(&p, ZERO, 12, S11);
+    ADDI(&p, S11, S11, PROG_RECORD_SIZE);
+    ADDI(&p, T6, T6, 4);
+    CSRW(&p, 0x341, T6);
+    MRET(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.syscall_proxy = false; // ecalls trap
+    ISS *iss             = prog_iss(&p, &config);
+    arch_state_t s       = run_to_halt(iss, 10000);
+    const struct {
+        uint32_t cause, tval;
+        bool s_mode;
+    } traps[] = {
+        { 13, SV32_VA + SV32_U_PAGE * MMU_PAGE_SIZE, true },  // S: user page, SUM clear
+        { 13, SV32_VA + SV32_X_PAGE * MMU_PAGE_SIZE, true },  // S: MXR clear
+        { 13, SV32_VA + SV32_NO_PAGE * MMU_PAGE_SIZE, true }, // S: invalid
+        { 15, SV32_VA + SV32_R_PAGE * MMU_PAGE_SIZE, true },  // S: read only
+        { 12, SV32_VA + SV32_NX_PAGE * MMU_PAGE_SIZE, true }, // S: no execute
+        { 9, 0, false },                                      // ecall from S
+        { 13, SV32_VA + SV32_S_PAGE * MMU_PAGE_SIZE, true },  // U: supervisor page
+        { 2, csrr_sstatus, false },                           // U: csrr sstatus
+        { 8, 0, false },                                      // ecall from U
+        { 13, SV32_VA + SV32_S_PAGE * MMU_PAGE_SIZE, false }, // M: MPRV with MPP = U
+    };
+    const unsigned num_traps = sizeof(traps) / sizeof(traps[0]);
+    CHECK(NUM_TRAPS(s) == num_traps, "%u traps, not %u", NUM_TRAPS(s), num_traps);
+    for (unsigned i = 0; i < num_traps; i++) {
+        uint32_t rec[4];
+        ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE + PROG_RECORDS + PROG_RECORD_SIZE * i,
+                            sizeof(rec), (byte_t *)rec);
+        CHECK(rec[0] == traps[i].cause && rec[1] == traps[i].tval && rec[3] == traps[i].s_mode,
+              "trap %u: cause %u, tval 0x%x, in %s-mode", i, rec[0], rec[1], rec[3] ? "S" : "M");
+    }
+    ISS_dtor(iss);
+    CHECK(s.gpr[S0] == SV32_D0_VALUE && s.gpr[S1] == SV32_D1_VALUE && s.gpr[S2] == SV32_D0_VALUE,
+          "S-mode loads 0x%x, with SUM 0x%x, with MXR 0x%x", (unsigned)s.gpr[S0],
+          (unsigned)s.gpr[S1], (unsigned)s.gpr[S2]);
+    CHECK(s.gpr[S3] == SV32_D0_VALUE && s.gpr[S4] == SV32_D0_VALUE && s.gpr[S5] == SV32_D1_VALUE,
+          "remapped page 0x%x, before sfence.vma 0x%x, after 0x%x", (unsigned)s.gpr[S3],
+          (unsigned)s.gpr[S4], (unsigned)s.gpr[S5]);
+    CHECK(s.gpr[S6] == SV32_D1_VALUE && s.gpr[S7] == SV32_D0_VALUE,
+          "U-mode load 0x%x, M-mode load with MPRV 0x%x", (unsigned)s.gpr[S6],
+          (unsigned)s.gpr[S7]);
+    return true;
+}
+#endif
+
+// the devices and the main memory are reached through the addresses that
+// lui and li give, which RV64 sign-extends from 32 bits: loads, stores and
+// fetches of the main memory, and the Halt device
+#define SIGN_EXTENDED_CODE 0x100
+
+static bool test_sign_extended_addresses(void) {
+    prog_t p;
+    prog_init(&p);
+    // addi s1, zero, 42; ret
+    const uint32_t code[] = { enc_i(42, ZERO, 0, S1, 0x13), enc_i(0, RA, 0, ZERO, 0x67) };
+    memcpy(p.data + SIGN_EXTENDED_CODE, code, sizeof(code));
+    p.data_filesz = p.data_memsz = SIGN_EXTENDED_CODE + sizeof(code);
+    LI(&p, T1, MAIN_MEM_MMAP_BASE);
+    LI(&p, T2, 0x1234567);
+    SW(&p, T2, 4, T1);
+    LW(&p, S0, 4, T1);
+    LI(&p, T1, MAIN_MEM_MMAP_BASE + SIGN_EXTENDED_CODE);
+    JALR(&p, RA, T1, 0);
+    HALT(&p);
+
+    iss_config_t config;
+    ISS_config_default(&config);
+    ISS *iss       = prog_iss(&p, &config);
+    arch_state_t s = run_to_halt(iss, 1000);
+    uint32_t word;
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE + 4, 4, (byte_t *)&word);
+    ISS_dtor(iss);
+    CHECK(s.gpr[S0] == 0x1234567 && word == 0x1234567, "loaded 0x%" PRIxREG ", memory 0x%x",
+          s.gpr[S0], word);
+    CHECK(s.gpr[S1] == 42, "the code in the main memory left s1 0x%" PRIxREG, s.gpr[S1]);
+    return true;
+}
+
+#if XLEN == 32
+// ISSBatch runs a program like ISS_step() runs it in every lane, and stops a
+// lane with a fault where it leaves the batch subset
+#define BATCH_LANES 24
+#define BATCH_RAM_CHECKED 0x800
+
+// lane i of batch against the ISS running p on its input
+static bool batch_lane_matches(ISSBatch *batch, unsigned i, prog_t *p, const byte_t *input,
+                               size_t size) {
+    static byte_t lane_mem[BATCH_RAM_CHECKED], iss_mem[BATCH_RAM_CHECKED];
+    bool fault        = ISSBatch_get_fault(batch, i);
+    uint64_t instret  = ISSBatch_get_instret(batch, i);
+    arch_state_t lane = ISSBatch_get_arch_state(batch, i);
+    ISSBatch_get_main_memory(batch, i, MAIN_MEM_MMAP_BASE, BATCH_RAM_CHECKED, lane_mem);
+
+    // the ISS up to the same instruction: to the halt, or to the fault
+    char input_file_name[4096];
+    write_input(input_file_name, sizeof(input_file_name), input, size);
+    iss_config_t config;
+    ISS_config_default(&config);
+    config.input_file = input_file_name;
+    ISS *iss          = prog_iss(p, &config);
+    unlink(input_file_name);
+    ISS_step(iss, fault ? instret : 1000000);
+    arch_state_t s = ISS_get_arch_state(iss);
+    iss_stats_t stats, after;
+    ISS_get_stats(iss, &stats);
+    ISS_get_main_memory(iss, MAIN_MEM_MMAP_BASE, BATCH_RAM_CHECKED, iss_mem);
+    bool halted = ISS_get_halt(iss);
+    ISS_step(iss, 1); // a trap does not retire
+    ISS_get_stats(iss, &after);
+    ISS_dtor(iss);
+
+    char end = (size > 0) ? (char)input[0] : '\0';
+    CHECK(ISSBatch_get_halt(batch, i), "lane %u did not stop", i);
+    CHECK(fault == (end == 'M' || end == 'C' || end == 'U'), "lane %u: fault %d at 0x%x", i,
+          fault, (unsigned)lane.current_pc);
+    CHECK(fault || halted, "lane %u: the ISS did not halt", i);
+    CHECK(!fault || end == 'C' || after.instret == stats.instret,
+          "lane %u: the ISS does not trap at 0x%x", i, (unsigned)s.current_pc);
+    CHECK(instret == stats.instret, "lane %u: instret %llu, ISS %llu", i,
+          (unsigned long long)instret, (unsigned long long)stats.instret);
+    CHECK(lane.current_pc == s.current_pc, "lane %u: pc 0x%x, ISS 0x%x", i,
+          (unsigned)lane.current_pc, (unsigned)s.current_pc);
+    for (unsigned r = 1; r < 32; r++) {
+        CHECK(lane.gpr[r] == s.gpr[r], "lane %u: x%u 0x%x, ISS 0x%x", i, r,
+              (unsigned)lane.gpr[r], (unsigned)s.gpr[r]);
+    }
+    CHECK(memcmp(lane_mem, iss_mem, sizeof(lane_mem)) == 0, "lane %u: main memory differs", i);
+    return true;
+}
+
+static bool test_batch_vs_iss(void) {
+    enum { LOOP, EVEN, DONE, SKIP };
+    prog_t p;
+    prog_init(&p);
+    // checksum the input (after its first byte) from the DATA register,
+    // diverging on odd and even bytes, and keep every partial sum
+    LI(&p, T0, INPUT_FILE_MMAP_BASE);
+    LI(&p, A3, MAIN_MEM_MMAP_BASE);
+    LW(&p, S0, INPUT_REG_SIZE_LO, T0);
+    LBU(&p, A4, INPUT_REG_DATA, T0);
+    place(&p, LOOP);
+    LW(&p, T1, INPUT_REG_STATUS, T0);
+    ANDI(&p, T1, T1, INPUT_STATUS_EOF);
+    BNE(&p, T1, ZERO, DONE);
+    LBU(&p, A5, INPUT_REG_DATA, T0);
+    SLLI(&p, T3, S1, 5);
+    SUB(&p, S1, T3, S1);
+    ADD(&p, S1, S1, A5);
+    SW(&p, S1, 0, A3);
+    ADDI(&p, A3, A3, 4);
+    ANDI(&p, T3, A5, 1);
+    BEQ(&p, T3, ZERO, EVEN);
+    ADD(&p, S2, S2, A5);
+    J(&p, LOOP);
+    place(&p, EVEN);
+    XOR(&p, S3, S3, A5);
+    J(&p, LOOP);
+    place(&p, DONE);
+
+    // the window, moved by INPUT_REG_WINDOW
+    LI(&p, T1, INPUT_WINDOW_MMAP_BASE);
+    LW(&p, S4, 0, T1);
+    LH(&p, S5, 2, T1);
+    LI(&p, T3, 1);
+    SW(&p, T3, INPUT_REG_WINDOW, T0);
+    LW(&p, S6, 0, T1);
+    LW(&p, S7, INPUT_REG_WINDOW, T0);
+    CSRR(&p, S8, 0xc02); // instret
+    CSRR(&p, S9, 0xc00); // cycle
+    LI(&p, T1, HALT_MMAP_BASE);
+    SB(&p, ZERO, 0, T1); // bit 0 clear: no halt
+
+    // the first byte picks the end
+    const char ends[] = "MCUE";
+    for (int i = 0; i < 4; i++) {
+        LI(&p, T3, (uint32_t)ends[i]);
+        BNE(&p, A4, T3, SKIP + i);
+        switch (ends[i]) {
+        case 'M': MUL(&p, S1, S1, S1); break;             // not RV32I
+        case 'C': SYSCALL(&p, 64, 1, 0, 0); break;        // write(): proxied by the ISS
+        case 'U': LI(&p, T1, MAIN_MEM_MMAP_BASE + 2); LW(&p, S1, 0, T1); break; // misaligned
+        default:  MV(&p, A0, S1); LI(&p, A7, 93); ECALL(&p); break; // exit(checksum)
+        }
+        place(&p, SKIP + i);
+    }
+    HALT(&p);
+
+    // the inputs of the lanes, the same input file for the ISS
+    static byte_t inputs[BATCH_LANES][64];
+    size_t sizes[BATCH_LANES];
+    const char *fixed[] = { "Hello, world", "Exit", "Mul", "Call", "Unaligned", "", "abc" };
+    uint32_t seed       = 12345;
+    for (unsigned i = 0; i < BATCH_LANES; i++) {
+        if (i < sizeof(fixed) / sizeof(fixed[0])) {
+            sizes[i] = strlen(fixed[i]);
+            memcpy(inputs[i], fixed[i], sizes[i]);
+            continue;
+        }
+        seed     = seed * 1103515245 + 12345;
+        sizes[i] = (seed >> 16) % sizeof(inputs[i]);
+        for (size_t j = 0; j < sizes[i]; j++) {
+            seed         = seed * 1103515245 + 12345;
+            inputs[i][j] = (byte_t)((seed >> 16) | 0x80); // never one of the ends
+        }
+    }
+
+    char elf_file_name[4096];
+    temp_name(elf_file_name, sizeof(elf_file_name), "regression_XXXXXX");
+    prog_link(&p);
+    write_elf(&p, elf_file_name);
+    ISSBatch *batch;
+    Assert(ISSBatch_ctor(&batch, elf_file_name, BATCH_LANES) == 0, "ISSBatch_ctor failed!");
+    unlink(elf_file_name);
+    for (unsigned i = 0; i < BATCH_LANES; i++) {
+        ISSBatch_set_input(batch, i, inputs[i], sizes[i]);
+    }
+    ISSBatch_step(batch, 1000000);
+
+    bool ok = true;
+    for (unsigned i = 0; i < BATCH_LANES && ok; i++) {
+        ok = batch_lane_matches(batch, i, &p, inputs[i], sizes[i]);
+    }
+    ISSBatch_dtor(batch);
+    return ok;
+}
+#endif
+
+typedef struct {
+    const char *name;
+    bool (*run)(void);
+} test_t;
+
+static const test_t tests[] = {
+    { "brk", test_brk },
+    { "sandbox_symlink", test_sandbox_symlink },
+    { "device_access_fault", test_device_access_fault },
+    { "input_window_write", test_input_window_write },
+    { "sampled_children", test_sampled_children },
+#if XLEN == 32
+    { "batch_vs_iss", test_batch_vs_iss },
+#endif
+    { "step_back_host_writes", test_step_back_host_writes },
+    { "fast_mem_stray", test_fast_mem_stray },
+    { "amo_device", test_amo_device },
+    { "sign_extended_addresses", test_sign_extended_addresses },
+    { "trap_not_retired", test_trap_not_retired },
+    { "stats_interval", test_stats_interval },
+    { "vector", test_vector },
+    { "vector_vlen512", test_vector_vlen512 },
+    { "bitmanip", test_bitmanip },
+    { "isa_string", test_isa_string },
+    { "isa_deselect", test_isa_deselect },
+    { "cache_counts", test_cache_counts },
+    { "timing_mispredict", test_timing_mispredict },
+    { "locality_stride", test_locality_stride },
+    { "state_image", test_state_image },
+    { "dma_copy_fill", test_dma_copy_fill },
+    { "counter_csrs", test_counter_csrs },
+#ifdef ISS_HOST_PERF
+    { "host_perf_fallback", test_host_perf_fallback },
+#endif
+    { "record_replay", test_record_replay },
+    { "debugger", test_debugger },
+#if XLEN == 32
+    { "privilege_sv32", test_privilege_sv32 },
+#endif
+};
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s test\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (strcmp(argv[1], tests[i].name) == 0) {
+            return tests[i].run() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    fprintf(stderr, "No test named %s\n", argv[1]);
+    return EXIT_FAILURE;
+}
@@ -4,16 +4,25 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+// a riscv-tests program halts within far fewer steps; one that does not is
+// stuck (a trap loop, say) and fails
+#define MAX_STEPS 10000000ul
+
 int main(int argc, char *argv[]) {
     ISS *iss_ptr = NULL;
     ISS_ctor(&iss_ptr, argv[1]);
+    unsigned long steps = 0;
     while (!ISS_get_halt(iss_ptr)) {
+        if (steps++ == MAX_STEPS) {
+            printf("no halt after %lu steps\n", MAX_STEPS);
+            return EXIT_FAILURE;
+        }
         ISS_step(iss_ptr, 1);
     }
 
     // checl value in register x3 ($gp)
     arch_state_t state = ISS_get_arch_state(iss_ptr);
-    printf("gp: %x\n", state.gpr[3]);
+    printf("gp: %" PRIxREG "\n", state.gpr[3]);
     if (state.gpr[3] == 1) {
         return EXIT_SUCCESS;
     }